@@ -298,10 +298,21 @@ int main(int argc, char *argv[]) {
 
   end_request:
     if (mapserv->map && mapserv->map->debug >= MS_DEBUGLEVEL_TUNING) {
+      connPoolStatsObj poolstats;
+
       msGettimeofday(&requestendtime, NULL);
       msDebug("mapserv request processing time (msLoadMap not incl.): %.3fs\n",
               (requestendtime.tv_sec + requestendtime.tv_usec / 1.0e6) -
                   (requeststarttime.tv_sec + requeststarttime.tv_usec / 1.0e6));
+
+      /* counters are process wide, they add up across FastCGI requests */
+      msConnPoolGetStatistics(&poolstats);
+      msDebug("mapserv connection pool: %d open, %d idle, %ld hits, "
+              "%ld misses, %ld waits, %ld timeouts, %ld evictions, "
+              "%ld failed checks\n",
+              poolstats.connections, poolstats.idle, poolstats.hits,
+              poolstats.misses, poolstats.waits, poolstats.timeouts,
+              poolstats.evictions, poolstats.failed_checks);
     }
     msFreeMapServObj(mapserv);
 #ifdef USE_FASTCGI
@@ -4,7 +4,10 @@
  * Project:  MapServer
  * Purpose:  Command line utility to sort a shapefile based on a single
  *           attribute in ascending or descending order. Useful for
- *           prioritizing drawing or labeling of shapes.
+ *           prioritizing drawing or labeling of shapes. Shapefiles can
+ *           also be sorted spatially, along a Hilbert or Z-order curve,
+ *           so that shapes close to each other on the map are close to
+ *           each other in the file.
  * Author:   Steve Lime and the MapServer team.
  *
  ******************************************************************************
@@ -33,8 +36,10 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "../mapserver.h"
+#include "../maptree.h"
 
 typedef struct {
   double number;
@@ -42,6 +47,14 @@ typedef struct {
   int index;
 } sortStruct;
 
+typedef struct {
+  uint64_t key;
+  int index;
+} spatialSortStruct;
+
+/* shape bounds are read this many at a time to compute the sort keys */
+#define SPATIAL_SORT_BLOCK 65536
+
 static int compare_string_descending(const void *a, const void *b) {
   const sortStruct *i = a, *j = b;
   return (strcmp(j->string, i->string));
@@ -70,10 +83,165 @@ static int compare_number_ascending(const void *a, const void *b) {
   return (0);
 }
 
+static int compare_spatial_key(const void *a, const void *b) {
+  const spatialSortStruct *i = a, *j = b;
+  if (i->key != j->key)
+    return (i->key > j->key ? 1 : -1);
+  return (i->index - j->index); /* keep the original order of ties */
+}
+
+/*
+** Position of (x,y) along a Hilbert curve filling a 2^32 x 2^32 grid.
+*/
+static uint64_t hilbert_key(uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  uint32_t s;
+
+  for (s = 1U << 31; s > 0; s >>= 1) {
+    const uint32_t rx = (x & s) != 0;
+    const uint32_t ry = (y & s) != 0;
+    uint32_t t;
+
+    d += (uint64_t)s * s * ((3 * rx) ^ ry);
+
+    /* rotate the quadrant */
+    if (ry == 0) {
+      if (rx == 1) {
+        x = ~x;
+        y = ~y;
+      }
+      t = x;
+      x = y;
+      y = t;
+    }
+  }
+
+  return (d);
+}
+
+/*
+** Position of (x,y) along a Z-order (Morton) curve: the bits of x and y
+** interleaved.
+*/
+static uint64_t zorder_key(uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  int i;
+
+  for (i = 31; i >= 0; i--)
+    d = (d << 2) | (((uint64_t)(y >> i) & 1) << 1) | ((x >> i) & 1);
+
+  return (d);
+}
+
+/*
+** Sort the shapes along a space filling curve, using the center of their
+** bounds. Shapes without bounds (NULL or empty shapes) go last.
+**
+** The bounds are read by blocks, so only the sort key of each shape is held
+** in memory: that is still O(num_records), like the .shx offsets that the
+** shapefile library keeps for the input and output files.
+*/
+static spatialSortStruct *spatial_sort(SHPHandle inSHP, int num_records,
+                                       int hilbert) {
+  spatialSortStruct *array;
+  rectObj extent, *bounds;
+  char *valid;
+  double scalex, scaley;
+  int first, i;
+
+  array = (spatialSortStruct *)malloc(sizeof(spatialSortStruct) *
+                                      MS_MAX(1, num_records));
+  bounds = (rectObj *)malloc(sizeof(rectObj) * SPATIAL_SORT_BLOCK);
+  valid = (char *)malloc(SPATIAL_SORT_BLOCK);
+  if (!array || !bounds || !valid) {
+    fprintf(stderr, "Unable to allocate sort array.\n");
+    exit(1);
+  }
+
+  msSHPReadBounds(inSHP, -1, &extent);
+  scalex = (extent.maxx > extent.minx)
+               ? 4294967295.0 / (extent.maxx - extent.minx)
+               : 0;
+  scaley = (extent.maxy > extent.miny)
+               ? 4294967295.0 / (extent.maxy - extent.miny)
+               : 0;
+
+  for (first = 0; first < num_records; first += SPATIAL_SORT_BLOCK) {
+    const int count = MS_MIN(SPATIAL_SORT_BLOCK, num_records - first);
+
+    if (msSHPReadBoundsRange(inSHP, first, count, bounds, valid) !=
+        MS_SUCCESS) {
+      fprintf(stderr, "Unable to read shape bounds.\n");
+      exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+      spatialSortStruct *item = &(array[first + i]);
+
+      item->index = first + i;
+
+      if (!valid[i]) {
+        item->key = UINT64_MAX;
+        continue;
+      }
+
+      const double x =
+          ((bounds[i].minx + bounds[i].maxx) / 2 - extent.minx) * scalex;
+      const double y =
+          ((bounds[i].miny + bounds[i].maxy) / 2 - extent.miny) * scaley;
+      const uint32_t ix = (uint32_t)MS_MAX(0, MS_MIN(x, 4294967295.0));
+      const uint32_t iy = (uint32_t)MS_MAX(0, MS_MIN(y, 4294967295.0));
+
+      item->key = hilbert ? hilbert_key(ix, iy) : zorder_key(ix, iy);
+    }
+  }
+
+  free(bounds);
+  free(valid);
+
+  qsort(array, num_records, sizeof(spatialSortStruct), compare_spatial_key);
+
+  return (array);
+}
+
+/*
+** Write a .qix for the newly written shapefile, as shptree would.
+*/
+static void write_index(const char *filename) {
+  shapefileObj shapefile;
+  treeObj *tree;
+  int i = 1;
+  int byte_order;
+
+  /* cppcheck-suppress knownConditionTrueFalse */
+  if (*((uchar *)&i) == 1)
+    byte_order = MS_NEW_LSB_ORDER;
+  else
+    byte_order = MS_NEW_MSB_ORDER;
+
+  if (msShapefileOpen(&shapefile, "rb", filename, MS_TRUE) == -1) {
+    fprintf(stderr, "Unable to open %s to index it.\n", filename);
+    exit(1);
+  }
+
+  tree = msCreateTree(&shapefile, 0);
+  if (!tree) {
+    fprintf(stderr, "Error generating quadtree.\n");
+    exit(1);
+  }
+
+  msWriteTree(tree, (char *)filename, byte_order);
+  msDestroyTree(tree);
+
+  msShapefileClose(&shapefile);
+}
+
 int main(int argc, char *argv[]) {
   SHPHandle inSHP, outSHP; /* ---- Shapefile file pointers ---- */
   DBFHandle inDBF, outDBF; /* ---- DBF file pointers ---- */
-  sortStruct *array;
+  sortStruct *array = NULL;
+  spatialSortStruct *spatial_array = NULL;
+  int spatial = MS_FALSE, hilbert = MS_FALSE;
   shapeObj shape;
   int shpType, nShapes;
   int fieldNumber = -1; /* ---- Field number of item to be sorted on ---- */
@@ -94,10 +262,15 @@ int main(int argc, char *argv[]) {
   /*       Check the number of arguments, return syntax if not correct */
   /* -------------------------------------------------------------------------------
    */
-  if (argc != 5) {
+  if (argc == 4 && (strcasecmp(argv[3], "-hilbert") == 0 ||
+                    strcasecmp(argv[3], "-zorder") == 0)) {
+    spatial = MS_TRUE;
+    hilbert = (strcasecmp(argv[3], "-hilbert") == 0);
+  } else if (argc != 5) {
     fprintf(
         stderr,
-        "Syntax: sortshp [infile] [outfile] [item] [ascending|descending]\n");
+        "Syntax: sortshp [infile] [outfile] [item] [ascending|descending]\n"
+        "        sortshp [infile] [outfile] [-hilbert|-zorder]\n");
     exit(1);
   }
 
@@ -130,62 +303,71 @@ int main(int argc, char *argv[]) {
   num_fields = msDBFGetFieldCount(inDBF);
   num_records = msDBFGetRecordCount(inDBF);
 
-  for (i = 0; i < num_fields; i++) {
-    msDBFGetFieldInfo(inDBF, i, fName, NULL, NULL);
-    if (strncasecmp(argv[3], fName, (int)strlen(argv[3])) ==
-        0) { /* ---- Found it ---- */
-      fieldNumber = i;
-      break;
-    }
-  }
-
-  if (fieldNumber < 0) {
-    fprintf(stderr, "Item %s doesn't exist in %s\n", argv[3], buffer);
-    exit(1);
-  }
-
-  array = (sortStruct *)malloc(sizeof(sortStruct) *
-                               num_records); /* ---- Allocate the array ---- */
-  if (!array) {
-    fprintf(stderr, "Unable to allocate sort array.\n");
-    exit(1);
-  }
-
   /* -------------------------------------------------------------------------------
    */
-  /*       Load the array to be sorted */
+  /*       Sort spatially (writing a spatial index along with the output) or */
+  /*       on the attribute */
   /* -------------------------------------------------------------------------------
    */
-  dbfField = msDBFGetFieldInfo(inDBF, fieldNumber, NULL, NULL, NULL);
-  switch (dbfField) {
-  case FTString:
-    for (i = 0; i < num_records; i++) {
-      strlcpy(array[i].string, msDBFReadStringAttribute(inDBF, i, fieldNumber),
-              sizeof(array[i].string));
-      array[i].index = i;
+  if (spatial) {
+    spatial_array = spatial_sort(inSHP, num_records, hilbert);
+  } else {
+    for (i = 0; i < num_fields; i++) {
+      msDBFGetFieldInfo(inDBF, i, fName, NULL, NULL);
+      if (strncasecmp(argv[3], fName, (int)strlen(argv[3])) ==
+          0) { /* ---- Found it ---- */
+        fieldNumber = i;
+        break;
+      }
     }
 
-    if (*argv[4] == 'd')
-      qsort(array, num_records, sizeof(sortStruct), compare_string_descending);
-    else
-      qsort(array, num_records, sizeof(sortStruct), compare_string_ascending);
-    break;
-  case FTInteger:
-  case FTDouble:
-    for (i = 0; i < num_records; i++) {
-      array[i].number = msDBFReadDoubleAttribute(inDBF, i, fieldNumber);
-      array[i].index = i;
+    if (fieldNumber < 0) {
+      fprintf(stderr, "Item %s doesn't exist in %s\n", argv[3], buffer);
+      exit(1);
     }
 
-    if (*argv[4] == 'd')
-      qsort(array, num_records, sizeof(sortStruct), compare_number_descending);
-    else
-      qsort(array, num_records, sizeof(sortStruct), compare_number_ascending);
+    array = (sortStruct *)malloc(
+        sizeof(sortStruct) * num_records); /* ---- Allocate the array ---- */
+    if (!array) {
+      fprintf(stderr, "Unable to allocate sort array.\n");
+      exit(1);
+    }
 
-    break;
-  default:
-    fprintf(stderr, "Data type for item %s not supported.\n", argv[3]);
-    exit(1);
+    /* ---- Load the array to be sorted ---- */
+    dbfField = msDBFGetFieldInfo(inDBF, fieldNumber, NULL, NULL, NULL);
+    switch (dbfField) {
+    case FTString:
+      for (i = 0; i < num_records; i++) {
+        strlcpy(array[i].string,
+                msDBFReadStringAttribute(inDBF, i, fieldNumber),
+                sizeof(array[i].string));
+        array[i].index = i;
+      }
+
+      if (*argv[4] == 'd')
+        qsort(array, num_records, sizeof(sortStruct),
+              compare_string_descending);
+      else
+        qsort(array, num_records, sizeof(sortStruct), compare_string_ascending);
+      break;
+    case FTInteger:
+    case FTDouble:
+      for (i = 0; i < num_records; i++) {
+        array[i].number = msDBFReadDoubleAttribute(inDBF, i, fieldNumber);
+        array[i].index = i;
+      }
+
+      if (*argv[4] == 'd')
+        qsort(array, num_records, sizeof(sortStruct),
+              compare_number_descending);
+      else
+        qsort(array, num_records, sizeof(sortStruct), compare_number_ascending);
+
+      break;
+    default:
+      fprintf(stderr, "Data type for item %s not supported.\n", argv[3]);
+      exit(1);
+    }
   }
 
   /* -------------------------------------------------------------------------------
@@ -219,6 +401,7 @@ int main(int argc, char *argv[]) {
   /* -------------------------------------------------------------------------------
    */
   for (i = 0; i < num_records; i++) { /* ---- For each shape/record ---- */
+    const int index = spatial ? spatial_array[i].index : array[i].index;
 
     for (j = 0; j < num_fields; j++) { /* ---- For each .dbf field ---- */
 
@@ -227,15 +410,15 @@ int main(int argc, char *argv[]) {
       switch (dbfField) {
       case FTInteger:
         msDBFWriteIntegerAttribute(
-            outDBF, i, j, msDBFReadIntegerAttribute(inDBF, array[i].index, j));
+            outDBF, i, j, msDBFReadIntegerAttribute(inDBF, index, j));
         break;
       case FTDouble:
         msDBFWriteDoubleAttribute(
-            outDBF, i, j, msDBFReadDoubleAttribute(inDBF, array[i].index, j));
+            outDBF, i, j, msDBFReadDoubleAttribute(inDBF, index, j));
         break;
       case FTString:
         msDBFWriteStringAttribute(
-            outDBF, i, j, msDBFReadStringAttribute(inDBF, array[i].index, j));
+            outDBF, i, j, msDBFReadStringAttribute(inDBF, index, j));
         break;
       default:
         fprintf(stderr, "Unsupported data type for field: %s, exiting.\n",
@@ -244,17 +427,21 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    msSHPReadShape(inSHP, array[i].index, &shape);
+    msSHPReadShape(inSHP, index, &shape);
     msSHPWriteShape(outSHP, &shape);
     msFreeShape(&shape);
   }
 
   free(array);
+  free(spatial_array);
 
   msSHPClose(inSHP);
   msDBFClose(inDBF);
   msSHPClose(outSHP);
   msDBFClose(outDBF);
 
+  if (spatial)
+    write_index(argv[2]);
+
   return (0);
 }
@@ -3,7 +3,12 @@
 #include "feature_generated.h"
 #include "geometryreader.h"
 #include "packedrtree.h"
+#include "../../mapthread.h"
+#include <map>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 using namespace mapserver::flatbuffers;
 using namespace mapserver::FlatGeobuf;
@@ -14,6 +19,23 @@ uint8_t flatgeobuf_magicbytes[] = { 0x66, 0x67, 0x62, 0x03, 0x66, 0x67, 0x62, 0x
 uint8_t FLATGEOBUF_MAGICBYTES_SIZE = sizeof(flatgeobuf_magicbytes);
 uint32_t INIT_BUFFER_SIZE = 1024 * 4;
 
+// upper bound of a single coalesced read of search result features
+const uint32_t MAX_READAHEAD_SIZE = 16 * 1024 * 1024;
+
+// per process cache of the upper (non leaf) levels of the packed R-trees
+const size_t MAX_INDEX_CACHE_SIZE = 64 * 1024 * 1024;
+
+struct flatgeobuf_index_cache_entry
+{
+    time_t mtime;
+    vsi_l_offset size;
+    uint64_t index_offset;
+    std::shared_ptr<const std::vector<uint8_t>> nodes;
+};
+
+static std::map<std::string, flatgeobuf_index_cache_entry> index_cache;
+static size_t index_cache_size = 0;
+
 template <typename T>
 void parse_value(uint8_t *data, char **values, uint16_t i, uint32_t &offset, bool found)
 {
@@ -44,6 +66,10 @@ void flatgeobuf_free_ctx(ctx *ctx)
     }
     if (ctx->search_result)
         free(ctx->search_result);
+    if (ctx->readahead)
+        free(ctx->readahead);
+    if (ctx->path)
+        free(ctx->path);
     if (ctx->buf)
         free(ctx->buf);
     if (ctx->wkt)
@@ -104,6 +130,8 @@ int flatgeobuf_ensure_buf(ctx *ctx, uint32_t size)
     return 0;
 }
 
+static int flatgeobuf_decode_feature_data(ctx *ctx, layerObj *layer, shapeObj *shape, const uint8_t *data);
+
 int flatgeobuf_decode_feature(ctx *ctx, layerObj *layer, shapeObj *shape)
 {
     ctx->is_null_geom = false;
@@ -127,7 +155,12 @@ int flatgeobuf_decode_feature(ctx *ctx, layerObj *layer, shapeObj *shape)
         return -1;
     }
     ctx->offset += featureSize;
-    auto feature = GetFeature(ctx->buf);
+    return flatgeobuf_decode_feature_data(ctx, layer, shape, ctx->buf);
+}
+
+static int flatgeobuf_decode_feature_data(ctx *ctx, layerObj *layer, shapeObj *shape, const uint8_t *data)
+{
+    auto feature = GetFeature(data);
     const auto geometry = feature->geometry();
     if (geometry) {
         GeometryReader(ctx, geometry).read(shape);
@@ -147,6 +180,87 @@ int flatgeobuf_decode_feature(ctx *ctx, layerObj *layer, shapeObj *shape)
     return 0;
 }
 
+// Reads the features of the search result starting at search_index in one go,
+// as long as the gap between consecutive hits stays below read_gap
+static int flatgeobuf_fill_readahead(ctx *ctx)
+{
+    const auto &first = ctx->search_result[ctx->search_index];
+    const uint64_t start = ctx->feature_offset + first.offset;
+    const uint32_t tail = std::max(ctx->read_gap, INIT_BUFFER_SIZE);
+    uint64_t last = first.offset;
+    for (uint32_t i = ctx->search_index + 1; i < ctx->search_result_len; i++) {
+        const uint64_t next = ctx->search_result[i].offset;
+        if (next < last || next - last > ctx->read_gap ||
+            next - first.offset + tail > MAX_READAHEAD_SIZE)
+            break;
+        last = next;
+    }
+    const uint32_t size = (uint32_t) std::min<uint64_t>(last - first.offset + tail, MAX_READAHEAD_SIZE);
+
+    if (ctx->readahead_size < size) {
+        auto buf = (uint8_t *) realloc(ctx->readahead, size);
+        if (buf == NULL) {
+            msSetError(MS_FGBERR, "Failed to allocate read-ahead buffer", "flatgeobuf_fill_readahead");
+            return -1;
+        }
+        ctx->readahead = buf;
+        ctx->readahead_size = size;
+    }
+    ctx->readahead_len = 0;
+    if (VSIFSeekL(ctx->file, start, SEEK_SET) == -1) {
+        msSetError(MS_FGBERR, "Unable to seek in file", "flatgeobuf_fill_readahead");
+        return -1;
+    }
+    // a short read is expected when the tail goes past the end of the file
+    ctx->readahead_len = (uint32_t) VSIFReadL(ctx->readahead, 1, size, ctx->file);
+    ctx->readahead_offset = start;
+    return 0;
+}
+
+static bool flatgeobuf_readahead_contains(ctx *ctx, uint64_t offset, uint64_t size)
+{
+    return ctx->readahead_len > 0 && offset >= ctx->readahead_offset &&
+        offset + size <= ctx->readahead_offset + ctx->readahead_len;
+}
+
+int flatgeobuf_decode_search_result(ctx *ctx, layerObj *layer, shapeObj *shape)
+{
+    ctx->is_null_geom = false;
+
+    const auto &item = ctx->search_result[ctx->search_index];
+    const uint64_t offset = ctx->feature_offset + item.offset;
+    ctx->feature_index = item.index;
+
+    if (ctx->read_gap > 0) {
+        if (!flatgeobuf_readahead_contains(ctx, offset, sizeof(uoffset_t)) &&
+            flatgeobuf_fill_readahead(ctx) != 0)
+            return -1;
+        if (flatgeobuf_readahead_contains(ctx, offset, sizeof(uoffset_t))) {
+            const uint8_t *data = ctx->readahead + (offset - ctx->readahead_offset);
+            uint32_t featureSize;
+            memcpy(&featureSize, data, sizeof(featureSize));
+            const uint64_t size = sizeof(uoffset_t) + (uint64_t) featureSize;
+            if (!flatgeobuf_readahead_contains(ctx, offset, size) && ctx->readahead_offset != offset) {
+                if (flatgeobuf_fill_readahead(ctx) != 0)
+                    return -1;
+                data = ctx->readahead;
+            }
+            if (flatgeobuf_readahead_contains(ctx, offset, size)) {
+                ctx->offset = offset + sizeof(uoffset_t) + featureSize;
+                return flatgeobuf_decode_feature_data(ctx, layer, shape, data + sizeof(uoffset_t));
+            }
+        }
+    }
+
+    // features larger than the read-ahead buffer are read on their own
+    if (VSIFSeekL(ctx->file, offset, SEEK_SET) == -1) {
+        msSetError(MS_FGBERR, "Unable to seek in file", "flatgeobuf_decode_search_result");
+        return -1;
+    }
+    ctx->offset = offset;
+    return flatgeobuf_decode_feature(ctx, layer, shape);
+}
+
 int flatgeobuf_decode_properties(ctx *ctx, layerObj *layer, shapeObj *shape)
 {
 	uint8_t type;
@@ -343,10 +457,78 @@ int flatgeobuf_decode_header(ctx *ctx)
     return 0;
 }
 
+// Returns the upper levels of the index of the file, read once per process and
+// shared between the layers as long as the file is not modified
+static std::shared_ptr<const std::vector<uint8_t>> flatgeobuf_index_upper_levels(ctx *ctx)
+{
+    if (!ctx->path)
+        return nullptr;
+    VSIStatBufL stat;
+    if (VSIStatL(ctx->path, &stat) != 0)
+        return nullptr;
+    const auto levelBounds = PackedRTree::generateLevelBounds(ctx->features_count, ctx->index_node_size);
+    const size_t upperSize = levelBounds.front().first * sizeof(NodeItem);
+    if (upperSize == 0 || upperSize > MAX_INDEX_CACHE_SIZE / 4)
+        return nullptr;
+
+    const std::string key(ctx->path);
+    std::shared_ptr<const std::vector<uint8_t>> nodes;
+    msAcquireLock(TLOCK_FLATGEOBUF);
+    auto it = index_cache.find(key);
+    if (it != index_cache.end() && it->second.mtime == stat.st_mtime &&
+        it->second.size == (vsi_l_offset) stat.st_size &&
+        it->second.index_offset == ctx->index_offset &&
+        it->second.nodes->size() == upperSize)
+        nodes = it->second.nodes;
+    msReleaseLock(TLOCK_FLATGEOBUF);
+    if (nodes)
+        return nodes;
+
+    auto buf = std::make_shared<std::vector<uint8_t>>(upperSize);
+    if (VSIFSeekL(ctx->file, ctx->index_offset, SEEK_SET) == -1 ||
+        VSIFReadL(buf->data(), 1, upperSize, ctx->file) != upperSize)
+        throw std::runtime_error("Unable to read file");
+
+    msAcquireLock(TLOCK_FLATGEOBUF);
+    it = index_cache.find(key);
+    if (it != index_cache.end()) {
+        index_cache_size -= it->second.nodes->size();
+        index_cache.erase(it);
+    }
+    while (!index_cache.empty() && index_cache_size + upperSize > MAX_INDEX_CACHE_SIZE) {
+        index_cache_size -= index_cache.begin()->second.nodes->size();
+        index_cache.erase(index_cache.begin());
+    }
+    index_cache[key] = { stat.st_mtime, (vsi_l_offset) stat.st_size, ctx->index_offset, buf };
+    index_cache_size += upperSize;
+    msReleaseLock(TLOCK_FLATGEOBUF);
+    return buf;
+}
+
+void flatgeobuf_index_cache_cleanup(void)
+{
+    msAcquireLock(TLOCK_FLATGEOBUF);
+    index_cache.clear();
+    index_cache_size = 0;
+    msReleaseLock(TLOCK_FLATGEOBUF);
+}
+
 int flatgeobuf_index_search(ctx *ctx, rectObj *rect)
 {
-    const auto treeOffset = ctx->offset;
-    const auto readNode = [treeOffset, ctx] (uint8_t *buf, size_t i, size_t s) {
+    if (ctx->search_result) {
+        free(ctx->search_result);
+        ctx->search_result = NULL;
+    }
+    ctx->search_result_len = 0;
+    ctx->search_index = 0;
+
+    const auto treeOffset = ctx->index_offset;
+    std::shared_ptr<const std::vector<uint8_t>> upperLevels;
+    const auto readNode = [treeOffset, ctx, &upperLevels] (uint8_t *buf, size_t i, size_t s) {
+        if (upperLevels && i + s <= upperLevels->size()) {
+            memcpy(buf, upperLevels->data() + i, s);
+            return;
+        }
         if (VSIFSeekL(ctx->file, treeOffset + i, SEEK_SET) == -1)
             throw std::runtime_error("Unable to seek in file");
         if (VSIFReadL(buf, 1, s, ctx->file) != s)
@@ -354,6 +536,7 @@ int flatgeobuf_index_search(ctx *ctx, rectObj *rect)
     };
     NodeItem n { rect->minx, rect->miny, rect->maxx, rect->maxy, 0 };
     try {
+        upperLevels = flatgeobuf_index_upper_levels(ctx);
         const auto foundItems = PackedRTree::streamSearch(ctx->features_count, ctx->index_node_size, n, readNode);
         ctx->search_result = (flatgeobuf_search_item *) malloc(foundItems.size() * sizeof(flatgeobuf_search_item));
         memcpy(ctx->search_result, foundItems.data(), foundItems.size() * sizeof(flatgeobuf_search_item));
@@ -99,6 +99,14 @@ typedef struct flatgeobuf_ctx
 	uint32_t search_result_len;
 	uint32_t search_index;
 
+	// read-ahead of the features of the search result
+	char *path;
+	uint32_t read_gap;
+	uint8_t *readahead;
+	uint32_t readahead_size;
+	uint32_t readahead_len;
+	uint64_t readahead_offset;
+
 	// shape parts buffers
 	// NOTE: not used at this time, need to introduce optional free in mapdraw
 	lineObj *line;
@@ -125,9 +133,12 @@ int flatgeobuf_decode_header(flatgeobuf_ctx *ctx);
 int flatgeobuf_decode_feature(flatgeobuf_ctx *ctx, layerObj *layer, shapeObj *shape);
 int flatgeobuf_decode_properties(flatgeobuf_ctx *ctx, layerObj *layer, shapeObj *shape);
 
+int flatgeobuf_decode_search_result(flatgeobuf_ctx *ctx, layerObj *layer, shapeObj *shape);
+
 int flatgeobuf_index_search(flatgeobuf_ctx *ctx, rectObj *rect);
 int flatgeobuf_index_skip(flatgeobuf_ctx *ctx);
 int flatgeobuf_read_feature_offset(flatgeobuf_ctx *ctx, uint64_t index, uint64_t *featureOffset);
+void flatgeobuf_index_cache_cleanup(void);
 
 #ifdef __cplusplus
 }
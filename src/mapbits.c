@@ -90,6 +90,35 @@ int msGetNextBit(ms_const_bitarray array, int i, int size) {
   return -1;
 }
 
+/*
+** msCountBits( status, size)
+**
+** Count the bits set among the first size bits of the array.
+*/
+int msCountBits(ms_const_bitarray array, int size) {
+  int i, count = 0;
+  int nwords = size / MS_ARRAY_BIT;
+
+  for (i = 0; i <= nwords; i++) {
+    ms_uint32 b;
+
+    if (i == nwords) {
+      if (size % MS_ARRAY_BIT == 0)
+        break;
+      b = array[i] & ((1U << (size % MS_ARRAY_BIT)) - 1);
+    } else
+      b = array[i];
+
+    /* population count of a 32 bit word */
+    b = b - ((b >> 1) & 0x55555555U);
+    b = (b & 0x33333333U) + ((b >> 2) & 0x33333333U);
+    b = (b + (b >> 4)) & 0x0F0F0F0FU;
+    count += (int)(((b * 0x01010101U) & 0xFFFFFFFFU) >> 24);
+  }
+
+  return count;
+}
+
 void msSetBit(ms_bitarray array, int index, int value) {
   array += index / MS_ARRAY_BIT;
   if (value)
@@ -66,6 +66,7 @@ typedef int (*clusterCompareRegionFunc)(clusterInfo *current,
 /* cluster algorithm */
 #define MSCLUSTER_ALGORITHM_FULL 0
 #define MSCLUSTER_ALGORITHM_SIMPLE 1
+#define MSCLUSTER_ALGORITHM_GRID 2
 
 /* cluster data */
 struct cluster_info {
@@ -91,8 +92,28 @@ struct cluster_info {
   /* current group */
   char *group;
   int filter;
+  /* next cluster in the same grid cell (grid algorithm) */
+  clusterInfo *gridnext;
 };
 
+/* grid cell of the grid algorithm, the cells are maxdistance sized */
+typedef struct {
+  int x;
+  int y;
+  clusterInfo *clusters; /* NULL for unused hash slots */
+} clusterGridCell;
+
+/* spatial hash of the grid cells (open addressing, linear probing) */
+typedef struct {
+  clusterGridCell *cells;
+  int size; /* power of two */
+  int count;
+  double originx;
+  double originy;
+  double cellsizex;
+  double cellsizey;
+} clusterGrid;
+
 /* quadtree node */
 struct cluster_tree_node {
   /* area covered by this node */
@@ -282,6 +303,7 @@ static clusterInfo *clusterInfoCreate(msClusterLayerInfo *layerinfo) {
   feature->group = NULL;
   feature->node = NULL;
   feature->siblings = NULL;
+  feature->gridnext = NULL;
   feature->index = layerinfo->numFeatures;
   feature->filter = -1; /* not yet calculated */
   ++layerinfo->numFeatures;
@@ -1015,6 +1037,97 @@ static int ValidateTree(msClusterLayerInfo *layerinfo, clusterTreeNode *node) {
 }
 #endif
 
+static void clusterGridInit(clusterGrid *grid, rectObj *rect, double cellsizex,
+                            double cellsizey) {
+  grid->size = 1024;
+  grid->count = 0;
+  grid->cells =
+      (clusterGridCell *)msSmallCalloc(grid->size, sizeof(clusterGridCell));
+  grid->originx = rect->minx;
+  grid->originy = rect->miny;
+  /* a zero maxdistance only clusters identical locations */
+  grid->cellsizex = cellsizex > 0 ? cellsizex : 1;
+  grid->cellsizey = cellsizey > 0 ? cellsizey : 1;
+}
+
+static clusterGridCell *clusterGridLookup(clusterGrid *grid, int x, int y) {
+  unsigned int i = ((unsigned int)x * 73856093U) ^ ((unsigned int)y * 19349663U);
+
+  for (i &= grid->size - 1;; i = (i + 1) & (grid->size - 1)) {
+    clusterGridCell *cell = grid->cells + i;
+    if (cell->clusters == NULL || (cell->x == x && cell->y == y))
+      return cell;
+  }
+}
+
+static void clusterGridCellIndex(clusterGrid *grid, clusterInfo *shape, int *x,
+                                 int *y) {
+  *x = (int)floor((shape->x - grid->originx) / grid->cellsizex);
+  *y = (int)floor((shape->y - grid->originy) / grid->cellsizey);
+}
+
+/* register a new cluster in the grid */
+static void clusterGridAdd(clusterGrid *grid, clusterInfo *shape) {
+  clusterGridCell *cell;
+  int x, y;
+
+  if (2 * (grid->count + 1) > grid->size) {
+    clusterGridCell *oldcells = grid->cells;
+    int i, oldsize = grid->size;
+
+    grid->size *= 2;
+    grid->cells =
+        (clusterGridCell *)msSmallCalloc(grid->size, sizeof(clusterGridCell));
+    for (i = 0; i < oldsize; i++) {
+      if (oldcells[i].clusters)
+        *clusterGridLookup(grid, oldcells[i].x, oldcells[i].y) = oldcells[i];
+    }
+    msFree(oldcells);
+  }
+
+  clusterGridCellIndex(grid, shape, &x, &y);
+  cell = clusterGridLookup(grid, x, y);
+  if (cell->clusters == NULL) {
+    cell->x = x;
+    cell->y = y;
+    ++grid->count;
+  }
+  shape->gridnext = cell->clusters;
+  cell->clusters = shape;
+}
+
+/* find the cluster of a shape in the neighbouring grid cells, same as
+findRelatedShapes2() does with the quadtree */
+static void clusterGridFindCluster(msClusterLayerInfo *layerinfo,
+                                   clusterGrid *grid, clusterInfo *current) {
+  int x, y, i, j;
+
+  clusterGridCellIndex(grid, current, &x, &y);
+
+  for (j = y - 1; j <= y + 1; j++) {
+    for (i = x - 1; i <= x + 1; i++) {
+      clusterInfo *s = clusterGridLookup(grid, i, j)->clusters;
+      while (s) {
+        if (layerinfo->fnCompare(s, current)) {
+          if (layerinfo->rank > 0) {
+            double r = (current->x - s->x) * (current->x - s->x) +
+                       (current->y - s->y) * (current->y - s->y);
+            if (r < layerinfo->rank) {
+              layerinfo->current = s;
+              layerinfo->rank = r;
+            }
+          } else {
+            /* no rank was specified, return immediately */
+            layerinfo->current = s;
+            return;
+          }
+        }
+        s = s->gridnext;
+      }
+    }
+  }
+}
+
 /* rebuild the clusters according to the current extent */
 int RebuildClusters(layerObj *layer, int isQuery) {
   mapObj *map;
@@ -1029,6 +1142,7 @@ int RebuildClusters(layerObj *layer, int isQuery) {
   int layerIndex;
 #endif
   reprojectionObj *reprojector = NULL;
+  clusterGrid grid;
 
   msClusterLayerInfo *layerinfo = layer->layerinfo;
 
@@ -1055,6 +1169,8 @@ int RebuildClusters(layerObj *layer, int isQuery) {
   pszProcessing = msLayerGetProcessingKey(layer, "CLUSTER_ALGORITHM");
   if (pszProcessing && !strncasecmp(pszProcessing, "SIMPLE", 6))
     layerinfo->algorithm = MSCLUSTER_ALGORITHM_SIMPLE;
+  else if (pszProcessing && !strncasecmp(pszProcessing, "GRID", 4))
+    layerinfo->algorithm = MSCLUSTER_ALGORITHM_GRID;
   else
     layerinfo->algorithm = MSCLUSTER_ALGORITHM_FULL;
 
@@ -1161,10 +1277,19 @@ int RebuildClusters(layerObj *layer, int isQuery) {
     return MS_FAILURE;
   }
 
+  /* the grid algorithm finds the clusters in a spatial hash of maxdistance
+   * sized cells, the clusters are then kept at the root node */
+  if (layerinfo->algorithm == MSCLUSTER_ALGORITHM_GRID)
+    clusterGridInit(&grid, &searchrect, maxDistanceX, maxDistanceY);
+  else
+    grid.cells = NULL;
+
   /* step through the source shapes and populate the quadtree with the tentative
    * clusters */
-  if ((current = clusterInfoCreate(layerinfo)) == NULL)
+  if ((current = clusterInfoCreate(layerinfo)) == NULL) {
+    msFree(grid.cells);
     return MS_FAILURE;
+  }
 
 #if defined(USE_CLUSTER_EXTERNAL)
   if (srcLayer->transform == MS_TRUE && srcLayer->project &&
@@ -1239,11 +1364,30 @@ int RebuildClusters(layerObj *layer, int isQuery) {
           return MS_FAILURE;
         }
       }
+    } else if (layerinfo->algorithm == MSCLUSTER_ALGORITHM_GRID) {
+      /* find a related cluster in the neighbouring cells */
+      layerinfo->rank = 0;
+      layerinfo->current = NULL;
+      clusterGridFindCluster(layerinfo, &grid, current);
+      if (layerinfo->current) {
+        /* store these points until all clusters are created */
+        current->next = layerinfo->finalizedSiblings;
+        layerinfo->finalizedSiblings = current;
+      } else {
+        /* if not found add this shape as a new cluster */
+        clusterTreeNode *root = layerinfo->root;
+        root->numshapes++;
+        current->next = root->shapes;
+        root->shapes = current;
+        current->node = root;
+        clusterGridAdd(&grid, current);
+      }
     }
 
     if ((current = clusterInfoCreate(layerinfo)) == NULL) {
       clusterInfoDestroyList(layerinfo, current);
       msProjectDestroyReprojector(reprojector);
+      msFree(grid.cells);
       return MS_FAILURE;
     }
   }
@@ -1380,14 +1524,18 @@ int RebuildClusters(layerObj *layer, int isQuery) {
       }
 #endif
     }
-  } else if (layerinfo->algorithm == MSCLUSTER_ALGORITHM_SIMPLE) {
+  } else if (layerinfo->algorithm == MSCLUSTER_ALGORITHM_SIMPLE ||
+             layerinfo->algorithm == MSCLUSTER_ALGORITHM_GRID) {
     /* assingn stired points to clusters */
     while (layerinfo->finalizedSiblings) {
       current = layerinfo->finalizedSiblings;
       layerinfo->rank =
           maxDistanceX * maxDistanceX + maxDistanceY * maxDistanceY;
       layerinfo->current = NULL;
-      findRelatedShapes2(layerinfo, layerinfo->root, current);
+      if (grid.cells)
+        clusterGridFindCluster(layerinfo, &grid, current);
+      else
+        findRelatedShapes2(layerinfo, layerinfo->root, current);
       if (layerinfo->current) {
         clusterInfo *s = layerinfo->current;
         /* found a matching cluster */
@@ -1409,6 +1557,8 @@ int RebuildClusters(layerObj *layer, int isQuery) {
     collectClusterShapes2(layer, layerinfo, layerinfo->root);
   }
 
+  msFree(grid.cells);
+
   /* set the pointer to the first shape */
   layerinfo->current = layerinfo->finalized;
 
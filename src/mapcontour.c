@@ -59,8 +59,36 @@ typedef struct {
   OGRDataSourceH hOGRDS;
   double cellsize;
 
+  /* CONTOUR_CACHE=ON: contours are assembled from cached DEM blocks */
+  int use_cache;
+  int band;
+  int step_x, step_y; /* sampling step of the source raster */
+  rectObj cache_rect; /* requested area, in layer coordinates */
+
 } contourLayerInfo;
 
+/*
+** Process wide cache of the contours generated for fixed blocks of a DEM,
+** at a given sampling step and interval/levels.  Blocks overlap their
+** right and bottom neighbours by one sample so that the contour lines of
+** adjacent blocks meet on the block edges.
+*/
+#define MS_CONTOUR_CACHE_DEFAULT_SIZE 256
+#define MS_CONTOUR_CACHE_DEFAULT_BLOCK_SIZE 256
+
+typedef struct contourCacheBlock {
+  char *key;
+  int numlines;
+  OGRGeometryH *lines;
+  double *elevations;
+  struct contourCacheBlock *prev;
+  struct contourCacheBlock *next;
+} contourCacheBlock;
+
+static contourCacheBlock *contourCacheHead = NULL;
+static contourCacheBlock *contourCacheTail = NULL;
+static int contourCacheCount = 0;
+
 static int msContourLayerInitItemInfo(layerObj *layer) {
   contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
 
@@ -138,6 +166,71 @@ static void msContourLayerInfoFree(layerObj *layer) {
   layer->layerinfo = NULL;
 }
 
+static int msContourCacheMaxSize(void) {
+  const char *value = CPLGetConfigOption("MS_CONTOUR_CACHE_SIZE", NULL);
+  if (value == NULL)
+    return MS_CONTOUR_CACHE_DEFAULT_SIZE;
+  return MS_MAX(0, atoi(value));
+}
+
+static int msContourCacheEnabled(layerObj *layer) {
+  const char *value = CSLFetchNameValue(layer->processing, "CONTOUR_CACHE");
+  return layer->transform && value != NULL && CSLTestBoolean(value) &&
+         msContourCacheMaxSize() > 0;
+}
+
+static void msContourCacheUnlink(contourCacheBlock *block) {
+  if (block->prev)
+    block->prev->next = block->next;
+  else
+    contourCacheHead = block->next;
+  if (block->next)
+    block->next->prev = block->prev;
+  else
+    contourCacheTail = block->prev;
+  block->prev = block->next = NULL;
+  contourCacheCount--;
+}
+
+static void msContourCachePushFront(contourCacheBlock *block) {
+  block->prev = NULL;
+  block->next = contourCacheHead;
+  if (contourCacheHead)
+    contourCacheHead->prev = block;
+  contourCacheHead = block;
+  if (contourCacheTail == NULL)
+    contourCacheTail = block;
+  contourCacheCount++;
+}
+
+static void msContourCacheFreeBlock(contourCacheBlock *block) {
+  int i;
+
+  for (i = 0; i < block->numlines; i++)
+    OGR_G_DestroyGeometry(block->lines[i]);
+  msFree(block->lines);
+  msFree(block->elevations);
+  msFree(block->key);
+  msFree(block);
+}
+
+/************************************************************************/
+/*                        msContourCacheCleanup()                       */
+/************************************************************************/
+
+void msContourCacheCleanup(void) {
+  contourCacheBlock *block, *next;
+
+  msAcquireLock(TLOCK_CONTOUR);
+  for (block = contourCacheHead; block != NULL; block = next) {
+    next = block->next;
+    msContourCacheFreeBlock(block);
+  }
+  contourCacheHead = contourCacheTail = NULL;
+  contourCacheCount = 0;
+  msReleaseLock(TLOCK_CONTOUR);
+}
+
 static int msContourLayerReadRaster(layerObj *layer, rectObj rect) {
   mapObj *map = layer->map;
   char **bands;
@@ -164,6 +257,8 @@ static int msContourLayerReadRaster(layerObj *layer, rectObj rect) {
     return MS_FAILURE;
   }
 
+  clinfo->use_cache = MS_FALSE;
+
   bands = CSLTokenizeStringComplex(
       CSLFetchNameValue(layer->processing, "BANDS"), " ,", FALSE, FALSE);
   if (CSLCount(bands) > 0) {
@@ -186,6 +281,7 @@ static int msContourLayerReadRaster(layerObj *layer, rectObj rect) {
                "msContourLayerReadRaster()", band);
     return MS_FAILURE;
   }
+  clinfo->band = band;
 
   if (layer->projection.numargs > 0 &&
       EQUAL(layer->projection.args[0], "auto")) {
@@ -404,6 +500,20 @@ static int msContourLayerReadRaster(layerObj *layer, rectObj rect) {
       msDebug("msContourLayerReadRaster(): src=%d,%d,%d,%d, dst=%d,%d,%d,%d\n",
               src_xoff, src_yoff, src_xsize, src_ysize, 0, 0, dst_xsize,
               dst_ysize);
+
+    /* The cached blocks are read by msContourLayerGenerateContour() */
+    if (msContourCacheEnabled(layer)) {
+      char buf[64];
+
+      clinfo->use_cache = MS_TRUE;
+      clinfo->step_x = virtual_grid_step_x;
+      clinfo->step_y = virtual_grid_step_y;
+      clinfo->cache_rect = copyRect;
+      clinfo->cellsize = MS_MAX(dst_cellsize_x, dst_cellsize_y);
+      sprintf(buf, "%lf", clinfo->cellsize);
+      msInsertHashTable(&layer->metadata, "__data_cellsize__", buf);
+      return MS_SUCCESS;
+    }
   } else {
     src_xoff = 0;
     src_yoff = 0;
@@ -538,53 +648,56 @@ static char *msContourGetOption(layerObj *layer, const char *name) {
   return value;
 }
 
-static int msContourLayerGenerateContour(layerObj *layer) {
-  OGRSFDriverH hDriver;
-  OGRFieldDefnH hFld;
-  OGRLayerH hLayer;
-  const char *elevItem;
+/* Parse the CONTOUR_INTERVAL and CONTOUR_LEVELS processing options. */
+static void msContourGetLevels(layerObj *layer, double *interval,
+                               double *levels, int maxLevels,
+                               int *levelCount) {
   char *option;
-  double interval = 1.0, levels[1000];
-  int levelCount = 0;
-  GDALRasterBandH hBand = NULL;
-  CPLErr eErr;
-  int bHasNoData = FALSE;
-  double dfNoDataValue;
-
-  contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
 
-  OGRRegisterAll();
+  *interval = 1.0;
+  *levelCount = 0;
 
-  if (clinfo == NULL) {
-    msSetError(MS_MISCERR, "Assertion failed: Contour layer not opened!!!",
-               "msContourLayerCreateOGRDataSource()");
-    return MS_FAILURE;
+  option = msContourGetOption(layer, "CONTOUR_INTERVAL");
+  if (option) {
+    *interval = atof(option);
+    free(option);
   }
 
-  if (!clinfo->hDS) { /* no overlap */
-    return MS_SUCCESS;
-  }
+  option = msContourGetOption(layer, "CONTOUR_LEVELS");
+  if (option) {
+    int i, c;
+    char **levelsTmp;
+    levelsTmp = CSLTokenizeStringComplex(option, ",", FALSE, FALSE);
+    c = CSLCount(levelsTmp);
+    for (i = 0; i < c && i < maxLevels; ++i)
+      levels[(*levelCount)++] = atof(levelsTmp[i]);
 
-  hBand = GDALGetRasterBand(clinfo->hDS, 1);
-  if (hBand == NULL) {
-    msSetError(MS_IMGERR, "Band %d does not exist on dataset.",
-               "msContourLayerGenerateContour()", 1);
-    return MS_FAILURE;
+    CSLDestroy(levelsTmp);
+    free(option);
   }
+}
+
+/* Create the OGR DataSource and layer holding the generated contours. */
+static OGRLayerH msContourCreateOGRLayer(layerObj *layer,
+                                         const char *elevItem) {
+  OGRSFDriverH hDriver;
+  OGRFieldDefnH hFld;
+  OGRLayerH hLayer;
+
+  contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
 
-  /* Create the OGR DataSource */
   hDriver = OGRGetDriverByName("Memory");
   if (hDriver == NULL) {
     msSetError(MS_OGRERR, "Unable to get OGR driver 'Memory'.",
                "msContourLayerCreateOGRDataSource()");
-    return MS_FAILURE;
+    return NULL;
   }
 
   clinfo->hOGRDS = OGR_Dr_CreateDataSource(hDriver, "", NULL);
   if (clinfo->hOGRDS == NULL) {
     msSetError(MS_OGRERR, "Unable to create OGR DataSource.",
                "msContourLayerCreateOGRDataSource()");
-    return MS_FAILURE;
+    return NULL;
   }
 
   hLayer = OGR_DS_CreateLayer(clinfo->hOGRDS, clinfo->ogrLayer.name, NULL,
@@ -595,37 +708,385 @@ static int msContourLayerGenerateContour(layerObj *layer) {
   OGR_L_CreateField(hLayer, hFld, FALSE);
   OGR_Fld_Destroy(hFld);
 
-  /* Check if we have a coutour item specified */
-  elevItem = CSLFetchNameValue(layer->processing, "CONTOUR_ITEM");
-  if (elevItem && strlen(elevItem) > 0) {
+  if (elevItem) {
     hFld = OGR_Fld_Create(elevItem, OFTReal);
     OGR_Fld_SetWidth(hFld, 12);
     OGR_Fld_SetPrecision(hFld, 3);
     OGR_L_CreateField(hLayer, hFld, FALSE);
     OGR_Fld_Destroy(hFld);
-  } else {
+  }
+
+  return hLayer;
+}
+
+/************************************************************************/
+/*                     msContourCacheGenerateBlock()                    */
+/*                                                                      */
+/*      Generate the contours of one block of the sampled DEM.  Block   */
+/*      (bx,by) covers the samples bx*size to bx*size+size included.    */
+/************************************************************************/
+
+static contourCacheBlock *
+msContourCacheGenerateBlock(layerObj *layer, int bx, int by, int blocksize,
+                            double interval, double *levels, int levelCount) {
+  contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
+  GDALRasterBandH hSrcBand = GDALGetRasterBand(clinfo->hOrigDS, clinfo->band);
+  double adfSrcGeoTransform[6], adfGeoTransform[6];
+  int dst_xoff = bx * blocksize, dst_yoff = by * blocksize;
+  int dst_xsize, dst_ysize;
+  int bHasNoData = FALSE;
+  double dfNoDataValue;
+  char pointer[64], memDSPointer[128];
+  double *buffer;
+  GDALDatasetH hDS;
+  OGRSFDriverH hDriver;
+  OGRDataSourceH hOGRDS;
+  OGRLayerH hLayer;
+  OGRFieldDefnH hFld;
+  OGRFeatureH hFeature;
+  contourCacheBlock *block;
+  int nFeatures;
+  CPLErr eErr;
+
+  block = (contourCacheBlock *)msSmallCalloc(1, sizeof(contourCacheBlock));
+
+  dst_xsize = MS_MIN(blocksize + 1,
+                     GDALGetRasterXSize(clinfo->hOrigDS) / clinfo->step_x -
+                         dst_xoff);
+  dst_ysize = MS_MIN(blocksize + 1,
+                     GDALGetRasterYSize(clinfo->hOrigDS) / clinfo->step_y -
+                         dst_yoff);
+  if (dst_xsize < 2 || dst_ysize < 2)
+    return block; /* nothing to contour */
+
+  buffer = (double *)malloc(sizeof(double) * dst_xsize * dst_ysize);
+  if (buffer == NULL) {
+    msSetError(MS_MEMERR, "Malloc(): Out of memory.",
+               "msContourCacheGenerateBlock()");
+    msContourCacheFreeBlock(block);
+    return NULL;
+  }
+
+  eErr = GDALRasterIO(hSrcBand, GF_Read, dst_xoff * clinfo->step_x,
+                      dst_yoff * clinfo->step_y, dst_xsize * clinfo->step_x,
+                      dst_ysize * clinfo->step_y, buffer, dst_xsize, dst_ysize,
+                      GDT_Float64, 0, 0);
+  if (eErr != CE_None) {
+    msSetError(MS_IOERR, "GDALRasterIO() failed: %s",
+               "msContourCacheGenerateBlock()", CPLGetLastErrorMsg());
+    free(buffer);
+    msContourCacheFreeBlock(block);
+    return NULL;
+  }
+
+  memset(pointer, 0, sizeof(pointer));
+  CPLPrintPointer(pointer, buffer, sizeof(pointer));
+  sprintf(memDSPointer,
+          "MEM:::DATAPOINTER=%s,PIXELS=%d,LINES=%d,BANDS=1,DATATYPE=Float64",
+          pointer, dst_xsize, dst_ysize);
+  hDS = GDALOpen(memDSPointer, GA_ReadOnly);
+  if (hDS == NULL) {
+    msSetError(MS_IMGERR, "Unable to open GDAL Memory dataset.",
+               "msContourCacheGenerateBlock()");
+    free(buffer);
+    msContourCacheFreeBlock(block);
+    return NULL;
+  }
+
+  dfNoDataValue = GDALGetRasterNoDataValue(hSrcBand, &bHasNoData);
+  if (bHasNoData)
+    GDALSetRasterNoDataValue(GDALGetRasterBand(hDS, 1), dfNoDataValue);
+
+  msGetGDALGeoTransform(clinfo->hOrigDS, layer->map, layer,
+                        adfSrcGeoTransform);
+  adfGeoTransform[0] =
+      adfSrcGeoTransform[0] + dst_xoff * clinfo->step_x * adfSrcGeoTransform[1];
+  adfGeoTransform[1] = adfSrcGeoTransform[1] * clinfo->step_x;
+  adfGeoTransform[2] = 0;
+  adfGeoTransform[3] =
+      adfSrcGeoTransform[3] + dst_yoff * clinfo->step_y * adfSrcGeoTransform[5];
+  adfGeoTransform[4] = 0;
+  adfGeoTransform[5] = adfSrcGeoTransform[5] * clinfo->step_y;
+  GDALSetGeoTransform(hDS, adfGeoTransform);
+
+  /* Contour into a scratch OGR layer, then keep the geometries */
+  hDriver = OGRGetDriverByName("Memory");
+  hOGRDS = hDriver ? OGR_Dr_CreateDataSource(hDriver, "", NULL) : NULL;
+  if (hOGRDS == NULL) {
+    msSetError(MS_OGRERR, "Unable to create OGR DataSource.",
+               "msContourCacheGenerateBlock()");
+    GDALClose(hDS);
+    free(buffer);
+    msContourCacheFreeBlock(block);
+    return NULL;
+  }
+
+  hLayer = OGR_DS_CreateLayer(hOGRDS, "contour", NULL, wkbLineString, NULL);
+  hFld = OGR_Fld_Create("ID", OFTInteger);
+  OGR_L_CreateField(hLayer, hFld, FALSE);
+  OGR_Fld_Destroy(hFld);
+  hFld = OGR_Fld_Create("ELEV", OFTReal);
+  OGR_L_CreateField(hLayer, hFld, FALSE);
+  OGR_Fld_Destroy(hFld);
+
+  eErr = GDALContourGenerate(GDALGetRasterBand(hDS, 1), interval, 0.0,
+                             levelCount, levels, bHasNoData, dfNoDataValue,
+                             hLayer, 0, 1, NULL, NULL);
+  if (eErr != CE_None) {
+    msSetError(MS_IOERR, "GDALContourGenerate() failed: %s",
+               "msContourCacheGenerateBlock()", CPLGetLastErrorMsg());
+    OGR_DS_Destroy(hOGRDS);
+    GDALClose(hDS);
+    free(buffer);
+    msContourCacheFreeBlock(block);
+    return NULL;
+  }
+
+  nFeatures = (int)OGR_L_GetFeatureCount(hLayer, TRUE);
+  block->lines =
+      (OGRGeometryH *)msSmallMalloc(sizeof(OGRGeometryH) * MS_MAX(1, nFeatures));
+  block->elevations =
+      (double *)msSmallMalloc(sizeof(double) * MS_MAX(1, nFeatures));
+  OGR_L_ResetReading(hLayer);
+  while (block->numlines < nFeatures &&
+         (hFeature = OGR_L_GetNextFeature(hLayer)) != NULL) {
+    OGRGeometryH hGeom = OGR_F_GetGeometryRef(hFeature);
+    if (hGeom != NULL) {
+      block->lines[block->numlines] = OGR_G_Clone(hGeom);
+      block->elevations[block->numlines] =
+          OGR_F_GetFieldAsDouble(hFeature, 1);
+      block->numlines++;
+    }
+    OGR_F_Destroy(hFeature);
+  }
+
+  OGR_DS_Destroy(hOGRDS);
+  GDALClose(hDS);
+  free(buffer);
+
+  return block;
+}
+
+/************************************************************************/
+/*                  msContourLayerGenerateCachedContour()               */
+/*                                                                      */
+/*      Assemble the contours of the requested area from the cached     */
+/*      DEM blocks, generating the missing ones.                        */
+/************************************************************************/
+
+static int msContourLayerGenerateCachedContour(layerObj *layer) {
+  contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
+  const char *elevItem, *value;
+  double interval, levels[1000];
+  double adfGeoTransform[6], adfInvGeoTransform[6];
+  double x1, y1, x2, y2;
+  int levelCount, blocksize, max_size, i;
+  int bx, by, bx_min, bx_max, by_min, by_max, nblocks_x, nblocks_y;
+  int nextId = 0;
+  char *key_prefix;
+  OGRLayerH hLayer;
+
+  elevItem = CSLFetchNameValue(layer->processing, "CONTOUR_ITEM");
+  if (elevItem && strlen(elevItem) == 0)
     elevItem = NULL;
+
+  msContourGetLevels(layer, &interval, levels,
+                     (int)(sizeof(levels) / sizeof(double)), &levelCount);
+
+  value = CSLFetchNameValue(layer->processing, "CONTOUR_CACHE_BLOCK_SIZE");
+  blocksize = value ? atoi(value) : MS_CONTOUR_CACHE_DEFAULT_BLOCK_SIZE;
+  if (blocksize < 16)
+    blocksize = 16;
+
+  /* Find the blocks touched by the requested area */
+  msGetGDALGeoTransform(clinfo->hOrigDS, layer->map, layer, adfGeoTransform);
+  InvGeoTransform(adfGeoTransform, adfInvGeoTransform);
+  x1 = GEO_TRANS(adfInvGeoTransform, clinfo->cache_rect.minx,
+                 clinfo->cache_rect.maxy);
+  y1 = GEO_TRANS(adfInvGeoTransform + 3, clinfo->cache_rect.minx,
+                 clinfo->cache_rect.maxy);
+  x2 = GEO_TRANS(adfInvGeoTransform, clinfo->cache_rect.maxx,
+                 clinfo->cache_rect.miny);
+  y2 = GEO_TRANS(adfInvGeoTransform + 3, clinfo->cache_rect.maxx,
+                 clinfo->cache_rect.miny);
+
+  nblocks_x =
+      MS_MAX(1, (GDALGetRasterXSize(clinfo->hOrigDS) / clinfo->step_x - 2) /
+                        blocksize +
+                    1);
+  nblocks_y =
+      MS_MAX(1, (GDALGetRasterYSize(clinfo->hOrigDS) / clinfo->step_y - 2) /
+                        blocksize +
+                    1);
+  bx_min = (int)floor(MS_MIN(x1, x2) / clinfo->step_x / blocksize);
+  bx_max = (int)floor(MS_MAX(x1, x2) / clinfo->step_x / blocksize);
+  by_min = (int)floor(MS_MIN(y1, y2) / clinfo->step_y / blocksize);
+  by_max = (int)floor(MS_MAX(y1, y2) / clinfo->step_y / blocksize);
+  bx_min = MS_MAX(0, bx_min);
+  by_min = MS_MAX(0, by_min);
+  bx_max = MS_MIN(nblocks_x - 1, bx_max);
+  by_max = MS_MIN(nblocks_y - 1, by_max);
+
+  hLayer = msContourCreateOGRLayer(layer, elevItem);
+  if (hLayer == NULL)
+    return MS_FAILURE;
+
+  /* Everything the contours depend on, except the block position */
+  key_prefix = msStringConcatenate(NULL, GDALGetDescription(clinfo->hOrigDS));
+  {
+    char szTmp[128];
+    snprintf(szTmp, sizeof(szTmp), "|%d|%d,%d|%d|%.17g|", clinfo->band,
+             clinfo->step_x, clinfo->step_y, blocksize, interval);
+    key_prefix = msStringConcatenate(key_prefix, szTmp);
+    for (i = 0; i < levelCount; i++) {
+      snprintf(szTmp, sizeof(szTmp), "%.17g,", levels[i]);
+      key_prefix = msStringConcatenate(key_prefix, szTmp);
+    }
   }
 
-  option = msContourGetOption(layer, "CONTOUR_INTERVAL");
-  if (option) {
-    interval = atof(option);
-    free(option);
+  max_size = msContourCacheMaxSize();
+
+  for (by = by_min; by <= by_max; by++) {
+    for (bx = bx_min; bx <= bx_max; bx++) {
+      contourCacheBlock *block, *newBlock = NULL;
+      char szPos[64];
+      char *key;
+
+      snprintf(szPos, sizeof(szPos), "|%d,%d", bx, by);
+      key = msStringConcatenate(msStrdup(key_prefix), szPos);
+
+      msAcquireLock(TLOCK_CONTOUR);
+      for (block = contourCacheHead; block != NULL; block = block->next) {
+        if (strcmp(block->key, key) == 0)
+          break;
+      }
+
+      if (block == NULL) {
+        /* generate without holding the lock */
+        msReleaseLock(TLOCK_CONTOUR);
+        if (layer->debug)
+          msDebug("msContourLayerGenerateCachedContour(): generating block "
+                  "%d,%d.\n",
+                  bx, by);
+        newBlock = msContourCacheGenerateBlock(layer, bx, by, blocksize,
+                                               interval, levels, levelCount);
+        if (newBlock == NULL) {
+          msFree(key);
+          msFree(key_prefix);
+          return MS_FAILURE;
+        }
+        newBlock->key = key;
+        key = NULL;
+
+        /* another thread may have generated it meanwhile */
+        msAcquireLock(TLOCK_CONTOUR);
+        for (block = contourCacheHead; block != NULL; block = block->next) {
+          if (strcmp(block->key, newBlock->key) == 0)
+            break;
+        }
+        if (block == NULL) {
+          block = newBlock;
+          newBlock = NULL;
+          msContourCachePushFront(block);
+        }
+      }
+
+      if (block != contourCacheHead) {
+        msContourCacheUnlink(block);
+        msContourCachePushFront(block);
+      }
+
+      /* copy the lines that may be visible in the output layer */
+      for (i = 0; i < block->numlines; i++) {
+        OGREnvelope sEnvelope;
+        OGRFeatureH hFeature;
+
+        OGR_G_GetEnvelope(block->lines[i], &sEnvelope);
+        if (sEnvelope.MaxX < clinfo->cache_rect.minx ||
+            sEnvelope.MinX > clinfo->cache_rect.maxx ||
+            sEnvelope.MaxY < clinfo->cache_rect.miny ||
+            sEnvelope.MinY > clinfo->cache_rect.maxy)
+          continue;
+
+        hFeature = OGR_F_Create(OGR_L_GetLayerDefn(hLayer));
+        OGR_F_SetFieldInteger(hFeature, 0, nextId++);
+        if (elevItem)
+          OGR_F_SetFieldDouble(hFeature, 1, block->elevations[i]);
+        OGR_F_SetGeometry(hFeature, block->lines[i]);
+        OGR_L_CreateFeature(hLayer, hFeature);
+        OGR_F_Destroy(hFeature);
+      }
+
+      /* trim the least recently used blocks */
+      while (contourCacheCount > max_size &&
+             contourCacheTail != contourCacheHead) {
+        contourCacheBlock *victim = contourCacheTail;
+        msContourCacheUnlink(victim);
+        msContourCacheFreeBlock(victim);
+      }
+      msReleaseLock(TLOCK_CONTOUR);
+
+      if (newBlock)
+        msContourCacheFreeBlock(newBlock);
+      msFree(key);
+    }
   }
 
-  option = msContourGetOption(layer, "CONTOUR_LEVELS");
-  if (option) {
-    int i, c;
-    char **levelsTmp;
-    levelsTmp = CSLTokenizeStringComplex(option, ",", FALSE, FALSE);
-    c = CSLCount(levelsTmp);
-    for (i = 0; i < c && i < (int)(sizeof(levels) / sizeof(double)); ++i)
-      levels[levelCount++] = atof(levelsTmp[i]);
+  msFree(key_prefix);
 
-    CSLDestroy(levelsTmp);
-    free(option);
+  msConnPoolRegister(&clinfo->ogrLayer, clinfo->hOGRDS,
+                     msContourOGRCloseConnection);
+
+  return MS_SUCCESS;
+}
+
+static int msContourLayerGenerateContour(layerObj *layer) {
+  OGRLayerH hLayer;
+  const char *elevItem;
+  double interval, levels[1000];
+  int levelCount;
+  GDALRasterBandH hBand = NULL;
+  CPLErr eErr;
+  int bHasNoData = FALSE;
+  double dfNoDataValue;
+
+  contourLayerInfo *clinfo = (contourLayerInfo *)layer->layerinfo;
+
+  OGRRegisterAll();
+
+  if (clinfo == NULL) {
+    msSetError(MS_MISCERR, "Assertion failed: Contour layer not opened!!!",
+               "msContourLayerCreateOGRDataSource()");
+    return MS_FAILURE;
   }
 
+  if (clinfo->use_cache)
+    return msContourLayerGenerateCachedContour(layer);
+
+  if (!clinfo->hDS) { /* no overlap */
+    return MS_SUCCESS;
+  }
+
+  hBand = GDALGetRasterBand(clinfo->hDS, 1);
+  if (hBand == NULL) {
+    msSetError(MS_IMGERR, "Band %d does not exist on dataset.",
+               "msContourLayerGenerateContour()", 1);
+    return MS_FAILURE;
+  }
+
+  /* Check if we have a coutour item specified */
+  elevItem = CSLFetchNameValue(layer->processing, "CONTOUR_ITEM");
+  if (elevItem && strlen(elevItem) == 0)
+    elevItem = NULL;
+
+  /* Create the OGR DataSource */
+  hLayer = msContourCreateOGRLayer(layer, elevItem);
+  if (hLayer == NULL)
+    return MS_FAILURE;
+
+  msContourGetLevels(layer, &interval, levels,
+                     (int)(sizeof(levels) / sizeof(double)), &levelCount);
+
   dfNoDataValue = GDALGetRasterNoDataValue(hBand, &bHasNoData);
 
   eErr = GDALContourGenerate(
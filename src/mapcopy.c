@@ -1183,6 +1183,7 @@ int msCopyMap(mapObj *dst, const mapObj *src) {
   MS_COPYSTELEM(resolution);
   MS_COPYSTRING(dst->shapepath, src->shapepath);
   MS_COPYSTRING(dst->mappath, src->mappath);
+  MS_COPYSTRING(dst->mapfile, src->mapfile);
   MS_COPYSTELEM(sldurl);
 
   MS_COPYCOLOR(&(dst->imagecolor), &(src->imagecolor));
@@ -1094,7 +1094,9 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
   int status, retcode = MS_SUCCESS;
   int drawmode = MS_DRAWMODE_FEATURES;
   char annotate = MS_TRUE;
-  shapeObj shape;
+  shapeBatchObj batch;
+  shapeObj *shape = NULL;
+  int batchindex = -1;
   shapeObj savedShape;
   rectObj searchrect;
   char cache = MS_FALSE;
@@ -1216,38 +1218,46 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
     return MS_FAILURE;
   }
 
-  /* step through the target shapes and their classes */
-  msInitShape(&shape);
+  /* step through the target shapes, MS_SHAPE_BATCH_SIZE at a time, and their
+   * classes. Styles from the data source (STYLEITEM "AUTO" in particular) are
+   * looked up in the provider's state for the last shape read, so those layers
+   * are read one shape at a time. */
+  const int batchsize = layer->styleitem ? 1 : MS_SHAPE_BATCH_SIZE;
+  msInitShapeBatch(&batch);
   int classindex = -1;
   int classcount = 0;
   for (;;) {
     int rendermode;
     if (classindex == -1) {
-      msFreeShape(&shape);
-      status = msLayerNextShape(layer, &shape);
-      if (status != MS_SUCCESS) {
-        break;
+      if (++batchindex >= batch.numshapes) {
+        msClearShapeBatch(&batch);
+        status = msLayerNextShapes(layer, &batch, batchsize);
+        if (status != MS_SUCCESS) {
+          break;
+        }
+        batchindex = 0;
       }
+      shape = &(batch.shapes[batchindex]);
 
       /* Check if the shape size is ok to be drawn */
-      if ((shape.type == MS_SHAPE_LINE || shape.type == MS_SHAPE_POLYGON) &&
+      if ((shape->type == MS_SHAPE_LINE || shape->type == MS_SHAPE_POLYGON) &&
           (minfeaturesize > 0) &&
-          (msShapeCheckSize(&shape, minfeaturesize) == MS_FALSE)) {
+          (msShapeCheckSize(shape, minfeaturesize) == MS_FALSE)) {
         if (layer->debug >= MS_DEBUGLEVEL_V)
           msDebug("msDrawVectorLayer(): Skipping shape (%ld) because "
                   "LAYER::MINFEATURESIZE is bigger than shape size\n",
-                  shape.index);
+                  shape->index);
         continue;
       }
       classcount = 0;
     }
 
-    classindex = msShapeGetNextClass(classindex, layer, map, &shape, classgroup,
+    classindex = msShapeGetNextClass(classindex, layer, map, shape, classgroup,
                                      nclasses);
     if ((classindex == -1) || (layer->class[classindex] -> status == MS_OFF)) {
       continue;
     }
-    shape.classindex = classindex;
+    shape->classindex = classindex;
 
     // When only one class is applicable, rendering mode is forced to its
     // default, i.e. only the first applicable class is actually applied. As a
@@ -1255,7 +1265,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
     classcount++;
     rendermode = ref_rendermode;
     if ((classcount == 1) &&
-        (msShapeGetNextClass(classindex, layer, map, &shape, classgroup,
+        (msShapeGetNextClass(classindex, layer, map, shape, classgroup,
                              nclasses) == -1)) {
       rendermode = MS_FIRST_MATCHING_CLASS;
     }
@@ -1272,13 +1282,13 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
 
     cache = MS_FALSE;
     if (layer->type == MS_LAYER_LINE &&
-        (layer->class[shape.classindex]
+        (layer->class[shape->classindex]
          -> numstyles > 1 ||
-                (layer->class[shape.classindex]
+                (layer->class[shape->classindex]
                  -> numstyles == 1 &&
-                        (layer->class[shape.classindex] -> styles[0]
+                        (layer->class[shape->classindex] -> styles[0]
                          -> outlinewidth > 0 ||
-                                layer -> class[shape.classindex] -> styles[0]
+                                layer -> class[shape->classindex] -> styles[0]
                          -> bindings[MS_STYLE_BINDING_OUTLINEWIDTH].index !=
                                 -1)))) {
       cache = MS_TRUE; /* only line layers with multiple styles need be cached
@@ -1290,15 +1300,15 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
     /* style parameters for this shape. */
     if (layer->styleitem) {
       if (strcasecmp(layer->styleitem, "AUTO") == 0) {
-        if (msLayerGetAutoStyle(map, layer, layer->class[shape.classindex],
-                                &shape) != MS_SUCCESS) {
+        if (msLayerGetAutoStyle(map, layer, layer->class[shape->classindex],
+                                shape) != MS_SUCCESS) {
           retcode = MS_FAILURE;
           break;
         }
       } else {
         /* Generic feature style handling as per RFC-61 */
-        if (msLayerGetFeatureStyle(map, layer, layer->class[shape.classindex],
-                                   &shape) != MS_SUCCESS) {
+        if (msLayerGetFeatureStyle(map, layer, layer->class[shape->classindex],
+                                   shape) != MS_SUCCESS) {
           retcode = MS_FAILURE;
           break;
         }
@@ -1316,7 +1326,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
 
     /* RFC77 TODO: check return value, may need a more sophisticated if-then
      * test. */
-    if (annotate && layer->class[shape.classindex] -> numlabels > 0) {
+    if (annotate && layer->class[shape->classindex] -> numlabels > 0) {
       drawmode |= MS_DRAWMODE_LABELS;
       if (msLayerGetProcessingKey(layer, "LABEL_NO_CLIP")) {
         drawmode |= MS_DRAWMODE_UNCLIPPEDLABELS;
@@ -1334,15 +1344,15 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
       // original values for the shape to be drawn multiple times. Here the
       // original shape is saved.
       msInitShape(&savedShape);
-      msCopyShape(&shape, &savedShape);
+      msCopyShape(shape, &savedShape);
     }
 
     if (cache) {
-      styleObj *pStyle = layer->class[shape.classindex]->styles[0];
+      styleObj *pStyle = layer->class[shape->classindex]->styles[0];
 
       // first ensure the style properties are bound to the shape
       // any outlinewidth bindings will then be set
-      if (msBindLayerToShape(layer, &shape, drawmode) != MS_SUCCESS) {
+      if (msBindLayerToShape(layer, shape, drawmode) != MS_SUCCESS) {
         retcode = MS_FAILURE;
         break;
       }
@@ -1359,7 +1369,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
         msOutlineRenderingPrepareStyle(pStyle, map, layer, image);
       }
       /* draw a single style */
-      status = msDrawShape(map, layer, &shape, image, 0,
+      status = msDrawShape(map, layer, shape, image, 0,
                            drawmode | MS_DRAWMODE_SINGLESTYLE);
 
       if (pStyle->outlinewidth > 0) {
@@ -1372,7 +1382,7 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
       }
     } else {
       status =
-          msDrawShape(map, layer, &shape, image, -1, drawmode); /* all styles */
+          msDrawShape(map, layer, shape, image, -1, drawmode); /* all styles */
     }
 
     if (rendermode == MS_ALL_MATCHING_CLASSES) {
@@ -1380,8 +1390,8 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
       // actually applied. Coordinates stored in the shape must keep their
       // original values for the shape to be drawn multiple times. Here the
       // original shape is restored.
-      msFreeShape(&shape);
-      msCopyShape(&savedShape, &shape);
+      msFreeShape(shape);
+      msCopyShape(&savedShape, shape);
       msFreeShape(&savedShape);
     }
 
@@ -1390,22 +1400,22 @@ int msDrawVectorLayer(mapObj *map, layerObj *layer, imageObj *image) {
       break;
     }
 
-    if (shape.numlines ==
+    if (shape->numlines ==
         0) { /* once clipped the shape didn't need to be drawn */
       continue;
     }
 
     if (cache) {
-      if (insertFeatureList(&shpcache, &shape) == NULL) {
+      if (insertFeatureList(&shpcache, shape) == NULL) {
         retcode = MS_FAILURE; /* problem adding to the cache */
         break;
       }
     }
 
     maxnumstyles =
-        MS_MAX(maxnumstyles, layer->class[shape.classindex] -> numstyles);
+        MS_MAX(maxnumstyles, layer->class[shape->classindex] -> numstyles);
   }
-  msFreeShape(&shape);
+  msFreeShapeBatch(&batch);
 
   if (classgroup)
     msFree(classgroup);
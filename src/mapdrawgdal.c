@@ -64,6 +64,11 @@ static int msDrawRasterLayerGDAL_RawMode(mapObj *map, layerObj *layer,
                                          int dst_xoff, int dst_yoff,
                                          int dst_xsize, int dst_ysize);
 
+static CPLErr msGDALBandRasterIO(layerObj *layer, GDALRasterBandH hBand,
+                                 int src_xoff, int src_yoff, int src_xsize,
+                                 int src_ysize, void *pData, int dst_xsize,
+                                 int dst_ysize, GDALDataType eDT);
+
 static int msDrawRasterLayerGDAL_16BitClassification(
     mapObj *map, layerObj *layer, rasterBufferObj *rb, GDALRasterBandH hBand,
     int src_xoff, int src_yoff, int src_xsize, int src_ysize, int dst_xoff,
@@ -751,9 +756,9 @@ int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer, imageObj *image,
 
       hBandAlpha = GDALGetMaskBand(hBand1);
 
-      eErr = GDALRasterIO(hBandAlpha, GF_Read, src_xoff, src_yoff, src_xsize,
-                          src_ysize, pabyRawAlpha, dst_xsize, dst_ysize,
-                          GDT_Byte, 0, 0);
+      eErr = msGDALBandRasterIO(layer, hBandAlpha, src_xoff, src_yoff,
+                                src_xsize, src_ysize, pabyRawAlpha, dst_xsize,
+                                dst_ysize, GDT_Byte);
 
       if (eErr != CE_None) {
         msSetError(MS_IOERR, "GDALRasterIO() failed: %s", "drawGDAL()",
@@ -1235,6 +1240,185 @@ static int ApplyLUT(int iColorIndex, const char *lut_def, const void *pInBuffer,
   return err;
 }
 
+/************************************************************************/
+/*                        msGDALSelectOverview()                        */
+/*                                                                      */
+/*      Select the overview of a band to read a source window from      */
+/*      at the requested buffer size.  The coarsest overview whose      */
+/*      decimation factor does not exceed the requested one             */
+/*      multiplied by the OVERSAMPLING_THRESHOLD processing option      */
+/*      (default 1.2, like GDAL) is returned, or -1 for the full        */
+/*      resolution band.  OVERSAMPLING_THRESHOLD=0 lets GDAL choose.    */
+/************************************************************************/
+
+static int msGDALSelectOverview(layerObj *layer, GDALRasterBandH hBand,
+                                int src_xsize, int src_ysize, int dst_xsize,
+                                int dst_ysize) {
+  const char *pszThreshold =
+      msLayerGetProcessingKey(layer, "OVERSAMPLING_THRESHOLD");
+  double dfThreshold = pszThreshold ? CPLAtof(pszThreshold) : 1.2;
+  double dfFactor, dfBestFactor = 1.0;
+  int i, nOverviews, iBest = -1;
+
+  if (dfThreshold <= 0.0 || dst_xsize <= 0 || dst_ysize <= 0)
+    return -1;
+
+  dfFactor = MS_MIN(src_xsize / (double)dst_xsize,
+                    src_ysize / (double)dst_ysize) *
+             MS_MAX(1.0, dfThreshold);
+  if (dfFactor <= 1.0)
+    return -1;
+
+  nOverviews = GDALGetOverviewCount(hBand);
+  for (i = 0; i < nOverviews; i++) {
+    GDALRasterBandH hOverview = GDALGetOverview(hBand, i);
+    double dfOverviewFactor;
+
+    if (hOverview == NULL || GDALGetRasterBandXSize(hOverview) == 0)
+      continue;
+    dfOverviewFactor = GDALGetRasterBandXSize(hBand) /
+                       (double)GDALGetRasterBandXSize(hOverview);
+    if (dfOverviewFactor <= dfFactor && dfOverviewFactor > dfBestFactor) {
+      dfBestFactor = dfOverviewFactor;
+      iBest = i;
+    }
+  }
+
+  return iBest;
+}
+
+/************************************************************************/
+/*                       msGDALOverviewRasterIO()                       */
+/*                                                                      */
+/*      Read a full resolution source window from the given overview    */
+/*      of a band (or the band itself if iOverview is -1).  The window  */
+/*      generally falls between overview pixels, so its exact extent    */
+/*      is passed to GDAL for the resampling, the integer window being  */
+/*      only the pixels it covers.                                      */
+/************************************************************************/
+
+static CPLErr msGDALOverviewRasterIO(GDALRasterBandH hBand, int iOverview,
+                                     int src_xoff, int src_yoff,
+                                     int src_xsize, int src_ysize,
+                                     void *pData, int dst_xsize,
+                                     int dst_ysize, GDALDataType eDT) {
+  GDALRasterBandH hOverview;
+  GDALRasterIOExtraArg sExtraArg;
+  double dfXRatio, dfYRatio;
+  int ovr_width, ovr_height;
+  int ovr_xoff, ovr_yoff, ovr_xsize, ovr_ysize;
+
+  hOverview = iOverview < 0 ? NULL : GDALGetOverview(hBand, iOverview);
+  if (hOverview == NULL)
+    return GDALRasterIO(hBand, GF_Read, src_xoff, src_yoff, src_xsize,
+                        src_ysize, pData, dst_xsize, dst_ysize, eDT, 0, 0);
+
+  ovr_width = GDALGetRasterBandXSize(hOverview);
+  ovr_height = GDALGetRasterBandYSize(hOverview);
+
+  dfXRatio = ovr_width / (double)GDALGetRasterBandXSize(hBand);
+  dfYRatio = ovr_height / (double)GDALGetRasterBandYSize(hBand);
+
+  INIT_RASTERIO_EXTRA_ARG(sExtraArg);
+  sExtraArg.bFloatingPointWindowValidity = TRUE;
+  sExtraArg.dfXOff = src_xoff * dfXRatio;
+  sExtraArg.dfYOff = src_yoff * dfYRatio;
+  sExtraArg.dfXSize = src_xsize * dfXRatio;
+  sExtraArg.dfYSize = src_ysize * dfYRatio;
+  sExtraArg.dfXOff = MS_MIN(sExtraArg.dfXOff, ovr_width - 1);
+  sExtraArg.dfYOff = MS_MIN(sExtraArg.dfYOff, ovr_height - 1);
+  sExtraArg.dfXSize = MS_MIN(sExtraArg.dfXSize, ovr_width - sExtraArg.dfXOff);
+  sExtraArg.dfYSize = MS_MIN(sExtraArg.dfYSize, ovr_height - sExtraArg.dfYOff);
+
+  ovr_xoff = (int)floor(sExtraArg.dfXOff);
+  ovr_yoff = (int)floor(sExtraArg.dfYOff);
+  ovr_xsize = MS_MAX(1, MS_MIN((int)ceil(sExtraArg.dfXOff + sExtraArg.dfXSize),
+                               ovr_width) -
+                            ovr_xoff);
+  ovr_ysize = MS_MAX(1, MS_MIN((int)ceil(sExtraArg.dfYOff + sExtraArg.dfYSize),
+                               ovr_height) -
+                            ovr_yoff);
+
+  return GDALRasterIOEx(hOverview, GF_Read, ovr_xoff, ovr_yoff, ovr_xsize,
+                        ovr_ysize, pData, dst_xsize, dst_ysize, eDT, 0, 0,
+                        &sExtraArg);
+}
+
+/************************************************************************/
+/*                          msGDALBandRasterIO()                        */
+/*                                                                      */
+/*      GDALRasterIO() replacement for rendering that reads from the    */
+/*      overview selected by msGDALSelectOverview().                    */
+/************************************************************************/
+
+static CPLErr msGDALBandRasterIO(layerObj *layer, GDALRasterBandH hBand,
+                                 int src_xoff, int src_yoff, int src_xsize,
+                                 int src_ysize, void *pData, int dst_xsize,
+                                 int dst_ysize, GDALDataType eDT) {
+  int iOverview = msGDALSelectOverview(layer, hBand, src_xsize, src_ysize,
+                                       dst_xsize, dst_ysize);
+
+  return msGDALOverviewRasterIO(hBand, iOverview, src_xoff, src_yoff,
+                                src_xsize, src_ysize, pData, dst_xsize,
+                                dst_ysize, eDT);
+}
+
+/************************************************************************/
+/*                        msGDALDatasetRasterIO()                       */
+/*                                                                      */
+/*      GDALDatasetRasterIO() replacement for rendering.  The overview  */
+/*      is selected on the first band and used for all of them, as     */
+/*      long as they all have a matching one.  Bands are read into a    */
+/*      band sequential buffer.                                         */
+/************************************************************************/
+
+static CPLErr msGDALDatasetRasterIO(layerObj *layer, GDALDatasetH hDS,
+                                    int src_xoff, int src_yoff,
+                                    int src_xsize, int src_ysize, void *pData,
+                                    int dst_xsize, int dst_ysize,
+                                    GDALDataType eDT, int band_count,
+                                    int *band_numbers) {
+  GDALRasterBandH hFirstBand = GDALGetRasterBand(hDS, band_numbers[0]);
+  const size_t nBandSize = (size_t)dst_xsize * dst_ysize *
+                           (GDALGetDataTypeSize(eDT) / 8);
+  CPLErr eErr = CE_None;
+  int i, iOverview;
+
+  iOverview = msGDALSelectOverview(layer, hFirstBand, src_xsize, src_ysize,
+                                   dst_xsize, dst_ysize);
+
+  for (i = 1; i < band_count && iOverview >= 0; i++) {
+    GDALRasterBandH hBand = GDALGetRasterBand(hDS, band_numbers[i]);
+    GDALRasterBandH hOverview;
+
+    if (GDALGetOverviewCount(hBand) <= iOverview ||
+        (hOverview = GDALGetOverview(hBand, iOverview)) == NULL ||
+        GDALGetRasterBandXSize(hOverview) !=
+            GDALGetRasterBandXSize(GDALGetOverview(hFirstBand, iOverview)) ||
+        GDALGetRasterBandYSize(hOverview) !=
+            GDALGetRasterBandYSize(GDALGetOverview(hFirstBand, iOverview)))
+      iOverview = -1;
+  }
+
+  if (iOverview < 0)
+    return GDALDatasetRasterIO(hDS, GF_Read, src_xoff, src_yoff, src_xsize,
+                               src_ysize, pData, dst_xsize, dst_ysize, eDT,
+                               band_count, band_numbers, 0, 0, 0);
+
+  if (layer->debug >= MS_DEBUGLEVEL_VV)
+    msDebug("msGDALDatasetRasterIO(%s): reading overview %d.\n", layer->name,
+            iOverview);
+
+  for (i = 0; i < band_count && eErr == CE_None; i++) {
+    eErr = msGDALOverviewRasterIO(GDALGetRasterBand(hDS, band_numbers[i]),
+                                  iOverview, src_xoff, src_yoff, src_xsize,
+                                  src_ysize, (GByte *)pData + i * nBandSize,
+                                  dst_xsize, dst_ysize, eDT);
+  }
+
+  return eErr;
+}
+
 /************************************************************************/
 /*                           LoadGDALImages()                           */
 /*                                                                      */
@@ -1315,9 +1499,9 @@ static int LoadGDALImages(GDALDatasetH hDS, int band_numbers[4], int band_count,
     } else
       pBuffer = pabyWholeBuffer;
 
-    eErr = GDALDatasetRasterIO(hDS, GF_Read, src_xoff, src_yoff, src_xsize,
-                               src_ysize, pBuffer, dst_xsize, dst_ysize, eDT,
-                               band_count, band_numbers, 0, 0, 0);
+    eErr = msGDALDatasetRasterIO(layer, hDS, src_xoff, src_yoff, src_xsize,
+                                 src_ysize, pBuffer, dst_xsize, dst_ysize, eDT,
+                                 band_count, band_numbers);
 
     if (eErr != CE_None) {
       msSetError(MS_IOERR, "GDALDatasetRasterIO() failed: %s", "drawGDAL()",
@@ -1370,9 +1554,9 @@ static int LoadGDALImages(GDALDatasetH hDS, int band_numbers[4], int band_count,
     return -1;
   }
 
-  eErr = GDALDatasetRasterIO(hDS, GF_Read, src_xoff, src_yoff, src_xsize,
-                             src_ysize, pafWholeRawData, dst_xsize, dst_ysize,
-                             GDT_Float32, band_count, band_numbers, 0, 0, 0);
+  eErr = msGDALDatasetRasterIO(layer, hDS, src_xoff, src_yoff, src_xsize,
+                               src_ysize, pafWholeRawData, dst_xsize, dst_ysize,
+                               GDT_Float32, band_count, band_numbers);
 
   if (eErr != CE_None) {
     msSetError(MS_IOERR, "GDALDatasetRasterIO() failed: %s", "drawGDAL()",
@@ -1935,6 +2119,7 @@ static int msDrawRasterLayerGDAL_16BitClassification(
   rasterBufferObj *mask_rb = NULL;
   rasterBufferObj s_mask_rb;
   int lastC;
+  rasterClassTableObj *psClassTable;
   struct mstimeval starttime = {0}, endtime = {0};
 
   const char *pszClassifyScaled;
@@ -1964,8 +2149,9 @@ static int msDrawRasterLayerGDAL_16BitClassification(
     return -1;
   }
 
-  eErr = GDALRasterIO(hBand, GF_Read, src_xoff, src_yoff, src_xsize, src_ysize,
-                      pafRawData, dst_xsize, dst_ysize, GDT_Float32, 0, 0);
+  eErr = msGDALBandRasterIO(layer, hBand, src_xoff, src_yoff, src_xsize,
+                            src_ysize, pafRawData, dst_xsize, dst_ysize,
+                            GDT_Float32);
 
   if (eErr != CE_None) {
     free(pafRawData);
@@ -2110,6 +2296,14 @@ static int msDrawRasterLayerGDAL_16BitClassification(
   const char *sgamma = msLayerGetProcessingKey(layer, "GAMMA");
   const double gamma = sgamma ? CPLAtof(sgamma) : 1.0;
 
+  /* Classify the buckets with a binary search over the class intervals
+     when the class expressions allow it. */
+  psClassTable = msRasterClassTableCreate(layer);
+  if (layer->debug > 0)
+    msDebug("msDrawRasterGDAL_16BitClassification(%s): "
+            "classes are%s compiled.\n",
+            layer->name, psClassTable ? "" : " not");
+
   lastC = -1;
   for (i = 0; i < nBucketCount; i++) {
     double dfOriginalValue;
@@ -2122,7 +2316,11 @@ static int msDrawRasterLayerGDAL_16BitClassification(
     /* The creation of buckets takes a significant time when they are many, and
        many classes as well. When iterating over buckets, a faster strategy is
        to reuse first the last used class index. */
-    if (bClassifyScaled == TRUE)
+    if (psClassTable)
+      c = msRasterClassTableLookup(psClassTable, bClassifyScaled == TRUE
+                                                     ? (float)i
+                                                     : (float)dfOriginalValue);
+    else if (bClassifyScaled == TRUE)
       c = msGetClass_FloatRGB_WithFirstClassToTry(layer, (float)i, -1, -1, -1,
                                                   lastC);
     else
@@ -2174,6 +2372,8 @@ static int msDrawRasterLayerGDAL_16BitClassification(
     }
   }
 
+  msRasterClassTableFree(psClassTable);
+
   if (layer->debug >= MS_DEBUGLEVEL_TUNING) {
     msGettimeofday(&endtime, NULL);
     msDebug(
@@ -2213,10 +2413,14 @@ static int msDrawRasterLayerGDAL_16BitClassification(
       if (iMapIndex >= nBucketCount || iMapIndex < 0) {
         continue;
       }
-      /* currently we never have partial alpha so keep simple */
-      if (rb_cmap[3][iMapIndex] > 0)
+      /* classes with an opacity are blended over what is already drawn */
+      if (rb_cmap[3][iMapIndex] > 253) {
         RB_SET_PIXEL(rb, j, i, rb_cmap[0][iMapIndex], rb_cmap[1][iMapIndex],
                      rb_cmap[2][iMapIndex], rb_cmap[3][iMapIndex]);
+      } else if (rb_cmap[3][iMapIndex] > 1) {
+        RB_MIX_PIXEL(rb, j, i, rb_cmap[0][iMapIndex], rb_cmap[1][iMapIndex],
+                     rb_cmap[2][iMapIndex], rb_cmap[3][iMapIndex]);
+      }
     }
   }
 
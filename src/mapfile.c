@@ -2515,11 +2515,9 @@ static void writeHashTable(FILE *stream, int indent, const char *title,
 
   indent++;
   writeBlockBegin(stream, indent, title);
-  for (i = 0; i < MS_HASHSIZE; i++) {
-    if (table->items[i] != NULL) {
-      for (tp = table->items[i]; tp != NULL; tp = tp->next)
-        writeNameValuePair(stream, indent, tp->key, tp->data);
-    }
+  for (i = 0; i < table->numitems; i++) {
+    tp = &(table->items[i]);
+    writeNameValuePair(stream, indent, tp->key, tp->data);
   }
   writeBlockEnd(stream, indent, title);
 }
@@ -2535,17 +2533,14 @@ static void writeHashTableInline(FILE *stream, int indent, char *name,
     return;
 
   ++indent;
-  for (i = 0; i < MS_HASHSIZE; ++i) {
-    if (table->items[i] != NULL) {
-      for (tp = table->items[i]; tp != NULL; tp = tp->next) {
-        writeIndent(stream, indent);
-        msIO_fprintf(stream, "%s ", name);
-        writeStringElement(stream, tp->key);
-        msIO_fprintf(stream, " ");
-        writeStringElement(stream, tp->data);
-        writeLineFeed(stream);
-      }
-    }
+  for (i = 0; i < table->numitems; ++i) {
+    tp = &(table->items[i]);
+    writeIndent(stream, indent);
+    msIO_fprintf(stream, "%s ", name);
+    writeStringElement(stream, tp->key);
+    msIO_fprintf(stream, " ");
+    writeStringElement(stream, tp->data);
+    writeLineFeed(stream);
   }
 }
 
@@ -6214,6 +6209,7 @@ int initMap(mapObj *map) {
   map->cellsize = 0;
   map->shapepath = NULL;
   map->mappath = NULL;
+  map->mapfile = NULL;
   map->sldurl = NULL;
 
   MS_INIT_COLOR(map->imagecolor, 255, 255, 255, 255); /* white */
@@ -7049,6 +7045,8 @@ mapObj *msLoadMap(const char *filename, const char *new_mappath,
   }
   msReleaseLock(TLOCK_PARSER);
 
+  map->mapfile = msStrdup(filename);
+
   applyStyleItemToLayer(map);
 
   if (debuglevel >= MS_DEBUGLEVEL_TUNING) {
@@ -39,6 +39,8 @@
 #include <cpl_conv.h>
 #include <ogr_srs_api.h>
 
+#define FLATGEOBUF_DEFAULT_READ_GAP (64 * 1024)
+
 static void msFGBPassThroughFieldDefinitions(layerObj *layer,
                                              flatgeobuf_ctx *ctx) {
   for (int i = 0; i < ctx->columns_len; i++) {
@@ -146,6 +148,14 @@ int msFlatGeobufLayerOpen(layerObj *layer) {
     flatgeobuf_free_ctx(ctx);
     return MS_FAILURE;
   }
+  ctx->path = msStrdup(szPath);
+
+  /* hits of an index search closer than this many bytes are read together */
+  const char *pszReadGap =
+      msLayerGetProcessingKey(layer, "FLATGEOBUF_READ_GAP");
+  ctx->read_gap = FLATGEOBUF_DEFAULT_READ_GAP;
+  if (pszReadGap != NULL)
+    ctx->read_gap = (uint32_t)MS_MIN(MS_MAX(0, atoi(pszReadGap)), 1024 * 1024);
 
   ret = flatgeobuf_check_magicbytes(ctx);
   if (ret == -1) {
@@ -235,21 +245,15 @@ int msFlatGeobufLayerNextShape(layerObj *layer, shapeObj *shape) {
     return MS_FAILURE;
 
   do {
+    int ret;
     if (ctx->search_result) {
       if (ctx->search_index >= ctx->search_result_len)
         return MS_DONE;
-      flatgeobuf_search_item item = ctx->search_result[ctx->search_index];
-      if (VSIFSeekL(ctx->file, ctx->feature_offset + item.offset, SEEK_SET) ==
-          -1) {
-        msSetError(MS_FGBERR, "Unable to seek in file",
-                   "msFlatGeobufLayerNextShape");
-        return MS_FAILURE;
-      }
-      ctx->offset = ctx->feature_offset + item.offset;
+      ret = flatgeobuf_decode_search_result(ctx, layer, shape);
       ctx->search_index++;
-      ctx->feature_index = item.index;
+    } else {
+      ret = flatgeobuf_decode_feature(ctx, layer, shape);
     }
-    int ret = flatgeobuf_decode_feature(ctx, layer, shape);
     if (ret == -1)
       return MS_FAILURE;
     shape->index = ctx->feature_index;
@@ -293,6 +297,54 @@ int msFlatGeobufLayerGetShape(layerObj *layer, shapeObj *shape,
   return MS_SUCCESS;
 }
 
+/*
+** The header of an indexed FlatGeobuf file gives the number of features, and
+** its packed R-tree the number of features whose bounding box intersects a
+** rect, which is used as an estimate with a COUNT_ESTIMATE_THRESHOLD.
+*/
+int msFlatGeobufLayerGetShapeCount(layerObj *layer, rectObj rect,
+                                   projectionObj *rectProjection) {
+  flatgeobuf_ctx *ctx;
+  ctx = layer->layerinfo;
+  if (!ctx)
+    return -1;
+
+  /* the layer FILTER can only be evaluated on the feature attributes */
+  if (layer->filter.string != NULL || !ctx->has_extent ||
+      !ctx->index_node_size || ctx->features_count == 0 ||
+      ctx->features_count > INT_MAX)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  rectObj searchrect = rect;
+  if (rectProjection != NULL && layer->project &&
+      msProjectionsDiffer(&(layer->projection), rectProjection))
+    msProjectRect(rectProjection, &(layer->projection), &searchrect);
+
+  int nCount = -1;
+  if (msRectOverlap(&ctx->bounds, &searchrect) != MS_TRUE)
+    nCount = 0;
+  else if (msRectContained(&ctx->bounds, &searchrect) == MS_TRUE)
+    nCount = (int)ctx->features_count;
+  else if (msLayerGetCountEstimateThreshold(layer) >= 0) {
+    if (flatgeobuf_index_search(ctx, &searchrect) == -1)
+      return -1;
+    if ((int)ctx->search_result_len >= msLayerGetCountEstimateThreshold(layer))
+      nCount = (int)ctx->search_result_len;
+    /* leave the layer ready for msFlatGeobufLayerWhichShapes() */
+    free(ctx->search_result);
+    ctx->search_result = NULL;
+    ctx->search_result_len = 0;
+    ctx->search_index = 0;
+  }
+
+  if (nCount < 0)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  if (layer->maxfeatures > 0 && nCount > layer->maxfeatures)
+    nCount = layer->maxfeatures;
+  return nCount;
+}
+
 int msFlatGeobufLayerClose(layerObj *layer) {
   flatgeobuf_ctx *ctx;
   ctx = layer->layerinfo;
@@ -352,7 +404,7 @@ int msFlatGeobufLayerInitializeVirtualTable(layerObj *layer) {
   layer->vtable->LayerWhichShapes = msFlatGeobufLayerWhichShapes;
   layer->vtable->LayerNextShape = msFlatGeobufLayerNextShape;
   layer->vtable->LayerGetShape = msFlatGeobufLayerGetShape;
-  /* layer->vtable->LayerGetShapeCount, use default */
+  layer->vtable->LayerGetShapeCount = msFlatGeobufLayerGetShapeCount;
   layer->vtable->LayerClose = msFlatGeobufLayerClose;
   layer->vtable->LayerGetItems = msFlatGeobufLayerGetItems;
   layer->vtable->LayerGetExtent = msFlatGeobufLayerGetExtent;
@@ -366,3 +418,5 @@ int msFlatGeobufLayerInitializeVirtualTable(layerObj *layer) {
 
   return MS_SUCCESS;
 }
+
+void msFlatGeobufCleanup(void) { flatgeobuf_index_cache_cleanup(); }
@@ -79,6 +79,8 @@ void msGDALCleanup(void)
     int nDSCount = 0;
     int bDidSomething;
 
+    msRasterDatasetCacheCleanup();
+
     msAcquireLock(TLOCK_GDAL);
 
     do {
@@ -598,12 +600,9 @@ char **msGetStringListFromHashTable(hashTableObj *table) {
   if (msHashIsEmpty(table))
     return NULL;
 
-  for (i = 0; i < MS_HASHSIZE; ++i) {
-    if (table->items[i] != NULL) {
-      for (tp = table->items[i]; tp != NULL; tp = tp->next) {
-        papszRet = CSLSetNameValue(papszRet, tp->key, tp->data);
-      }
-    }
+  for (i = 0; i < table->numitems; ++i) {
+    tp = &(table->items[i]);
+    papszRet = CSLSetNameValue(papszRet, tp->key, tp->data);
   }
   return papszRet;
 }
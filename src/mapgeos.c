@@ -753,6 +753,13 @@ void msGEOSFreeGeometry(shapeObj *shape) {
   if (!shape || !shape->geometry)
     return;
 
+  /* the prepared geometry references the geometry, destroy it first */
+  if (shape->prepared_geometry) {
+    GEOSPreparedGeom_destroy_r(
+        handle, (const GEOSPreparedGeometry *)shape->prepared_geometry);
+    shape->prepared_geometry = NULL;
+  }
+
   g = (GEOSGeom)shape->geometry;
   GEOSGeom_destroy_r(handle, g);
   shape->geometry = NULL;
@@ -763,6 +770,37 @@ void msGEOSFreeGeometry(shapeObj *shape) {
 #endif
 }
 
+/*
+** Prepare the geometry of a shape that is going to be tested against many
+** other shapes (e.g. a query or filter shape).  The binary predicates below
+** use the prepared geometry, which indexes the segments of the shape, when
+** either of their arguments has one.  Returns MS_SUCCESS or MS_FAILURE.
+*/
+int msGEOSPrepareGeometry(shapeObj *shape) {
+#ifdef USE_GEOS
+  GEOSContextHandle_t handle = msGetGeosContextHandle();
+
+  if (!shape)
+    return MS_FAILURE;
+
+  if (shape->prepared_geometry)
+    return MS_SUCCESS;
+
+  if (!shape->geometry) /* if no geometry for the shape then build one */
+    shape->geometry = (GEOSGeom)msGEOSShape2Geometry(shape);
+  if (!shape->geometry)
+    return MS_FAILURE;
+
+  shape->prepared_geometry =
+      (void *)GEOSPrepare_r(handle, (GEOSGeom)shape->geometry);
+  return shape->prepared_geometry ? MS_SUCCESS : MS_FAILURE;
+#else
+  msSetError(MS_GEOSERR, "GEOS support is not available.",
+             "msGEOSPrepareGeometry()");
+  return MS_FAILURE;
+#endif
+}
+
 /*
 ** WKT input and output functions
 */
@@ -1427,7 +1465,14 @@ int msGEOSContains(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSContains_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedContains_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedWithin_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSContains_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSContains()");
@@ -1459,7 +1504,14 @@ int msGEOSOverlaps(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSOverlaps_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedOverlaps_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedOverlaps_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSOverlaps_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSOverlaps()");
@@ -1491,7 +1543,14 @@ int msGEOSWithin(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSWithin_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedWithin_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedContains_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSWithin_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSWithin()");
@@ -1523,7 +1582,11 @@ int msGEOSCrosses(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSCrosses_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedCrosses_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else
+    result = GEOSCrosses_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSCrosses()");
@@ -1555,7 +1618,14 @@ int msGEOSIntersects(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSIntersects_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedIntersects_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedIntersects_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSIntersects_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   if (!shape1 || !shape2)
@@ -1608,7 +1678,14 @@ int msGEOSTouches(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSTouches_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedTouches_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedTouches_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSTouches_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSTouches()");
@@ -1672,7 +1749,14 @@ int msGEOSDisjoint(shapeObj *shape1, shapeObj *shape2) {
   if (!g2)
     return -1;
 
-  result = GEOSDisjoint_r(handle, g1, g2);
+  if (shape1->prepared_geometry)
+    result = GEOSPreparedDisjoint_r(
+        handle, (const GEOSPreparedGeometry *)shape1->prepared_geometry, g2);
+  else if (shape2->prepared_geometry)
+    result = GEOSPreparedDisjoint_r(
+        handle, (const GEOSPreparedGeometry *)shape2->prepared_geometry, g1);
+  else
+    result = GEOSDisjoint_r(handle, g1, g2);
   return ((result == 2) ? -1 : result);
 #else
   msSetError(MS_GEOSERR, "GEOS support is not available.", "msGEOSDisjoint()");
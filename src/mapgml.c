@@ -46,69 +46,94 @@ static int msGMLGeometryLookup(gmlGeometryListObj *geometryList,
 */
 
 /* GML 2.1.2 */
-static int gmlWriteBounds_GML2(FILE *stream, rectObj *rect, const char *srsname,
-                               const char *tab, const char *pszTopPrefix) {
+static int gmlWriteBounds_GML2(msIOWriter *writer, rectObj *rect,
+                               const char *srsname, const char *tab,
+                               const char *pszTopPrefix) {
   char *srsname_encoded;
 
-  if (!stream)
+  if (!writer)
     return (MS_FAILURE);
   if (!rect)
     return (MS_FAILURE);
   if (!tab)
     return (MS_FAILURE);
 
-  msIO_fprintf(stream, "%s<%s:boundedBy>\n", tab, pszTopPrefix);
+  msIO_writerPrintf(writer, "%s<%s:boundedBy>\n", tab, pszTopPrefix);
   if (srsname) {
     srsname_encoded = msEncodeHTMLEntities(srsname);
-    msIO_fprintf(stream, "%s\t<gml:Box srsName=\"%s\">\n", tab,
-                 srsname_encoded);
+    msIO_writerPrintf(writer, "%s\t<gml:Box srsName=\"%s\">\n", tab,
+                      srsname_encoded);
     msFree(srsname_encoded);
   } else
-    msIO_fprintf(stream, "%s\t<gml:Box>\n", tab);
+    msIO_writerPrintf(writer, "%s\t<gml:Box>\n", tab);
 
-  msIO_fprintf(stream, "%s\t\t<gml:coordinates>", tab);
-  msIO_fprintf(stream, "%.6f,%.6f %.6f,%.6f", rect->minx, rect->miny,
-               rect->maxx, rect->maxy);
-  msIO_fprintf(stream, "</gml:coordinates>\n");
-  msIO_fprintf(stream, "%s\t</gml:Box>\n", tab);
-  msIO_fprintf(stream, "%s</%s:boundedBy>\n", tab, pszTopPrefix);
+  msIO_writerPrintf(writer, "%s\t\t<gml:coordinates>", tab);
+  msIO_writerPrintf(writer, "%.6f,%.6f %.6f,%.6f", rect->minx, rect->miny,
+                    rect->maxx, rect->maxy);
+  msIO_writerPrintf(writer, "</gml:coordinates>\n");
+  msIO_writerPrintf(writer, "%s\t</gml:Box>\n", tab);
+  msIO_writerPrintf(writer, "%s</%s:boundedBy>\n", tab, pszTopPrefix);
 
   return MS_SUCCESS;
 }
 
 /* GML 3.1 or GML 3.2 (MapServer limits GML encoding to the level 0 profile) */
-static int gmlWriteBounds_GML3(FILE *stream, rectObj *rect, const char *srsname,
-                               const char *tab, const char *pszTopPrefix) {
+static int gmlWriteBounds_GML3(msIOWriter *writer, rectObj *rect,
+                               const char *srsname, const char *tab,
+                               const char *pszTopPrefix) {
   char *srsname_encoded;
 
-  if (!stream)
+  if (!writer)
     return (MS_FAILURE);
   if (!rect)
     return (MS_FAILURE);
   if (!tab)
     return (MS_FAILURE);
 
-  msIO_fprintf(stream, "%s<%s:boundedBy>\n", tab, pszTopPrefix);
+  msIO_writerPrintf(writer, "%s<%s:boundedBy>\n", tab, pszTopPrefix);
   if (srsname) {
     srsname_encoded = msEncodeHTMLEntities(srsname);
-    msIO_fprintf(stream, "%s\t<gml:Envelope srsName=\"%s\">\n", tab,
-                 srsname_encoded);
+    msIO_writerPrintf(writer, "%s\t<gml:Envelope srsName=\"%s\">\n", tab,
+                      srsname_encoded);
     msFree(srsname_encoded);
   } else
-    msIO_fprintf(stream, "%s\t<gml:Envelope>\n", tab);
+    msIO_writerPrintf(writer, "%s\t<gml:Envelope>\n", tab);
 
-  msIO_fprintf(stream, "%s\t\t<gml:lowerCorner>%.6f %.6f</gml:lowerCorner>\n",
-               tab, rect->minx, rect->miny);
-  msIO_fprintf(stream, "%s\t\t<gml:upperCorner>%.6f %.6f</gml:upperCorner>\n",
-               tab, rect->maxx, rect->maxy);
+  msIO_writerPrintf(writer,
+                    "%s\t\t<gml:lowerCorner>%.6f %.6f</gml:lowerCorner>\n", tab,
+                    rect->minx, rect->miny);
+  msIO_writerPrintf(writer,
+                    "%s\t\t<gml:upperCorner>%.6f %.6f</gml:upperCorner>\n", tab,
+                    rect->maxx, rect->maxy);
 
-  msIO_fprintf(stream, "%s\t</gml:Envelope>\n", tab);
-  msIO_fprintf(stream, "%s</%s:boundedBy>\n", tab, pszTopPrefix);
+  msIO_writerPrintf(writer, "%s\t</gml:Envelope>\n", tab);
+  msIO_writerPrintf(writer, "%s</%s:boundedBy>\n", tab, pszTopPrefix);
 
   return MS_SUCCESS;
 }
 
-static void gmlStartGeometryContainer(FILE *stream, const char *name,
+/*
+** Write the vertices of a line as a GML coordinate list: "x,y x,y " for
+** GML2 coordinates or "x y x y " for a GML3 posList.
+*/
+static void gmlWriteCoordinates(msIOWriter *writer, lineObj *line,
+                                char separator, int nSRSDimension,
+                                int precision) {
+  int j;
+
+  for (j = 0; j < line->numpoints; j++) {
+    msIO_writerDouble(writer, line->point[j].x, precision);
+    msIO_writerWrite(writer, &separator, 1);
+    msIO_writerDouble(writer, line->point[j].y, precision);
+    if (nSRSDimension == 3) {
+      msIO_writerWrite(writer, &separator, 1);
+      msIO_writerDouble(writer, line->point[j].z, precision);
+    }
+    msIO_writerWrite(writer, " ", 1);
+  }
+}
+
+static void gmlStartGeometryContainer(msIOWriter *writer, const char *name,
                                       const char *namespace, const char *tab) {
   const char *tag_name = OWS_GML_DEFAULT_GEOMETRY_NAME;
 
@@ -116,12 +141,12 @@ static void gmlStartGeometryContainer(FILE *stream, const char *name,
     tag_name = name;
 
   if (namespace)
-    msIO_fprintf(stream, "%s<%s:%s>\n", tab, namespace, tag_name);
+    msIO_writerPrintf(writer, "%s<%s:%s>\n", tab, namespace, tag_name);
   else
-    msIO_fprintf(stream, "%s<%s>\n", tab, tag_name);
+    msIO_writerPrintf(writer, "%s<%s>\n", tab, tag_name);
 }
 
-static void gmlEndGeometryContainer(FILE *stream, const char *name,
+static void gmlEndGeometryContainer(msIOWriter *writer, const char *name,
                                     const char *namespace, const char *tab) {
   const char *tag_name = OWS_GML_DEFAULT_GEOMETRY_NAME;
 
@@ -129,13 +154,14 @@ static void gmlEndGeometryContainer(FILE *stream, const char *name,
     tag_name = name;
 
   if (namespace)
-    msIO_fprintf(stream, "%s</%s:%s>\n", tab, namespace, tag_name);
+    msIO_writerPrintf(writer, "%s</%s:%s>\n", tab, namespace, tag_name);
   else
-    msIO_fprintf(stream, "%s</%s>\n", tab, tag_name);
+    msIO_writerPrintf(writer, "%s</%s>\n", tab, tag_name);
 }
 
 /* GML 2.1.2 */
-static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
+static int gmlWriteGeometry_GML2(msIOWriter *writer,
+                                 gmlGeometryListObj *geometryList,
                                  shapeObj *shape, const char *srsname,
                                  const char *namespace, const char *tab,
                                  int nSRSDimension, int geometry_precision) {
@@ -146,7 +172,7 @@ static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
   int geometry_aggregate_index, geometry_simple_index;
   char *geometry_aggregate_name = NULL, *geometry_simple_name = NULL;
 
-  if (!stream)
+  if (!writer)
     return (MS_FAILURE);
   if (!shape)
     return (MS_FAILURE);
@@ -181,19 +207,19 @@ static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
 
       for (i = 0; i < shape->numlines; i++) {
         for (j = 0; j < shape->line[i].numpoints; j++) {
-          gmlStartGeometryContainer(stream, geometry_simple_name, namespace,
+          gmlStartGeometryContainer(writer, geometry_simple_name, namespace,
                                     tab);
 
           /* Point */
           if (srsname_encoded)
-            msIO_fprintf(stream, "%s<gml:Point srsName=\"%s\">\n", tab,
-                         srsname_encoded);
+            msIO_writerPrintf(writer, "%s<gml:Point srsName=\"%s\">\n", tab,
+                              srsname_encoded);
           else
-            msIO_fprintf(stream, "%s<gml:Point>\n", tab);
+            msIO_writerPrintf(writer, "%s<gml:Point>\n", tab);
 
           if (nSRSDimension == 3)
-            msIO_fprintf(
-                stream,
+            msIO_writerPrintf(
+                writer,
                 "%s  <gml:coordinates>%.*f,%.*f,%.*f</gml:coordinates>\n", tab,
                 geometry_precision, shape->line[i].point[j].x,
                 geometry_precision, shape->line[i].point[j].y,
@@ -201,55 +227,56 @@ static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
           else
             /* fall-through */
 
-            msIO_fprintf(stream,
-                         "%s  <gml:coordinates>%.*f,%.*f</gml:coordinates>\n",
-                         tab, geometry_precision, shape->line[i].point[j].x,
-                         geometry_precision, shape->line[i].point[j].y);
+            msIO_writerPrintf(
+                writer, "%s  <gml:coordinates>%.*f,%.*f</gml:coordinates>\n",
+                tab, geometry_precision, shape->line[i].point[j].x,
+                geometry_precision, shape->line[i].point[j].y);
 
-          msIO_fprintf(stream, "%s</gml:Point>\n", tab);
+          msIO_writerPrintf(writer, "%s</gml:Point>\n", tab);
 
-          gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+          gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
         }
       }
     } else if ((geometry_aggregate_index != -1) ||
                (geometryList->numgeometries == 0)) { /* write a MultiPoint */
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       /* MultiPoint */
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s<gml:MultiPoint srsName=\"%s\">\n", tab,
-                     srsname_encoded);
+        msIO_writerPrintf(writer, "%s<gml:MultiPoint srsName=\"%s\">\n", tab,
+                          srsname_encoded);
       else
-        msIO_fprintf(stream, "%s<gml:MultiPoint>\n", tab);
+        msIO_writerPrintf(writer, "%s<gml:MultiPoint>\n", tab);
 
       for (i = 0; i < shape->numlines; i++) {
         for (j = 0; j < shape->line[i].numpoints; j++) {
-          msIO_fprintf(stream, "%s  <gml:pointMember>\n", tab);
-          msIO_fprintf(stream, "%s    <gml:Point>\n", tab);
+          msIO_writerPrintf(writer, "%s  <gml:pointMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    <gml:Point>\n", tab);
           if (nSRSDimension == 3)
-            msIO_fprintf(
-                stream,
+            msIO_writerPrintf(
+                writer,
                 "%s      <gml:coordinates>%.*f,%.*f,%.*f</gml:coordinates>\n",
                 tab, geometry_precision, shape->line[i].point[j].x,
                 geometry_precision, shape->line[i].point[j].y,
                 geometry_precision, shape->line[i].point[j].z);
           else
             /* fall-through */
-            msIO_fprintf(
-                stream, "%s      <gml:coordinates>%f,%f</gml:coordinates>\n",
+            msIO_writerPrintf(
+                writer, "%s      <gml:coordinates>%f,%f</gml:coordinates>\n",
                 tab, shape->line[i].point[j].x, shape->line[i].point[j].y);
-          msIO_fprintf(stream, "%s    </gml:Point>\n", tab);
-          msIO_fprintf(stream, "%s  </gml:pointMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    </gml:Point>\n", tab);
+          msIO_writerPrintf(writer, "%s  </gml:pointMember>\n", tab);
         }
       }
 
-      msIO_fprintf(stream, "%s</gml:MultiPoint>\n", tab);
+      msIO_writerPrintf(writer, "%s</gml:MultiPoint>\n", tab);
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "point/multipoint geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "point/multipoint geometry defined. -->\n");
     }
 
     break;
@@ -268,76 +295,57 @@ static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
         (geometryList->numgeometries == 0 &&
          shape->numlines == 1)) { /* write a LineStrings(s) */
       for (i = 0; i < shape->numlines; i++) {
-        gmlStartGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlStartGeometryContainer(writer, geometry_simple_name, namespace, tab);
 
         /* LineString */
         if (srsname_encoded)
-          msIO_fprintf(stream, "%s<gml:LineString srsName=\"%s\">\n", tab,
-                       srsname_encoded);
+          msIO_writerPrintf(writer, "%s<gml:LineString srsName=\"%s\">\n", tab,
+                            srsname_encoded);
         else
-          msIO_fprintf(stream, "%s<gml:LineString>\n", tab);
+          msIO_writerPrintf(writer, "%s<gml:LineString>\n", tab);
 
-        msIO_fprintf(stream, "%s  <gml:coordinates>", tab);
-        for (j = 0; j < shape->line[i].numpoints; j++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y, geometry_precision,
-                         shape->line[i].point[j].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y);
-        }
-        msIO_fprintf(stream, "</gml:coordinates>\n");
+        msIO_writerPrintf(writer, "%s  <gml:coordinates>", tab);
+        gmlWriteCoordinates(writer, &(shape->line[i]), ',', nSRSDimension,
+                            geometry_precision);
+        msIO_writerPrintf(writer, "</gml:coordinates>\n");
 
-        msIO_fprintf(stream, "%s</gml:LineString>\n", tab);
+        msIO_writerPrintf(writer, "%s</gml:LineString>\n", tab);
 
-        gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
       }
     } else if (geometry_aggregate_index != -1 ||
                (geometryList->numgeometries == 0)) { /* write a MultiCurve */
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       /* MultiLineString */
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s<gml:MultiLineString srsName=\"%s\">\n", tab,
-                     srsname_encoded);
+        msIO_writerPrintf(writer, "%s<gml:MultiLineString srsName=\"%s\">\n",
+                          tab, srsname_encoded);
       else
-        msIO_fprintf(stream, "%s<gml:MultiLineString>\n", tab);
+        msIO_writerPrintf(writer, "%s<gml:MultiLineString>\n", tab);
 
       for (j = 0; j < shape->numlines; j++) {
-        msIO_fprintf(stream, "%s  <gml:lineStringMember>\n",
+        msIO_writerPrintf(writer, "%s  <gml:lineStringMember>\n",
                      tab); /* no srsname at this point */
-        msIO_fprintf(stream, "%s    <gml:LineString>\n",
+        msIO_writerPrintf(writer, "%s    <gml:LineString>\n",
                      tab); /* no srsname at this point */
 
-        msIO_fprintf(stream, "%s      <gml:coordinates>", tab);
-        for (i = 0; i < shape->line[j].numpoints; i++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                         shape->line[j].point[i].x, geometry_precision,
-                         shape->line[j].point[i].y, geometry_precision,
-                         shape->line[j].point[i].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                         shape->line[j].point[i].x, geometry_precision,
-                         shape->line[j].point[i].y);
-        }
-        msIO_fprintf(stream, "</gml:coordinates>\n");
-        msIO_fprintf(stream, "%s    </gml:LineString>\n", tab);
-        msIO_fprintf(stream, "%s  </gml:lineStringMember>\n", tab);
+        msIO_writerPrintf(writer, "%s      <gml:coordinates>", tab);
+        gmlWriteCoordinates(writer, &(shape->line[j]), ',', nSRSDimension,
+                            geometry_precision);
+        msIO_writerPrintf(writer, "</gml:coordinates>\n");
+        msIO_writerPrintf(writer, "%s    </gml:LineString>\n", tab);
+        msIO_writerPrintf(writer, "%s  </gml:lineStringMember>\n", tab);
       }
 
-      msIO_fprintf(stream, "%s</gml:MultiLineString>\n", tab);
+      msIO_writerPrintf(writer, "%s</gml:MultiLineString>\n", tab);
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "line/multiline geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "line/multiline geometry defined. -->\n");
     }
 
     break;
@@ -372,150 +380,111 @@ static int gmlWriteGeometry_GML2(FILE *stream, gmlGeometryListObj *geometryList,
         /* get a list of inner rings for this polygon */
         innerlist = msGetInnerList(shape, i, outerlist);
 
-        gmlStartGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlStartGeometryContainer(writer, geometry_simple_name, namespace, tab);
 
         /* Polygon */
         if (srsname_encoded)
-          msIO_fprintf(stream, "%s<gml:Polygon srsName=\"%s\">\n", tab,
-                       srsname_encoded);
+          msIO_writerPrintf(writer, "%s<gml:Polygon srsName=\"%s\">\n", tab,
+                            srsname_encoded);
         else
-          msIO_fprintf(stream, "%s<gml:Polygon>\n", tab);
+          msIO_writerPrintf(writer, "%s<gml:Polygon>\n", tab);
 
-        msIO_fprintf(stream, "%s  <gml:outerBoundaryIs>\n", tab);
-        msIO_fprintf(stream, "%s    <gml:LinearRing>\n", tab);
+        msIO_writerPrintf(writer, "%s  <gml:outerBoundaryIs>\n", tab);
+        msIO_writerPrintf(writer, "%s    <gml:LinearRing>\n", tab);
 
-        msIO_fprintf(stream, "%s      <gml:coordinates>", tab);
-        for (j = 0; j < shape->line[i].numpoints; j++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y, geometry_precision,
-                         shape->line[i].point[j].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y);
-        }
-        msIO_fprintf(stream, "</gml:coordinates>\n");
+        msIO_writerPrintf(writer, "%s      <gml:coordinates>", tab);
+        gmlWriteCoordinates(writer, &(shape->line[i]), ',', nSRSDimension,
+                            geometry_precision);
+        msIO_writerPrintf(writer, "</gml:coordinates>\n");
 
-        msIO_fprintf(stream, "%s    </gml:LinearRing>\n", tab);
-        msIO_fprintf(stream, "%s  </gml:outerBoundaryIs>\n", tab);
+        msIO_writerPrintf(writer, "%s    </gml:LinearRing>\n", tab);
+        msIO_writerPrintf(writer, "%s  </gml:outerBoundaryIs>\n", tab);
 
         for (k = 0; k < shape->numlines;
              k++) { /* now step through all the inner rings */
           if (innerlist[k] == MS_TRUE) {
-            msIO_fprintf(stream, "%s  <gml:innerBoundaryIs>\n", tab);
-            msIO_fprintf(stream, "%s    <gml:LinearRing>\n", tab);
-
-            msIO_fprintf(stream, "%s      <gml:coordinates>", tab);
-            for (j = 0; j < shape->line[k].numpoints; j++) {
-              if (nSRSDimension == 3)
-                msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                             shape->line[k].point[j].x, geometry_precision,
-                             shape->line[k].point[j].y, geometry_precision,
-                             shape->line[k].point[j].z);
-              else
-                /* fall-through */
-                msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                             shape->line[k].point[j].x, geometry_precision,
-                             shape->line[k].point[j].y);
-            }
-            msIO_fprintf(stream, "</gml:coordinates>\n");
+            msIO_writerPrintf(writer, "%s  <gml:innerBoundaryIs>\n", tab);
+            msIO_writerPrintf(writer, "%s    <gml:LinearRing>\n", tab);
 
-            msIO_fprintf(stream, "%s    </gml:LinearRing>\n", tab);
-            msIO_fprintf(stream, "%s  </gml:innerBoundaryIs>\n", tab);
+            msIO_writerPrintf(writer, "%s      <gml:coordinates>", tab);
+            gmlWriteCoordinates(writer, &(shape->line[k]), ',', nSRSDimension,
+                                geometry_precision);
+            msIO_writerPrintf(writer, "</gml:coordinates>\n");
+
+            msIO_writerPrintf(writer, "%s    </gml:LinearRing>\n", tab);
+            msIO_writerPrintf(writer, "%s  </gml:innerBoundaryIs>\n", tab);
           }
         }
 
-        msIO_fprintf(stream, "%s</gml:Polygon>\n", tab);
+        msIO_writerPrintf(writer, "%s</gml:Polygon>\n", tab);
         free(innerlist);
 
-        gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
       }
       free(outerlist);
       outerlist = NULL;
     } else if (geometry_aggregate_index != -1 ||
                (geometryList->numgeometries == 0)) { /* write a MultiPolygon */
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       /* MultiPolygon */
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s<gml:MultiPolygon srsName=\"%s\">\n", tab,
-                     srsname_encoded);
+        msIO_writerPrintf(writer, "%s<gml:MultiPolygon srsName=\"%s\">\n", tab,
+                          srsname_encoded);
       else
-        msIO_fprintf(stream, "%s<gml:MultiPolygon>\n", tab);
+        msIO_writerPrintf(writer, "%s<gml:MultiPolygon>\n", tab);
 
       for (i = 0; i < shape->numlines; i++) { /* step through the outer rings */
         if (outerlist[i] == MS_TRUE) {
           innerlist = msGetInnerList(shape, i, outerlist);
 
-          msIO_fprintf(stream, "%s<gml:polygonMember>\n", tab);
-          msIO_fprintf(stream, "%s  <gml:Polygon>\n", tab);
-
-          msIO_fprintf(stream, "%s    <gml:outerBoundaryIs>\n", tab);
-          msIO_fprintf(stream, "%s      <gml:LinearRing>\n", tab);
-
-          msIO_fprintf(stream, "%s        <gml:coordinates>", tab);
-          for (j = 0; j < shape->line[i].numpoints; j++) {
-            if (nSRSDimension == 3)
-              msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                           shape->line[i].point[j].x, geometry_precision,
-                           shape->line[i].point[j].y, geometry_precision,
-                           shape->line[i].point[j].z);
-            else
-              /* fall-through */
-              msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                           shape->line[i].point[j].x, geometry_precision,
-                           shape->line[i].point[j].y);
-          }
-          msIO_fprintf(stream, "</gml:coordinates>\n");
+          msIO_writerPrintf(writer, "%s<gml:polygonMember>\n", tab);
+          msIO_writerPrintf(writer, "%s  <gml:Polygon>\n", tab);
+
+          msIO_writerPrintf(writer, "%s    <gml:outerBoundaryIs>\n", tab);
+          msIO_writerPrintf(writer, "%s      <gml:LinearRing>\n", tab);
+
+          msIO_writerPrintf(writer, "%s        <gml:coordinates>", tab);
+          gmlWriteCoordinates(writer, &(shape->line[i]), ',', nSRSDimension,
+                              geometry_precision);
+          msIO_writerPrintf(writer, "</gml:coordinates>\n");
 
-          msIO_fprintf(stream, "%s      </gml:LinearRing>\n", tab);
-          msIO_fprintf(stream, "%s    </gml:outerBoundaryIs>\n", tab);
+          msIO_writerPrintf(writer, "%s      </gml:LinearRing>\n", tab);
+          msIO_writerPrintf(writer, "%s    </gml:outerBoundaryIs>\n", tab);
 
           for (k = 0; k < shape->numlines;
                k++) { /* now step through all the inner rings */
             if (innerlist[k] == MS_TRUE) {
-              msIO_fprintf(stream, "%s    <gml:innerBoundaryIs>\n", tab);
-              msIO_fprintf(stream, "%s      <gml:LinearRing>\n", tab);
-
-              msIO_fprintf(stream, "%s        <gml:coordinates>", tab);
-              for (j = 0; j < shape->line[k].numpoints; j++) {
-                if (nSRSDimension == 3)
-                  msIO_fprintf(stream, "%.*f,%.*f,%.*f ", geometry_precision,
-                               shape->line[k].point[j].x, geometry_precision,
-                               shape->line[k].point[j].y, geometry_precision,
-                               shape->line[k].point[j].z);
-                else
-                  /* fall-through */
-                  msIO_fprintf(stream, "%.*f,%.*f ", geometry_precision,
-                               shape->line[k].point[j].x, geometry_precision,
-                               shape->line[k].point[j].y);
-              }
-              msIO_fprintf(stream, "</gml:coordinates>\n");
-
-              msIO_fprintf(stream, "%s      </gml:LinearRing>\n", tab);
-              msIO_fprintf(stream, "%s    </gml:innerBoundaryIs>\n", tab);
+              msIO_writerPrintf(writer, "%s    <gml:innerBoundaryIs>\n", tab);
+              msIO_writerPrintf(writer, "%s      <gml:LinearRing>\n", tab);
+
+              msIO_writerPrintf(writer, "%s        <gml:coordinates>", tab);
+              gmlWriteCoordinates(writer, &(shape->line[k]), ',', nSRSDimension,
+                                  geometry_precision);
+              msIO_writerPrintf(writer, "</gml:coordinates>\n");
+
+              msIO_writerPrintf(writer, "%s      </gml:LinearRing>\n", tab);
+              msIO_writerPrintf(writer, "%s    </gml:innerBoundaryIs>\n", tab);
             }
           }
 
-          msIO_fprintf(stream, "%s  </gml:Polygon>\n", tab);
-          msIO_fprintf(stream, "%s</gml:polygonMember>\n", tab);
+          msIO_writerPrintf(writer, "%s  </gml:Polygon>\n", tab);
+          msIO_writerPrintf(writer, "%s</gml:polygonMember>\n", tab);
 
           free(innerlist);
         }
       }
-      msIO_fprintf(stream, "%s</gml:MultiPolygon>\n", tab);
+      msIO_writerPrintf(writer, "%s</gml:MultiPolygon>\n", tab);
 
       free(outerlist);
       outerlist = NULL;
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "polygon/multipolygon geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "polygon/multipolygon geometry defined. -->\n");
     }
 
     break;
@@ -544,7 +513,8 @@ static char *gmlCreateGeomId(OWSGMLVersion nGMLVersion, const char *pszFID,
 }
 
 /* GML 3.1 or GML 3.2 (MapServer limits GML encoding to the level 0 profile) */
-static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
+static int gmlWriteGeometry_GML3(msIOWriter *writer,
+                                 gmlGeometryListObj *geometryList,
                                  shapeObj *shape, const char *srsname,
                                  const char *namespace, const char *tab,
                                  const char *pszFID, OWSGMLVersion nGMLVersion,
@@ -557,7 +527,7 @@ static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
   int geometry_aggregate_index, geometry_simple_index;
   char *geometry_aggregate_name = NULL, *geometry_simple_name = NULL;
 
-  if (!stream)
+  if (!writer)
     return (MS_FAILURE);
   if (!shape)
     return (MS_FAILURE);
@@ -592,80 +562,84 @@ static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
 
       for (i = 0; i < shape->numlines; i++) {
         for (j = 0; j < shape->line[i].numpoints; j++) {
-          gmlStartGeometryContainer(stream, geometry_simple_name, namespace,
+          gmlStartGeometryContainer(writer, geometry_simple_name, namespace,
                                     tab);
 
           /* Point */
           pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
           if (srsname_encoded)
-            msIO_fprintf(stream, "%s  <gml:Point%s srsName=\"%s\">\n", tab,
-                         pszGMLId, srsname_encoded);
+            msIO_writerPrintf(writer, "%s  <gml:Point%s srsName=\"%s\">\n", tab,
+                              pszGMLId, srsname_encoded);
           else
-            msIO_fprintf(stream, "%s  <gml:Point%s>\n", tab, pszGMLId);
+            msIO_writerPrintf(writer, "%s  <gml:Point%s>\n", tab, pszGMLId);
 
           if (nSRSDimension == 3)
-            msIO_fprintf(
-                stream,
+            msIO_writerPrintf(
+                writer,
                 "%s    <gml:pos srsDimension=\"3\">%.*f %.*f %.*f</gml:pos>\n",
                 tab, geometry_precision, shape->line[i].point[j].x,
                 geometry_precision, shape->line[i].point[j].y,
                 geometry_precision, shape->line[i].point[j].z);
           else
             /* fall-through */
-            msIO_fprintf(stream, "%s    <gml:pos>%.*f %.*f</gml:pos>\n", tab,
-                         geometry_precision, shape->line[i].point[j].x,
-                         geometry_precision, shape->line[i].point[j].y);
+            msIO_writerPrintf(writer, "%s    <gml:pos>%.*f %.*f</gml:pos>\n",
+                              tab, geometry_precision,
+                              shape->line[i].point[j].x, geometry_precision,
+                              shape->line[i].point[j].y);
 
-          msIO_fprintf(stream, "%s  </gml:Point>\n", tab);
+          msIO_writerPrintf(writer, "%s  </gml:Point>\n", tab);
 
-          gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+          gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
           msFree(pszGMLId);
         }
       }
     } else if ((geometry_aggregate_index != -1) ||
                (geometryList->numgeometries == 0)) { /* write a MultiPoint */
       pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       /* MultiPoint */
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s  <gml:MultiPoint%s srsName=\"%s\">\n", tab,
-                     pszGMLId, srsname_encoded);
+        msIO_writerPrintf(writer, "%s  <gml:MultiPoint%s srsName=\"%s\">\n",
+                          tab, pszGMLId, srsname_encoded);
       else
-        msIO_fprintf(stream, "%s  <gml:MultiPoint%s>\n", tab, pszGMLId);
+        msIO_writerPrintf(writer, "%s  <gml:MultiPoint%s>\n", tab, pszGMLId);
 
       msFree(pszGMLId);
 
       for (i = 0; i < shape->numlines; i++) {
         for (j = 0; j < shape->line[i].numpoints; j++) {
-          msIO_fprintf(stream, "%s    <gml:pointMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    <gml:pointMember>\n", tab);
           pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
-          msIO_fprintf(stream, "%s      <gml:Point%s>\n", tab, pszGMLId);
+          msIO_writerPrintf(writer, "%s      <gml:Point%s>\n", tab, pszGMLId);
           if (nSRSDimension == 3)
-            msIO_fprintf(stream,
-                         "%s        <gml:pos srsDimension=\"3\">%.*f %.*f "
-                         "%.*f</gml:pos>\n",
-                         tab, geometry_precision, shape->line[i].point[j].x,
-                         geometry_precision, shape->line[i].point[j].y,
-                         geometry_precision, shape->line[i].point[j].z);
+            msIO_writerPrintf(writer,
+                              "%s        <gml:pos srsDimension=\"3\">%.*f %.*f "
+                              "%.*f</gml:pos>\n",
+                              tab, geometry_precision,
+                              shape->line[i].point[j].x, geometry_precision,
+                              shape->line[i].point[j].y, geometry_precision,
+                              shape->line[i].point[j].z);
           else
             /* fall-through */
-            msIO_fprintf(stream, "%s        <gml:pos>%.*f %.*f</gml:pos>\n",
-                         tab, geometry_precision, shape->line[i].point[j].x,
-                         geometry_precision, shape->line[i].point[j].y);
-          msIO_fprintf(stream, "%s      </gml:Point>\n", tab);
+            msIO_writerPrintf(writer,
+                              "%s        <gml:pos>%.*f %.*f</gml:pos>\n", tab,
+                              geometry_precision, shape->line[i].point[j].x,
+                              geometry_precision, shape->line[i].point[j].y);
+          msIO_writerPrintf(writer, "%s      </gml:Point>\n", tab);
           msFree(pszGMLId);
-          msIO_fprintf(stream, "%s    </gml:pointMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    </gml:pointMember>\n", tab);
         }
       }
 
-      msIO_fprintf(stream, "%s  </gml:MultiPoint>\n", tab);
+      msIO_writerPrintf(writer, "%s  </gml:MultiPoint>\n", tab);
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "point/multipoint geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "point/multipoint geometry defined. -->\n");
     }
 
     break;
@@ -684,84 +658,65 @@ static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
         (geometryList->numgeometries == 0 &&
          shape->numlines == 1)) { /* write a LineStrings(s) */
       for (i = 0; i < shape->numlines; i++) {
-        gmlStartGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlStartGeometryContainer(writer, geometry_simple_name, namespace, tab);
 
         /* LineString (should be Curve?) */
         pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
         if (srsname_encoded)
-          msIO_fprintf(stream, "%s  <gml:LineString%s srsName=\"%s\">\n", tab,
-                       pszGMLId, srsname_encoded);
+          msIO_writerPrintf(writer, "%s  <gml:LineString%s srsName=\"%s\">\n",
+                            tab, pszGMLId, srsname_encoded);
         else
-          msIO_fprintf(stream, "%s  <gml:LineString%s>\n", tab, pszGMLId);
+          msIO_writerPrintf(writer, "%s  <gml:LineString%s>\n", tab, pszGMLId);
         msFree(pszGMLId);
 
-        msIO_fprintf(stream, "%s    <gml:posList srsDimension=\"%d\">", tab,
-                     nSRSDimension);
-        for (j = 0; j < shape->line[i].numpoints; j++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y, geometry_precision,
-                         shape->line[i].point[j].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y);
-        }
-        msIO_fprintf(stream, "</gml:posList>\n");
+        msIO_writerPrintf(writer, "%s    <gml:posList srsDimension=\"%d\">",
+                          tab, nSRSDimension);
+        gmlWriteCoordinates(writer, &(shape->line[i]), ' ', nSRSDimension,
+                            geometry_precision);
+        msIO_writerPrintf(writer, "</gml:posList>\n");
 
-        msIO_fprintf(stream, "%s  </gml:LineString>\n", tab);
+        msIO_writerPrintf(writer, "%s  </gml:LineString>\n", tab);
 
-        gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
       }
     } else if (geometry_aggregate_index != -1 ||
                (geometryList->numgeometries == 0)) { /* write a MultiCurve */
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       /* MultiCurve */
       pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s  <gml:MultiCurve%s srsName=\"%s\">\n", tab,
-                     pszGMLId, srsname_encoded);
+        msIO_writerPrintf(writer, "%s  <gml:MultiCurve%s srsName=\"%s\">\n",
+                          tab, pszGMLId, srsname_encoded);
       else
-        msIO_fprintf(stream, "%s  <gml:MultiCurve%s>\n", tab, pszGMLId);
+        msIO_writerPrintf(writer, "%s  <gml:MultiCurve%s>\n", tab, pszGMLId);
       msFree(pszGMLId);
 
       for (i = 0; i < shape->numlines; i++) {
-        msIO_fprintf(stream, "%s    <gml:curveMember>\n", tab);
+        msIO_writerPrintf(writer, "%s    <gml:curveMember>\n", tab);
         pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
-        msIO_fprintf(stream, "%s      <gml:LineString%s>\n", tab,
+        msIO_writerPrintf(writer, "%s      <gml:LineString%s>\n", tab,
                      pszGMLId); /* no srsname at this point */
         msFree(pszGMLId);
 
-        msIO_fprintf(stream, "%s        <gml:posList srsDimension=\"%d\">", tab,
-                     nSRSDimension);
-        for (j = 0; j < shape->line[i].numpoints; j++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y, geometry_precision,
-                         shape->line[i].point[j].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y);
-        }
+        msIO_writerPrintf(writer, "%s        <gml:posList srsDimension=\"%d\">",
+                          tab, nSRSDimension);
+        gmlWriteCoordinates(writer, &(shape->line[i]), ' ', nSRSDimension,
+                            geometry_precision);
 
-        msIO_fprintf(stream, "</gml:posList>\n");
-        msIO_fprintf(stream, "%s      </gml:LineString>\n", tab);
-        msIO_fprintf(stream, "%s    </gml:curveMember>\n", tab);
+        msIO_writerPrintf(writer, "</gml:posList>\n");
+        msIO_writerPrintf(writer, "%s      </gml:LineString>\n", tab);
+        msIO_writerPrintf(writer, "%s    </gml:curveMember>\n", tab);
       }
 
-      msIO_fprintf(stream, "%s  </gml:MultiCurve>\n", tab);
+      msIO_writerPrintf(writer, "%s  </gml:MultiCurve>\n", tab);
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "line/multiline geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "line/multiline geometry defined. -->\n");
     }
 
     break;
@@ -796,170 +751,132 @@ static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
         /* get a list of inner rings for this polygon */
         innerlist = msGetInnerList(shape, i, outerlist);
 
-        gmlStartGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlStartGeometryContainer(writer, geometry_simple_name, namespace, tab);
 
         pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
 
         /* Polygon (should be Surface?) */
         if (srsname_encoded)
-          msIO_fprintf(stream, "%s  <gml:Polygon%s srsName=\"%s\">\n", tab,
-                       pszGMLId, srsname_encoded);
+          msIO_writerPrintf(writer, "%s  <gml:Polygon%s srsName=\"%s\">\n", tab,
+                            pszGMLId, srsname_encoded);
         else
-          msIO_fprintf(stream, "%s  <gml:Polygon%s>\n", tab, pszGMLId);
+          msIO_writerPrintf(writer, "%s  <gml:Polygon%s>\n", tab, pszGMLId);
         msFree(pszGMLId);
 
-        msIO_fprintf(stream, "%s    <gml:exterior>\n", tab);
-        msIO_fprintf(stream, "%s      <gml:LinearRing>\n", tab);
+        msIO_writerPrintf(writer, "%s    <gml:exterior>\n", tab);
+        msIO_writerPrintf(writer, "%s      <gml:LinearRing>\n", tab);
 
-        msIO_fprintf(stream, "%s        <gml:posList srsDimension=\"%d\">", tab,
-                     nSRSDimension);
-        for (j = 0; j < shape->line[i].numpoints; j++) {
-          if (nSRSDimension == 3)
-            msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y, geometry_precision,
-                         shape->line[i].point[j].z);
-          else
-            /* fall-through */
-            msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                         shape->line[i].point[j].x, geometry_precision,
-                         shape->line[i].point[j].y);
-        }
+        msIO_writerPrintf(writer, "%s        <gml:posList srsDimension=\"%d\">",
+                          tab, nSRSDimension);
+        gmlWriteCoordinates(writer, &(shape->line[i]), ' ', nSRSDimension,
+                            geometry_precision);
 
-        msIO_fprintf(stream, "</gml:posList>\n");
+        msIO_writerPrintf(writer, "</gml:posList>\n");
 
-        msIO_fprintf(stream, "%s      </gml:LinearRing>\n", tab);
-        msIO_fprintf(stream, "%s    </gml:exterior>\n", tab);
+        msIO_writerPrintf(writer, "%s      </gml:LinearRing>\n", tab);
+        msIO_writerPrintf(writer, "%s    </gml:exterior>\n", tab);
 
         for (k = 0; k < shape->numlines;
              k++) { /* now step through all the inner rings */
           if (innerlist[k] == MS_TRUE) {
-            msIO_fprintf(stream, "%s    <gml:interior>\n", tab);
-            msIO_fprintf(stream, "%s      <gml:LinearRing>\n", tab);
-
-            msIO_fprintf(stream, "%s        <gml:posList srsDimension=\"%d\">",
-                         tab, nSRSDimension);
-            for (j = 0; j < shape->line[k].numpoints; j++) {
-              if (nSRSDimension == 3)
-                msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                             shape->line[k].point[j].x, geometry_precision,
-                             shape->line[k].point[j].y, geometry_precision,
-                             shape->line[k].point[j].z);
-              else
-                /* fall-through */
-                msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                             shape->line[k].point[j].x, geometry_precision,
-                             shape->line[k].point[j].y);
-            }
+            msIO_writerPrintf(writer, "%s    <gml:interior>\n", tab);
+            msIO_writerPrintf(writer, "%s      <gml:LinearRing>\n", tab);
+
+            msIO_writerPrintf(writer,
+                              "%s        <gml:posList srsDimension=\"%d\">",
+                              tab, nSRSDimension);
+            gmlWriteCoordinates(writer, &(shape->line[k]), ' ', nSRSDimension,
+                                geometry_precision);
 
-            msIO_fprintf(stream, "</gml:posList>\n");
+            msIO_writerPrintf(writer, "</gml:posList>\n");
 
-            msIO_fprintf(stream, "%s      </gml:LinearRing>\n", tab);
-            msIO_fprintf(stream, "%s    </gml:interior>\n", tab);
+            msIO_writerPrintf(writer, "%s      </gml:LinearRing>\n", tab);
+            msIO_writerPrintf(writer, "%s    </gml:interior>\n", tab);
           }
         }
 
-        msIO_fprintf(stream, "%s  </gml:Polygon>\n", tab);
+        msIO_writerPrintf(writer, "%s  </gml:Polygon>\n", tab);
         free(innerlist);
 
-        gmlEndGeometryContainer(stream, geometry_simple_name, namespace, tab);
+        gmlEndGeometryContainer(writer, geometry_simple_name, namespace, tab);
       }
       free(outerlist);
       outerlist = NULL;
     } else if (geometry_aggregate_index != -1 ||
                (geometryList->numgeometries == 0)) { /* write a MultiSurface */
-      gmlStartGeometryContainer(stream, geometry_aggregate_name, namespace,
+      gmlStartGeometryContainer(writer, geometry_aggregate_name, namespace,
                                 tab);
 
       pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
 
       /* MultiSurface */
       if (srsname_encoded)
-        msIO_fprintf(stream, "%s  <gml:MultiSurface%s srsName=\"%s\">\n", tab,
-                     pszGMLId, srsname_encoded);
+        msIO_writerPrintf(writer, "%s  <gml:MultiSurface%s srsName=\"%s\">\n",
+                          tab, pszGMLId, srsname_encoded);
       else
-        msIO_fprintf(stream, "%s  <gml:MultiSurface%s>\n", tab, pszGMLId);
+        msIO_writerPrintf(writer, "%s  <gml:MultiSurface%s>\n", tab, pszGMLId);
       msFree(pszGMLId);
 
       for (i = 0; i < shape->numlines; i++) { /* step through the outer rings */
         if (outerlist[i] == MS_TRUE) {
-          msIO_fprintf(stream, "%s    <gml:surfaceMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    <gml:surfaceMember>\n", tab);
 
           /* get a list of inner rings for this polygon */
           innerlist = msGetInnerList(shape, i, outerlist);
 
           pszGMLId = gmlCreateGeomId(nGMLVersion, pszFID, &id);
 
-          msIO_fprintf(stream, "%s      <gml:Polygon%s>\n", tab, pszGMLId);
+          msIO_writerPrintf(writer, "%s      <gml:Polygon%s>\n", tab, pszGMLId);
           msFree(pszGMLId);
 
-          msIO_fprintf(stream, "%s        <gml:exterior>\n", tab);
-          msIO_fprintf(stream, "%s          <gml:LinearRing>\n", tab);
-
-          msIO_fprintf(stream,
-                       "%s            <gml:posList srsDimension=\"%d\">", tab,
-                       nSRSDimension);
-          for (j = 0; j < shape->line[i].numpoints; j++) {
-            if (nSRSDimension == 3)
-              msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                           shape->line[i].point[j].x, geometry_precision,
-                           shape->line[i].point[j].y, geometry_precision,
-                           shape->line[i].point[j].z);
-            else
-              /* fall-through */
-              msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                           shape->line[i].point[j].x, geometry_precision,
-                           shape->line[i].point[j].y);
-          }
+          msIO_writerPrintf(writer, "%s        <gml:exterior>\n", tab);
+          msIO_writerPrintf(writer, "%s          <gml:LinearRing>\n", tab);
 
-          msIO_fprintf(stream, "</gml:posList>\n");
+          msIO_writerPrintf(writer,
+                            "%s            <gml:posList srsDimension=\"%d\">",
+                            tab, nSRSDimension);
+          gmlWriteCoordinates(writer, &(shape->line[i]), ' ', nSRSDimension,
+                              geometry_precision);
 
-          msIO_fprintf(stream, "%s          </gml:LinearRing>\n", tab);
-          msIO_fprintf(stream, "%s        </gml:exterior>\n", tab);
+          msIO_writerPrintf(writer, "</gml:posList>\n");
+
+          msIO_writerPrintf(writer, "%s          </gml:LinearRing>\n", tab);
+          msIO_writerPrintf(writer, "%s        </gml:exterior>\n", tab);
 
           for (k = 0; k < shape->numlines;
                k++) { /* now step through all the inner rings */
             if (innerlist[k] == MS_TRUE) {
-              msIO_fprintf(stream, "%s        <gml:interior>\n", tab);
-              msIO_fprintf(stream, "%s          <gml:LinearRing>\n", tab);
-
-              msIO_fprintf(stream,
-                           "%s            <gml:posList srsDimension=\"%d\">",
-                           tab, nSRSDimension);
-              for (j = 0; j < shape->line[k].numpoints; j++) {
-                if (nSRSDimension == 3)
-                  msIO_fprintf(stream, "%.*f %.*f %.*f ", geometry_precision,
-                               shape->line[k].point[j].x, geometry_precision,
-                               shape->line[k].point[j].y, geometry_precision,
-                               shape->line[k].point[j].z);
-                else
-                  /* fall-through */
-                  msIO_fprintf(stream, "%.*f %.*f ", geometry_precision,
-                               shape->line[k].point[j].x, geometry_precision,
-                               shape->line[k].point[j].y);
-              }
-              msIO_fprintf(stream, "</gml:posList>\n");
-
-              msIO_fprintf(stream, "%s          </gml:LinearRing>\n", tab);
-              msIO_fprintf(stream, "%s        </gml:interior>\n", tab);
+              msIO_writerPrintf(writer, "%s        <gml:interior>\n", tab);
+              msIO_writerPrintf(writer, "%s          <gml:LinearRing>\n", tab);
+
+              msIO_writerPrintf(
+                  writer, "%s            <gml:posList srsDimension=\"%d\">",
+                  tab, nSRSDimension);
+              gmlWriteCoordinates(writer, &(shape->line[k]), ' ', nSRSDimension,
+                                  geometry_precision);
+              msIO_writerPrintf(writer, "</gml:posList>\n");
+
+              msIO_writerPrintf(writer, "%s          </gml:LinearRing>\n", tab);
+              msIO_writerPrintf(writer, "%s        </gml:interior>\n", tab);
             }
           }
 
-          msIO_fprintf(stream, "%s      </gml:Polygon>\n", tab);
+          msIO_writerPrintf(writer, "%s      </gml:Polygon>\n", tab);
 
           free(innerlist);
-          msIO_fprintf(stream, "%s    </gml:surfaceMember>\n", tab);
+          msIO_writerPrintf(writer, "%s    </gml:surfaceMember>\n", tab);
         }
       }
-      msIO_fprintf(stream, "%s  </gml:MultiSurface>\n", tab);
+      msIO_writerPrintf(writer, "%s  </gml:MultiSurface>\n", tab);
 
       free(outerlist);
       outerlist = NULL;
 
-      gmlEndGeometryContainer(stream, geometry_aggregate_name, namespace, tab);
+      gmlEndGeometryContainer(writer, geometry_aggregate_name, namespace, tab);
     } else {
-      msIO_fprintf(stream, "<!-- Warning: Cannot write geometry- no "
-                           "polygon/multipolygon geometry defined. -->\n");
+      msIO_writerPrintf(writer,
+                        "<!-- Warning: Cannot write geometry- no "
+                        "polygon/multipolygon geometry defined. -->\n");
     }
 
     break;
@@ -977,16 +894,16 @@ static int gmlWriteGeometry_GML3(FILE *stream, gmlGeometryListObj *geometryList,
 /*
 ** Wrappers for the format specific encoding functions.
 */
-static int gmlWriteBounds(FILE *stream, OWSGMLVersion format, rectObj *rect,
-                          const char *srsname, const char *tab,
+static int gmlWriteBounds(msIOWriter *writer, OWSGMLVersion format,
+                          rectObj *rect, const char *srsname, const char *tab,
                           const char *pszTopPrefix) {
   switch (format) {
   case (OWS_GML2):
-    return gmlWriteBounds_GML2(stream, rect, srsname, tab, pszTopPrefix);
+    return gmlWriteBounds_GML2(writer, rect, srsname, tab, pszTopPrefix);
     break;
   case (OWS_GML3):
   case (OWS_GML32):
-    return gmlWriteBounds_GML3(stream, rect, srsname, tab, pszTopPrefix);
+    return gmlWriteBounds_GML3(writer, rect, srsname, tab, pszTopPrefix);
     break;
   default:
     msSetError(MS_IOERR, "Unsupported GML format.", "gmlWriteBounds()");
@@ -995,20 +912,21 @@ static int gmlWriteBounds(FILE *stream, OWSGMLVersion format, rectObj *rect,
   return (MS_FAILURE);
 }
 
-static int gmlWriteGeometry(FILE *stream, gmlGeometryListObj *geometryList,
+static int gmlWriteGeometry(msIOWriter *writer,
+                            gmlGeometryListObj *geometryList,
                             OWSGMLVersion format, shapeObj *shape,
                             const char *srsname, const char *namespace,
                             const char *tab, const char *pszFID,
                             int nSRSDimension, int geometry_precision) {
   switch (format) {
   case (OWS_GML2):
-    return gmlWriteGeometry_GML2(stream, geometryList, shape, srsname,
+    return gmlWriteGeometry_GML2(writer, geometryList, shape, srsname,
                                  namespace, tab, nSRSDimension,
                                  geometry_precision);
     break;
   case (OWS_GML3):
   case (OWS_GML32):
-    return gmlWriteGeometry_GML3(stream, geometryList, shape, srsname,
+    return gmlWriteGeometry_GML3(writer, geometryList, shape, srsname,
                                  namespace, tab, pszFID, format, nSRSDimension,
                                  geometry_precision);
     break;
@@ -1157,15 +1075,16 @@ void msGMLFreeGeometries(gmlGeometryListObj *geometryList) {
   free(geometryList);
 }
 
-static void msGMLWriteItem(FILE *stream, gmlItemObj *item, const char *value,
-                           const char *namespace, const char *tab,
-                           OWSGMLVersion outputformat, const char *pszFID) {
+static void msGMLWriteItem(msIOWriter *writer, gmlItemObj *item,
+                           const char *value, const char *namespace,
+                           const char *tab, OWSGMLVersion outputformat,
+                           const char *pszFID) {
   char *encoded_value = NULL, *tag_name;
   int add_namespace = MS_TRUE;
   char gmlid[256];
   gmlid[0] = 0;
 
-  if (!stream || !item)
+  if (!writer || !item)
     return;
   if (!item->visible)
     return;
@@ -1220,35 +1139,46 @@ static void msGMLWriteItem(FILE *stream, gmlItemObj *item, const char *value,
     }
   }
 
-  if (encoded_value == NULL) {
-    if (item->encode == MS_TRUE)
-      encoded_value = msEncodeHTMLEntities(value);
-    else
-      encoded_value = msStrdup(value);
-  }
-
   if (!item->template) { /* build the tag from pieces */
 
     if (add_namespace == MS_TRUE && msIsXMLTagValid(tag_name) == MS_FALSE)
-      msIO_fprintf(stream,
-                   "<!-- WARNING: The value '%s' is not valid in a XML tag "
-                   "context. -->\n",
-                   tag_name);
+      msIO_writerPrintf(writer,
+                        "<!-- WARNING: The value '%s' is not valid in a XML "
+                        "tag context. -->\n",
+                        tag_name);
 
     if (add_namespace == MS_TRUE)
-      msIO_fprintf(stream, "%s<%s:%s%s>%s</%s:%s>\n", tab, namespace, tag_name,
-                   gmlid, encoded_value, namespace, tag_name);
+      msIO_writerPrintf(writer, "%s<%s:%s%s>", tab, namespace, tag_name, gmlid);
+    else
+      msIO_writerPrintf(writer, "%s<%s%s>", tab, tag_name, gmlid);
+
+    /* the value is encoded straight into the output */
+    if (encoded_value)
+      msIO_writerPuts(writer, encoded_value);
+    else if (item->encode == MS_TRUE)
+      msIO_writerXMLEncode(writer, value);
     else
-      msIO_fprintf(stream, "%s<%s%s>%s</%s>\n", tab, tag_name, gmlid,
-                   encoded_value, tag_name);
+      msIO_writerPuts(writer, value);
+
+    if (add_namespace == MS_TRUE)
+      msIO_writerPrintf(writer, "</%s:%s>\n", namespace, tag_name);
+    else
+      msIO_writerPrintf(writer, "</%s>\n", tag_name);
   } else {
     char *tag = NULL;
 
+    if (encoded_value == NULL) {
+      if (item->encode == MS_TRUE)
+        encoded_value = msEncodeHTMLEntities(value);
+      else
+        encoded_value = msStrdup(value);
+    }
+
     tag = msStrdup(item->template);
     tag = msReplaceSubstring(tag, "$value", encoded_value);
     if (namespace)
       tag = msReplaceSubstring(tag, "$namespace", namespace);
-    msIO_fprintf(stream, "%s%s\n", tab, tag);
+    msIO_writerPrintf(writer, "%s%s\n", tab, tag);
     free(tag);
   }
 
@@ -1407,11 +1337,11 @@ void msGMLFreeConstants(gmlConstantListObj *constantList) {
   free(constantList);
 }
 
-static void msGMLWriteConstant(FILE *stream, gmlConstantObj *constant,
+static void msGMLWriteConstant(msIOWriter *writer, gmlConstantObj *constant,
                                const char *namespace, const char *tab) {
   int add_namespace = MS_TRUE;
 
-  if (!stream || !constant)
+  if (!writer || !constant)
     return;
   if (!constant->value)
     return;
@@ -1422,23 +1352,24 @@ static void msGMLWriteConstant(FILE *stream, gmlConstantObj *constant,
     add_namespace = MS_FALSE;
 
   if (add_namespace == MS_TRUE && msIsXMLTagValid(constant->name) == MS_FALSE)
-    msIO_fprintf(
-        stream,
+    msIO_writerPrintf(
+        writer,
         "<!-- WARNING: The value '%s' is not valid in a XML tag context. -->\n",
         constant->name);
 
   if (add_namespace == MS_TRUE)
-    msIO_fprintf(stream, "%s<%s:%s>%s</%s:%s>\n", tab, namespace,
-                 constant->name, constant->value, namespace, constant->name);
+    msIO_writerPrintf(writer, "%s<%s:%s>%s</%s:%s>\n", tab, namespace,
+                      constant->name, constant->value, namespace,
+                      constant->name);
   else
-    msIO_fprintf(stream, "%s<%s>%s</%s>\n", tab, constant->name,
-                 constant->value, constant->name);
+    msIO_writerPrintf(writer, "%s<%s>%s</%s>\n", tab, constant->name,
+                      constant->value, constant->name);
 
   return;
 }
 
-static void msGMLWriteGroup(FILE *stream, gmlGroupObj *group, shapeObj *shape,
-                            gmlItemListObj *itemList,
+static void msGMLWriteGroup(msIOWriter *writer, gmlGroupObj *group,
+                            shapeObj *shape, gmlItemListObj *itemList,
                             gmlConstantListObj *constantList,
                             const char *namespace, const char *tab,
                             OWSGMLVersion outputformat, const char *pszFID) {
@@ -1449,7 +1380,7 @@ static void msGMLWriteGroup(FILE *stream, gmlGroupObj *group, shapeObj *shape,
   gmlItemObj *item = NULL;
   gmlConstantObj *constant = NULL;
 
-  if (!stream || !group)
+  if (!writer || !group)
     return;
 
   /* setup the item/constant tab */
@@ -1462,16 +1393,16 @@ static void msGMLWriteGroup(FILE *stream, gmlGroupObj *group, shapeObj *shape,
 
   /* start the group */
   if (add_namespace == MS_TRUE)
-    msIO_fprintf(stream, "%s<%s:%s>\n", tab, namespace, group->name);
+    msIO_writerPrintf(writer, "%s<%s:%s>\n", tab, namespace, group->name);
   else
-    msIO_fprintf(stream, "%s<%s>\n", tab, group->name);
+    msIO_writerPrintf(writer, "%s<%s>\n", tab, group->name);
 
   /* now the items/constants in the group */
   for (i = 0; i < group->numitems; i++) {
     for (j = 0; j < constantList->numconstants; j++) {
       constant = &(constantList->constants[j]);
       if (strcasecmp(constant->name, group->items[i]) == 0) {
-        msGMLWriteConstant(stream, constant, namespace, itemtab);
+        msGMLWriteConstant(writer, constant, namespace, itemtab);
         break;
       }
     }
@@ -1481,7 +1412,7 @@ static void msGMLWriteGroup(FILE *stream, gmlGroupObj *group, shapeObj *shape,
       item = &(itemList->items[j]);
       if (strcasecmp(item->name, group->items[i]) == 0) {
         /* the number of items matches the number of values exactly */
-        msGMLWriteItem(stream, item, shape->values[j], namespace, itemtab,
+        msGMLWriteItem(writer, item, shape->values[j], namespace, itemtab,
                        outputformat, pszFID);
         break;
       }
@@ -1490,9 +1421,9 @@ static void msGMLWriteGroup(FILE *stream, gmlGroupObj *group, shapeObj *shape,
 
   /* end the group */
   if (add_namespace == MS_TRUE)
-    msIO_fprintf(stream, "%s</%s:%s>\n", tab, namespace, group->name);
+    msIO_writerPrintf(writer, "%s</%s:%s>\n", tab, namespace, group->name);
   else
-    msIO_fprintf(stream, "%s</%s>\n", tab, group->name);
+    msIO_writerPrintf(writer, "%s</%s>\n", tab, group->name);
 
   msFree(itemtab);
 
@@ -1586,6 +1517,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
   shapeObj shape;
   FILE *stream_to_free = NULL;
   FILE *stream = stdout; /* defaults to stdout */
+  msIOWriter writer;
   char szPath[MS_MAXPATHLEN];
   char *value;
   char *pszMapSRS = NULL;
@@ -1609,6 +1541,8 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
     stream = stream_to_free;
   }
 
+  msIO_writerInit(&writer, stream);
+
   msIO_fprintf(stream, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\n");
   msOWSPrintValidateMetadata(stream, &(map->web.metadata), namespaces,
                              "rootname", OWS_NOERR, "<%s ", "msGMLOutput");
@@ -1689,6 +1623,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
         msSetError(MS_MISCERR,
                    "Unable to populate item and group metadata structures",
                    "msGMLWriteQuery()");
+        msIO_writerClose(&writer);
         if (stream_to_free != NULL)
           fclose(stream_to_free);
         return MS_FAILURE;
@@ -1704,6 +1639,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
           msGMLFreeItems(itemList);
           msGMLFreeGeometries(geometryList);
           msFree(pszOutputSRS);
+          msIO_writerClose(&writer);
           if (stream_to_free != NULL)
             fclose(stream_to_free);
           return MS_FAILURE;
@@ -1719,6 +1655,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
           msGMLFreeGeometries(geometryList);
           msProjectDestroyReprojector(reprojector);
           msFree(pszOutputSRS);
+          msIO_writerClose(&writer);
           if (stream_to_free != NULL)
             fclose(stream_to_free);
           return MS_FAILURE;
@@ -1753,10 +1690,10 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
          * only if explicitly requested */
         if (!(geometryList && geometryList->numgeometries == 1 &&
               strcasecmp(geometryList->geometries[0].name, "none") == 0)) {
-          gmlWriteBounds(stream, OWS_GML2, &(shape.bounds), pszOutputSRS,
+          gmlWriteBounds(&writer, OWS_GML2, &(shape.bounds), pszOutputSRS,
                          "\t\t\t", "gml");
           if (geometryList && geometryList->numgeometries > 0)
-            gmlWriteGeometry(stream, geometryList, OWS_GML2, &(shape),
+            gmlWriteGeometry(&writer, geometryList, OWS_GML2, &(shape),
                              pszOutputSRS, NULL, "\t\t\t", "", nSRSDimension,
                              6);
         }
@@ -1765,7 +1702,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
         for (k = 0; k < itemList->numitems; k++) {
           item = &(itemList->items[k]);
           if (msItemInGroups(item->name, groupList) == MS_FALSE)
-            msGMLWriteItem(stream, item, shape.values[k], NULL, "\t\t\t",
+            msGMLWriteItem(&writer, item, shape.values[k], NULL, "\t\t\t",
                            OWS_GML2, NULL);
         }
 
@@ -1773,13 +1710,14 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
         for (k = 0; k < constantList->numconstants; k++) {
           constant = &(constantList->constants[k]);
           if (msItemInGroups(constant->name, groupList) == MS_FALSE)
-            msGMLWriteConstant(stream, constant, NULL, "\t\t\t");
+            msGMLWriteConstant(&writer, constant, NULL, "\t\t\t");
         }
 
         /* write any groups */
         for (k = 0; k < groupList->numgroups; k++)
-          msGMLWriteGroup(stream, &(groupList->groups[k]), &shape, itemList,
+          msGMLWriteGroup(&writer, &(groupList->groups[k]), &shape, itemList,
                           constantList, NULL, "\t\t\t", OWS_GML2, NULL);
+        msIO_writerFlush(&writer);
 
         /* end this feature */
         /* specify a feature name if nothing provided */
@@ -1820,6 +1758,7 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
   msOWSPrintValidateMetadata(stream, &(map->web.metadata), namespaces,
                              "rootname", OWS_NOERR, "</%s>\n", "msGMLOutput");
 
+  msIO_writerClose(&writer);
   if (stream_to_free != NULL)
     fclose(stream_to_free);
   msFree(pszMapSRS);
@@ -1833,9 +1772,9 @@ int msGMLWriteQuery(mapObj *map, char *filename, const char *namespaces) {
 }
 
 #ifdef USE_WFS_SVR
-void msGMLWriteWFSBounds(mapObj *map, FILE *stream, const char *tab,
-                         OWSGMLVersion outputformat, int nWFSVersion,
-                         int bUseURN) {
+static void gmlWriteWFSBounds(mapObj *map, msIOWriter *writer,
+                              const char *tab, OWSGMLVersion outputformat,
+                              int nWFSVersion, int bUseURN) {
   rectObj resultBounds = {-1.0, -1.0, -1.0, -1.0};
 
   /*add a check to see if the map projection is set to be north-east*/
@@ -1867,12 +1806,22 @@ void msGMLWriteWFSBounds(mapObj *map, FILE *stream, const char *tab,
                          MS_TRUE, &srs);
     }
 
-    gmlWriteBounds(stream, outputformat, &resultBounds, srs, tab,
+    gmlWriteBounds(writer, outputformat, &resultBounds, srs, tab,
                    (nWFSVersion == OWS_2_0_0) ? "wfs" : "gml");
     msFree(srs);
   }
 }
 
+void msGMLWriteWFSBounds(mapObj *map, FILE *stream, const char *tab,
+                         OWSGMLVersion outputformat, int nWFSVersion,
+                         int bUseURN) {
+  msIOWriter writer;
+
+  msIO_writerInit(&writer, stream);
+  gmlWriteWFSBounds(map, &writer, tab, outputformat, nWFSVersion, bUseURN);
+  msIO_writerClose(&writer);
+}
+
 #endif
 
 /*
@@ -1899,16 +1848,18 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
 
   const char *namespace_prefix = NULL;
   int bSwapAxis;
+  msIOWriter writer;
 
   msInitShape(&shape);
+  msIO_writerInit(&writer, stream);
 
   /*add a check to see if the map projection is set to be north-east*/
   bSwapAxis = msIsAxisInvertedProj(&(map->projection));
 
   /* Need to start with BBOX of the whole resultset */
   if (!bGetPropertyValueRequest) {
-    msGMLWriteWFSBounds(map, stream, "      ", outputformat, nWFSVersion,
-                        bUseURN);
+    gmlWriteWFSBounds(map, &writer, "      ", outputformat, nWFSVersion,
+                      bUseURN);
   }
   /* step through the layers looking for query results */
   for (i = 0; i < map->numlayers; i++) {
@@ -1951,15 +1902,16 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         /* Produce a warning if a featureid was set but the corresponding item
          * is not found. */
         if (featureIdIndex == -1)
-          msIO_fprintf(stream,
-                       "<!-- WARNING: FeatureId item '%s' not found in "
-                       "typename '%s'. -->\n",
-                       value, lp->name);
+          msIO_writerPrintf(&writer,
+                            "<!-- WARNING: FeatureId item '%s' not found in "
+                            "typename '%s'. -->\n",
+                            value, lp->name);
       } else if (outputformat == OWS_GML32)
-        msIO_fprintf(stream,
-                     "<!-- WARNING: No featureid defined for typename '%s'. "
-                     "Output will not validate. -->\n",
-                     lp->name);
+        msIO_writerPrintf(
+            &writer,
+            "<!-- WARNING: No featureid defined for typename '%s'. "
+            "Output will not validate. -->\n",
+            lp->name);
 
       /* populate item and group metadata structures */
       itemList = msGMLGetItems(lp, "G");
@@ -1971,6 +1923,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         msSetError(MS_MISCERR,
                    "Unable to populate item and group metadata structures",
                    "msGMLWriteWFSQuery()");
+        msIO_writerClose(&writer);
         return MS_FAILURE;
       }
 
@@ -2017,6 +1970,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
           msGMLFreeGeometries(geometryList);
           msFree(layerName);
           msFree(srs);
+          msIO_writerClose(&writer);
           return MS_FAILURE;
         }
       }
@@ -2038,6 +1992,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
             msFree(layerName);
             msProjectDestroyReprojector(reprojector);
             msFree(srs);
+            msIO_writerClose(&writer);
             return (status);
           }
         }
@@ -2055,7 +2010,8 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
           pszFID = msStrdup("");
 
         if (bOutputGMLIdOnly) {
-          msIO_fprintf(stream, "    <wfs:member>%s</wfs:member>\n", pszFID);
+          msIO_writerPrintf(&writer, "    <wfs:member>%s</wfs:member>\n",
+                            pszFID);
           msFree(pszFID);
           msFreeShape(&shape); /* init too */
           continue;
@@ -2065,26 +2021,27 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         ** start this feature
         */
         if (nWFSVersion == OWS_2_0_0)
-          msIO_fprintf(stream, "    <wfs:member>\n");
+          msIO_writerPrintf(&writer, "    <wfs:member>\n");
         else
-          msIO_fprintf(stream, "    <gml:featureMember>\n");
+          msIO_writerPrintf(&writer, "    <gml:featureMember>\n");
         if (msIsXMLTagValid(layerName) == MS_FALSE)
-          msIO_fprintf(stream,
-                       "<!-- WARNING: The value '%s' is not valid in a XML tag "
-                       "context. -->\n",
-                       layerName);
+          msIO_writerPrintf(
+              &writer,
+              "<!-- WARNING: The value '%s' is not valid in a XML tag "
+              "context. -->\n",
+              layerName);
         if (featureIdIndex != -1) {
           if (!bGetPropertyValueRequest) {
             if (outputformat == OWS_GML2)
-              msIO_fprintf(stream, "      <%s fid=\"%s\">\n", layerName,
-                           pszFID);
+              msIO_writerPrintf(&writer, "      <%s fid=\"%s\">\n", layerName,
+                                pszFID);
             else /* OWS_GML3 or OWS_GML32 */
-              msIO_fprintf(stream, "      <%s gml:id=\"%s\">\n", layerName,
-                           pszFID);
+              msIO_writerPrintf(&writer, "      <%s gml:id=\"%s\">\n",
+                                layerName, pszFID);
           }
         } else {
           if (!bGetPropertyValueRequest)
-            msIO_fprintf(stream, "      <%s>\n", layerName);
+            msIO_writerPrintf(&writer, "      <%s>\n", layerName);
         }
 
         if (bSwapAxis)
@@ -2094,7 +2051,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         if (!(geometryList && geometryList->numgeometries == 1 &&
               strcasecmp(geometryList->geometries[0].name, "none") == 0)) {
           if (!bGetPropertyValueRequest)
-            gmlWriteBounds(stream, outputformat, &(shape.bounds), srs,
+            gmlWriteBounds(&writer, outputformat, &(shape.bounds), srs,
                            "        ", "gml");
 
           if (msOWSLookupMetadata(&(lp->metadata), "F", "geometry_precision")) {
@@ -2106,7 +2063,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
                 &map->web.metadata, "F", "geometry_precision"));
           }
 
-          gmlWriteGeometry(stream, geometryList, outputformat, &(shape), srs,
+          gmlWriteGeometry(&writer, geometryList, outputformat, &(shape), srs,
                            namespace_prefix, "        ", pszFID, nSRSDimension,
                            geometry_precision);
         }
@@ -2115,7 +2072,7 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         for (k = 0; k < itemList->numitems; k++) {
           item = &(itemList->items[k]);
           if (msItemInGroups(item->name, groupList) == MS_FALSE)
-            msGMLWriteItem(stream, item, shape.values[k], namespace_prefix,
+            msGMLWriteItem(&writer, item, shape.values[k], namespace_prefix,
                            "        ", outputformat, pszFID);
         }
 
@@ -2123,23 +2080,23 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
         for (k = 0; k < constantList->numconstants; k++) {
           constant = &(constantList->constants[k]);
           if (msItemInGroups(constant->name, groupList) == MS_FALSE)
-            msGMLWriteConstant(stream, constant, namespace_prefix, "        ");
+            msGMLWriteConstant(&writer, constant, namespace_prefix, "        ");
         }
 
         /* write any groups */
         for (k = 0; k < groupList->numgroups; k++)
-          msGMLWriteGroup(stream, &(groupList->groups[k]), &shape, itemList,
+          msGMLWriteGroup(&writer, &(groupList->groups[k]), &shape, itemList,
                           constantList, namespace_prefix, "        ",
                           outputformat, pszFID);
 
         if (!bGetPropertyValueRequest)
           /* end this feature */
-          msIO_fprintf(stream, "      </%s>\n", layerName);
+          msIO_writerPrintf(&writer, "      </%s>\n", layerName);
 
         if (nWFSVersion == OWS_2_0_0)
-          msIO_fprintf(stream, "    </wfs:member>\n");
+          msIO_writerPrintf(&writer, "    </wfs:member>\n");
         else
-          msIO_fprintf(stream, "    </gml:featureMember>\n");
+          msIO_writerPrintf(&writer, "    </gml:featureMember>\n");
 
         msFree(pszFID);
         pszFID = NULL;
@@ -2163,6 +2120,8 @@ int msGMLWriteWFSQuery(mapObj *map, FILE *stream,
 
   } /* next layer */
 
+  msIO_writerClose(&writer);
+
   return (MS_SUCCESS);
 
 #else  /* Stub for mapscript */
@@ -32,41 +32,109 @@
 #include "mapserver.h"
 #include "maphash.h"
 
-static unsigned hash(const char *key) {
-  unsigned hashval;
+/*
+** Case insensitive FNV-1a hash. The full value is kept with every item so
+** that growing the table does not rehash the keys, and mismatching keys
+** are mostly rejected without a string comparison.
+*/
+unsigned msHashKey(const char *key) {
+  unsigned hashval = 2166136261U;
+
+  for (; *key != '\0'; key++) {
+    hashval ^= (unsigned)tolower((unsigned char)*key);
+    hashval *= 16777619U;
+  }
 
-  for (hashval = 0; *key != '\0'; key++)
-    hashval = tolower(*key) + 31 * hashval;
+  return hashval;
+}
 
-  return (hashval % MS_HASHSIZE);
+/*
+** Return the index of the item matching key, or -1. If slot is not NULL it
+** receives the slot referencing the item, or the empty slot where the key
+** would be inserted. The table is kept at most half full, so a probe always
+** ends on an empty slot.
+*/
+static int msHashFindItem(const hashTableObj *table, const char *key,
+                          unsigned hashval, int *slot) {
+  unsigned mask, i;
+
+  if (table->numslots == 0) {
+    if (slot)
+      *slot = -1;
+    return -1;
+  }
+
+  mask = (unsigned)table->numslots - 1;
+  for (i = hashval & mask;; i = (i + 1) & mask) {
+    const int item = table->slots[i];
+    if (item < 0 || (table->items[item].hashval == hashval &&
+                     strcasecmp(key, table->items[item].key) == 0)) {
+      if (slot)
+        *slot = (int)i;
+      return item;
+    }
+  }
 }
 
-hashTableObj *msCreateHashTable() {
+static void msHashRebuildSlots(hashTableObj *table) {
+  const unsigned mask = (unsigned)table->numslots - 1;
   int i;
+
+  for (i = 0; i < table->numslots; i++)
+    table->slots[i] = -1;
+
+  for (i = 0; i < table->numitems; i++) {
+    unsigned j = table->items[i].hashval & mask;
+    while (table->slots[j] >= 0)
+      j = (j + 1) & mask;
+    table->slots[j] = i;
+  }
+}
+
+static int msHashGrow(hashTableObj *table) {
+  const int numslots = table->numslots ? table->numslots * 2 : MS_HASHSIZE;
+  struct hashObj *items;
+  int *slots;
+
+  items = (struct hashObj *)realloc(table->items,
+                                    sizeof(struct hashObj) * (numslots / 2));
+  MS_CHECK_ALLOC(items, sizeof(struct hashObj) * (numslots / 2), MS_FAILURE);
+  table->items = items;
+
+  slots = (int *)realloc(table->slots, sizeof(int) * numslots);
+  MS_CHECK_ALLOC(slots, sizeof(int) * numslots, MS_FAILURE);
+  table->slots = slots;
+  table->numslots = numslots;
+
+  msHashRebuildSlots(table);
+  return MS_SUCCESS;
+}
+
+static void msHashDropResolved(hashTableObj *table) {
+  if (table->resolved) {
+    table->freeresolved(table->resolved);
+    table->resolved = NULL;
+    table->freeresolved = NULL;
+  }
+}
+
+hashTableObj *msCreateHashTable() {
   hashTableObj *table;
 
   table = (hashTableObj *)msSmallMalloc(sizeof(hashTableObj));
-  table->items =
-      (struct hashObj **)msSmallMalloc(sizeof(struct hashObj *) * MS_HASHSIZE);
-
-  for (i = 0; i < MS_HASHSIZE; i++)
-    table->items[i] = NULL;
-  table->numitems = 0;
+  initHashTable(table);
 
   return table;
 }
 
+/* The storage is only allocated on first insertion, most tables are empty */
 int initHashTable(hashTableObj *table) {
-  int i;
-
-  table->items =
-      (struct hashObj **)malloc(sizeof(struct hashObj *) * MS_HASHSIZE);
-  MS_CHECK_ALLOC(table->items, sizeof(struct hashObj *) * MS_HASHSIZE,
-                 MS_FAILURE);
-
-  for (i = 0; i < MS_HASHSIZE; i++)
-    table->items[i] = NULL;
+  table->items = NULL;
+  table->slots = NULL;
+  table->numslots = 0;
   table->numitems = 0;
+  table->resolved = NULL;
+  table->freeresolved = NULL;
   return MS_SUCCESS;
 }
 
@@ -86,140 +154,132 @@ int msHashIsEmpty(const hashTableObj *table) {
 
 void msFreeHashItems(hashTableObj *table) {
   int i;
-  struct hashObj *tp = NULL;
-  struct hashObj *prev_tp = NULL;
 
   if (table) {
-    if (table->items) {
-      for (i = 0; i < MS_HASHSIZE; i++) {
-        if (table->items[i] != NULL) {
-          for (tp = table->items[i]; tp != NULL;
-               prev_tp = tp, tp = tp->next, free(prev_tp)) {
-            msFree(tp->key);
-            msFree(tp->data);
-          }
-        }
-      }
-      free(table->items);
-      table->items = NULL;
-    } else {
-      msSetError(MS_HASHERR, "No items allocated.", "msFreeHashItems()");
+    msHashDropResolved(table);
+    for (i = 0; i < table->numitems; i++) {
+      msFree(table->items[i].key);
+      msFree(table->items[i].data);
     }
+    free(table->items);
+    free(table->slots);
+    table->items = NULL;
+    table->slots = NULL;
+    table->numslots = 0;
+    table->numitems = 0;
   } else {
     msSetError(MS_HASHERR, "Can't free NULL table", "msFreeHashItems()");
   }
 }
 
+void msHashTableSetResolved(hashTableObj *table, void *resolved,
+                            void (*freefunc)(void *)) {
+  msHashDropResolved(table);
+  if (resolved) {
+    table->resolved = resolved;
+    table->freeresolved = freefunc;
+  }
+}
+
 struct hashObj *msInsertHashTable(hashTableObj *table, const char *key,
                                   const char *value) {
   struct hashObj *tp;
   unsigned hashval;
+  char *data;
+  int item, slot;
 
   if (!table || !key || !value) {
     msSetError(MS_HASHERR, "Invalid hash table or key", "msInsertHashTable");
     return NULL;
   }
 
-  for (tp = table->items[hash(key)]; tp != NULL; tp = tp->next)
-    if (strcasecmp(key, tp->key) == 0)
-      break;
+  /* copy first, value may be the data of the item being replaced */
+  if ((data = msStrdup(value)) == NULL)
+    return NULL;
+
+  msHashDropResolved(table);
 
-  if (tp == NULL) { /* not found */
-    tp = (struct hashObj *)malloc(sizeof(*tp));
-    MS_CHECK_ALLOC(tp, sizeof(*tp), NULL);
+  hashval = msHashKey(key);
+  item = msHashFindItem(table, key, hashval, &slot);
+  if (item < 0) { /* not found */
+    if (table->numitems >= table->numslots / 2) {
+      if (msHashGrow(table) != MS_SUCCESS) {
+        msFree(data);
+        return NULL;
+      }
+      msHashFindItem(table, key, hashval, &slot);
+    }
+    item = table->numitems++;
+    tp = &(table->items[item]);
     tp->key = msStrdup(key);
-    hashval = hash(key);
-    tp->next = table->items[hashval];
-    table->items[hashval] = tp;
-    table->numitems++;
+    tp->hashval = hashval;
+    table->slots[slot] = item;
   } else {
+    tp = &(table->items[item]);
     free(tp->data);
   }
 
-  if ((tp->data = msStrdup(value)) == NULL)
-    return NULL;
+  tp->data = data;
 
   return tp;
 }
 
 const char *msLookupHashTable(const hashTableObj *table, const char *key) {
-  struct hashObj *tp;
+  int item;
 
   if (!table || !key) {
     return (NULL);
   }
 
-  for (tp = table->items[hash(key)]; tp != NULL; tp = tp->next)
-    if (strcasecmp(key, tp->key) == 0)
-      return (tp->data);
+  item = msHashFindItem(table, key, msHashKey(key), NULL);
+  if (item < 0)
+    return NULL;
 
-  return NULL;
+  return table->items[item].data;
 }
 
 int msRemoveHashTable(hashTableObj *table, const char *key) {
-  struct hashObj *tp;
-  struct hashObj *prev_tp = NULL;
-  int status = MS_FAILURE;
+  int item;
 
   if (!table || !key) {
     msSetError(MS_HASHERR, "No hash table", "msRemoveHashTable");
     return MS_FAILURE;
   }
 
-  tp = table->items[hash(key)];
-  if (!tp) {
+  item = msHashFindItem(table, key, msHashKey(key), NULL);
+  if (item < 0) {
     msSetError(MS_HASHERR, "No such hash entry", "msRemoveHashTable");
     return MS_FAILURE;
   }
 
-  prev_tp = NULL;
-  while (tp != NULL) {
-    if (strcasecmp(key, tp->key) == 0) {
-      status = MS_SUCCESS;
-      if (prev_tp) {
-        prev_tp->next = tp->next;
-        msFree(tp->key);
-        msFree(tp->data);
-        free(tp);
-        break;
-      } else {
-        table->items[hash(key)] = tp->next;
-        msFree(tp->key);
-        msFree(tp->data);
-        free(tp);
-        break;
-      }
-    }
-    prev_tp = tp;
-    tp = tp->next;
-  }
+  msHashDropResolved(table);
+  msFree(table->items[item].key);
+  msFree(table->items[item].data);
 
-  if (status == MS_SUCCESS)
-    table->numitems--;
+  /* keep the insertion order, removals are rare enough to reindex */
+  table->numitems--;
+  memmove(&(table->items[item]), &(table->items[item + 1]),
+          sizeof(struct hashObj) * (table->numitems - item));
+  msHashRebuildSlots(table);
 
-  return status;
+  return MS_SUCCESS;
 }
 
 const char *msFirstKeyFromHashTable(const hashTableObj *table) {
-  int hash_index;
-
   if (!table) {
     msSetError(MS_HASHERR, "No hash table", "msFirstKeyFromHashTable");
     return NULL;
   }
 
-  for (hash_index = 0; hash_index < MS_HASHSIZE; hash_index++) {
-    if (table->items[hash_index] != NULL)
-      return table->items[hash_index]->key;
-  }
+  if (table->numitems == 0)
+    return NULL;
 
-  return NULL;
+  return table->items[0].key;
 }
 
 const char *msNextKeyFromHashTable(const hashTableObj *table,
                                    const char *lastKey) {
-  int hash_index;
-  struct hashObj *link;
+  int item;
 
   if (!table) {
     msSetError(MS_HASHERR, "No hash table", "msNextKeyFromHashTable");
@@ -229,18 +289,9 @@ const char *msNextKeyFromHashTable(const hashTableObj *table,
   if (lastKey == NULL)
     return msFirstKeyFromHashTable(table);
 
-  hash_index = hash(lastKey);
-  for (link = table->items[hash_index];
-       link != NULL && strcasecmp(lastKey, link->key) != 0; link = link->next) {
-  }
-
-  if (link != NULL && link->next != NULL)
-    return link->next->key;
-
-  while (++hash_index < MS_HASHSIZE) {
-    if (table->items[hash_index] != NULL)
-      return table->items[hash_index]->key;
-  }
+  item = msHashFindItem(table, lastKey, msHashKey(lastKey), NULL);
+  if (item < 0 || item + 1 >= table->numitems)
+    return NULL;
 
-  return NULL;
+  return table->items[item + 1].key;
 }
@@ -40,7 +40,8 @@ extern "C" {
 #define MS_DLL_EXPORT
 #endif
 
-#define MS_HASHSIZE 41
+/* initial number of slots of a hash table, always a power of two */
+#define MS_HASHSIZE 16
 
 /* =========================================================================
  * Structs
@@ -48,9 +49,9 @@ extern "C" {
 
 #ifndef SWIG
 struct hashObj {
-  struct hashObj *next; /* pointer to next item */
-  char *key;            /* string key that is hashed */
-  char *data;           /* string stored in this item */
+  char *key;        /* string key that is hashed */
+  char *data;       /* string stored in this item */
+  unsigned hashval; /* cached hash of the case folded key */
 };
 #endif /*SWIG*/
 
@@ -60,7 +61,11 @@ struct hashObj {
  */
 typedef struct {
 #ifndef SWIG
-  struct hashObj **items; /* the hash table */
+  struct hashObj *items;        /* the items, in insertion order */
+  int *slots;                   /* index of the items, -1 when empty */
+  int numslots;                 /* a power of two, 0 before first insert */
+  void *resolved;               /* view derived from the items, */
+  void (*freeresolved)(void *); /* see msHashTableSetResolved() */
 #endif
 #ifdef SWIG
     %immutable;
@@ -157,6 +162,26 @@ MS_DLL_EXPORT const char *msNextKeyFromHashTable(const hashTableObj *table,
 
 MS_DLL_EXPORT int msHashIsEmpty(const hashTableObj *table);
 
+/* msHashKey - case insensitive hash of a string, as used by the table
+ * ARGS:
+ *     key - string to hash
+ * RETURNS:
+ *     the hash value
+ */
+MS_DLL_EXPORT unsigned msHashKey(const char *key);
+
+/* msHashTableSetResolved - attach a view derived from the table content
+ * ARGS:
+ *     table - target hash table
+ *     resolved - the view, or NULL
+ *     freefunc - function releasing the view
+ * RETURNS:
+ *     None. Any previous view is released, and the view is released as
+ *     soon as the table is modified or freed.
+ */
+MS_DLL_EXPORT void msHashTableSetResolved(hashTableObj *table, void *resolved,
+                                          void (*freefunc)(void *));
+
 #endif /*SWIG*/
 
 #ifdef __cplusplus
@@ -43,6 +43,7 @@
 
 #include "cpl_conv.h"
 
+#include <ctype.h>
 #include <time.h>
 #ifndef _WIN32
 #include <sys/time.h>
@@ -65,6 +66,19 @@
 
 #define unchecked_curl_easy_setopt(handle, opt, param)                         \
   IGNORE_RET_VAL(curl_easy_setopt(handle, opt, param))
+#define unchecked_curl_multi_setopt(handle, opt, param)                        \
+  IGNORE_RET_VAL(curl_multi_setopt(handle, opt, param))
+
+/* Maximum number of idle multi handles kept for reuse, number of
+ * connections each of them keeps open once its transfers are done, and
+ * default bound on the concurrent connections to a single host.
+ */
+#define MS_HTTP_MULTI_POOL_SIZE 8
+#define MS_HTTP_MAX_CACHED_CONNECTIONS 16
+#define MS_HTTP_MAX_HOST_CONNECTIONS 8
+
+/* Upper bound of the freshness lifetime of cached responses (one year) */
+#define MS_HTTP_CACHE_MAX_AGE (365 * 24 * 3600)
 
 /**********************************************************************
  *                          msHTTPInit()
@@ -80,6 +94,43 @@
  **********************************************************************/
 static int gbCurlInitialized = MS_FALSE;
 
+/* DNS and TLS session caches shared by all the requests of this process */
+static CURLSH *ghCurlShare = NULL;
+
+/* Idle multi handles, with the connections they keep alive */
+static CURLM *gahMultiPool[MS_HTTP_MULTI_POOL_SIZE];
+static int gnMultiPoolCount = 0;
+
+static void msHTTPCacheCleanup(void);
+
+static int msHTTPShareLockId(curl_lock_data data) {
+  switch (data) {
+  case CURL_LOCK_DATA_DNS:
+    return TLOCK_CURL_DNS;
+  case CURL_LOCK_DATA_SSL_SESSION:
+    return TLOCK_CURL_SSL;
+  default:
+    return TLOCK_CURL_SHARE;
+  }
+}
+
+static void msHTTPShareLock(CURL *handle, curl_lock_data data,
+                            curl_lock_access access, void *userptr) {
+  (void)handle;
+  (void)data;
+  (void)access;
+  (void)userptr;
+  msAcquireLock(msHTTPShareLockId(data));
+}
+
+static void msHTTPShareUnlock(CURL *handle, curl_lock_data data,
+                              void *userptr) {
+  (void)handle;
+  (void)data;
+  (void)userptr;
+  msReleaseLock(msHTTPShareLockId(data));
+}
+
 int msHTTPInit() {
   /* curl_global_init() should only be called once (no matter how
    * many threads or libcurl sessions that'll be used) by every
@@ -93,6 +144,17 @@ int msHTTPInit() {
     return MS_FAILURE;
   }
 
+  if (!gbCurlInitialized) {
+    ghCurlShare = curl_share_init();
+    if (ghCurlShare) {
+      curl_share_setopt(ghCurlShare, CURLSHOPT_LOCKFUNC, msHTTPShareLock);
+      curl_share_setopt(ghCurlShare, CURLSHOPT_UNLOCKFUNC, msHTTPShareUnlock);
+      curl_share_setopt(ghCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(ghCurlShare, CURLSHOPT_SHARE,
+                        CURL_LOCK_DATA_SSL_SESSION);
+    }
+  }
+
   gbCurlInitialized = MS_TRUE;
 
   msReleaseLock(TLOCK_OWS);
@@ -105,6 +167,13 @@ int msHTTPInit() {
  **********************************************************************/
 void msHTTPCleanup() {
   msAcquireLock(TLOCK_OWS);
+  msHTTPCacheCleanup();
+  while (gnMultiPoolCount > 0)
+    curl_multi_cleanup(gahMultiPool[--gnMultiPoolCount]);
+  if (ghCurlShare) {
+    curl_share_cleanup(ghCurlShare);
+    ghCurlShare = NULL;
+  }
   if (gbCurlInitialized)
     curl_global_cleanup();
 
@@ -148,6 +217,10 @@ void msHTTPInitRequestObj(httpRequestObj *pasReqInfo, int numRequests) {
     pasReqInfo[i].result_data = NULL;
     pasReqInfo[i].result_size = 0;
     pasReqInfo[i].result_buf_size = 0;
+
+    pasReqInfo[i].pszCacheKey = NULL;
+    pasReqInfo[i].nCacheMaxAge = -1;
+    pasReqInfo[i].bCacheForbidden = MS_FALSE;
   }
 }
 
@@ -196,6 +269,9 @@ void msHTTPFreeRequestObj(httpRequestObj *pasReqInfo, int numRequests) {
     pasReqInfo[i].result_data = NULL;
     pasReqInfo[i].result_size = 0;
     pasReqInfo[i].result_buf_size = 0;
+
+    msFree(pasReqInfo[i].pszCacheKey);
+    pasReqInfo[i].pszCacheKey = NULL;
   }
 }
 
@@ -260,6 +336,59 @@ static size_t msHTTPWriteFct(void *buffer, size_t size, size_t nmemb,
   }
 }
 
+/**********************************************************************
+ *                          msHTTPHeaderFct()
+ *
+ * CURLOPT_HEADERFUNCTION, called for each header line of the response
+ * of a request that may be cached, to collect its freshness lifetime
+ * from the Cache-Control and Expires headers.
+ **********************************************************************/
+static size_t msHTTPHeaderFct(char *buffer, size_t size, size_t nitems,
+                              void *reqInfo) {
+  httpRequestObj *psReq = (httpRequestObj *)reqInfo;
+  const size_t nLen = size * nitems;
+  char szHeader[1024];
+
+  /* buffer is not NUL terminated */
+  memcpy(szHeader, buffer, MS_MIN(nLen, sizeof(szHeader) - 1));
+  szHeader[MS_MIN(nLen, sizeof(szHeader) - 1)] = '\0';
+  szHeader[strcspn(szHeader, "\r\n")] = '\0';
+
+  if (strncmp(szHeader, "HTTP/", 5) == 0) {
+    /* Status line of a new response (e.g. after a redirection) */
+    psReq->nCacheMaxAge = -1;
+    psReq->bCacheForbidden = MS_FALSE;
+  } else if (strncasecmp(szHeader, "Cache-Control:", 14) == 0) {
+    int i, nTokens = 0, nSharedMaxAge = -1;
+    char **papszTokens = msStringSplit(szHeader + 14, ',', &nTokens);
+    for (i = 0; i < nTokens; i++) {
+      msStringTrim(papszTokens[i]);
+      if (strcasecmp(papszTokens[i], "no-store") == 0 ||
+          strcasecmp(papszTokens[i], "no-cache") == 0 ||
+          strcasecmp(papszTokens[i], "private") == 0)
+        psReq->bCacheForbidden = MS_TRUE;
+      else if (strncasecmp(papszTokens[i], "max-age=", 8) == 0)
+        psReq->nCacheMaxAge =
+            MS_MIN(atoi(papszTokens[i] + 8), MS_HTTP_CACHE_MAX_AGE);
+      else if (strncasecmp(papszTokens[i], "s-maxage=", 9) == 0)
+        nSharedMaxAge = MS_MIN(atoi(papszTokens[i] + 9), MS_HTTP_CACHE_MAX_AGE);
+    }
+    msFreeCharArray(papszTokens, nTokens);
+    /* s-maxage is the one that applies to a shared cache */
+    if (nSharedMaxAge >= 0)
+      psReq->nCacheMaxAge = nSharedMaxAge;
+  } else if (strncasecmp(szHeader, "Expires:", 8) == 0 &&
+             psReq->nCacheMaxAge < 0) {
+    /* max-age takes precedence over Expires, whatever their order */
+    time_t nExpires = curl_getdate(szHeader + 8, NULL);
+    if (nExpires != -1)
+      psReq->nCacheMaxAge =
+          (int)MS_MAX(0, MS_MIN(nExpires - time(NULL), MS_HTTP_CACHE_MAX_AGE));
+  }
+
+  return nLen;
+}
+
 /**********************************************************************
  *                          msGetCURLAuthType()
  *
@@ -417,6 +546,617 @@ int msHTTPAuthProxySetup(hashTableObj *mapmd, hashTableObj *lyrmd,
   return MS_SUCCESS;
 }
 
+/**********************************************************************
+ *                          msHTTPAcquireMultiHandle()
+ *
+ * Returns an idle multi handle from the pool, or a new one. Connections
+ * opened by a previous batch of requests stay in the connection cache of
+ * the multi handle, so requests to the same servers skip the TCP and TLS
+ * handshakes, and are multiplexed over HTTP/2 where available.
+ **********************************************************************/
+static CURLM *msHTTPAcquireMultiHandle(void) {
+  CURLM *multi_handle = NULL;
+
+  msAcquireLock(TLOCK_OWS);
+  if (gnMultiPoolCount > 0)
+    multi_handle = gahMultiPool[--gnMultiPoolCount];
+  msReleaseLock(TLOCK_OWS);
+  if (multi_handle != NULL)
+    return multi_handle;
+
+  multi_handle = curl_multi_init();
+  if (multi_handle == NULL)
+    return NULL;
+
+  unchecked_curl_multi_setopt(multi_handle, CURLMOPT_MAXCONNECTS,
+                              (long)MS_HTTP_MAX_CACHED_CONNECTIONS);
+#if CURL_AT_LEAST_VERSION(7, 30, 0)
+  {
+    const char *pszMaxHostConnections =
+        CPLGetConfigOption("CURL_MAX_HOST_CONNECTIONS", NULL);
+    long nMaxHostConnections = MS_HTTP_MAX_HOST_CONNECTIONS;
+    if (pszMaxHostConnections)
+      nMaxHostConnections = atol(pszMaxHostConnections);
+    if (nMaxHostConnections > 0)
+      unchecked_curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS,
+                                  nMaxHostConnections);
+  }
+#endif
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+  unchecked_curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING,
+                              (long)CURLPIPE_MULTIPLEX);
+#endif
+
+  return multi_handle;
+}
+
+/**********************************************************************
+ *                          msHTTPReleaseMultiHandle()
+ *
+ * Returns a multi handle, with no easy handle left in it, to the pool.
+ **********************************************************************/
+static void msHTTPReleaseMultiHandle(CURLM *multi_handle) {
+  msAcquireLock(TLOCK_OWS);
+  if (gbCurlInitialized && gnMultiPoolCount < MS_HTTP_MULTI_POOL_SIZE) {
+    gahMultiPool[gnMultiPoolCount++] = multi_handle;
+    multi_handle = NULL;
+  }
+  msReleaseLock(TLOCK_OWS);
+
+  if (multi_handle != NULL)
+    curl_multi_cleanup(multi_handle);
+}
+
+/* ====================================================================
+ * HTTP response cache.
+ *
+ * Successful responses that carry a freshness lifetime (Cache-Control
+ * max-age/s-maxage or Expires) are kept in a process wide LRU list, bounded
+ * to MS_HTTP_CACHE_SIZE bytes, and also written to the MS_HTTP_CACHE_DIR
+ * directory if that is set. Entries are keyed on the normalized request
+ * URL. While a response is being fetched its entry is pending and owned
+ * by the batch of requests (msHTTPExecuteRequests() call) fetching it.
+ * Concurrent requests for a pending key wait for that fetch instead of
+ * issuing their own. To avoid two batches waiting for each other, a batch
+ * only waits once its own fetches are over and its entries are released,
+ * and it fetches the response itself if the wait times out.
+ * ==================================================================== */
+
+#define MS_HTTP_CACHE_BUCKETS 1024
+
+/* msHTTPCacheLookup() status of a response being fetched by another batch */
+#define MS_HTTP_CACHE_PENDING (MS_DONE + 1)
+
+typedef struct httpCacheEntryObj {
+  char *key;
+  unsigned int hash;
+  char *data;
+  int size;
+  char *content_type;
+  time_t expires;
+
+  /* batch of requests fetching this entry, 0 once it is stored */
+  unsigned int owner;
+  time_t pending_until;
+
+  struct httpCacheEntryObj *next; /* in hash bucket */
+  struct httpCacheEntryObj *lru_prev;
+  struct httpCacheEntryObj *lru_next;
+} httpCacheEntryObj;
+
+static httpCacheEntryObj *gapsCacheBuckets[MS_HTTP_CACHE_BUCKETS];
+static httpCacheEntryObj *gpsCacheHead = NULL; /* most recently used */
+static httpCacheEntryObj *gpsCacheTail = NULL;
+static size_t gnCacheBytes = 0;
+static unsigned int gnCacheLastBatch = 0;
+
+static size_t msHTTPCacheMaxBytes(void) {
+  const char *pszSize = CPLGetConfigOption("MS_HTTP_CACHE_SIZE", NULL);
+  return pszSize ? (size_t)MS_MAX(0, atol(pszSize)) : 0;
+}
+
+static unsigned int msHTTPCacheHash(const char *key, unsigned int hash) {
+  for (; *key; key++) {
+    hash ^= (unsigned char)*key; /* FNV-1a */
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static int msHTTPCacheCompareParams(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**********************************************************************
+ *                          msHTTPCacheKey()
+ *
+ * Returns the cache key of a request, or NULL if its response must not
+ * be shared. The scheme and host are lowercased, and the query parameters
+ * sorted with their names uppercased, since OGC parameter names are case
+ * insensitive and their order is irrelevant.
+ **********************************************************************/
+static char *msHTTPCacheKey(const httpRequestObj *psReq) {
+  const char *pszQuery, *pszHost;
+  char *pszKey;
+  int i, nParams = 0;
+
+  if (psReq->pszHTTPCookieData != NULL)
+    return NULL;
+
+  pszQuery = strchr(psReq->pszGetUrl, '?');
+  if (pszQuery == NULL)
+    pszKey = msStrdup(psReq->pszGetUrl);
+  else {
+    pszKey = (char *)msSmallMalloc(pszQuery - psReq->pszGetUrl + 1);
+    memcpy(pszKey, psReq->pszGetUrl, pszQuery - psReq->pszGetUrl);
+    pszKey[pszQuery - psReq->pszGetUrl] = '\0';
+  }
+  pszHost = strstr(pszKey, "://");
+  for (i = 0; pszKey[i] != '\0' &&
+              (pszHost == NULL || pszKey + i < pszHost + 3 ||
+               pszKey[i] != '/');
+       i++)
+    pszKey[i] = tolower((unsigned char)pszKey[i]);
+
+  if (pszQuery != NULL) {
+    char **papszParams = msStringSplit(pszQuery + 1, '&', &nParams);
+    for (i = 0; i < nParams; i++) {
+      char *pszValue = strchr(papszParams[i], '=');
+      if (pszValue)
+        *pszValue = '\0';
+      msStringToUpper(papszParams[i]);
+      if (pszValue)
+        *pszValue = '=';
+    }
+    qsort(papszParams, nParams, sizeof(char *), msHTTPCacheCompareParams);
+    pszKey = msStringConcatenate(pszKey, "?");
+    for (i = 0; i < nParams; i++) {
+      if (papszParams[i][0] == '\0')
+        continue;
+      if (pszKey[strlen(pszKey) - 1] != '?')
+        pszKey = msStringConcatenate(pszKey, "&");
+      pszKey = msStringConcatenate(pszKey, papszParams[i]);
+    }
+    msFreeCharArray(papszParams, nParams);
+  }
+
+  if (psReq->pszPostRequest != NULL) {
+    pszKey = msStringConcatenate(pszKey, "\n");
+    if (psReq->pszPostContentType)
+      pszKey = msStringConcatenate(pszKey, psReq->pszPostContentType);
+    pszKey = msStringConcatenate(pszKey, "\n");
+    pszKey = msStringConcatenate(pszKey, psReq->pszPostRequest);
+  }
+  if (psReq->pszHttpUsername != NULL) {
+    pszKey = msStringConcatenate(pszKey, "\nuser=");
+    pszKey = msStringConcatenate(pszKey, psReq->pszHttpUsername);
+  }
+
+  return pszKey;
+}
+
+static httpCacheEntryObj *msHTTPCacheFind(const char *key, unsigned int hash) {
+  httpCacheEntryObj *psEntry = gapsCacheBuckets[hash % MS_HTTP_CACHE_BUCKETS];
+  while (psEntry && (psEntry->hash != hash || strcmp(psEntry->key, key) != 0))
+    psEntry = psEntry->next;
+  return psEntry;
+}
+
+static void msHTTPCacheLRUUnlink(httpCacheEntryObj *psEntry) {
+  if (psEntry->lru_prev)
+    psEntry->lru_prev->lru_next = psEntry->lru_next;
+  else
+    gpsCacheHead = psEntry->lru_next;
+  if (psEntry->lru_next)
+    psEntry->lru_next->lru_prev = psEntry->lru_prev;
+  else
+    gpsCacheTail = psEntry->lru_prev;
+  psEntry->lru_prev = psEntry->lru_next = NULL;
+}
+
+static void msHTTPCacheLRUPush(httpCacheEntryObj *psEntry) {
+  psEntry->lru_prev = NULL;
+  psEntry->lru_next = gpsCacheHead;
+  if (gpsCacheHead)
+    gpsCacheHead->lru_prev = psEntry;
+  gpsCacheHead = psEntry;
+  if (gpsCacheTail == NULL)
+    gpsCacheTail = psEntry;
+}
+
+static httpCacheEntryObj *msHTTPCacheAdd(const char *key, unsigned int hash) {
+  httpCacheEntryObj *psEntry =
+      (httpCacheEntryObj *)msSmallCalloc(1, sizeof(httpCacheEntryObj));
+  psEntry->key = msStrdup(key);
+  psEntry->hash = hash;
+  psEntry->next = gapsCacheBuckets[hash % MS_HTTP_CACHE_BUCKETS];
+  gapsCacheBuckets[hash % MS_HTTP_CACHE_BUCKETS] = psEntry;
+  msHTTPCacheLRUPush(psEntry);
+  return psEntry;
+}
+
+static void msHTTPCacheRemove(httpCacheEntryObj *psEntry) {
+  httpCacheEntryObj **ppsLink =
+      &gapsCacheBuckets[psEntry->hash % MS_HTTP_CACHE_BUCKETS];
+  while (*ppsLink != psEntry)
+    ppsLink = &((*ppsLink)->next);
+  *ppsLink = psEntry->next;
+  msHTTPCacheLRUUnlink(psEntry);
+
+  gnCacheBytes -= psEntry->size;
+  msFree(psEntry->key);
+  msFree(psEntry->data);
+  msFree(psEntry->content_type);
+  msFree(psEntry);
+}
+
+/* Drops the least recently used entries until the cache fits nMaxBytes */
+static void msHTTPCacheEvict(size_t nMaxBytes) {
+  httpCacheEntryObj *psEntry = gpsCacheTail;
+  while (psEntry && gnCacheBytes > nMaxBytes) {
+    httpCacheEntryObj *psPrev = psEntry->lru_prev;
+    if (psEntry->owner == 0)
+      msHTTPCacheRemove(psEntry);
+    psEntry = psPrev;
+  }
+}
+
+/**********************************************************************
+ *                          msHTTPCacheDiskPath()
+ *
+ * Returns the path of the file of the disk cache for a key, or NULL if
+ * there is no disk cache.
+ **********************************************************************/
+static char *msHTTPCacheDiskPath(const char *key) {
+  const char *pszDir = CPLGetConfigOption("MS_HTTP_CACHE_DIR", NULL);
+  if (pszDir == NULL || pszDir[0] == '\0')
+    return NULL;
+  return msStrdup(CPLSPrintf("%s/%08x%08x.mshc", pszDir,
+                             msHTTPCacheHash(key, 2166136261U),
+                             msHTTPCacheHash(key, 0x5bd1e995U)));
+}
+
+/* A disk cache file is a "MSHTTPCACHE1 expires keylen typelen datalen"
+ * line followed by the key, content type and data.
+ */
+static int msHTTPCacheDiskRead(const char *pszPath, const char *key,
+                               char **ppszData, int *pnSize,
+                               char **ppszContentType, time_t *pnExpires) {
+  VSILFILE *fp;
+  char szLine[128];
+  long nExpires;
+  int nKeyLen, nTypeLen, nDataLen, i;
+  char *pszKey = NULL, *pszType = NULL, *pszData = NULL;
+
+  fp = VSIFOpenL(pszPath, "rb");
+  if (fp == NULL)
+    return MS_FAILURE;
+
+  for (i = 0; i < (int)sizeof(szLine) - 1; i++) {
+    if (VSIFReadL(szLine + i, 1, 1, fp) != 1 || szLine[i] == '\n')
+      break;
+  }
+  szLine[i] = '\0';
+  if (sscanf(szLine, "MSHTTPCACHE1 %ld %d %d %d", &nExpires, &nKeyLen,
+             &nTypeLen, &nDataLen) != 4 ||
+      nKeyLen != (int)strlen(key) || nTypeLen < 0 || nDataLen < 0 ||
+      (time_t)nExpires <= time(NULL)) {
+    VSIFCloseL(fp);
+    return MS_FAILURE;
+  }
+
+  pszKey = (char *)msSmallMalloc(nKeyLen + 1);
+  pszType = (char *)msSmallMalloc(nTypeLen + 1);
+  pszData = (char *)msSmallMalloc(nDataLen + 1);
+  if (VSIFReadL(pszKey, 1, nKeyLen, fp) != (size_t)nKeyLen ||
+      VSIFReadL(pszType, 1, nTypeLen, fp) != (size_t)nTypeLen ||
+      VSIFReadL(pszData, 1, nDataLen, fp) != (size_t)nDataLen ||
+      memcmp(pszKey, key, nKeyLen) != 0) {
+    VSIFCloseL(fp);
+    msFree(pszKey);
+    msFree(pszType);
+    msFree(pszData);
+    return MS_FAILURE;
+  }
+  VSIFCloseL(fp);
+  msFree(pszKey);
+
+  pszType[nTypeLen] = '\0';
+  pszData[nDataLen] = '\0';
+  *ppszContentType = pszType;
+  *ppszData = pszData;
+  *pnSize = nDataLen;
+  *pnExpires = (time_t)nExpires;
+  return MS_SUCCESS;
+}
+
+static void msHTTPCacheDiskWrite(const char *pszPath, const char *key,
+                                 const char *pszData, int nSize,
+                                 const char *pszContentType, time_t nExpires) {
+  const char *pszType = pszContentType ? pszContentType : "";
+  char *pszTmpName = msTmpFilename("tmp");
+  char *pszTmpPath = msStrdup(CPLSPrintf("%s.%s", pszPath, pszTmpName));
+  const char *pszHeader =
+      CPLSPrintf("MSHTTPCACHE1 %ld %d %d %d\n", (long)nExpires,
+                 (int)strlen(key), (int)strlen(pszType), nSize);
+  VSILFILE *fp = VSIFOpenL(pszTmpPath, "wb");
+  int bOK = fp != NULL;
+
+  if (fp) {
+    bOK &= VSIFWriteL(pszHeader, 1, strlen(pszHeader), fp) == strlen(pszHeader);
+    bOK &= VSIFWriteL(key, 1, strlen(key), fp) == strlen(key);
+    bOK &= VSIFWriteL(pszType, 1, strlen(pszType), fp) == strlen(pszType);
+    bOK &= VSIFWriteL(pszData, 1, nSize, fp) == (size_t)nSize;
+    bOK &= VSIFCloseL(fp) == 0;
+  }
+  /* Write then rename so that readers never see a partial file */
+  if (!bOK || VSIRename(pszTmpPath, pszPath) != 0)
+    VSIUnlink(pszTmpPath);
+
+  msFree(pszTmpName);
+  msFree(pszTmpPath);
+}
+
+/* Hands a cached response over to a request, as if it was downloaded */
+static int msHTTPCacheDeliver(httpRequestObj *psReq, char *pszData, int nSize,
+                              const char *pszContentType) {
+  if (psReq->pszOutputFile != NULL) {
+    FILE *fp = fopen(psReq->pszOutputFile, "wb");
+    int bOK = fp != NULL && fwrite(pszData, 1, nSize, fp) == (size_t)nSize;
+    if (fp)
+      fclose(fp);
+    msFree(pszData);
+    if (!bOK)
+      return MS_FAILURE;
+  } else {
+    msFree(psReq->result_data);
+    psReq->result_data = pszData;
+    psReq->result_buf_size = nSize + 1;
+  }
+  psReq->result_size = nSize;
+  psReq->nStatus = 200;
+  if (pszContentType && pszContentType[0] != '\0')
+    psReq->pszContentType = msStrdup(pszContentType);
+  return MS_SUCCESS;
+}
+
+/* Hands a fresh entry over to a request, called with TLOCK_OWS held and
+ * releases it */
+static int msHTTPCacheDeliverEntry(httpRequestObj *psReq,
+                                   httpCacheEntryObj *psEntry) {
+  const int nSize = psEntry->size;
+  char *pszData, *pszContentType;
+  int nStatus;
+
+  msHTTPCacheLRUUnlink(psEntry);
+  msHTTPCacheLRUPush(psEntry);
+  pszData = (char *)msSmallMalloc(nSize + 1);
+  memcpy(pszData, psEntry->data, nSize);
+  pszData[nSize] = '\0';
+  pszContentType = msStrdup(psEntry->content_type);
+  msReleaseLock(TLOCK_OWS);
+
+  nStatus = msHTTPCacheDeliver(psReq, pszData, nSize, pszContentType);
+  msFree(pszContentType);
+  return nStatus == MS_SUCCESS ? MS_SUCCESS : MS_FAILURE;
+}
+
+/**********************************************************************
+ *                          msHTTPCacheLookup()
+ *
+ * Looks up the response to a request in the cache. Returns MS_SUCCESS if
+ * it was found and handed over to the request, MS_DONE if it was not and
+ * the caller is now expected to fetch it and call msHTTPCacheStore(),
+ * MS_HTTP_CACHE_PENDING if another batch is fetching it (only when
+ * bWaitPending is set, see msHTTPCacheWait()), or MS_FAILURE if the
+ * request should be executed without the cache.
+ **********************************************************************/
+static int msHTTPCacheLookup(httpRequestObj *psReq, const char *key,
+                             unsigned int owner, int nTimeout,
+                             int bWaitPending) {
+  const unsigned int hash = msHTTPCacheHash(key, 2166136261U);
+  httpCacheEntryObj *psEntry;
+  char *pszData = NULL, *pszContentType = NULL, *pszPath;
+  int nSize = 0;
+  time_t nExpires;
+
+  msAcquireLock(TLOCK_OWS);
+  psEntry = msHTTPCacheFind(key, hash);
+  if (psEntry && psEntry->owner == 0 && psEntry->expires > time(NULL))
+    return msHTTPCacheDeliverEntry(psReq, psEntry);
+  if (psEntry && psEntry->owner == 0) {
+    msHTTPCacheRemove(psEntry); /* stale */
+    psEntry = NULL;
+  }
+  if (psEntry && psEntry->owner == owner) {
+    /* Same URL twice in one batch, fetch both */
+    msReleaseLock(TLOCK_OWS);
+    return MS_FAILURE;
+  }
+  if (psEntry && psEntry->pending_until > time(NULL)) {
+    /* Being fetched by another batch */
+    msReleaseLock(TLOCK_OWS);
+    return bWaitPending ? MS_HTTP_CACHE_PENDING : MS_FAILURE;
+  }
+
+  /* Take over the entry, abandoned entries included */
+  if (psEntry == NULL)
+    psEntry = msHTTPCacheAdd(key, hash);
+  psEntry->owner = owner;
+  psEntry->pending_until = time(NULL) + nTimeout;
+  msReleaseLock(TLOCK_OWS);
+
+  /* Fall back to the disk cache before going to the server */
+  pszPath = msHTTPCacheDiskPath(key);
+  if (pszPath != NULL &&
+      msHTTPCacheDiskRead(pszPath, key, &pszData, &nSize, &pszContentType,
+                          &nExpires) == MS_SUCCESS) {
+    const size_t nMaxBytes = msHTTPCacheMaxBytes();
+    msAcquireLock(TLOCK_OWS);
+    psEntry = msHTTPCacheFind(key, hash);
+    if (psEntry && psEntry->owner == owner) {
+      if ((size_t)nSize <= nMaxBytes / 4) {
+        psEntry->data = (char *)msSmallMalloc(nSize);
+        memcpy(psEntry->data, pszData, nSize);
+        psEntry->size = nSize;
+        psEntry->content_type = msStrdup(pszContentType);
+        psEntry->expires = nExpires;
+        psEntry->owner = 0;
+        gnCacheBytes += nSize;
+        msHTTPCacheEvict(nMaxBytes);
+      } else
+        msHTTPCacheRemove(psEntry);
+    }
+    msReleaseLock(TLOCK_OWS);
+    msFree(pszPath);
+
+    int nStatus = msHTTPCacheDeliver(psReq, pszData, nSize, pszContentType);
+    msFree(pszContentType);
+    return nStatus == MS_SUCCESS ? MS_SUCCESS : MS_FAILURE;
+  }
+  msFree(pszPath);
+
+  return MS_DONE;
+}
+
+/**********************************************************************
+ *                          msHTTPCacheStore()
+ *
+ * Stores the response of a request fetched after msHTTPCacheLookup()
+ * returned MS_DONE, or only releases its pending entry if the response
+ * cannot be cached.
+ **********************************************************************/
+static void msHTTPCacheStore(httpRequestObj *psReq, unsigned int owner) {
+  const char *key = psReq->pszCacheKey;
+  const unsigned int hash = msHTTPCacheHash(key, 2166136261U);
+  const size_t nMaxBytes = msHTTPCacheMaxBytes();
+  httpCacheEntryObj *psEntry;
+  char *pszData = NULL, *pszPath;
+  int nSize = 0;
+  time_t nExpires = time(NULL) + psReq->nCacheMaxAge;
+  int bCacheable = psReq->nStatus == 200 && !psReq->bCacheForbidden &&
+                   psReq->nCacheMaxAge > 0;
+
+  if (bCacheable && psReq->pszOutputFile != NULL) {
+    /* Read back what was written to disk */
+    FILE *fp = fopen(psReq->pszOutputFile, "rb");
+    bCacheable = MS_FALSE;
+    if (fp) {
+      nSize = psReq->result_size;
+      pszData = (char *)msSmallMalloc(nSize + 1);
+      bCacheable = fread(pszData, 1, nSize, fp) == (size_t)nSize;
+      fclose(fp);
+    }
+  } else if (bCacheable) {
+    nSize = psReq->result_size;
+    pszData = psReq->result_data;
+  }
+
+  msAcquireLock(TLOCK_OWS);
+  psEntry = msHTTPCacheFind(key, hash);
+  if (psEntry && psEntry->owner == owner) {
+    if (bCacheable && (size_t)nSize <= nMaxBytes / 4) {
+      psEntry->data = (char *)msSmallMalloc(MS_MAX(1, nSize));
+      memcpy(psEntry->data, pszData, nSize);
+      psEntry->size = nSize;
+      psEntry->content_type =
+          psReq->pszContentType ? msStrdup(psReq->pszContentType) : NULL;
+      psEntry->expires = nExpires;
+      psEntry->owner = 0;
+      gnCacheBytes += nSize;
+      msHTTPCacheEvict(nMaxBytes);
+    } else
+      msHTTPCacheRemove(psEntry);
+  }
+  msReleaseLock(TLOCK_OWS);
+
+  if (bCacheable && (pszPath = msHTTPCacheDiskPath(key)) != NULL) {
+    msHTTPCacheDiskWrite(pszPath, key, pszData, nSize, psReq->pszContentType,
+                         nExpires);
+    msFree(pszPath);
+  }
+
+  if (pszData != psReq->result_data)
+    msFree(pszData);
+}
+
+/**********************************************************************
+ *                          msHTTPCacheNewBatch()
+ *
+ * Returns a token identifying a batch of requests as the owner of the
+ * cache entries it fetches.
+ **********************************************************************/
+static unsigned int msHTTPCacheNewBatch(void) {
+  unsigned int nBatch;
+
+  msAcquireLock(TLOCK_OWS);
+  if (++gnCacheLastBatch == 0) /* 0 means no owner */
+    ++gnCacheLastBatch;
+  nBatch = gnCacheLastBatch;
+  msReleaseLock(TLOCK_OWS);
+
+  return nBatch;
+}
+
+/**********************************************************************
+ *                          msHTTPCacheRelease()
+ *
+ * Drops the entries still pending for a batch of requests, when it
+ * gives up before fetching them.
+ **********************************************************************/
+static void msHTTPCacheRelease(unsigned int owner) {
+  httpCacheEntryObj *psEntry, *psNext;
+
+  msAcquireLock(TLOCK_OWS);
+  for (psEntry = gpsCacheHead; psEntry; psEntry = psNext) {
+    psNext = psEntry->lru_next;
+    if (psEntry->owner == owner)
+      msHTTPCacheRemove(psEntry);
+  }
+  msReleaseLock(TLOCK_OWS);
+}
+
+/**********************************************************************
+ *                          msHTTPCacheWait()
+ *
+ * Waits until nDeadline for another batch to fetch the response to a
+ * request, after msHTTPCacheLookup() returned MS_HTTP_CACHE_PENDING.
+ * Returns MS_SUCCESS if the response was handed over to the request, or
+ * MS_FAILURE if the caller has to fetch it: the wait timed out, or the
+ * other batch failed or got a response that cannot be cached.
+ *
+ * Must not be called while the batch owns pending entries.
+ **********************************************************************/
+static int msHTTPCacheWait(httpRequestObj *psReq, const char *key,
+                           time_t nDeadline) {
+  const unsigned int hash = msHTTPCacheHash(key, 2166136261U);
+  httpCacheEntryObj *psEntry;
+
+  while (MS_TRUE) {
+    msAcquireLock(TLOCK_OWS);
+    psEntry = msHTTPCacheFind(key, hash);
+    if (psEntry && psEntry->owner == 0 && psEntry->expires > time(NULL))
+      return msHTTPCacheDeliverEntry(psReq, psEntry);
+    if (psEntry == NULL || psEntry->owner == 0 ||
+        psEntry->pending_until <= time(NULL)) {
+      /* Dropped, stale or abandoned */
+      msReleaseLock(TLOCK_OWS);
+      return MS_FAILURE;
+    }
+    msReleaseLock(TLOCK_OWS);
+
+    if (time(NULL) >= nDeadline)
+      return MS_FAILURE;
+    CPLSleep(0.02);
+  }
+}
+
+static void msHTTPCacheCleanup(void) {
+  while (gpsCacheHead)
+    msHTTPCacheRemove(gpsCacheHead);
+  gnCacheBytes = 0;
+}
+
 /**********************************************************************
  *                          msHTTPExecuteRequests()
  *
@@ -430,8 +1170,21 @@ int msHTTPAuthProxySetup(hashTableObj *mapmd, hashTableObj *lyrmd,
  * MS_FAILURE if a fatal error happened
  * MS_DONE if some requests failed with 40x status for instance (not fatal)
  **********************************************************************/
+static int msHTTPExecuteRequestsEx(httpRequestObj *pasReqInfo,
+                                   int numRequests, int bCheckLocalCache,
+                                   int bWaitPending);
+
 int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
                           int bCheckLocalCache) {
+  return msHTTPExecuteRequestsEx(pasReqInfo, numRequests, bCheckLocalCache,
+                                 MS_TRUE);
+}
+
+/* Same, bWaitPending telling whether requests whose response is being
+ * fetched by another batch may wait for it */
+static int msHTTPExecuteRequestsEx(httpRequestObj *pasReqInfo,
+                                   int numRequests, int bCheckLocalCache,
+                                   int bWaitPending) {
   int i, nStatus = MS_SUCCESS, nTimeout, still_running = 0, num_msgs = 0;
   CURLM *multi_handle;
   CURLMsg *curl_msg;
@@ -474,10 +1227,16 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
 
   const char *pszHttpVersion = CPLGetConfigOption("CURL_HTTP_VERSION", NULL);
 
-  /* Alloc a curl-multi handle, and add a curl-easy handle to it for each
+  const int bUseCache = msHTTPCacheMaxBytes() > 0 ||
+                        CPLGetConfigOption("MS_HTTP_CACHE_DIR", NULL) != NULL;
+  const unsigned int nCacheBatch = bUseCache ? msHTTPCacheNewBatch() : 0;
+  const time_t nCacheDeadline = time(NULL) + nTimeout;
+  int bCacheWaiting = MS_FALSE;
+
+  /* Get a curl-multi handle, and add a curl-easy handle to it for each
    * file to download.
    */
-  multi_handle = curl_multi_init();
+  multi_handle = msHTTPAcquireMultiHandle();
   if (multi_handle == NULL) {
     msSetError(MS_HTTPERR, "curl_multi_init() failed.",
                "msHTTPExecuteRequests()");
@@ -491,6 +1250,8 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
     if (pasReqInfo[i].pszGetUrl == NULL) {
       msSetError(MS_HTTPERR, "URL or output file parameter missing.",
                  "msHTTPExecuteRequests()");
+      if (bUseCache)
+        msHTTPCacheRelease(nCacheBatch);
       return (MS_FAILURE);
     }
 
@@ -504,6 +1265,8 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
     if (pasReqInfo[i].pszContentType)
       free(pasReqInfo[i].pszContentType);
     pasReqInfo[i].pszContentType = NULL;
+    pasReqInfo[i].nCacheMaxAge = -1;
+    pasReqInfo[i].bCacheForbidden = MS_FALSE;
 
     /* Check local cache if requested */
     if (bCheckLocalCache && pasReqInfo[i].pszOutputFile != NULL) {
@@ -520,11 +1283,39 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
       }
     }
 
+    /* Check the response cache */
+    msFree(pasReqInfo[i].pszCacheKey);
+    pasReqInfo[i].pszCacheKey = NULL;
+    if (bUseCache &&
+        (pasReqInfo[i].pszCacheKey = msHTTPCacheKey(&(pasReqInfo[i]))) !=
+            NULL) {
+      int nCacheStatus =
+          msHTTPCacheLookup(&(pasReqInfo[i]), pasReqInfo[i].pszCacheKey,
+                            nCacheBatch, nTimeout, bWaitPending);
+      if (nCacheStatus == MS_HTTP_CACHE_PENDING) {
+        /* Waited for once the fetches of this batch are over */
+        bCacheWaiting = MS_TRUE;
+        continue;
+      }
+      if (nCacheStatus != MS_DONE) {
+        msFree(pasReqInfo[i].pszCacheKey);
+        pasReqInfo[i].pszCacheKey = NULL;
+      }
+      if (nCacheStatus == MS_SUCCESS) {
+        if (pasReqInfo[i].debug)
+          msDebug("HTTP request: id=%d, found in response cache.\n",
+                  pasReqInfo[i].nLayerId);
+        continue;
+      }
+    }
+
     /* Alloc curl handle */
     http_handle = curl_easy_init();
     if (http_handle == NULL) {
       msSetError(MS_HTTPERR, "curl_easy_init() failed.",
                  "msHTTPExecuteRequests()");
+      if (bUseCache)
+        msHTTPCacheRelease(nCacheBatch);
       return (MS_FAILURE);
     }
 
@@ -548,6 +1339,25 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
     else if (pszHttpVersion && strcmp(pszHttpVersion, "1.1") == 0)
       unchecked_curl_easy_setopt(http_handle, CURLOPT_HTTP_VERSION,
                                  CURL_HTTP_VERSION_1_1);
+#if CURL_AT_LEAST_VERSION(7, 33, 0)
+    else if (pszHttpVersion && strcmp(pszHttpVersion, "2") == 0)
+      unchecked_curl_easy_setopt(http_handle, CURLOPT_HTTP_VERSION,
+                                 CURL_HTTP_VERSION_2_0);
+#endif
+#if CURL_AT_LEAST_VERSION(7, 47, 0)
+    else if (pszHttpVersion && strcmp(pszHttpVersion, "2TLS") == 0)
+      unchecked_curl_easy_setopt(http_handle, CURLOPT_HTTP_VERSION,
+                                 CURL_HTTP_VERSION_2TLS);
+#endif
+
+#if CURL_AT_LEAST_VERSION(7, 43, 0)
+    /* Rather wait for a connection that can be multiplexed than open a new
+     * one */
+    unchecked_curl_easy_setopt(http_handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+    if (ghCurlShare)
+      unchecked_curl_easy_setopt(http_handle, CURLOPT_SHARE, ghCurlShare);
 
     /* Set User-Agent (auto-generate if not set by caller */
     if (pasReqInfo[i].pszUserAgent == NULL) {
@@ -660,6 +1470,8 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
       if ((fp = fopen(pasReqInfo[i].pszOutputFile, "wb")) == NULL) {
         msSetError(MS_HTTPERR, "Can't open output file %s.",
                    "msHTTPExecuteRequests()", pasReqInfo[i].pszOutputFile);
+        if (bUseCache)
+          msHTTPCacheRelease(nCacheBatch);
         return (MS_FAILURE);
       }
 
@@ -672,6 +1484,14 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
     unchecked_curl_easy_setopt(http_handle, CURLOPT_WRITEFUNCTION,
                                msHTTPWriteFct);
 
+    /* Collect the freshness lifetime of responses that may be cached */
+    if (pasReqInfo[i].pszCacheKey != NULL) {
+      unchecked_curl_easy_setopt(http_handle, CURLOPT_HEADERDATA,
+                                 &(pasReqInfo[i]));
+      unchecked_curl_easy_setopt(http_handle, CURLOPT_HEADERFUNCTION,
+                                 msHTTPHeaderFct);
+    }
+
     /* Provide a buffer where libcurl can write human readable error msgs
      */
     if (pasReqInfo[i].pszErrBuf == NULL)
@@ -711,6 +1531,8 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
           msSetError(MS_HTTPERR,
                      "Can't use cookie containing a newline character.",
                      "msHTTPExecuteRequests()");
+          if (bUseCache)
+            msHTTPCacheRelease(nCacheBatch);
           return (MS_FAILURE);
         }
       }
@@ -822,6 +1644,8 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
 
     if (psReq->nStatus == 242)
       continue; /* Nothing to do here, this file was in cache already */
+    if (psReq->curl_handle == NULL)
+      continue; /* Served from, or waiting for, the response cache */
 
     if (psReq->fp)
       fclose(psReq->fp);
@@ -912,6 +1736,12 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
               dTotalTime - dStartTfrTime, dTotalTime);
     }
 
+    if (psReq->pszCacheKey != NULL) {
+      msHTTPCacheStore(psReq, nCacheBatch);
+      msFree(psReq->pszCacheKey);
+      psReq->pszCacheKey = NULL;
+    }
+
     /* Cleanup this handle */
     unchecked_curl_easy_setopt(http_handle, CURLOPT_URL, "");
     curl_multi_remove_handle(multi_handle, http_handle);
@@ -920,8 +1750,40 @@ int msHTTPExecuteRequests(httpRequestObj *pasReqInfo, int numRequests,
     curl_slist_free_all(psReq->curl_headers); // free the header list
   }
 
-  /* Cleanup multi handle, each handle had to be cleaned up individually */
-  curl_multi_cleanup(multi_handle);
+  /* Return the multi handle, and the connections it holds, to the pool.
+   * Each easy handle had to be cleaned up individually.
+   */
+  msHTTPReleaseMultiHandle(multi_handle);
+
+  /* Entries of requests that never completed */
+  if (bUseCache)
+    msHTTPCacheRelease(nCacheBatch);
+
+  /* Now that this batch owns no pending entry, wait for the responses
+   * fetched by other batches, and fetch those that don't come in time */
+  for (i = 0; bCacheWaiting && i < numRequests; i++) {
+    httpRequestObj *psReq = &(pasReqInfo[i]);
+    int nCacheStatus;
+
+    if (psReq->pszCacheKey == NULL)
+      continue;
+
+    nCacheStatus = msHTTPCacheWait(psReq, psReq->pszCacheKey, nCacheDeadline);
+    msFree(psReq->pszCacheKey);
+    psReq->pszCacheKey = NULL;
+
+    if (nCacheStatus == MS_SUCCESS) {
+      if (psReq->debug)
+        msDebug("HTTP request: id=%d, fetched by another request.\n",
+                psReq->nLayerId);
+    } else {
+      int nReqStatus =
+          msHTTPExecuteRequestsEx(psReq, 1, bCheckLocalCache, MS_FALSE);
+      if (nReqStatus == MS_FAILURE ||
+          (nReqStatus == MS_DONE && nStatus == MS_SUCCESS))
+        nStatus = nReqStatus;
+    }
+  }
 
   return nStatus;
 }
@@ -83,6 +83,10 @@ typedef struct http_request_info {
   int result_size;
   int result_buf_size;
 
+  char *pszCacheKey;   /* response cache key, set while fetching for cache */
+  int nCacheMaxAge;    /* freshness of the response in seconds, or -1 */
+  int bCacheForbidden; /* Cache-Control: no-store, no-cache or private */
+
 } httpRequestObj;
 
 #ifdef USE_CURL
@@ -27,7 +27,10 @@
  * DEALINGS IN THE SOFTWARE.
  ****************************************************************************/
 
+#include <float.h>
+#include <math.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #include "mapserver.h"
 #include "mapthread.h"
@@ -56,6 +59,11 @@ typedef struct msIOContextGroup_t {
 
 static msIOContextGroup default_contexts;
 static msIOContextGroup *io_context_list = NULL;
+
+/* Each thread caches its own group, valid until the next msIO_Cleanup(). */
+static volatile int io_context_generation = 0;
+static MS_THREAD_LOCAL msIOContextGroup *current_context_group = NULL;
+static MS_THREAD_LOCAL int current_context_generation = -1;
 static void msIO_Initialize(void);
 
 #ifdef msIO_printf
@@ -76,27 +84,37 @@ void msIO_Cleanup()
   if (is_msIO_initialized)
 
   {
+    msAcquireLock(TLOCK_IOCONTEXT);
     is_msIO_initialized = MS_FALSE;
+    io_context_generation++;
     while (io_context_list != NULL) {
       msIOContextGroup *last = io_context_list;
       io_context_list = io_context_list->next;
       free(last);
     }
+    msReleaseLock(TLOCK_IOCONTEXT);
   }
 }
 
 /************************************************************************/
 /*                        msIO_GetContextGroup()                        */
+/*                                                                      */
+/*      The group is looked up in the shared list, under lock, only    */
+/*      the first time a thread does I/O; afterwards it comes from     */
+/*      thread local storage.                                          */
 /************************************************************************/
 
 static msIOContextGroup *msIO_GetContextGroup()
 
 {
-  void *nThreadId = msGetThreadId();
-  msIOContextGroup *prev = NULL, *group = io_context_list;
+  void *nThreadId;
+  msIOContextGroup *group;
+
+  if (current_context_group != NULL &&
+      current_context_generation == io_context_generation)
+    return current_context_group;
 
-  if (group != NULL && group->thread_id == nThreadId)
-    return group;
+  nThreadId = msGetThreadId();
 
   /* -------------------------------------------------------------------- */
   /*      Search for group for this thread                                */
@@ -105,38 +123,26 @@ static msIOContextGroup *msIO_GetContextGroup()
   msIO_Initialize();
 
   group = io_context_list;
-  while (group != NULL && group->thread_id != nThreadId) {
-    prev = group;
+  while (group != NULL && group->thread_id != nThreadId)
     group = group->next;
-  }
-
-  /* -------------------------------------------------------------------- */
-  /*      If we found it, make sure it is pushed to the front of the      */
-  /*      link for faster finding next time, and return it.               */
-  /* -------------------------------------------------------------------- */
-  if (group != NULL) {
-    if (prev != NULL) {
-      prev->next = group->next;
-      group->next = io_context_list;
-      io_context_list = group;
-    }
-
-    msReleaseLock(TLOCK_IOCONTEXT);
-    return group;
-  }
 
   /* -------------------------------------------------------------------- */
   /*      Create a new context group for this thread.                     */
   /* -------------------------------------------------------------------- */
-  group = (msIOContextGroup *)calloc(sizeof(msIOContextGroup), 1);
+  if (group == NULL) {
+    group = (msIOContextGroup *)calloc(sizeof(msIOContextGroup), 1);
 
-  group->stdin_context = default_contexts.stdin_context;
-  group->stdout_context = default_contexts.stdout_context;
-  group->stderr_context = default_contexts.stderr_context;
-  group->thread_id = nThreadId;
+    group->stdin_context = default_contexts.stdin_context;
+    group->stdout_context = default_contexts.stdout_context;
+    group->stderr_context = default_contexts.stderr_context;
+    group->thread_id = nThreadId;
+
+    group->next = io_context_list;
+    io_context_list = group;
+  }
 
-  group->next = io_context_list;
-  io_context_list = group;
+  current_context_group = group;
+  current_context_generation = io_context_generation;
 
   msReleaseLock(TLOCK_IOCONTEXT);
 
@@ -145,13 +151,9 @@ static msIOContextGroup *msIO_GetContextGroup()
 
 /* returns MS_TRUE if the msIO standard output hasn't been redirected */
 int msIO_isStdContext() {
-  msIOContextGroup *group = io_context_list;
-  void *nThreadId = msGetThreadId();
-  if (!group || group->thread_id != nThreadId) {
-    group = msIO_GetContextGroup();
-    if (!group) {
-      return MS_FALSE; /* probably a bug */
-    }
+  msIOContextGroup *group = msIO_GetContextGroup();
+  if (!group) {
+    return MS_FALSE; /* probably a bug */
   }
   if (group->stderr_context.cbData == (void *)stderr &&
       group->stdin_context.cbData == (void *)stdin &&
@@ -167,16 +169,10 @@ int msIO_isStdContext() {
 msIOContext *msIO_getHandler(FILE *fp)
 
 {
-  void *nThreadId = msGetThreadId();
-  msIOContextGroup *group = io_context_list;
-
-  msIO_Initialize();
+  msIOContextGroup *group = msIO_GetContextGroup();
 
-  if (group == NULL || group->thread_id != nThreadId) {
-    group = msIO_GetContextGroup();
-    if (group == NULL)
-      return NULL;
-  }
+  if (group == NULL)
+    return NULL;
 
   if (fp == stdin || fp == NULL || strcmp((const char *)fp, "stdin") == 0)
     return &(group->stdin_context);
@@ -1064,3 +1060,271 @@ int msIO_bufferRead(void *cbData, void *data, int byteCount)
   /* not implemented yet. */
   return 0;
 }
+
+/* ==================================================================== */
+/* ==================================================================== */
+/*      Buffered writer.                                                */
+/* ==================================================================== */
+/* ==================================================================== */
+
+#define MS_IO_WRITER_BUFSIZE 65536
+
+/************************************************************************/
+/*                          msIO_writerInit()                           */
+/************************************************************************/
+
+void msIO_writerInit(msIOWriter *writer, FILE *stream)
+
+{
+  writer->stream = stream;
+  writer->data = NULL;
+  writer->data_len = 0;
+  writer->data_offset = 0;
+}
+
+/************************************************************************/
+/*                          msIO_writerFlush()                          */
+/*                                                                      */
+/*      Hands the buffered output to the stream, in one write.          */
+/************************************************************************/
+
+int msIO_writerFlush(msIOWriter *writer)
+
+{
+  int ret = 0;
+
+  if (writer->data_offset > 0) {
+    ret = msIO_fwrite(writer->data, 1, writer->data_offset, writer->stream);
+    writer->data_offset = 0;
+  }
+
+  return ret;
+}
+
+/************************************************************************/
+/*                          msIO_writerClose()                          */
+/************************************************************************/
+
+int msIO_writerClose(msIOWriter *writer)
+
+{
+  int ret = msIO_writerFlush(writer);
+
+  msFree(writer->data);
+  writer->data = NULL;
+  writer->data_len = 0;
+
+  return ret;
+}
+
+/************************************************************************/
+/*                         msIO_writerReserve()                         */
+/*                                                                      */
+/*      Makes room for byteCount more bytes in the buffer, flushing     */
+/*      it first if needed. Returns a pointer to the free space.        */
+/************************************************************************/
+
+static char *msIO_writerReserve(msIOWriter *writer, int byteCount)
+
+{
+  if (writer->data_offset + byteCount > writer->data_len) {
+    msIO_writerFlush(writer);
+    if (byteCount > writer->data_len) {
+      writer->data_len = MS_MAX(byteCount, MS_IO_WRITER_BUFSIZE);
+      msFree(writer->data);
+      writer->data = (char *)msSmallMalloc(writer->data_len);
+    }
+  }
+
+  return writer->data + writer->data_offset;
+}
+
+/************************************************************************/
+/*                          msIO_writerWrite()                          */
+/************************************************************************/
+
+void msIO_writerWrite(msIOWriter *writer, const void *data, int byteCount)
+
+{
+  if (byteCount <= 0)
+    return;
+
+  memcpy(msIO_writerReserve(writer, byteCount), data, byteCount);
+  writer->data_offset += byteCount;
+}
+
+/************************************************************************/
+/*                          msIO_writerPuts()                           */
+/************************************************************************/
+
+void msIO_writerPuts(msIOWriter *writer, const char *string)
+
+{
+  if (string)
+    msIO_writerWrite(writer, string, strlen(string));
+}
+
+/************************************************************************/
+/*                         msIO_writerPrintf()                          */
+/*                                                                      */
+/*      Formats straight into the buffer, which is grown rather than    */
+/*      going through a temporary allocation for long results.          */
+/************************************************************************/
+
+int msIO_writerPrintf(msIOWriter *writer, const char *format, ...)
+
+{
+  va_list args;
+  int ret;
+
+  msIO_writerReserve(writer, 1);
+
+  va_start(args, format);
+  ret = vsnprintf(writer->data + writer->data_offset,
+                  writer->data_len - writer->data_offset, format, args);
+  va_end(args);
+
+  if (ret < 0)
+    return -1;
+
+  if (ret >= writer->data_len - writer->data_offset) {
+    char *dst = msIO_writerReserve(writer, ret + 1);
+    va_start(args, format);
+    ret = vsnprintf(dst, ret + 1, format, args);
+    va_end(args);
+    if (ret < 0)
+      return -1;
+  }
+
+  writer->data_offset += ret;
+
+  return ret;
+}
+
+/************************************************************************/
+/*                         msIO_writerDouble()                          */
+/*                                                                      */
+/*      Writes value exactly as printf("%.*f", precision, value)        */
+/*      would. Values whose scaled magnitude fits in 53 bits are        */
+/*      rounded with integer arithmetic, unless they are so close to    */
+/*      a rounding tie that the scaling error could matter, in which    */
+/*      case, as for very large values, printf is used.                 */
+/************************************************************************/
+
+void msIO_writerDouble(msIOWriter *writer, double value, int precision)
+
+{
+  static const double powers[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,
+                                  1e6, 1e7, 1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15};
+  static const uint64_t ipowers[] = {1ULL,
+                                     10ULL,
+                                     100ULL,
+                                     1000ULL,
+                                     10000ULL,
+                                     100000ULL,
+                                     1000000ULL,
+                                     10000000ULL,
+                                     100000000ULL,
+                                     1000000000ULL,
+                                     10000000000ULL,
+                                     100000000000ULL,
+                                     1000000000000ULL,
+                                     10000000000000ULL,
+                                     100000000000000ULL,
+                                     1000000000000000ULL};
+  double scaled, whole, fraction;
+  uint64_t n, intpart, fracpart;
+  char digits[24];
+  char *dst;
+  int i, len;
+
+  if (precision < 0 || precision > 15 || !isfinite(value)) {
+    msIO_writerPrintf(writer, "%.*f", precision, value);
+    return;
+  }
+
+  scaled = fabs(value) * powers[precision];
+  if (!(scaled < 4503599627370496.0)) { /* 2^52 */
+    msIO_writerPrintf(writer, "%.*f", precision, value);
+    return;
+  }
+
+  whole = floor(scaled);
+  fraction = scaled - whole;
+  if (fabs(fraction - 0.5) <= scaled * (2 * DBL_EPSILON)) {
+    msIO_writerPrintf(writer, "%.*f", precision, value);
+    return;
+  }
+
+  n = (uint64_t)whole + (fraction > 0.5 ? 1 : 0);
+  intpart = n / ipowers[precision];
+  fracpart = n % ipowers[precision];
+
+  /* sign, integer digits, decimal point and fraction digits */
+  dst = msIO_writerReserve(writer, 1 + 20 + 1 + precision);
+  len = 0;
+  if (signbit(value))
+    dst[len++] = '-';
+
+  i = sizeof(digits);
+  do {
+    digits[--i] = (char)('0' + intpart % 10);
+    intpart /= 10;
+  } while (intpart > 0);
+  memcpy(dst + len, digits + i, sizeof(digits) - i);
+  len += sizeof(digits) - i;
+
+  if (precision > 0) {
+    dst[len++] = '.';
+    for (i = precision - 1; i >= 0; i--) {
+      dst[len + i] = (char)('0' + fracpart % 10);
+      fracpart /= 10;
+    }
+    len += precision;
+  }
+
+  writer->data_offset += len;
+}
+
+/************************************************************************/
+/*                        msIO_writerXMLEncode()                        */
+/*                                                                      */
+/*      Writes string with the same entities as msEncodeHTMLEntities(), */
+/*      without building the encoded copy first.                        */
+/************************************************************************/
+
+void msIO_writerXMLEncode(msIOWriter *writer, const char *string)
+
+{
+  if (string == NULL)
+    return;
+
+  while (*string != '\0') {
+    const size_t run = strcspn(string, "&<>\"'");
+
+    msIO_writerWrite(writer, string, run);
+    string += run;
+
+    switch (*string) {
+    case '&':
+      msIO_writerWrite(writer, "&amp;", 5);
+      break;
+    case '<':
+      msIO_writerWrite(writer, "&lt;", 4);
+      break;
+    case '>':
+      msIO_writerWrite(writer, "&gt;", 4);
+      break;
+    case '"':
+      msIO_writerWrite(writer, "&quot;", 6);
+      break;
+    case '\'':
+      msIO_writerWrite(writer, "&#39;", 5);
+      break;
+    default: /* end of string */
+      return;
+    }
+    string++;
+  }
+}
@@ -104,6 +104,31 @@ typedef struct {
   int data_offset; /* really buffer used */
 } msIOBuffer;
 
+/*
+** Buffered writer for producing large documents on a msIO stream: output
+** is accumulated in memory and handed to the stream in large chunks.
+*/
+
+typedef struct {
+  FILE *stream;
+  char *data;
+  int data_len;    /* buffer length */
+  int data_offset; /* buffer used */
+} msIOWriter;
+
+void MS_DLL_EXPORT msIO_writerInit(msIOWriter *writer, FILE *stream);
+int MS_DLL_EXPORT msIO_writerFlush(msIOWriter *writer);
+int MS_DLL_EXPORT msIO_writerClose(msIOWriter *writer);
+void MS_DLL_EXPORT msIO_writerWrite(msIOWriter *writer, const void *data,
+                                    int byteCount);
+void MS_DLL_EXPORT msIO_writerPuts(msIOWriter *writer, const char *string);
+int MS_DLL_EXPORT msIO_writerPrintf(msIOWriter *writer, const char *format,
+                                    ...) MS_PRINT_FUNC_FORMAT(2, 3);
+void MS_DLL_EXPORT msIO_writerDouble(msIOWriter *writer, double value,
+                                     int precision);
+void MS_DLL_EXPORT msIO_writerXMLEncode(msIOWriter *writer,
+                                        const char *string);
+
 int MS_DLL_EXPORT msIO_bufferRead(void *, void *, int);
 int MS_DLL_EXPORT msIO_bufferWrite(void *, void *, int);
 
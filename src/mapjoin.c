@@ -28,6 +28,10 @@
  ****************************************************************************/
 
 #include "mapserver.h"
+#include "mapthread.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #define ROW_ALLOCATION_SIZE 10
 
@@ -149,6 +153,183 @@ int msJoinClose(joinObj *join) {
   return MS_FAILURE;
 }
 
+/*  */
+/* Join table index, maps the values of the "to" column of a DBF or CSV */
+/* table to the matching records. Indexes are shared by all the joins on */
+/* the same table and column, until the table is modified. */
+/*  */
+typedef struct joinIndexObj {
+  char *path;
+  int column;
+  time_t mtime;
+  long long size;
+  int refcount;
+  int stale; /* no longer in the list, freed on its last release */
+
+  int numrecords;
+  char **keys;
+  int numbuckets;
+  int *buckets; /* first record of each bucket, -1 if empty */
+  int *next;    /* next record in the same bucket, in file order, or -1 */
+
+  struct joinIndexObj *nextindex;
+} joinIndexObj;
+
+static joinIndexObj *joinIndexes = NULL;
+
+static unsigned int msJoinIndexHash(const char *key) {
+  unsigned int hash = 2166136261U; /* FNV-1a */
+  for (; *key; key++)
+    hash = (hash ^ (unsigned char)*key) * 16777619U;
+  return hash;
+}
+
+static void msJoinIndexFree(joinIndexObj *index) {
+  msFree(index->path);
+  msFreeCharArray(index->keys, index->numrecords);
+  msFree(index->buckets);
+  msFree(index->next);
+  msFree(index);
+}
+
+/*
+** Build the index of the given keys (one per record, taken over by the index)
+** of a table.
+*/
+static joinIndexObj *msJoinIndexCreate(const char *path, int column,
+                                       const struct stat *stat_buf,
+                                       char **keys, int numrecords) {
+  int i, *tails;
+  joinIndexObj *index = (joinIndexObj *)msSmallCalloc(1, sizeof(joinIndexObj));
+
+  index->path = msStrdup(path);
+  index->column = column;
+  index->mtime = stat_buf->st_mtime;
+  index->size = stat_buf->st_size;
+  index->numrecords = numrecords;
+  index->keys = keys;
+  index->numbuckets = MS_MAX(numrecords, 1);
+  index->buckets = (int *)msSmallMalloc(index->numbuckets * sizeof(int));
+  index->next = (int *)msSmallMalloc(index->numbuckets * sizeof(int));
+  tails = (int *)msSmallMalloc(index->numbuckets * sizeof(int));
+
+  for (i = 0; i < index->numbuckets; i++)
+    index->buckets[i] = tails[i] = -1;
+
+  /* records are appended to their bucket to keep them in file order */
+  for (i = 0; i < numrecords; i++) {
+    int bucket = msJoinIndexHash(keys[i]) % index->numbuckets;
+    index->next[i] = -1;
+    if (tails[bucket] < 0)
+      index->buckets[bucket] = i;
+    else
+      index->next[tails[bucket]] = i;
+    tails[bucket] = i;
+  }
+  free(tails);
+
+  return index;
+}
+
+/*
+** Returns the first record matching key after record (or from the start of
+** the table if record is -1), or -1 if there is none.
+*/
+static int msJoinIndexLookup(const joinIndexObj *index, const char *key,
+                             int record) {
+  if (record < 0)
+    record = index->buckets[msJoinIndexHash(key) % index->numbuckets];
+  else
+    record = index->next[record];
+
+  while (record >= 0 && strcmp(index->keys[record], key) != 0)
+    record = index->next[record];
+
+  return record;
+}
+
+/*
+** Get a reference on the index of a table column if it has already been built
+** and the table hasn't changed since, NULL otherwise.
+*/
+static joinIndexObj *msJoinIndexAcquire(const char *path, int column,
+                                        const struct stat *stat_buf) {
+  joinIndexObj **link, *index = NULL;
+
+  msAcquireLock(TLOCK_JOIN);
+  for (link = &joinIndexes; *link; link = &((*link)->nextindex)) {
+    if ((*link)->column == column && strcmp((*link)->path, path) == 0)
+      break;
+  }
+  if (*link) {
+    index = *link;
+    if (index->mtime == stat_buf->st_mtime && index->size == stat_buf->st_size)
+      index->refcount++;
+    else { /* the table has been modified */
+      *link = index->nextindex;
+      if (index->refcount == 0)
+        msJoinIndexFree(index);
+      else
+        index->stale = MS_TRUE;
+      index = NULL;
+    }
+  }
+  msReleaseLock(TLOCK_JOIN);
+
+  return index;
+}
+
+/*
+** Make a newly built index available to other joins, and return the index to
+** use (which may have been registered meanwhile by another thread).
+*/
+static joinIndexObj *msJoinIndexRegister(joinIndexObj *index) {
+  joinIndexObj *other;
+
+  msAcquireLock(TLOCK_JOIN);
+  for (other = joinIndexes; other; other = other->nextindex) {
+    if (other->column == index->column &&
+        strcmp(other->path, index->path) == 0 &&
+        other->mtime == index->mtime && other->size == index->size)
+      break;
+  }
+  if (other) {
+    msJoinIndexFree(index);
+    index = other;
+  } else {
+    index->nextindex = joinIndexes;
+    joinIndexes = index;
+  }
+  index->refcount++;
+  msReleaseLock(TLOCK_JOIN);
+
+  return index;
+}
+
+static void msJoinIndexRelease(joinIndexObj *index) {
+  msAcquireLock(TLOCK_JOIN);
+  index->refcount--;
+  if (index->stale && index->refcount == 0)
+    msJoinIndexFree(index);
+  msReleaseLock(TLOCK_JOIN);
+}
+
+/*
+** Free the join indexes, called by msCleanup().
+*/
+void msJoinCleanup(void) {
+  msAcquireLock(TLOCK_JOIN);
+  while (joinIndexes) {
+    joinIndexObj *index = joinIndexes;
+    joinIndexes = index->nextindex;
+    if (index->refcount == 0)
+      msJoinIndexFree(index);
+    else
+      index->stale = MS_TRUE;
+  }
+  msReleaseLock(TLOCK_JOIN);
+}
+
 /*  */
 /* XBASE join functions */
 /*  */
@@ -156,12 +337,14 @@ typedef struct {
   DBFHandle hDBF;
   int fromindex, toindex;
   char *target;
-  int nextrecord;
+  int lastrecord; /* last record joined to target, -1 if none yet */
+  joinIndexObj *index;
 } msDBFJoinInfo;
 
 int msDBFJoinConnect(layerObj *layer, joinObj *join) {
   int i;
   char szPath[MS_MAXPATHLEN];
+  struct stat stat_buf;
   msDBFJoinInfo *joininfo;
 
   if (join->joininfo)
@@ -180,7 +363,8 @@ int msDBFJoinConnect(layerObj *layer, joinObj *join) {
 
   /* initialize any members that won't get set later on in this function */
   joininfo->target = NULL;
-  joininfo->nextrecord = 0;
+  joininfo->lastrecord = -1;
+  joininfo->index = NULL;
 
   join->joininfo = joininfo;
 
@@ -218,12 +402,27 @@ int msDBFJoinConnect(layerObj *layer, joinObj *join) {
     return (MS_FAILURE);
   }
 
-  /* finally store away the item names in the XBase table */
+  /* store away the item names in the XBase table */
   join->numitems = msDBFGetFieldCount(joininfo->hDBF);
   join->items = msDBFGetItems(joininfo->hDBF);
   if (!join->items)
     return (MS_FAILURE);
 
+  /* finally index the "to" item, unless it already is */
+  if (stat(szPath, &stat_buf) != 0)
+    memset(&stat_buf, 0, sizeof(stat_buf));
+  joininfo->index = msJoinIndexAcquire(szPath, joininfo->toindex, &stat_buf);
+  if (!joininfo->index) {
+    int n = msDBFGetRecordCount(joininfo->hDBF);
+    char **keys = (char **)msSmallMalloc(MS_MAX(n, 1) * sizeof(char *));
+
+    for (i = 0; i < n; i++)
+      keys[i] = msStrdup(
+          msDBFReadStringAttribute(joininfo->hDBF, i, joininfo->toindex));
+    joininfo->index = msJoinIndexRegister(
+        msJoinIndexCreate(szPath, joininfo->toindex, &stat_buf, keys, n));
+  }
+
   return (MS_SUCCESS);
 }
 
@@ -248,7 +447,7 @@ int msDBFJoinPrepare(joinObj *join, shapeObj *shape) {
     return (MS_FAILURE);
   }
 
-  joininfo->nextrecord = 0; /* starting with the first record */
+  joininfo->lastrecord = -1; /* starting with the first record */
 
   if (joininfo->target)
     free(joininfo->target); /* clear last target */
@@ -258,7 +457,7 @@ int msDBFJoinPrepare(joinObj *join, shapeObj *shape) {
 }
 
 int msDBFJoinNext(joinObj *join) {
-  int i, n;
+  int i;
   msDBFJoinInfo *joininfo = join->joininfo;
 
   if (!joininfo) {
@@ -279,16 +478,11 @@ int msDBFJoinNext(joinObj *join) {
     join->values = NULL;
   }
 
-  n = msDBFGetRecordCount(joininfo->hDBF);
+  /* find a match */
+  i = msJoinIndexLookup(joininfo->index, joininfo->target,
+                        joininfo->lastrecord);
 
-  for (i = joininfo->nextrecord; i < n; i++) { /* find a match */
-    if (strcmp(joininfo->target, msDBFReadStringAttribute(joininfo->hDBF, i,
-                                                          joininfo->toindex)) ==
-        0)
-      break;
-  }
-
-  if (i == n) { /* unable to do the join */
+  if (i < 0) { /* unable to do the join */
     if ((join->values = (char **)malloc(sizeof(char *) * join->numitems)) ==
         NULL) {
       msSetError(MS_MEMERR, NULL, "msDBFJoinNext()");
@@ -297,15 +491,14 @@ int msDBFJoinNext(joinObj *join) {
     for (i = 0; i < join->numitems; i++)
       join->values[i] = msStrdup("\0"); /* initialize to zero length strings */
 
-    joininfo->nextrecord = n;
     return (MS_DONE);
   }
 
   if ((join->values = msDBFGetValues(joininfo->hDBF, i)) == NULL)
     return (MS_FAILURE);
 
-  joininfo->nextrecord =
-      i + 1; /* so we know where to start looking next time through */
+  joininfo->lastrecord =
+      i; /* so we know where to start looking next time through */
 
   return (MS_SUCCESS);
 }
@@ -318,6 +511,8 @@ int msDBFJoinClose(joinObj *join) {
 
   if (joininfo->hDBF)
     msDBFClose(joininfo->hDBF);
+  if (joininfo->index)
+    msJoinIndexRelease(joininfo->index);
   if (joininfo->target)
     free(joininfo->target);
   free(joininfo);
@@ -334,13 +529,15 @@ typedef struct {
   char *target;
   char ***rows;
   int numrows;
-  int nextrow;
+  int lastrow; /* last row joined to target, -1 if none yet */
+  joinIndexObj *index;
 } msCSVJoinInfo;
 
 int msCSVJoinConnect(layerObj *layer, joinObj *join) {
   int i;
   FILE *stream;
   char szPath[MS_MAXPATHLEN];
+  struct stat stat_buf;
   msCSVJoinInfo *joininfo;
   char buffer[MS_BUFFER_LENGTH];
 
@@ -358,7 +555,8 @@ int msCSVJoinConnect(layerObj *layer, joinObj *join) {
 
   /* initialize any members that won't get set later on in this function */
   joininfo->target = NULL;
-  joininfo->nextrow = 0;
+  joininfo->lastrow = -1;
+  joininfo->index = NULL;
 
   join->joininfo = joininfo;
 
@@ -412,7 +610,7 @@ int msCSVJoinConnect(layerObj *layer, joinObj *join) {
 
   /* get "to" index (for now the user tells us which column, 1..n) */
   joininfo->toindex = atoi(join->to) - 1;
-  if (joininfo->toindex < 0 || joininfo->toindex > join->numitems) {
+  if (joininfo->toindex < 0 || joininfo->toindex >= join->numitems) {
     msSetError(MS_JOINERR, "Invalid column index %s.", "msCSVJoinConnect()",
                join->to);
     return (MS_FAILURE);
@@ -430,6 +628,20 @@ int msCSVJoinConnect(layerObj *layer, joinObj *join) {
     sprintf(join->items[i], "%d", i + 1);
   }
 
+  /* finally index the "to" column, unless it already is */
+  if (stat(szPath, &stat_buf) != 0)
+    memset(&stat_buf, 0, sizeof(stat_buf));
+  joininfo->index = msJoinIndexAcquire(szPath, joininfo->toindex, &stat_buf);
+  if (!joininfo->index) {
+    char **keys =
+        (char **)msSmallMalloc(MS_MAX(joininfo->numrows, 1) * sizeof(char *));
+
+    for (i = 0; i < joininfo->numrows; i++)
+      keys[i] = msStrdup(joininfo->rows[i][joininfo->toindex]);
+    joininfo->index = msJoinIndexRegister(msJoinIndexCreate(
+        szPath, joininfo->toindex, &stat_buf, keys, joininfo->numrows));
+  }
+
   return (MS_SUCCESS);
 }
 
@@ -454,7 +666,7 @@ int msCSVJoinPrepare(joinObj *join, shapeObj *shape) {
     return (MS_FAILURE);
   }
 
-  joininfo->nextrow = 0; /* starting with the first record */
+  joininfo->lastrow = -1; /* starting with the first record */
 
   if (joininfo->target)
     free(joininfo->target); /* clear last target */
@@ -479,10 +691,8 @@ int msCSVJoinNext(joinObj *join) {
     join->values = NULL;
   }
 
-  for (i = joininfo->nextrow; i < joininfo->numrows; i++) { /* find a match */
-    if (strcmp(joininfo->target, joininfo->rows[i][joininfo->toindex]) == 0)
-      break;
-  }
+  /* find a match */
+  i = msJoinIndexLookup(joininfo->index, joininfo->target, joininfo->lastrow);
 
   if ((join->values = (char **)malloc(sizeof(char *) * join->numitems)) ==
       NULL) {
@@ -490,19 +700,18 @@ int msCSVJoinNext(joinObj *join) {
     return (MS_FAILURE);
   }
 
-  if (i == joininfo->numrows) { /* unable to do the join     */
+  if (i < 0) { /* unable to do the join     */
     for (j = 0; j < join->numitems; j++)
       join->values[j] = msStrdup("\0"); /* initialize to zero length strings */
 
-    joininfo->nextrow = joininfo->numrows;
     return (MS_DONE);
   }
 
   for (j = 0; j < join->numitems; j++)
     join->values[j] = msStrdup(joininfo->rows[i][j]);
 
-  joininfo->nextrow =
-      i + 1; /* so we know where to start looking next time through */
+  joininfo->lastrow =
+      i; /* so we know where to start looking next time through */
 
   return (MS_SUCCESS);
 }
@@ -517,6 +726,8 @@ int msCSVJoinClose(joinObj *join) {
   for (i = 0; i < joininfo->numrows; i++)
     msFreeCharArray(joininfo->rows[i], join->numitems);
   free(joininfo->rows);
+  if (joininfo->index)
+    msJoinIndexRelease(joininfo->index);
   if (joininfo->target)
     free(joininfo->target);
   free(joininfo);
@@ -338,6 +338,31 @@ int msLayerWhichShapes(layerObj *layer, rectObj rect, int isQuery) {
   return layer->vtable->LayerWhichShapes(layer, rect, isQuery);
 }
 
+/*
+** Apply the MapServer side filter to a shape freshly read from the data
+** source. Shapes that do not pass the filter are freed.
+*/
+static int msLayerFilterShape(layerObj *layer, shapeObj *shape,
+                              int *filter_passed) {
+  int rv;
+
+  /* attributes need to be iconv'd to UTF-8 before any filter logic is applied
+   */
+  if (layer->encoding) {
+    rv = msLayerEncodeShapeAttributes(layer, shape);
+    if (rv != MS_SUCCESS)
+      return rv;
+  }
+
+  *filter_passed =
+      msEvalExpression(layer, shape, &(layer->filter), layer->filteritemindex);
+
+  if (!*filter_passed)
+    msFreeShape(shape);
+
+  return MS_SUCCESS;
+}
+
 /*
 ** Called after msWhichShapes has been called to actually retrieve shapes within
 *a given area
@@ -377,19 +402,9 @@ int msLayerNextShape(layerObj *layer, shapeObj *shape) {
     if (rv != MS_SUCCESS)
       return rv;
 
-    /* attributes need to be iconv'd to UTF-8 before any filter logic is applied
-     */
-    if (layer->encoding) {
-      rv = msLayerEncodeShapeAttributes(layer, shape);
-      if (rv != MS_SUCCESS)
-        return rv;
-    }
-
-    filter_passed = msEvalExpression(layer, shape, &(layer->filter),
-                                     layer->filteritemindex);
-
-    if (!filter_passed)
-      msFreeShape(shape);
+    rv = msLayerFilterShape(layer, shape, &filter_passed);
+    if (rv != MS_SUCCESS)
+      return rv;
   } while (!filter_passed);
 
   /* RFC89 Apply Layer GeomTransform */
@@ -402,6 +417,70 @@ int msLayerNextShape(layerObj *layer, shapeObj *shape) {
   return rv;
 }
 
+/*
+** Batch version of msLayerNextShape(): appends up to maxshapes shapes, with
+** the same filtering and geomtransform applied, to the batch. Returns
+** MS_SUCCESS if at least one shape was added and MS_DONE once the layer is
+** exhausted. The shapes are released in one go with msClearShapeBatch().
+*/
+int msLayerNextShapes(layerObj *layer, shapeBatchObj *batch, int maxshapes) {
+  int rv, first = batch->numshapes;
+
+  if (!layer->vtable) {
+    rv = msInitializeVirtualTable(layer);
+    if (rv != MS_SUCCESS)
+      return rv;
+  }
+  cppcheck_assert(layer->vtable);
+
+#ifdef USE_V8_MAPSCRIPT
+  /* we need to force the GetItems for the geomtransform attributes */
+  if (!layer->items &&
+      layer->_geomtransform.type == MS_GEOMTRANSFORM_EXPRESSION &&
+      strstr(layer->_geomtransform.string, "javascript"))
+    msLayerGetItems(layer);
+#endif
+
+  /* RFC 91: MapServer-based filtering is done at a more general level. */
+  while (batch->numshapes == first) {
+    int i, numshapes;
+
+    rv = layer->vtable->LayerNextShapes(layer, batch, maxshapes);
+    if (rv != MS_SUCCESS)
+      return rv;
+
+    /* filter the new shapes, compacting the batch as we go */
+    numshapes = first;
+    for (i = first; i < batch->numshapes; i++) {
+      shapeObj *shape = &(batch->shapes[i]);
+      int filter_passed;
+
+      rv = msLayerFilterShape(layer, shape, &filter_passed);
+      if (rv != MS_SUCCESS)
+        return rv;
+      if (!filter_passed)
+        continue;
+
+      /* RFC89 Apply Layer GeomTransform */
+      if (layer->_geomtransform.type != MS_GEOMTRANSFORM_NONE) {
+        rv = msGeomTransformShape(layer->map, layer, shape);
+        if (rv != MS_SUCCESS)
+          return rv;
+      }
+
+      if (i != numshapes) {
+        shapeObj tmp = batch->shapes[numshapes];
+        batch->shapes[numshapes] = *shape;
+        *shape = tmp;
+      }
+      numshapes++;
+    }
+    batch->numshapes = numshapes;
+  }
+
+  return MS_SUCCESS;
+}
+
 /*
 ** Used to retrieve a shape from a result set by index. Result sets are created
 *by the various
@@ -484,6 +563,22 @@ int msLayerGetShapeCount(layerObj *layer, rectObj rect,
   return layer->vtable->LayerGetShapeCount(layer, rect, rectProjection);
 }
 
+/*
+** Returns the value of the COUNT_ESTIMATE_THRESHOLD processing option, or -1
+* if it is not set.
+* When it is set, LayerGetShapeCount() implementations that can cheaply
+* estimate the number of matching shapes (from a spatial index or a query
+* planner) may return that estimate instead of an exact count if it is at
+* least this threshold. Set it to 0 to always use the estimate.
+*/
+int msLayerGetCountEstimateThreshold(const layerObj *layer) {
+  const char *value =
+      msLayerGetProcessingKey(layer, "COUNT_ESTIMATE_THRESHOLD");
+  if (value == NULL)
+    return -1;
+  return MS_MAX(0, atoi(value));
+}
+
 /*
 ** Closes resources used by a particular layer.
 */
@@ -838,6 +933,11 @@ int msTokenizeExpression(expressionObj *expression, char **list,
         goto parse_error;
       }
 
+#ifdef USE_GEOS
+      /* the shape is typically compared to every feature, prepare it once */
+      msGEOSPrepareGeometry(node->tokenval.shpval);
+#endif
+
       /* todo: perhaps process optional args (e.g. projection) */
 
       if ((token = msyylex()) != 41) { /* ) */
@@ -1875,6 +1975,32 @@ int LayerDefaultNextShape(layerObj *layer, shapeObj *shape) {
   return MS_FAILURE;
 }
 
+/*
+** Fill a batch by calling the layer's NextShape until maxshapes shapes have
+** been added. Used by the data sources without a batch reader of their own.
+*/
+int LayerDefaultNextShapes(layerObj *layer, shapeBatchObj *batch,
+                           int maxshapes) {
+  int rv = MS_SUCCESS, first = batch->numshapes;
+
+  while (batch->numshapes - first < maxshapes) {
+    shapeObj *shape = msShapeBatchAdd(batch);
+
+    msFreeShape(shape); /* drop any recycled storage */
+    rv = layer->vtable->LayerNextShape(layer, shape);
+    if (rv != MS_SUCCESS) {
+      msFreeShape(shape);
+      batch->numshapes--;
+      break;
+    }
+  }
+
+  if (rv == MS_FAILURE)
+    return MS_FAILURE;
+
+  return (batch->numshapes > first) ? MS_SUCCESS : MS_DONE;
+}
+
 int LayerDefaultGetShape(layerObj *layer, shapeObj *shape, resultObj *record) {
   (void)layer;
   (void)shape;
@@ -2316,6 +2442,7 @@ static int populateVirtualTable(layerVTableObj *vtable) {
   vtable->LayerWhichShapes = LayerDefaultWhichShapes;
 
   vtable->LayerNextShape = LayerDefaultNextShape;
+  vtable->LayerNextShapes = LayerDefaultNextShapes;
   /* vtable->LayerResultsGetShape = LayerDefaultResultsGetShape; */
   vtable->LayerGetShape = LayerDefaultGetShape;
   vtable->LayerGetShapeCount = LayerDefaultGetShapeCount;
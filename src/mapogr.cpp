@@ -89,6 +89,7 @@ static int msOGRLayerInitItemInfo(layerObj *layer);
 static int msOGRLayerGetAutoStyle(mapObj *map, layerObj *layer, classObj *c,
                                   shapeObj *shape);
 static void msOGRCloseConnection(void *conn_handle);
+static int msOGRCheckConnection(void *conn_handle);
 
 /* ==================================================================
  * Geometry conversion functions
@@ -186,31 +187,26 @@ static int ogrGeomPoints(OGRGeometryH hGeom, shapeObj *outshp) {
 
   /* ------------------------------------------------------------------
    * Do we need to allocate a line object to contain all our points?
+   * Otherwise extend the point array for the new of points to add from
+   * the current geometry.
    * ------------------------------------------------------------------ */
-  if (outshp->numlines == 0) {
-    lineObj newline;
-
-    newline.numpoints = 0;
-    newline.point = NULL;
-    msAddLine(outshp, &newline);
-  }
+  lineObj *line;
 
-  /* ------------------------------------------------------------------
-   * Extend the point array for the new of points to add from the
-   * current geometry.
-   * ------------------------------------------------------------------ */
-  lineObj *line = outshp->line + outshp->numlines - 1;
-
-  if (line->point == NULL)
-    line->point = (pointObj *)malloc(sizeof(pointObj) * numpoints);
-  else
+  if (outshp->numlines == 0) {
+    if (msShapeAddPoints(outshp, numpoints) == NULL)
+      return (-1);
+    line = outshp->line;
+    line->numpoints = 0;
+  } else {
+    line = outshp->line + outshp->numlines - 1;
     line->point = (pointObj *)realloc(
         line->point, sizeof(pointObj) * (numpoints + line->numpoints));
 
-  if (!line->point) {
-    msSetError(MS_MEMERR, "Unable to allocate temporary point cache.",
-               "ogrGeomPoints()");
-    return (-1);
+    if (!line->point) {
+      msSetError(MS_MEMERR, "Unable to allocate temporary point cache.",
+                 "ogrGeomPoints()");
+      return (-1);
+    }
   }
 
   /* ------------------------------------------------------------------
@@ -277,7 +273,6 @@ static int ogrGeomLine(OGRGeometryH hGeom, shapeObj *outshp, int bCloseRings) {
    * ------------------------------------------------------------------ */
   else if (eGType == wkbLineString) {
     int j, numpoints;
-    lineObj line = {0, NULL};
     double dX, dY;
 
     if ((numpoints = OGR_G_GetPointCount(hGeom)) < 2)
@@ -286,13 +281,11 @@ static int ogrGeomLine(OGRGeometryH hGeom, shapeObj *outshp, int bCloseRings) {
     if (outshp->type == MS_SHAPE_NULL)
       outshp->type = MS_SHAPE_LINE;
 
-    line.numpoints = 0;
-    line.point = (pointObj *)malloc(sizeof(pointObj) * (numpoints + 1));
-    if (!line.point) {
-      msSetError(MS_MEMERR, "Unable to allocate temporary point cache.",
-                 "ogrGeomLine");
+    /* reuses the point buffer of a recycled shape if there is one */
+    const int bFirstLine = outshp->numlines == 0;
+    if (msShapeAddPoints(outshp, numpoints + 1) == NULL)
       return (-1);
-    }
+    lineObj &line = outshp->line[outshp->numlines - 1];
 
     OGR_G_GetPoints(hGeom, &(line.point[0].x), sizeof(pointObj),
                     &(line.point[0].y), sizeof(pointObj), &(line.point[0].z),
@@ -303,7 +296,7 @@ static int ogrGeomLine(OGRGeometryH hGeom, shapeObj *outshp, int bCloseRings) {
       dY = line.point[j].y = OGR_G_GetY(hGeom, j);
 
       /* Keep track of shape bounds */
-      if (j == 0 && outshp->numlines == 0) {
+      if (j == 0 && bFirstLine) {
         outshp->bounds.minx = outshp->bounds.maxx = dX;
         outshp->bounds.miny = outshp->bounds.maxy = dY;
       } else {
@@ -326,8 +319,6 @@ static int ogrGeomLine(OGRGeometryH hGeom, shapeObj *outshp, int bCloseRings) {
       line.point[line.numpoints].z = line.point[0].z;
       line.numpoints++;
     }
-
-    msAddLineDirectly(outshp, &line);
   } else {
     msSetError(MS_OGRERR, "OGRGeometry type `%s' not supported.",
                "ogrGeomLine()", OGR_G_GetGeometryName(hGeom));
@@ -433,6 +424,8 @@ static int ogrConvertGeometry(OGRGeometryH hGeom, shapeObj *outshp,
     nStatus = MS_FAILURE;
   } /* switch layertype */
 
+  msShapeTrimLines(outshp);
+
   return nStatus;
 }
 
@@ -1201,7 +1194,8 @@ static msOGRFileInfo *msOGRFileOpen(layerObj *layer, const char *connection)
       return NULL;
     }
 
-    msConnPoolRegister(layer, hDS, msOGRCloseConnection);
+    msConnPoolRegisterWithCheck(layer, hDS, msOGRCloseConnection,
+                                msOGRCheckConnection);
   }
 
   CPLFree(pszDSName);
@@ -1659,6 +1653,44 @@ static void msOGRCloseConnection(void *conn_handle)
   RELEASE_OGR_LOCK;
 }
 
+/************************************************************************/
+/*                        msOGRCheckConnection()                        */
+/*                                                                      */
+/*      Callback for the connection pool to check a pooled OGR          */
+/*      connection is still usable: the files behind it must still      */
+/*      exist, and database connections must answer a trivial query.   */
+/************************************************************************/
+
+static int msOGRCheckConnection(void *conn_handle)
+
+{
+  GDALDatasetH hDS = (GDALDatasetH)conn_handle;
+  int bAlive = MS_TRUE;
+
+  ACQUIRE_OGR_LOCK;
+  char **papszFiles = GDALGetFileList(hDS);
+  if (papszFiles != NULL && papszFiles[0] != NULL) {
+    VSIStatBufL sStat;
+    if (VSIStatL(papszFiles[0], &sStat) != 0)
+      bAlive = MS_FALSE;
+  } else {
+    GDALDriverH hDriver = GDALGetDatasetDriver(hDS);
+    if (hDriver != NULL &&
+        EQUAL(GDALGetDriverShortName(hDriver), "PostgreSQL")) {
+      CPLErrorReset();
+      OGRLayerH hLayer = GDALDatasetExecuteSQL(hDS, "SELECT 1", NULL, NULL);
+      if (hLayer == NULL)
+        bAlive = MS_FALSE;
+      else
+        GDALDatasetReleaseResultSet(hDS, hLayer);
+    }
+  }
+  CSLDestroy(papszFiles);
+  RELEASE_OGR_LOCK;
+
+  return bAlive;
+}
+
 /**********************************************************************
  *                     msOGRFileClose()
  **********************************************************************/
@@ -2767,10 +2799,13 @@ static char **msOGRFileGetItems(layerObj *layer, msOGRFileInfo *psInfo) {
  * Returns shape sequentially from OGR data source.
  * msOGRLayerWhichShape() must have been called first.
  *
+ * With bRecycle, shape is a reset shape (see msResetShape()) whose storage
+ * is reused for the geometry.
+ *
  * Returns MS_SUCCESS/MS_FAILURE
  **********************************************************************/
 static int msOGRFileNextShape(layerObj *layer, shapeObj *shape,
-                              msOGRFileInfo *psInfo) {
+                              msOGRFileInfo *psInfo, int bRecycle) {
   OGRFeatureH hFeature = NULL;
 
   if (psInfo == NULL || psInfo->hLayer == NULL) {
@@ -2783,7 +2818,8 @@ static int msOGRFileNextShape(layerObj *layer, shapeObj *shape,
    * Read until we find a feature that matches attribute filter and
    * whose geometry is compatible with current layer type.
    * ------------------------------------------------------------------ */
-  msFreeShape(shape);
+  if (!bRecycle)
+    msFreeShape(shape);
   shape->type = MS_SHAPE_NULL;
 
   ACQUIRE_OGR_LOCK;
@@ -2811,7 +2847,9 @@ static int msOGRFileNextShape(layerObj *layer, shapeObj *shape,
 
     if (layer->numitems > 0) {
       if (shape->values)
-        msFreeCharArray(shape->values, shape->numvalues);
+        msFreeCharArray(shape->values,
+                        MS_MAX(shape->numvalues, shape->maxvalues));
+      shape->maxvalues = 0;
       shape->values = msOGRGetValues(layer, hFeature);
       shape->numvalues = layer->numitems;
       if (!shape->values) {
@@ -2847,7 +2885,10 @@ static int msOGRFileNextShape(layerObj *layer, shapeObj *shape,
     }
 
     // Feature rejected... free shape to clear attributes values.
-    msFreeShape(shape);
+    if (bRecycle)
+      msResetShape(shape);
+    else
+      msFreeShape(shape);
     shape->type = MS_SHAPE_NULL;
   }
 
@@ -4206,7 +4247,8 @@ void msOGRLayerFreeItemInfo(layerObj *layer) {
  *
  * Returns MS_SUCCESS/MS_FAILURE
  **********************************************************************/
-int msOGRLayerNextShape(layerObj *layer, shapeObj *shape) {
+static int msOGRLayerReadNextShape(layerObj *layer, shapeObj *shape,
+                                   int bRecycle) {
   msOGRFileInfo *psInfo = (msOGRFileInfo *)layer->layerinfo;
   int status;
 
@@ -4217,7 +4259,7 @@ int msOGRLayerNextShape(layerObj *layer, shapeObj *shape) {
   }
 
   if (layer->tileindex == NULL)
-    return msOGRFileNextShape(layer, shape, psInfo);
+    return msOGRFileNextShape(layer, shape, psInfo, bRecycle);
 
   // Do we need to load the first tile?
   if (psInfo->poCurTile == NULL) {
@@ -4228,7 +4270,7 @@ int msOGRLayerNextShape(layerObj *layer, shapeObj *shape) {
 
   do {
     // Try getting a shape from this tile.
-    status = msOGRFileNextShape(layer, shape, psInfo->poCurTile);
+    status = msOGRFileNextShape(layer, shape, psInfo->poCurTile, bRecycle);
     if (status != MS_DONE) {
       if (psInfo->sTileProj.numargs > 0) {
         msProjectShape(&(psInfo->sTileProj), &(layer->projection), shape);
@@ -4245,6 +4287,37 @@ int msOGRLayerNextShape(layerObj *layer, shapeObj *shape) {
   return status; // make compiler happy. this is never reached however
 }
 
+int msOGRLayerNextShape(layerObj *layer, shapeObj *shape) {
+  return msOGRLayerReadNextShape(layer, shape, MS_FALSE);
+}
+
+/**********************************************************************
+ *                     msOGRLayerNextShapes()
+ *
+ * Batch version of msOGRLayerNextShape(), reading the features into the
+ * storage left in the batch by the previous one.
+ **********************************************************************/
+static int msOGRLayerNextShapes(layerObj *layer, shapeBatchObj *batch,
+                                int maxshapes) {
+  int status = MS_SUCCESS, first = batch->numshapes;
+
+  while (batch->numshapes - first < maxshapes) {
+    shapeObj *shape = msShapeBatchAdd(batch);
+
+    status = msOGRLayerReadNextShape(layer, shape, MS_TRUE);
+    if (status != MS_SUCCESS) {
+      msResetShape(shape);
+      batch->numshapes--;
+      break;
+    }
+  }
+
+  if (status == MS_FAILURE)
+    return MS_FAILURE;
+
+  return (batch->numshapes > first) ? MS_SUCCESS : MS_DONE;
+}
+
 /**********************************************************************
  *                     msOGRLayerGetShape()
  *
@@ -4358,6 +4431,128 @@ int msOGRLayerGetNumFeatures(layerObj *layer) {
   return result;
 }
 
+/**********************************************************************
+ *                     msOGRLayerAcceptsGeomType()
+ *
+ * Whether ogrConvertGeometry() keeps all the geometries of the given type
+ * for the layer type, so that msOGRFileNextShape() returns every feature
+ * counted by the driver.
+ **********************************************************************/
+static bool msOGRLayerAcceptsGeomType(const layerObj *layer,
+                                      OGRwkbGeometryType eType) {
+  switch (wkbFlatten(eType)) {
+  case wkbPoint:
+  case wkbMultiPoint:
+    return layer->type == MS_LAYER_POINT || layer->type == MS_LAYER_QUERY ||
+           layer->type == MS_LAYER_CHART;
+  case wkbLineString:
+  case wkbMultiLineString:
+    return layer->type == MS_LAYER_LINE || layer->type == MS_LAYER_QUERY ||
+           layer->type == MS_LAYER_CHART;
+  case wkbPolygon:
+  case wkbMultiPolygon:
+    return layer->type == MS_LAYER_POLYGON || layer->type == MS_LAYER_LINE ||
+           layer->type == MS_LAYER_QUERY || layer->type == MS_LAYER_CHART;
+  default:
+    return false;
+  }
+}
+
+/**********************************************************************
+ *                     msOGRLayerGetShapeCount()
+ *
+ * Returns the number of features matching rect and the layer filter,
+ * letting the driver count them with OGR_L_GetFeatureCount() instead of
+ * translating every feature to a shapeObj.
+ *
+ * The features whose geometry type doesn't match the layer TYPE are dropped
+ * by msOGRFileNextShape(), so the driver count is only used when the layer
+ * geometry type matches. OGR spatial filters may only test feature
+ * envelopes, so it is then only exact for point layers or when rect covers
+ * the whole layer. Otherwise it is used as an estimate if
+ * COUNT_ESTIMATE_THRESHOLD allows it.
+ *
+ * Returns -1 on error
+ **********************************************************************/
+static int msOGRLayerGetShapeCount(layerObj *layer, rectObj rect,
+                                   projectionObj *rectProjection) {
+  msOGRFileInfo *psInfo = (msOGRFileInfo *)layer->layerinfo;
+
+  if (psInfo == NULL || psInfo->hLayer == NULL) {
+    msSetError(MS_MISCERR, "Assertion failed: OGR layer not opened!!!",
+               "msOGRLayerGetShapeCount()");
+    return -1;
+  }
+
+  // Tile indexes are read tile by tile, and paging without an OFFSET in the
+  // SQL is done by msLayerNextShape()
+  if (layer->tileindex != NULL ||
+      (psInfo->bPaging && layer->startindex > 1 && layer->maxfeatures <= 0))
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  // The layer FILTER is evaluated again on each feature by
+  // msLayerNextShape(), unless it could be entirely translated to SQL
+  msLayerTranslateFilter(layer, &layer->filter, layer->filteritem);
+  if (layer->filter.string != NULL && layer->filter.native_string == NULL)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  ACQUIRE_OGR_LOCK;
+  const OGRwkbGeometryType eGeomType = OGR_L_GetGeomType(psInfo->hLayer);
+  RELEASE_OGR_LOCK;
+  if (!msOGRLayerAcceptsGeomType(layer, eGeomType))
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  const int nThreshold = msLayerGetCountEstimateThreshold(layer);
+  const rectObj rectInvalid = MS_INIT_INVALID_RECT;
+  rectObj searchrect = rect;
+  bool bExact = true;
+
+  if (rectProjection != NULL && layer->project &&
+      msProjectionsDiffer(&(layer->projection), rectProjection)) {
+    msProjectRect(rectProjection, &(layer->projection), &searchrect);
+    bExact = false;
+  } else if (memcmp(&rect, &rectInvalid, sizeof(rect)) != 0 &&
+             wkbFlatten(eGeomType) != wkbPoint) {
+    OGREnvelope oExtent;
+
+    ACQUIRE_OGR_LOCK;
+    bExact = OGR_L_GetExtent(psInfo->hLayer, &oExtent, FALSE) == OGRERR_NONE &&
+             rect.minx <= oExtent.MinX && rect.miny <= oExtent.MinY &&
+             rect.maxx >= oExtent.MaxX && rect.maxy >= oExtent.MaxY;
+    RELEASE_OGR_LOCK;
+  }
+
+  if (!bExact && nThreshold < 0)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  const int status = msLayerWhichShapes(layer, searchrect, MS_TRUE);
+  if (status == MS_DONE)
+    return 0;
+  if (status != MS_SUCCESS)
+    return -1;
+
+  GIntBig nCount = -1;
+  ACQUIRE_OGR_LOCK;
+  if (nThreshold >= 0) {
+    // only counts that the driver can get cheaply
+    nCount = OGR_L_GetFeatureCount(psInfo->hLayer, FALSE);
+    if (nCount < nThreshold)
+      nCount = -1;
+  }
+  if (nCount < 0)
+    nCount = OGR_L_GetFeatureCount(psInfo->hLayer, TRUE);
+  OGR_L_ResetReading(psInfo->hLayer);
+  RELEASE_OGR_LOCK;
+
+  if (nCount < 0 || nCount > INT_MAX || (!bExact && nCount < nThreshold))
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  if (layer->maxfeatures > 0 && nCount > layer->maxfeatures)
+    nCount = layer->maxfeatures;
+
+  return (int)nCount;
+}
+
 /**********************************************************************
  *                     msOGRGetSymbolId()
  *
@@ -5244,8 +5439,9 @@ int msOGRLayerInitializeVirtualTable(layerObj *layer) {
   layer->vtable->LayerIsOpen = msOGRLayerIsOpen;
   layer->vtable->LayerWhichShapes = msOGRLayerWhichShapes;
   layer->vtable->LayerNextShape = msOGRLayerNextShape;
+  layer->vtable->LayerNextShapes = msOGRLayerNextShapes;
   layer->vtable->LayerGetShape = msOGRLayerGetShape;
-  /* layer->vtable->LayerGetShapeCount, use default */
+  layer->vtable->LayerGetShapeCount = msOGRLayerGetShapeCount;
   layer->vtable->LayerClose = msOGRLayerClose;
   layer->vtable->LayerGetItems = msOGRLayerGetItems;
   layer->vtable->LayerGetExtent = msOGRLayerGetExtent;
@@ -40,6 +40,9 @@
 #endif
 #include "mapowscommon.h"
 
+#include "cpl_conv.h"
+#include "cpl_vsi.h"
+
 #include <ctype.h> /* isalnum() */
 #include <stdarg.h>
 #include <assert.h>
@@ -230,6 +233,467 @@ static int msOWSPreParseRequest(cgiRequestObj *request,
   return MS_SUCCESS;
 }
 
+/*
+** GetCapabilities cache
+**
+** When the "ows_capabilities_cache" web metadata is set to true, the WMS,
+** WFS and WCS GetCapabilities responses are kept in a process wide LRU
+** list bounded to MS_CAPABILITIES_CACHE_SIZE bytes (64 MB by default), and
+** in the "ows_capabilities_cache_dir" directory if that metadata is set.
+** A gzip compressed copy of each document is kept next to it, for clients
+** accepting it. Entries are keyed on the mapfile name and modification
+** time, the service, the online resource and the request parameters, so
+** they are invalidated by any change of the mapfile itself, but not of the
+** files it includes or of the data.
+*/
+
+#define MS_CAPABILITIES_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+typedef struct capabilitiesCacheEntryObj {
+  char *key;
+  char *headers; /* "Name: value\r\n" lines, NULL if headers are disabled */
+  char *data;
+  int size;
+  char *gzdata; /* gzip compressed data, or NULL */
+  int gzsize;
+  struct capabilitiesCacheEntryObj *next; /* less recently used */
+} capabilitiesCacheEntryObj;
+
+static capabilitiesCacheEntryObj *gpsCapabilitiesCache = NULL;
+static size_t gnCapabilitiesCacheBytes = 0;
+
+static size_t msOWSCapabilitiesCacheMaxBytes(void) {
+  const char *pszSize = CPLGetConfigOption("MS_CAPABILITIES_CACHE_SIZE", NULL);
+  return pszSize ? (size_t)MS_MAX(0, atol(pszSize))
+                 : MS_CAPABILITIES_CACHE_DEFAULT_SIZE;
+}
+
+static void msOWSCapabilitiesCacheFreeEntry(capabilitiesCacheEntryObj *entry) {
+  msFree(entry->key);
+  msFree(entry->headers);
+  msFree(entry->data);
+  msFree(entry->gzdata);
+  msFree(entry);
+}
+
+static int msOWSCompareParams(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Does any of the map or layer metadata restrict access by IP address? */
+static int msOWSHasIpLists(mapObj *map, const char *namespaces) {
+  int i;
+
+  for (i = -1; i < map->numlayers; i++) {
+    hashTableObj *metadata =
+        i < 0 ? &(map->web.metadata) : &(GET_LAYER(map, i)->metadata);
+    if (msOWSLookupMetadata(metadata, namespaces, "allowed_ip_list") ||
+        msOWSLookupMetadata(metadata, namespaces, "denied_ip_list"))
+      return MS_TRUE;
+  }
+  return MS_FALSE;
+}
+
+/*
+** msOWSCapabilitiesCacheKey()
+**
+** Returns the cache key of a GetCapabilities request, or NULL if its
+** response must not be cached. The parameters are sorted with their names
+** uppercased, since their order and the case of their names do not matter.
+*/
+static char *msOWSCapabilitiesCacheKey(mapObj *map, cgiRequestObj *request,
+                                       owsRequestObj *ows_request) {
+  const char *value, *namespaces;
+  char *key, *online_resource, **params;
+  VSIStatBufL stat_buf;
+  int i;
+
+  value =
+      msOWSLookupMetadata(&(map->web.metadata), "O", "capabilities_cache");
+  if (value == NULL || strcasecmp(value, "true") != 0)
+    return NULL;
+
+  if (map->mapfile == NULL || request->postrequest != NULL ||
+      VSIStatL(map->mapfile, &stat_buf) != 0)
+    return NULL;
+
+  if (EQUAL(ows_request->service, "WMS"))
+    namespaces = "MO";
+  else if (EQUAL(ows_request->service, "WFS"))
+    namespaces = "FO";
+  else if (EQUAL(ows_request->service, "WCS"))
+    namespaces = "CO";
+  else
+    return NULL;
+
+  online_resource =
+      msOWSGetOnlineResource(map, namespaces, "onlineresource", request);
+  if (online_resource == NULL) {
+    msResetErrorList(); /* the request will report it */
+    return NULL;
+  }
+
+  key = msStrdup(CPLSPrintf("%s\n%ld\n%s\n%s\n", map->mapfile,
+                            (long)stat_buf.st_mtime, ows_request->service,
+                            online_resource));
+  msFree(online_resource);
+
+  params = (char **)msSmallMalloc(sizeof(char *) * (request->NumParams + 1));
+  for (i = 0; i < request->NumParams; i++) {
+    params[i] = msStrdup(request->ParamNames[i]);
+    msStringToUpper(params[i]);
+    params[i] = msStringConcatenate(params[i], "=");
+    params[i] = msStringConcatenate(params[i], request->ParamValues[i]);
+  }
+  qsort(params, request->NumParams, sizeof(char *), msOWSCompareParams);
+  for (i = 0; i < request->NumParams; i++) {
+    key = msStringConcatenate(key, params[i]);
+    key = msStringConcatenate(key, "&");
+  }
+  msFreeCharArray(params, request->NumParams);
+
+  /* the layers listed depend on the client address */
+  if (msOWSHasIpLists(map, namespaces) && getenv("REMOTE_ADDR")) {
+    key = msStringConcatenate(key, "\n");
+    key = msStringConcatenate(key, getenv("REMOTE_ADDR"));
+  }
+
+  return key;
+}
+
+static char *msOWSCapabilitiesCacheDiskPath(mapObj *map, const char *key) {
+  const char *dir = msOWSLookupMetadata(&(map->web.metadata), "O",
+                                        "capabilities_cache_dir");
+  if (dir == NULL || dir[0] == '\0')
+    return NULL;
+  return msStrdup(CPLSPrintf("%s/%08x.xml", dir, msHashKey(key)));
+}
+
+/* Compress data to the gzip format, through the GDAL virtual file systems */
+static char *msOWSGzip(const char *data, int size, int *gzsize) {
+  char *path =
+      msStrdup(CPLSPrintf("/vsimem/mscapabilities_%p.gz", (const void *)data));
+  VSILFILE *fp = VSIFOpenL(CPLSPrintf("/vsigzip/%s", path), "wb");
+  char *gzdata = NULL;
+  vsi_l_offset length = 0;
+  GByte *buffer;
+
+  if (fp == NULL) {
+    msFree(path);
+    return NULL;
+  }
+  VSIFWriteL(data, 1, size, fp);
+  VSIFCloseL(fp);
+
+  buffer = VSIGetMemFileBuffer(path, &length, MS_FALSE);
+  if (buffer != NULL && length > 0) {
+    gzdata = (char *)msSmallMalloc(length);
+    memcpy(gzdata, buffer, length);
+    *gzsize = (int)length;
+  }
+  VSIUnlink(path);
+  msFree(path);
+
+  return gzdata;
+}
+
+static void msOWSCapabilitiesCacheDiskWriteFile(const char *path,
+                                                const char *key,
+                                                const char *headers,
+                                                const char *data, int size) {
+  char *tmpname = msTmpFilename("tmp");
+  char *tmppath = msStrdup(CPLSPrintf("%s.%s", path, tmpname));
+  const char *header =
+      CPLSPrintf("MSCAPSCACHE1 %d %d %d\n", (int)strlen(key),
+                 headers ? (int)strlen(headers) : -1, size);
+  VSILFILE *fp = VSIFOpenL(tmppath, "wb");
+  int ok = fp != NULL;
+
+  if (fp) {
+    ok &= VSIFWriteL(header, 1, strlen(header), fp) == strlen(header);
+    ok &= VSIFWriteL(key, 1, strlen(key), fp) == strlen(key);
+    if (headers)
+      ok &= VSIFWriteL(headers, 1, strlen(headers), fp) == strlen(headers);
+    ok &= VSIFWriteL(data, 1, size, fp) == (size_t)size;
+    ok &= VSIFCloseL(fp) == 0;
+  }
+  /* write then rename so that readers never see a partial file */
+  if (!ok || VSIRename(tmppath, path) != 0)
+    VSIUnlink(tmppath);
+
+  msFree(tmpname);
+  msFree(tmppath);
+}
+
+static int msOWSCapabilitiesCacheDiskReadFile(const char *path,
+                                              const char *key, char **headers,
+                                              char **data, int *size) {
+  VSILFILE *fp;
+  char line[128];
+  int key_len, headers_len, data_len, i, ok;
+  char *file_key;
+
+  fp = VSIFOpenL(path, "rb");
+  if (fp == NULL)
+    return MS_FAILURE;
+
+  for (i = 0; i < (int)sizeof(line) - 1; i++) {
+    if (VSIFReadL(line + i, 1, 1, fp) != 1 || line[i] == '\n')
+      break;
+  }
+  line[i] = '\0';
+  if (sscanf(line, "MSCAPSCACHE1 %d %d %d", &key_len, &headers_len,
+             &data_len) != 3 ||
+      key_len != (int)strlen(key) || data_len < 0) {
+    VSIFCloseL(fp);
+    return MS_FAILURE;
+  }
+
+  file_key = (char *)msSmallMalloc(key_len + 1);
+  *headers = headers_len >= 0 ? (char *)msSmallMalloc(headers_len + 1) : NULL;
+  *data = (char *)msSmallMalloc(data_len + 1);
+  ok = VSIFReadL(file_key, 1, key_len, fp) == (size_t)key_len &&
+       memcmp(file_key, key, key_len) == 0 &&
+       (*headers == NULL ||
+        VSIFReadL(*headers, 1, headers_len, fp) == (size_t)headers_len) &&
+       VSIFReadL(*data, 1, data_len, fp) == (size_t)data_len;
+  VSIFCloseL(fp);
+  msFree(file_key);
+
+  if (!ok) {
+    msFree(*headers);
+    msFree(*data);
+    *headers = *data = NULL;
+    return MS_FAILURE;
+  }
+  if (*headers)
+    (*headers)[headers_len] = '\0';
+  (*data)[data_len] = '\0';
+  *size = data_len;
+  return MS_SUCCESS;
+}
+
+static int msOWSAcceptsGzip(void) {
+  const char *encodings = getenv("HTTP_ACCEPT_ENCODING");
+  return encodings != NULL && strstr(encodings, "gzip") != NULL;
+}
+
+static void msOWSCapabilitiesCacheSend(const char *headers, const char *data,
+                                       int size, int gzipped) {
+  if (headers) {
+    char **lines;
+    int numlines, i;
+
+    lines = msStringSplit(headers, '\n', &numlines);
+    for (i = 0; i < numlines; i++) {
+      char *value = strstr(lines[i], ": ");
+      if (value == NULL)
+        continue;
+      *value = '\0';
+      value += 2;
+      if (value[0] != '\0' && value[strlen(value) - 1] == '\r')
+        value[strlen(value) - 1] = '\0';
+      msIO_setHeader(lines[i], "%s", value);
+    }
+    msFreeCharArray(lines, numlines);
+    msIO_setHeader("Vary", "Accept-Encoding");
+    if (gzipped)
+      msIO_setHeader("Content-Encoding", "gzip");
+    msIO_sendHeaders();
+  }
+  msIO_fwrite(data, 1, size, stdout);
+}
+
+/*
+** msOWSCapabilitiesCacheServe()
+**
+** Writes the cached response for a key. Returns MS_SUCCESS if it was found
+** in memory or on disk, and MS_DONE if it must be generated.
+*/
+static int msOWSCapabilitiesCacheServe(mapObj *map, const char *key) {
+  const int gzip = msOWSAcceptsGzip();
+  capabilitiesCacheEntryObj *entry, **link;
+  char *headers = NULL, *data = NULL, *path;
+  int size = 0, gzipped = MS_FALSE;
+
+  msAcquireLock(TLOCK_OWS);
+  for (link = &gpsCapabilitiesCache; *link; link = &((*link)->next)) {
+    if (strcmp((*link)->key, key) == 0)
+      break;
+  }
+  entry = *link;
+  if (entry) {
+    /* move to the head of the list, and copy it out of the lock */
+    *link = entry->next;
+    entry->next = gpsCapabilitiesCache;
+    gpsCapabilitiesCache = entry;
+
+    gzipped = gzip && entry->headers && entry->gzdata;
+    size = gzipped ? entry->gzsize : entry->size;
+    data = (char *)msSmallMalloc(size);
+    memcpy(data, gzipped ? entry->gzdata : entry->data, size);
+    headers = entry->headers ? msStrdup(entry->headers) : NULL;
+  }
+  msReleaseLock(TLOCK_OWS);
+
+  if (entry == NULL) {
+    path = msOWSCapabilitiesCacheDiskPath(map, key);
+    if (path == NULL || msOWSCapabilitiesCacheDiskReadFile(
+                            path, key, &headers, &data, &size) != MS_SUCCESS) {
+      msFree(path);
+      return MS_DONE;
+    }
+    if (gzip && headers) {
+      char *gzpath = msStringConcatenate(msStrdup(path), ".gz");
+      char *gzheaders = NULL, *gzdata = NULL;
+      int gzsize = 0;
+      if (msOWSCapabilitiesCacheDiskReadFile(gzpath, key, &gzheaders, &gzdata,
+                                             &gzsize) == MS_SUCCESS) {
+        msFree(data);
+        data = gzdata;
+        size = gzsize;
+        gzipped = MS_TRUE;
+      }
+      msFree(gzheaders);
+      msFree(gzpath);
+    }
+    msFree(path);
+  }
+
+  if (map->debug >= MS_DEBUGLEVEL_V)
+    msDebug("msOWSCapabilitiesCacheServe(): serving cached %s document.\n",
+            gzipped ? "gzip compressed" : "uncompressed");
+
+  msOWSCapabilitiesCacheSend(headers, data, size, gzipped);
+  msFree(headers);
+  msFree(data);
+  return MS_SUCCESS;
+}
+
+/*
+** msOWSCapabilitiesCacheStore()
+**
+** Restores the stdout context saved when the response started to be
+** captured, writes the response and stores it if the request succeeded.
+*/
+static void msOWSCapabilitiesCacheStore(mapObj *map, const char *key,
+                                        int status,
+                                        msIOContext *old_context) {
+  msIOContext *context = msIO_getHandler(stdout);
+  msIOBuffer *buffer = (msIOBuffer *)context->cbData;
+  capabilitiesCacheEntryObj *entry = NULL;
+  hashTableObj *headers_table = NULL;
+  char *headers = NULL, *data, *path;
+  int size, i;
+
+  /* the headers, if enabled, precede the document */
+  if (status == MS_SUCCESS && buffer->data_offset > 0 &&
+      buffer->data[0] != '<') {
+    headers_table = msIO_getAndStripStdoutBufferMimeHeaders();
+    if (headers_table == NULL) {
+      msResetErrorList();
+      status = MS_FAILURE; /* pass it through, but do not cache it */
+    }
+  }
+
+  /* take the data before the buffer is released */
+  data = (char *)buffer->data;
+  size = buffer->data_offset;
+  buffer->data = NULL;
+  buffer->data_offset = buffer->data_len = 0;
+  msIO_restoreOldStdoutContext(old_context);
+
+  if (headers_table) {
+    for (i = 0; i < headers_table->numitems; i++) {
+      headers = msStringConcatenate(headers, headers_table->items[i].key);
+      headers = msStringConcatenate(headers, ": ");
+      headers = msStringConcatenate(headers, headers_table->items[i].data);
+      headers = msStringConcatenate(headers, "\r\n");
+    }
+    msFreeHashTable(headers_table);
+  }
+
+  if (status != MS_SUCCESS) { /* headers included, as generated */
+    msIO_fwrite(data, 1, size, stdout);
+    msFree(data);
+    return;
+  }
+
+  entry = (capabilitiesCacheEntryObj *)msSmallCalloc(
+      1, sizeof(capabilitiesCacheEntryObj));
+  entry->key = msStrdup(key);
+  entry->headers = headers;
+  entry->data = data;
+  entry->size = size;
+  if (headers)
+    entry->gzdata = msOWSGzip(data, size, &(entry->gzsize));
+
+  path = msOWSCapabilitiesCacheDiskPath(map, key);
+  if (path) {
+    msOWSCapabilitiesCacheDiskWriteFile(path, key, headers, data, size);
+    if (entry->gzdata) {
+      char *gzpath = msStringConcatenate(msStrdup(path), ".gz");
+      msOWSCapabilitiesCacheDiskWriteFile(gzpath, key, headers, entry->gzdata,
+                                          entry->gzsize);
+      msFree(gzpath);
+    }
+    msFree(path);
+  }
+
+  if (entry->gzdata && msOWSAcceptsGzip())
+    msOWSCapabilitiesCacheSend(headers, entry->gzdata, entry->gzsize,
+                               MS_TRUE);
+  else
+    msOWSCapabilitiesCacheSend(headers, data, size, MS_FALSE);
+
+  msAcquireLock(TLOCK_OWS);
+  {
+    const size_t max_bytes = msOWSCapabilitiesCacheMaxBytes();
+    capabilitiesCacheEntryObj **link;
+
+    /* replace any entry stored concurrently, then drop the tail */
+    for (link = &gpsCapabilitiesCache; *link; link = &((*link)->next)) {
+      if (strcmp((*link)->key, key) == 0) {
+        capabilitiesCacheEntryObj *old = *link;
+        *link = old->next;
+        gnCapabilitiesCacheBytes -= old->size + old->gzsize;
+        msOWSCapabilitiesCacheFreeEntry(old);
+        break;
+      }
+    }
+    entry->next = gpsCapabilitiesCache;
+    gpsCapabilitiesCache = entry;
+    gnCapabilitiesCacheBytes += entry->size + entry->gzsize;
+
+    /* the list is short, finding its tail is cheap enough */
+    while (gpsCapabilitiesCache && gnCapabilitiesCacheBytes > max_bytes) {
+      for (link = &gpsCapabilitiesCache; (*link)->next;
+           link = &((*link)->next)) {
+      }
+      gnCapabilitiesCacheBytes -= (*link)->size + (*link)->gzsize;
+      msOWSCapabilitiesCacheFreeEntry(*link);
+      *link = NULL;
+    }
+  }
+  msReleaseLock(TLOCK_OWS);
+}
+
+/*
+** msOWSCapabilitiesCacheCleanup()
+**
+** Releases the GetCapabilities documents kept in memory.
+*/
+void msOWSCapabilitiesCacheCleanup(void) {
+  msAcquireLock(TLOCK_OWS);
+  while (gpsCapabilitiesCache) {
+    capabilitiesCacheEntryObj *entry = gpsCapabilitiesCache;
+    gpsCapabilitiesCache = entry->next;
+    msOWSCapabilitiesCacheFreeEntry(entry);
+  }
+  gnCapabilitiesCacheBytes = 0;
+  msReleaseLock(TLOCK_OWS);
+}
+
 /*
 ** msOWSDispatch() is the entry point for any OWS request (WMS, WFS, ...)
 ** - If this is a valid request then it is processed and MS_SUCCESS is returned
@@ -243,6 +707,8 @@ static int msOWSPreParseRequest(cgiRequestObj *request,
 int msOWSDispatch(mapObj *map, cgiRequestObj *request, int ows_mode) {
   int status = MS_DONE, force_ows_mode = 0;
   owsRequestObj ows_request;
+  char *capabilities_key = NULL;
+  msIOContext *old_context = NULL;
 
   if (!request) {
     return status;
@@ -260,6 +726,23 @@ int msOWSDispatch(mapObj *map, cgiRequestObj *request, int ows_mode) {
     status = MS_DONE;
   }
 
+  if (ows_request.service != NULL) {
+    /* the metadata will be looked up many times from here on */
+    msOWSResolveMapMetadata(map);
+
+    if (ows_request.request && EQUAL(ows_request.request, "GetCapabilities"))
+      capabilities_key = msOWSCapabilitiesCacheKey(map, request, &ows_request);
+    if (capabilities_key) {
+      if (msOWSCapabilitiesCacheServe(map, capabilities_key) == MS_SUCCESS) {
+        msFree(capabilities_key);
+        msOWSClearRequestObj(&ows_request);
+        return MS_SUCCESS;
+      }
+      /* capture the response to cache it */
+      old_context = msIO_pushStdoutToBufferAndGetOldContext();
+    }
+  }
+
   if (ows_request.service == NULL) {
 #ifdef USE_LIBXML2
     if (ows_request.request && EQUAL(ows_request.request, "GetMetadata")) {
@@ -330,6 +813,11 @@ int msOWSDispatch(mapObj *map, cgiRequestObj *request, int ows_mode) {
     status = MS_FAILURE;
   }
 
+  if (capabilities_key) {
+    msOWSCapabilitiesCacheStore(map, capabilities_key, status, old_context);
+    msFree(capabilities_key);
+  }
+
   msOWSClearRequestObj(&ows_request);
   return status;
 }
@@ -868,6 +1356,122 @@ static const char *msOWSGetPrefixFromNamespace(char chNamespace) {
   }
 }
 
+/*
+** Resolved OWS metadata
+**
+** A view of a metadata table where the items named with one of the OWS
+** namespace prefixes are indexed by their unprefixed name, along with the
+** value found in each namespace. msOWSLookupMetadata() can then answer
+** with a single probe instead of one hash lookup per namespace.
+**
+** The view only points to the keys and values of the table, and is
+** dropped by the table as soon as it is modified.
+*/
+#define MS_OWS_NUM_NAMESPACES 7
+static const char msOWSNamespaces[MS_OWS_NUM_NAMESPACES + 1] = "OAMFCGS";
+
+typedef struct {
+  const char *name; /* the metadata key past its prefix, NULL if empty */
+  unsigned hashval;
+  const char *values[MS_OWS_NUM_NAMESPACES]; /* in msOWSNamespaces order */
+} owsResolvedMetadataEntry;
+
+typedef struct {
+  int numslots; /* a power of two */
+  owsResolvedMetadataEntry entries[1];
+} owsResolvedMetadata;
+
+static void msOWSFreeResolvedMetadata(void *resolved) { free(resolved); }
+
+/* Index of the namespace of a metadata key, or -1 if it has none */
+static int msOWSGetKeyNamespace(const char *key) {
+  int i;
+
+  if (strlen(key) < 5 || key[3] != '_')
+    return -1;
+
+  for (i = 0; i < MS_OWS_NUM_NAMESPACES; i++) {
+    if (strncasecmp(key, msOWSGetPrefixFromNamespace(msOWSNamespaces[i]), 3) ==
+        0)
+      return i;
+  }
+  return -1;
+}
+
+static owsResolvedMetadataEntry *
+msOWSFindResolvedEntry(owsResolvedMetadata *resolved, const char *name,
+                       unsigned hashval) {
+  const unsigned mask = (unsigned)resolved->numslots - 1;
+  unsigned i;
+
+  for (i = hashval & mask;; i = (i + 1) & mask) {
+    owsResolvedMetadataEntry *entry = &(resolved->entries[i]);
+    if (entry->name == NULL ||
+        (entry->hashval == hashval && strcasecmp(entry->name, name) == 0))
+      return entry;
+  }
+}
+
+/*
+** msOWSResolveMetadata()
+**
+** Build the resolved view of a metadata table, see above. To be called once
+** the table is fully populated, e.g. by msOWSResolveMapMetadata().
+*/
+void msOWSResolveMetadata(hashTableObj *metadata) {
+  owsResolvedMetadata *resolved;
+  int i, count = 0, numslots = 8;
+
+  if (metadata == NULL)
+    return;
+
+  for (i = 0; i < metadata->numitems; i++) {
+    if (msOWSGetKeyNamespace(metadata->items[i].key) >= 0)
+      count++;
+  }
+  while (numslots < count * 2)
+    numslots *= 2;
+
+  resolved = (owsResolvedMetadata *)msSmallCalloc(
+      1, sizeof(owsResolvedMetadata) +
+             sizeof(owsResolvedMetadataEntry) * (numslots - 1));
+  resolved->numslots = numslots;
+
+  for (i = 0; i < metadata->numitems; i++) {
+    const struct hashObj *item = &(metadata->items[i]);
+    const int ns = msOWSGetKeyNamespace(item->key);
+    owsResolvedMetadataEntry *entry;
+    unsigned hashval;
+
+    if (ns < 0)
+      continue;
+
+    hashval = msHashKey(item->key + 4);
+    entry = msOWSFindResolvedEntry(resolved, item->key + 4, hashval);
+    if (entry->name == NULL) {
+      entry->name = item->key + 4;
+      entry->hashval = hashval;
+    }
+    entry->values[ns] = item->data;
+  }
+
+  msHashTableSetResolved(metadata, resolved, msOWSFreeResolvedMetadata);
+}
+
+/*
+** msOWSResolveMapMetadata()
+**
+** Resolve the metadata of the map and of all its layers, which an OWS
+** request typically looks up many times each.
+*/
+void msOWSResolveMapMetadata(mapObj *map) {
+  int i;
+
+  msOWSResolveMetadata(&(map->web.metadata));
+  for (i = 0; i < map->numlayers; i++)
+    msOWSResolveMetadata(&(GET_LAYER(map, i)->metadata));
+}
+
 /*
 ** msOWSLookupMetadata()
 **
@@ -882,6 +1486,23 @@ const char *msOWSLookupMetadata(hashTableObj *metadata, const char *namespaces,
                                 const char *name) {
   const char *value = NULL;
 
+  if (namespaces != NULL && metadata != NULL &&
+      metadata->freeresolved == msOWSFreeResolvedMetadata) {
+    owsResolvedMetadataEntry *entry = msOWSFindResolvedEntry(
+        (owsResolvedMetadata *)metadata->resolved, name, msHashKey(name));
+    if (entry->name == NULL)
+      return NULL;
+    for (; *namespaces != '\0'; namespaces++) {
+      const char *ns = strchr(msOWSNamespaces, *namespaces);
+      if (ns == NULL)
+        break; /* let the regular lookup report the invalid namespace */
+      if (entry->values[ns - msOWSNamespaces])
+        return entry->values[ns - msOWSNamespaces];
+    }
+    if (*namespaces == '\0')
+      return NULL;
+  }
+
   if (namespaces == NULL) {
     value = msLookupHashTable(metadata, (char *)name);
   } else {
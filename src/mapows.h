@@ -146,6 +146,9 @@ MS_DLL_EXPORT int msOWSDispatch(mapObj *map, cgiRequestObj *request,
 MS_DLL_EXPORT const char *msOWSLookupMetadata(hashTableObj *metadata,
                                               const char *namespaces,
                                               const char *name);
+MS_DLL_EXPORT void msOWSResolveMetadata(hashTableObj *metadata);
+MS_DLL_EXPORT void msOWSResolveMapMetadata(mapObj *map);
+MS_DLL_EXPORT void msOWSCapabilitiesCacheCleanup(void);
 MS_DLL_EXPORT const char *
 msOWSLookupMetadataWithLanguage(hashTableObj *metadata, const char *namespaces,
                                 const char *name,
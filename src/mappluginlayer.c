@@ -158,6 +158,8 @@ static void copyVirtualTable(layerVTableObj *dest, const layerVTableObj *src) {
       src->LayerWhichShapes ? src->LayerWhichShapes : dest->LayerWhichShapes;
   dest->LayerNextShape =
       src->LayerNextShape ? src->LayerNextShape : dest->LayerNextShape;
+  dest->LayerNextShapes =
+      src->LayerNextShapes ? src->LayerNextShapes : dest->LayerNextShapes;
   dest->LayerGetShape =
       src->LayerGetShape ? src->LayerGetShape : dest->LayerGetShape;
   /* dest->LayerResultsGetShape = src->LayerResultsGetShape ?
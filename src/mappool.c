@@ -130,10 +130,43 @@ o The connection pooling API will let a connection be used/referenced multiple
   between different threads concurrently.  But if a connection is released
   by one thread, it is available for use by another thread.
 
+o Connections are looked up in a hash table keyed by connection type and
+  connection string.  The following PROCESSING options tune the pool for a
+  given connection:
+    - CONNECTION_POOL_MAX=n: at most n pooled connections for this key.  Once
+      reached, msConnPoolRequest() waits for one to be released.  If none is
+      released in time the driver opens an extra connection, which is closed
+      as soon as it is released.
+    - CONNECTION_POOL_WAIT=ms: how long to wait for a connection when the
+      limit is reached (default 0, don't wait).  Released connections go
+      to the waiting requests for that key in the order they started
+      waiting.
+    - CONNECTION_IDLE_TIMEOUT=seconds: with CLOSE_CONNECTION=DEFER, close the
+      connection once it has been unused for that long.
+
+o Unused deferred connections are kept in least recently used order.  The
+  MS_CONNECTION_POOL_MAX_IDLE configuration option bounds how many of them
+  are kept open, evicting the least recently used first.
+
+o A driver can register its connections with msConnPoolRegisterWithCheck()
+  to provide an "is alive" probe.  It is called before handing out a
+  connection that has been unused for MS_CONNECTION_POOL_CHECK_INTERVAL
+  seconds (30 by default); dead connections are closed and the request is
+  treated as a miss so the driver opens a fresh one.
+
+o msConnPoolGetStatistics() returns the number of open and idle connections
+  and counters of hits, misses, waits, timeouts, evictions and failed
+  checks since startup.  mapserv logs them after each request when the map
+  DEBUG level is 2 (MS_DEBUGLEVEL_TUNING) or more.
+
  ****************************************************************************/
 
+
 #include "mapserver.h"
 #include "mapthread.h"
+#include "maptime.h"
+
+#include "cpl_conv.h"
 
 /* defines for lifetime.
    A positive number is a time-from-last use in seconds */
@@ -142,9 +175,15 @@ o The connection pooling API will let a connection be used/referenced multiple
 #define MS_LIFE_ZEROREF -2
 #define MS_LIFE_SINGLE -3
 
-typedef struct {
+#define MS_CONN_POOL_BUCKETS 64
+
+/* default of MS_CONNECTION_POOL_CHECK_INTERVAL, in seconds */
+#define MS_CONN_POOL_CHECK_INTERVAL 30
+
+typedef struct connectionObj {
   enum MS_CONNECTION_TYPE connectiontype;
   char *connection;
+  unsigned int hash;
 
   int lifespan;
   int ref_count;
@@ -156,6 +195,12 @@ typedef struct {
   void *conn_handle;
 
   void (*close)(void *);
+  int (*is_alive)(void *);
+
+  struct connectionObj *next; /* in hash bucket */
+  struct connectionObj *idle_prev;
+  struct connectionObj *idle_next;
+  int idle;
 } connectionObj;
 
 /*
@@ -163,8 +208,134 @@ typedef struct {
 */
 
 static int connectionCount = 0;
-static int connectionMax = 0;
-static connectionObj *connections = NULL;
+static connectionObj *connectionBuckets[MS_CONN_POOL_BUCKETS];
+static connectionObj *idleHead = NULL; /* most recently used */
+static connectionObj *idleTail = NULL;
+static int idleCount = 0;
+static connPoolStatsObj connectionStats;
+
+/*
+** Requests waiting for a connection because their key reached
+** CONNECTION_POOL_MAX, oldest first.  The entries live on the stack of the
+** waiting msConnPoolRequest() calls.
+*/
+
+typedef struct connWaiterObj {
+  enum MS_CONNECTION_TYPE connectiontype;
+  const char *connection;
+  unsigned int hash;
+  struct connWaiterObj *next;
+} connWaiterObj;
+
+static connWaiterObj *waiterHead = NULL;
+static connWaiterObj *waiterTail = NULL;
+
+/************************************************************************/
+/*                          msConnPoolHash()                            */
+/************************************************************************/
+
+static unsigned int msConnPoolHash(enum MS_CONNECTION_TYPE connectiontype,
+                                   const char *connection)
+
+{
+  /* msHashKey() folds case, connections are matched case insensitively */
+  return msHashKey(connection) * 31U + (unsigned int)connectiontype;
+}
+
+/************************************************************************/
+/*                     msConnPoolGetProcessingInt()                     */
+/************************************************************************/
+
+static int msConnPoolGetProcessingInt(layerObj *layer, const char *key,
+                                      int default_value)
+
+{
+  const char *value = msLayerGetProcessingKey(layer, key);
+
+  if (value == NULL)
+    return default_value;
+
+  return MS_MAX(0, atoi(value));
+}
+
+/************************************************************************/
+/*                         msConnPoolIdleAdd()                          */
+/*                                                                      */
+/*      Idle list maintenance, connections with no references that      */
+/*      are kept open.                                                  */
+/************************************************************************/
+
+static void msConnPoolIdleAdd(connectionObj *conn)
+
+{
+  conn->idle_prev = NULL;
+  conn->idle_next = idleHead;
+  if (idleHead)
+    idleHead->idle_prev = conn;
+  idleHead = conn;
+  if (idleTail == NULL)
+    idleTail = conn;
+  conn->idle = MS_TRUE;
+  idleCount++;
+}
+
+static void msConnPoolIdleRemove(connectionObj *conn)
+
+{
+  if (!conn->idle)
+    return;
+
+  if (conn->idle_prev)
+    conn->idle_prev->idle_next = conn->idle_next;
+  else
+    idleHead = conn->idle_next;
+  if (conn->idle_next)
+    conn->idle_next->idle_prev = conn->idle_prev;
+  else
+    idleTail = conn->idle_prev;
+  conn->idle_prev = conn->idle_next = NULL;
+  conn->idle = MS_FALSE;
+  idleCount--;
+}
+
+/************************************************************************/
+/*                        msConnPoolWaiterAhead()                       */
+/*                                                                      */
+/*      Return MS_TRUE if a request for the same connection started     */
+/*      waiting before waiter, or at all if waiter is NULL.             */
+/************************************************************************/
+
+static int msConnPoolWaiterAhead(connWaiterObj *waiter, layerObj *layer,
+                                 unsigned int hash)
+
+{
+  connWaiterObj *other;
+
+  for (other = waiterHead; other != NULL && other != waiter;
+       other = other->next) {
+    if (other->hash == hash && other->connectiontype == layer->connectiontype &&
+        strcasecmp(other->connection, layer->connection) == 0)
+      return MS_TRUE;
+  }
+
+  return MS_FALSE;
+}
+
+static void msConnPoolWaiterRemove(connWaiterObj *waiter)
+
+{
+  connWaiterObj **link, *prev = NULL;
+
+  for (link = &waiterHead; *link != NULL; link = &((*link)->next)) {
+    if (*link == waiter) {
+      *link = waiter->next;
+      if (waiterTail == waiter)
+        waiterTail = prev;
+      return;
+    }
+    prev = *link;
+  }
+}
 
 /************************************************************************/
 /*                         msConnPoolRegister()                         */
@@ -175,9 +346,26 @@ static connectionObj *connections = NULL;
 void msConnPoolRegister(layerObj *layer, void *conn_handle,
                         void (*close_func)(void *))
 
+{
+  msConnPoolRegisterWithCheck(layer, conn_handle, close_func, NULL);
+}
+
+/************************************************************************/
+/*                    msConnPoolRegisterWithCheck()                     */
+/*                                                                      */
+/*      Same as msConnPoolRegister(), with a probe the pool can call    */
+/*      to check a connection is still usable before reusing it.  It    */
+/*      returns MS_TRUE if the connection is alive.                     */
+/************************************************************************/
+
+void msConnPoolRegisterWithCheck(layerObj *layer, void *conn_handle,
+                                 void (*close_func)(void *),
+                                 int (*alive_func)(void *))
+
 {
   const char *close_connection = NULL;
-  connectionObj *conn = NULL;
+  connectionObj *conn = NULL, *other;
+  int max_connections, count = 0;
 
   if (layer->debug)
     msDebug("msConnPoolRegister(%s,%s,%p)\n", layer->name, layer->connection,
@@ -200,33 +388,20 @@ void msConnPoolRegister(layerObj *layer, void *conn_handle,
     return;
   }
 
-  /* -------------------------------------------------------------------- */
-  /*      Grow the array of connection information objects if needed.     */
-  /* -------------------------------------------------------------------- */
-  msAcquireLock(TLOCK_POOL);
-
-  if (connectionCount == connectionMax) {
-    connectionMax += 10;
-    connectionObj *newConnections = (connectionObj *)realloc(
-        connections, sizeof(connectionObj) * connectionMax);
-    if (newConnections == NULL) {
-      msSetError(MS_MEMERR, NULL, "msConnPoolRegister()");
-      msReleaseLock(TLOCK_POOL);
-      return;
-    }
-    connections = newConnections;
-  }
-
   /* -------------------------------------------------------------------- */
   /*      Set the new connection information.                             */
   /* -------------------------------------------------------------------- */
-  conn = connections + connectionCount;
-
-  connectionCount++;
+  conn = (connectionObj *)calloc(1, sizeof(connectionObj));
+  if (conn == NULL) {
+    msSetError(MS_MEMERR, NULL, "msConnPoolRegister()");
+    return;
+  }
 
   conn->connectiontype = layer->connectiontype;
   conn->connection = msStrdup(layer->connection);
+  conn->hash = msConnPoolHash(layer->connectiontype, layer->connection);
   conn->close = close_func;
+  conn->is_alive = alive_func;
   conn->ref_count = 1;
   conn->thread_id = msGetThreadId();
   conn->last_used = time(NULL);
@@ -243,9 +418,12 @@ void msConnPoolRegister(layerObj *layer, void *conn_handle,
 
   if (strcasecmp(close_connection, "NORMAL") == 0)
     conn->lifespan = MS_LIFE_ZEROREF;
-  else if (strcasecmp(close_connection, "DEFER") == 0)
-    conn->lifespan = MS_LIFE_FOREVER;
-  else if (strcasecmp(close_connection, "ALWAYS") == 0)
+  else if (strcasecmp(close_connection, "DEFER") == 0) {
+    conn->lifespan = msConnPoolGetProcessingInt(
+        layer, "CONNECTION_IDLE_TIMEOUT", MS_LIFE_FOREVER);
+    if (conn->lifespan == 0)
+      conn->lifespan = MS_LIFE_FOREVER;
+  } else if (strcasecmp(close_connection, "ALWAYS") == 0)
     conn->lifespan = MS_LIFE_SINGLE;
   else {
     msDebug("msConnPoolRegister(): "
@@ -257,21 +435,51 @@ void msConnPoolRegister(layerObj *layer, void *conn_handle,
     conn->lifespan = MS_LIFE_ZEROREF;
   }
 
+  max_connections =
+      msConnPoolGetProcessingInt(layer, "CONNECTION_POOL_MAX", 0);
+
+  msAcquireLock(TLOCK_POOL);
+
+  /* -------------------------------------------------------------------- */
+  /*      Connections opened beyond CONNECTION_POOL_MAX are not pooled.   */
+  /* -------------------------------------------------------------------- */
+  if (max_connections > 0 && conn->lifespan != MS_LIFE_SINGLE) {
+    for (other = connectionBuckets[conn->hash % MS_CONN_POOL_BUCKETS]; other;
+         other = other->next) {
+      if (other->hash == conn->hash &&
+          other->connectiontype == conn->connectiontype &&
+          other->lifespan != MS_LIFE_SINGLE &&
+          strcasecmp(other->connection, conn->connection) == 0)
+        count++;
+    }
+
+    if (count >= max_connections) {
+      if (layer->debug)
+        msDebug("msConnPoolRegister(%s): CONNECTION_POOL_MAX=%d reached, "
+                "connection will not be pooled.\n",
+                layer->name, max_connections);
+      conn->lifespan = MS_LIFE_SINGLE;
+    }
+  }
+
+  conn->next = connectionBuckets[conn->hash % MS_CONN_POOL_BUCKETS];
+  connectionBuckets[conn->hash % MS_CONN_POOL_BUCKETS] = conn;
+  connectionCount++;
+
   msReleaseLock(TLOCK_POOL);
 }
 
 /************************************************************************/
 /*                          msConnPoolClose()                           */
 /*                                                                      */
-/*      Close the indicated connection.  The index in the connection    */
-/*      table is passed.  Remove the connection from the table as       */
-/*      well.                                                           */
+/*      Close the indicated connection and remove it from the pool.     */
+/*      We assume the caller has already acquired the pool lock.        */
 /************************************************************************/
 
-static void msConnPoolClose(int conn_index)
+static void msConnPoolClose(connectionObj *conn)
 
 {
-  connectionObj *conn = connections + conn_index;
+  connectionObj **link;
 
   if (conn->ref_count > 0) {
     if (conn->debug)
@@ -286,22 +494,60 @@ static void msConnPoolClose(int conn_index)
   if (conn->debug)
     msDebug("msConnPoolClose(%s,%p)\n", conn->connection, conn->conn_handle);
 
+  /* unlink it from its bucket and the idle list */
+  for (link = &(connectionBuckets[conn->hash % MS_CONN_POOL_BUCKETS]);
+       *link != NULL; link = &((*link)->next)) {
+    if (*link == conn) {
+      *link = conn->next;
+      break;
+    }
+  }
+  msConnPoolIdleRemove(conn);
+  connectionCount--;
+
+  /* a request waiting for CONNECTION_POOL_MAX may open its own now */
+  msSignalLockWaiters(TLOCK_POOL);
+
   if (conn->close != NULL)
     conn->close(conn->conn_handle);
 
   /* free malloced() stuff in this connection */
   free(conn->connection);
+  free(conn);
+}
 
-  connectionCount--;
-  if (connectionCount == 0) {
-    /* if there are no connections left we will "cleanup".  */
-    connectionMax = 0;
-    free(connections);
-    connections = NULL;
-  } else {
-    /* move the last connection in place of our now closed one */
-    memcpy(connections + conn_index, connections + connectionCount,
-           sizeof(connectionObj));
+/************************************************************************/
+/*                        msConnPoolReapIdle()                          */
+/*                                                                      */
+/*      Close idle connections past their CONNECTION_IDLE_TIMEOUT,      */
+/*      and the least recently used ones beyond                         */
+/*      MS_CONNECTION_POOL_MAX_IDLE.  We assume the caller has          */
+/*      already acquired the pool lock.                                 */
+/************************************************************************/
+
+static void msConnPoolReapIdle(time_t now)
+
+{
+  connectionObj *conn, *prev;
+  const char *max_idle_option;
+  int max_idle;
+
+  for (conn = idleTail; conn != NULL; conn = prev) {
+    prev = conn->idle_prev;
+    if (conn->lifespan > 0 && now - conn->last_used > conn->lifespan) {
+      connectionStats.evictions++;
+      msConnPoolClose(conn);
+    }
+  }
+
+  max_idle_option = CPLGetConfigOption("MS_CONNECTION_POOL_MAX_IDLE", NULL);
+  if (max_idle_option == NULL)
+    return;
+
+  max_idle = MS_MAX(0, atoi(max_idle_option));
+  while (idleCount > max_idle) {
+    connectionStats.evictions++;
+    msConnPoolClose(idleTail);
   }
 }
 
@@ -317,8 +563,15 @@ static void msConnPoolClose(int conn_index)
 void *msConnPoolRequest(layerObj *layer)
 
 {
-  int i;
   const char *close_connection;
+  connectionObj *conn = NULL;
+  connWaiterObj waiter;
+  unsigned int hash;
+  int max_connections, wait_ms, waited = 0, count = 0;
+  int check = MS_FALSE, waiting = MS_FALSE, ahead;
+  void *conn_handle, *thread_id = msGetThreadId();
+  struct mstimeval starttime, currenttime;
+  time_t now;
 
   if (layer->connection == NULL)
     return NULL;
@@ -328,36 +581,137 @@ void *msConnPoolRequest(layerObj *layer)
   if (close_connection && strcasecmp(close_connection, "ALWAYS") == 0)
     return NULL;
 
+  max_connections =
+      msConnPoolGetProcessingInt(layer, "CONNECTION_POOL_MAX", 0);
+  wait_ms = msConnPoolGetProcessingInt(layer, "CONNECTION_POOL_WAIT", 0);
+#ifndef USE_THREAD
+  wait_ms = 0; /* no other thread can release a connection */
+#endif
+  hash = msConnPoolHash(layer->connectiontype, layer->connection);
+
   msAcquireLock(TLOCK_POOL);
-  for (i = 0; i < connectionCount; i++) {
-    connectionObj *conn = connections + i;
 
-    if (layer->connectiontype == conn->connectiontype &&
-        strcasecmp(layer->connection, conn->connection) == 0 &&
-        (conn->ref_count == 0 || conn->thread_id == msGetThreadId()) &&
-        conn->lifespan != MS_LIFE_SINGLE) {
-      void *conn_handle = NULL;
+  for (;;) {
+    now = time(NULL);
+    msConnPoolReapIdle(now);
 
-      conn->ref_count++;
-      conn->thread_id = msGetThreadId();
-      conn->last_used = time(NULL);
+    /* unused connections go to the requests that waited longest first */
+    ahead = msConnPoolWaiterAhead(waiting ? &waiter : NULL, layer, hash);
 
-      if (layer->debug) {
-        msDebug("msConnPoolRequest(%s,%s) -> got %p\n", layer->name,
-                layer->connection, conn->conn_handle);
-        conn->debug = layer->debug;
-      }
+    count = 0;
+    for (conn = connectionBuckets[hash % MS_CONN_POOL_BUCKETS]; conn != NULL;
+         conn = conn->next) {
+      if (conn->hash != hash || layer->connectiontype != conn->connectiontype ||
+          conn->lifespan == MS_LIFE_SINGLE ||
+          strcasecmp(layer->connection, conn->connection) != 0)
+        continue;
+
+      count++;
+      if ((conn->ref_count == 0 && !ahead) || conn->thread_id == thread_id)
+        break;
+    }
+
+    /* -------------------------------------------------------------------- */
+    /*      Wait for a connection to be released if this key has reached   */
+    /*      its CONNECTION_POOL_MAX.                                        */
+    /* -------------------------------------------------------------------- */
+    if (conn != NULL || max_connections <= 0 || count < max_connections ||
+        waited >= wait_ms)
+      break;
+
+    if (!waiting) {
+      connectionStats.waits++;
+      waiter.connectiontype = layer->connectiontype;
+      waiter.connection = layer->connection;
+      waiter.hash = hash;
+      waiter.next = NULL;
+      if (waiterTail)
+        waiterTail->next = &waiter;
+      else
+        waiterHead = &waiter;
+      waiterTail = &waiter;
+      waiting = MS_TRUE;
+      msGettimeofday(&starttime, NULL);
+    }
 
-      conn_handle = conn->conn_handle;
+    /* woken up by msConnPoolRelease() and msConnPoolClose() */
+    msWaitOnLock(TLOCK_POOL, wait_ms - waited);
+    msGettimeofday(&currenttime, NULL);
+    waited = (int)((currenttime.tv_sec - starttime.tv_sec) * 1000 +
+                   (currenttime.tv_usec - starttime.tv_usec) / 1000);
+  }
+
+  if (waiting) {
+    msConnPoolWaiterRemove(&waiter);
+    /* the next request waiting for this key may take a connection now */
+    msSignalLockWaiters(TLOCK_POOL);
+  }
+
+  if (conn == NULL) {
+    if (max_connections > 0 && count >= max_connections && wait_ms > 0) {
+      connectionStats.timeouts++;
+      if (layer->debug)
+        msDebug("msConnPoolRequest(%s,%s): timed out waiting for one of %d "
+                "connections\n",
+                layer->name, layer->connection, max_connections);
+    }
+    connectionStats.misses++;
+    msReleaseLock(TLOCK_POOL);
+    return NULL;
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Take the connection, probing it first if it was unused for a    */
+  /*      while.  The probe may hit the network, so it is done without    */
+  /*      holding the lock, the reference keeps other threads away.       */
+  /* -------------------------------------------------------------------- */
+  if (conn->ref_count == 0) {
+    const char *check_interval =
+        CPLGetConfigOption("MS_CONNECTION_POOL_CHECK_INTERVAL", NULL);
+
+    check = conn->is_alive != NULL &&
+            now - conn->last_used >= (check_interval
+                                          ? atoi(check_interval)
+                                          : MS_CONN_POOL_CHECK_INTERVAL);
+    msConnPoolIdleRemove(conn);
+  }
+
+  conn->ref_count++;
+  conn->thread_id = thread_id;
+  conn->last_used = now;
+
+  if (layer->debug) {
+    msDebug("msConnPoolRequest(%s,%s) -> got %p\n", layer->name,
+            layer->connection, conn->conn_handle);
+    conn->debug = layer->debug;
+  }
 
+  if (check) {
+    int alive;
+
+    msReleaseLock(TLOCK_POOL);
+    alive = conn->is_alive(conn->conn_handle);
+    msAcquireLock(TLOCK_POOL);
+
+    if (!alive) {
+      if (layer->debug)
+        msDebug("msConnPoolRequest(%s,%s): connection %p is dead, closing "
+                "it\n",
+                layer->name, layer->connection, conn->conn_handle);
+      connectionStats.failed_checks++;
+      connectionStats.misses++;
+      conn->ref_count = 0;
+      msConnPoolClose(conn);
       msReleaseLock(TLOCK_POOL);
-      return conn_handle;
+      return NULL;
     }
   }
 
+  conn_handle = conn->conn_handle;
+  connectionStats.hits++;
   msReleaseLock(TLOCK_POOL);
 
-  return NULL;
+  return conn_handle;
 }
 
 /************************************************************************/
@@ -365,14 +719,14 @@ void *msConnPoolRequest(layerObj *layer)
 /*                                                                      */
 /*      Release the passed connection for the given layer.              */
 /*      Internally the reference count is dropped, and the              */
-/*      connection may be closed.  We assume the caller has already     */
-/*      acquired the pool lock.                                         */
+/*      connection may be closed.                                       */
 /************************************************************************/
 
 void msConnPoolRelease(layerObj *layer, void *conn_handle)
 
 {
-  int i;
+  connectionObj *conn;
+  unsigned int hash;
 
   if (layer->debug)
     msDebug("msConnPoolRelease(%s,%s,%p)\n", layer->name, layer->connection,
@@ -381,22 +735,29 @@ void msConnPoolRelease(layerObj *layer, void *conn_handle)
   if (layer->connection == NULL)
     return;
 
-  msAcquireLock(TLOCK_POOL);
-  for (i = 0; i < connectionCount; i++) {
-    connectionObj *conn = connections + i;
+  hash = msConnPoolHash(layer->connectiontype, layer->connection);
 
-    if (layer->connectiontype == conn->connectiontype &&
-        strcasecmp(layer->connection, conn->connection) == 0 &&
-        conn->conn_handle == conn_handle) {
+  msAcquireLock(TLOCK_POOL);
+  for (conn = connectionBuckets[hash % MS_CONN_POOL_BUCKETS]; conn != NULL;
+       conn = conn->next) {
+    if (conn->conn_handle == conn_handle && conn->hash == hash &&
+        layer->connectiontype == conn->connectiontype &&
+        strcasecmp(layer->connection, conn->connection) == 0) {
       conn->ref_count--;
       conn->last_used = time(NULL);
 
-      if (conn->ref_count == 0)
+      if (conn->ref_count == 0) {
         conn->thread_id = 0;
 
-      if (conn->ref_count == 0 && (conn->lifespan == MS_LIFE_ZEROREF ||
-                                   conn->lifespan == MS_LIFE_SINGLE))
-        msConnPoolClose(i);
+        if (conn->lifespan == MS_LIFE_ZEROREF ||
+            conn->lifespan == MS_LIFE_SINGLE)
+          msConnPoolClose(conn);
+        else {
+          msConnPoolIdleAdd(conn);
+          msConnPoolReapIdle(conn->last_used);
+          msSignalLockWaiters(TLOCK_POOL);
+        }
+      }
 
       msReleaseLock(TLOCK_POOL);
       return;
@@ -427,18 +788,34 @@ void msConnPoolCloseUnreferenced()
   /* msDebug( "msConnPoolCloseUnreferenced()\n" ); */
 
   msAcquireLock(TLOCK_POOL);
-  for (i = connectionCount - 1; i >= 0; i--) {
-    connectionObj *conn = connections + i;
+  for (i = 0; i < MS_CONN_POOL_BUCKETS; i++) {
+    connectionObj *conn = connectionBuckets[i], *next;
 
-    if (conn->ref_count == 0) {
-      /* for now we don't assume the locks are re-entrant, so release */
-      /* it so msConnPoolClose() can get it.  */
-      msConnPoolClose(i);
+    for (; conn != NULL; conn = next) {
+      next = conn->next;
+      if (conn->ref_count == 0)
+        msConnPoolClose(conn);
     }
   }
   msReleaseLock(TLOCK_POOL);
 }
 
+/************************************************************************/
+/*                      msConnPoolGetStatistics()                       */
+/*                                                                      */
+/*      Return the current state and counters of the pool.              */
+/************************************************************************/
+
+void msConnPoolGetStatistics(connPoolStatsObj *stats)
+
+{
+  msAcquireLock(TLOCK_POOL);
+  *stats = connectionStats;
+  stats->connections = connectionCount;
+  stats->idle = idleCount;
+  msReleaseLock(TLOCK_POOL);
+}
+
 /************************************************************************/
 /*                       msConnPoolFinalCleanup()                       */
 /*                                                                      */
@@ -449,11 +826,15 @@ void msConnPoolCloseUnreferenced()
 void msConnPoolFinalCleanup()
 
 {
+  int i;
+
   /* this really needs to be commented out before committing.  */
   /* msDebug( "msConnPoolFinalCleanup()\n" ); */
 
   msAcquireLock(TLOCK_POOL);
-  while (connectionCount > 0)
-    msConnPoolClose(0);
+  for (i = 0; i < MS_CONN_POOL_BUCKETS; i++) {
+    while (connectionBuckets[i] != NULL)
+      msConnPoolClose(connectionBuckets[i]);
+  }
   msReleaseLock(TLOCK_POOL);
 }
@@ -141,6 +141,26 @@ static void msPostGISCloseConnection(void *pgconn) {
   PQfinish((PGconn *)pgconn);
 }
 
+/*
+** msPostGISCheckConnection()
+**
+** Probe registered with msConnPoolRegisterWithCheck so that connections
+** dropped by the server while sitting in the pool are not handed out.
+*/
+static int msPostGISCheckConnection(void *pgconn) {
+  PGconn *conn = (PGconn *)pgconn;
+
+  if (PQstatus(conn) != CONNECTION_OK)
+    return MS_FALSE;
+
+  PGresult *pgresult = PQexec(conn, "SELECT 1");
+  const bool alive =
+      pgresult != nullptr && PQresultStatus(pgresult) == PGRES_TUPLES_OK;
+  PQclear(pgresult);
+
+  return alive ? MS_TRUE : MS_FALSE;
+}
+
 /*
 ** msPostGISCreateLayerInfo()
 */
@@ -301,34 +321,25 @@ static inline void wkbReadPointP(wkbObj *w, pointObj *p, int nZMFlag) {
 }
 
 /*
-** Read one pointObj (two doubles) from the WKB and advance the read pointer.
-** We assume the endianness of the WKB is the same as this machine.
-*/
-static inline pointObj wkbReadPoint(wkbObj *w, int nZMFlag) {
-  pointObj p;
-  wkbReadPointP(w, &p, nZMFlag);
-  return p;
-}
-
-/*
-** Read a "point array" and return an allocated lineObj.
+** Read a "point array" and append it as a line to a shape, reusing
+** the storage of a recycled shape (see msShapeAddPoints()).
 ** A point array is a WKB fragment that starts with a
 ** point count, which is followed by that number of doubles * 2.
 ** Linestrings, circular strings, polygon rings, all show this
 ** form.
 */
-static void wkbReadLine(wkbObj *w, lineObj *line, int nZMFlag) {
-  pointObj p;
+static int wkbReadLine(wkbObj *w, shapeObj *shape, int nZMFlag) {
   const int npoints = wkbReadInt(w);
-  if (npoints > (int)((w->size - (w->ptr - w->wkb)) / 16))
-    return;
+  if (npoints < 0 || npoints > (int)((w->size - (w->ptr - w->wkb)) / 16))
+    return MS_FAILURE;
 
-  line->numpoints = npoints;
-  line->point = (pointObj *)msSmallMalloc(npoints * sizeof(pointObj));
-  for (int i = 0; i < npoints; i++) {
-    wkbReadPointP(w, &p, nZMFlag);
-    line->point[i] = p;
-  }
+  pointObj *points = msShapeAddPoints(shape, npoints);
+  if (points == nullptr)
+    return MS_FAILURE;
+  for (int i = 0; i < npoints; i++)
+    wkbReadPointP(w, &(points[i]), nZMFlag);
+
+  return MS_SUCCESS;
 }
 
 /*
@@ -393,11 +404,10 @@ static int wkbConvPointToShape(wkbObj *w, shapeObj *shape) {
 
   if (!(shape->type == MS_SHAPE_POINT))
     return MS_FAILURE;
-  lineObj line;
-  line.numpoints = 1;
-  line.point = (pointObj *)msSmallMalloc(sizeof(pointObj));
-  line.point[0] = wkbReadPoint(w, nZMFlag);
-  msAddLineDirectly(shape, &line);
+  pointObj *point = msShapeAddPoints(shape, 1);
+  if (point == nullptr)
+    return MS_FAILURE;
+  wkbReadPointP(w, point, nZMFlag);
   return MS_SUCCESS;
 }
 
@@ -412,11 +422,7 @@ static int wkbConvLineStringToShape(wkbObj *w, shapeObj *shape) {
   if (type != WKB_LINESTRING)
     return MS_FAILURE;
 
-  lineObj line;
-  wkbReadLine(w, &line, nZMFlag);
-  msAddLineDirectly(shape, &line);
-
-  return MS_SUCCESS;
+  return wkbReadLine(w, shape, nZMFlag);
 }
 
 /*
@@ -436,10 +442,9 @@ static int wkbConvPolygonToShape(wkbObj *w, shapeObj *shape) {
     return MS_FAILURE;
 
   /* Add each ring to the shape */
-  lineObj line;
   for (int i = 0; i < nrings; i++) {
-    wkbReadLine(w, &line, nZMFlag);
-    msAddLineDirectly(shape, &line);
+    if (wkbReadLine(w, shape, nZMFlag) != MS_SUCCESS)
+      return MS_FAILURE;
   }
 
   return MS_SUCCESS;
@@ -546,8 +551,10 @@ static int wkbConvCompoundCurveToShape(wkbObj *w, shapeObj *shape) {
     wkbConvGeometryToShape(w, &shapebuf);
 
   /* Do nothing on empty */
-  if (shapebuf.numlines == 0)
+  if (shapebuf.numlines == 0) {
+    msFreeShape(&shapebuf);
     return MS_FAILURE;
+  }
 
   /* Count the total number of points */
   int npoints = 0;
@@ -555,8 +562,10 @@ static int wkbConvCompoundCurveToShape(wkbObj *w, shapeObj *shape) {
     npoints += shapebuf.line[i].numpoints;
 
   /* Do nothing on empty */
-  if (npoints == 0)
+  if (npoints == 0) {
+    msFreeShape(&shapebuf);
     return MS_FAILURE;
+  }
 
   lineObj line;
   line.numpoints = npoints;
@@ -2265,18 +2274,35 @@ static int msPostGISReadShape(layerObj *layer, shapeObj *shape) {
   if (wkb != wkbstatic)
     free(wkb);
 
+  /* spare lines of a recycled shape */
+  msShapeTrimLines(shape);
+
   if (result != MS_FAILURE) {
-    /* Found a drawable shape, so now retrieve the attributes. */
+    /* Found a drawable shape, so now retrieve the attributes. The value
+     * strings of a recycled shape are resized rather than reallocated. */
+    const int bReuseValues = shape->values != nullptr &&
+                             shape->maxvalues == layer->numitems &&
+                             layer->numitems > 0;
+
+    if (!bReuseValues) {
+      if (shape->maxvalues > 0)
+        msFreeCharArray(shape->values, shape->maxvalues);
+      shape->values =
+          (char **)msSmallMalloc(sizeof(char *) * layer->numitems);
+      for (int t = 0; t < layer->numitems; t++)
+        shape->values[t] = nullptr;
+    }
+    shape->maxvalues = 0;
 
-    shape->values = (char **)msSmallMalloc(sizeof(char *) * layer->numitems);
     for (int t = 0; t < layer->numitems; t++) {
       const int size = PQgetlength(layerinfo->pgresult, layerinfo->rownum, t);
       const char *val = PQgetvalue(layerinfo->pgresult, layerinfo->rownum, t);
       const int isnull = PQgetisnull(layerinfo->pgresult, layerinfo->rownum, t);
       if (isnull) {
-        shape->values[t] = msStrdup("");
+        shape->values[t] = (char *)msSmallRealloc(shape->values[t], 1);
+        shape->values[t][0] = '\0';
       } else {
-        shape->values[t] = (char *)msSmallMalloc(size + 1);
+        shape->values[t] = (char *)msSmallRealloc(shape->values[t], size + 1);
         memcpy(shape->values[t], val, size);
         shape->values[t][size] = '\0'; /* null terminate it */
 
@@ -2431,7 +2457,9 @@ static int msPostGISLayerOpen(layerObj *layer) {
                          (void *)layer);
 
     /* Save this connection in the pool for later. */
-    msConnPoolRegister(layer, layerinfo->pgconn, msPostGISCloseConnection);
+    msConnPoolRegisterWithCheck(layer, layerinfo->pgconn,
+                                msPostGISCloseConnection,
+                                msPostGISCheckConnection);
   } else {
     /* Connection in the pool should be tested to see if backend is alive. */
     if (PQstatus(layerinfo->pgconn) != CONNECTION_OK) {
@@ -2761,6 +2789,46 @@ static int msPostGISLayerNextShape(layerObj *layer, shapeObj *shape) {
 #endif
 }
 
+/*
+** msPostGISLayerNextShapes()
+**
+** Registered vtable->LayerNextShapes function. Reads the rows into the
+** storage left in the batch by the previous one.
+*/
+static int msPostGISLayerNextShapes(layerObj *layer, shapeBatchObj *batch,
+                                    int maxshapes) {
+#ifdef USE_POSTGIS
+  if (layer->debug) {
+    msDebug("msPostGISLayerNextShapes called.\n");
+  }
+
+  assert(layer != nullptr);
+  assert(layer->layerinfo != nullptr);
+
+  msPostGISLayerInfo *layerinfo = (msPostGISLayerInfo *)layer->layerinfo;
+  const int first = batch->numshapes;
+
+  while (batch->numshapes - first < maxshapes &&
+         layerinfo->rownum < PQntuples(layerinfo->pgresult)) {
+    shapeObj *shape = msShapeBatchAdd(batch);
+
+    shape->type = MS_SHAPE_NULL;
+    msPostGISReadShape(layer, shape);
+    (layerinfo->rownum)++; /* move to next shape */
+    if (shape->type == MS_SHAPE_NULL) {
+      msResetShape(shape);
+      batch->numshapes--;
+    }
+  }
+
+  return (batch->numshapes > first) ? MS_SUCCESS : MS_DONE;
+#else
+  msSetError(MS_MISCERR, "PostGIS support is not available.",
+             "msPostGISLayerNextShapes()");
+  return MS_FAILURE;
+#endif
+}
+
 /*
 ** msPostGISLayerGetShape()
 **
@@ -2827,6 +2895,34 @@ static int msPostGISLayerGetShapeCount(layerObj *layer, rectObj rect,
     return -1;
   }
 
+  /* With a COUNT_ESTIMATE_THRESHOLD, large result sets are only counted */
+  /* by the query planner. */
+  const int nThreshold = msLayerGetCountEstimateThreshold(layer);
+  if (nThreshold >= 0) {
+    const std::string strSQLExplain = "EXPLAIN " + strSQL;
+    PGresult *pgresult =
+        runPQexecParamsWithBindSubstitution(layer, strSQLExplain.c_str(), 0);
+    int nEstimate = -1;
+    if (pgresult && PQresultStatus(pgresult) == PGRES_TUPLES_OK &&
+        PQntuples(pgresult) > 0) {
+      /* first line of the plan: "... (cost=0.00..1.00 rows=N width=M)" */
+      const char *pszRows = strstr(PQgetvalue(pgresult, 0, 0), " rows=");
+      if (pszRows)
+        nEstimate = atoi(pszRows + strlen(" rows="));
+    }
+    if (pgresult) {
+      PQclear(pgresult);
+    }
+    if (layer->debug) {
+      msDebug("msPostGISLayerGetShapeCount estimate: %d.\n", nEstimate);
+    }
+    if (nEstimate >= nThreshold) {
+      if (layer->maxfeatures > 0 && nEstimate > layer->maxfeatures)
+        nEstimate = layer->maxfeatures;
+      return nEstimate;
+    }
+  }
+
   std::string strSQLCount = "SELECT COUNT(*) FROM (";
   strSQLCount += strSQL;
   strSQLCount += ") msQuery";
@@ -4007,6 +4103,7 @@ int msPostGISLayerInitializeVirtualTable(layerObj *layer) {
   layer->vtable->LayerIsOpen = msPostGISLayerIsOpen;
   layer->vtable->LayerWhichShapes = msPostGISLayerWhichShapes;
   layer->vtable->LayerNextShape = msPostGISLayerNextShape;
+  layer->vtable->LayerNextShapes = msPostGISLayerNextShapes;
   layer->vtable->LayerGetShape = msPostGISLayerGetShape;
   layer->vtable->LayerGetShapeCount = msPostGISLayerGetShapeCount;
   layer->vtable->LayerClose = msPostGISLayerClose;
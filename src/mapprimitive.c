@@ -29,9 +29,14 @@
 #include "mapserver.h"
 #include "mapprimitive.h"
 #include <assert.h>
+#include <float.h>
 #include <locale.h>
 #include "fontcache.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 typedef enum { CLIP_LEFT, CLIP_MIDDLE, CLIP_RIGHT } CLIP_STATE;
 
 #define CLIP_CHECK(min, a, max)                                                \
@@ -94,7 +99,12 @@ void msInitShape(shapeObj *shape) {
   shape->values = NULL;
   shape->numvalues = 0;
 
+  /* recycled storage */
+  shape->maxlines = 0;
+  shape->maxvalues = 0;
+
   shape->geometry = NULL;
+  shape->prepared_geometry = NULL;
   shape->renderer_cache = NULL;
 
   /* annotation component */
@@ -141,6 +151,7 @@ int msCopyShape(const shapeObj *from, shapeObj *to) {
   }
 
   to->geometry = NULL; /* GEOS code will build automatically if necessary */
+  to->prepared_geometry = NULL;
   to->scratch = from->scratch;
 
   return (0);
@@ -152,13 +163,14 @@ void msFreeShape(shapeObj *shape) {
   if (!shape)
     return; /* for safety */
 
-  for (c = 0; c < shape->numlines; c++)
+  /* a reset shape still owns its spare lines and values */
+  for (c = 0; c < MS_MAX(shape->numlines, shape->maxlines); c++)
     free(shape->line[c].point);
 
   if (shape->line)
     free(shape->line);
   if (shape->values)
-    msFreeCharArray(shape->values, shape->numvalues);
+    msFreeCharArray(shape->values, MS_MAX(shape->numvalues, shape->maxvalues));
   if (shape->text)
     free(shape->text);
 
@@ -169,6 +181,190 @@ void msFreeShape(shapeObj *shape) {
   msInitShape(shape); /* now reset */
 }
 
+/*
+** Empty a shape like msFreeShape() does, but keep its line array, point
+** buffers and value strings so that the next shape read into it only has to
+** grow them when needed. A reset shape must be filled again through
+** msShapeAllocLines()/msShapeAllocPoints() (as msSHPReadRecycledShape() does)
+** or released with msFreeShape(), not passed to msInitShape().
+*/
+void msResetShape(shapeObj *shape) {
+  if (!shape)
+    return;
+
+  /* numpoints of each line is left as the capacity of its point buffer */
+  shape->maxlines = MS_MAX(shape->maxlines, shape->numlines);
+  shape->numlines = 0;
+
+  if (shape->values && shape->numvalues > 0)
+    shape->maxvalues = shape->numvalues;
+  shape->numvalues = 0;
+
+  free(shape->text);
+  shape->text = NULL;
+
+#ifdef USE_GEOS
+  msGEOSFreeGeometry(shape);
+#endif
+  shape->renderer_cache = NULL;
+
+  shape->type = MS_SHAPE_NULL;
+  shape->bounds.minx = shape->bounds.miny = -1;
+  shape->bounds.maxx = shape->bounds.maxy = -1;
+  shape->classindex = 0;
+  shape->tileindex = shape->index = shape->resultindex = -1;
+  shape->scratch = MS_FALSE;
+}
+
+/*
+** Set the number of lines of an empty (initialized or reset) shape, reusing
+** the spare lines of a reset shape. The point buffers must then be set up
+** with msShapeAllocPoints() for every line.
+*/
+int msShapeAllocLines(shapeObj *shape, int numlines) {
+  int i;
+
+  /* spare lines beyond what is needed are released */
+  for (i = numlines; i < shape->maxlines; i++)
+    free(shape->line[i].point);
+  shape->maxlines = MS_MIN(shape->maxlines, numlines);
+
+  if (numlines > shape->maxlines) {
+    lineObj *line =
+        (lineObj *)realloc(shape->line, sizeof(lineObj) * numlines);
+    MS_CHECK_ALLOC(line, sizeof(lineObj) * numlines, MS_FAILURE);
+    shape->line = line;
+
+    for (i = shape->maxlines; i < numlines; i++) {
+      line[i].numpoints = 0;
+      line[i].point = NULL;
+    }
+  }
+
+  shape->numlines = numlines;
+  shape->maxlines = 0;
+
+  return MS_SUCCESS;
+}
+
+/*
+** Size the point buffer of a line set up by msShapeAllocLines(), growing it
+** only if the recycled one is too small.
+*/
+pointObj *msShapeAllocPoints(shapeObj *shape, int line, int numpoints) {
+  lineObj *l = &(shape->line[line]);
+
+  if (numpoints > l->numpoints || l->point == NULL) {
+    const size_t size = sizeof(pointObj) * MS_MAX(numpoints, 1);
+    pointObj *point = (pointObj *)realloc(l->point, size);
+    MS_CHECK_ALLOC(point, size, NULL);
+    l->point = point;
+  }
+
+  l->numpoints = numpoints;
+
+  return l->point;
+}
+
+/*
+** Append a line of numpoints points to a shape being read, reusing the spare
+** line of a reset shape at that position if there is one. For readers that
+** don't know the number of lines up front. Once the shape is read,
+** msShapeTrimLines() must release the spare lines left.
+*/
+pointObj *msShapeAddPoints(shapeObj *shape, int numpoints) {
+  if (shape->numlines >= shape->maxlines) {
+    const int maxlines = MS_MAX(4, shape->numlines * 2);
+    lineObj *line =
+        (lineObj *)realloc(shape->line, sizeof(lineObj) * maxlines);
+    int i;
+
+    MS_CHECK_ALLOC(line, sizeof(lineObj) * maxlines, NULL);
+    shape->line = line;
+    for (i = shape->numlines; i < maxlines; i++) {
+      line[i].numpoints = 0;
+      line[i].point = NULL;
+    }
+    shape->maxlines = maxlines;
+  }
+
+  shape->numlines++;
+
+  return msShapeAllocPoints(shape, shape->numlines - 1, numpoints);
+}
+
+/*
+** Release the spare lines of a shape read with msShapeAddPoints().
+*/
+void msShapeTrimLines(shapeObj *shape) {
+  int i;
+
+  for (i = shape->numlines; i < shape->maxlines; i++)
+    free(shape->line[i].point);
+  shape->maxlines = 0;
+
+  if (shape->numlines == 0) {
+    free(shape->line);
+    shape->line = NULL;
+  }
+}
+
+void msInitShapeBatch(shapeBatchObj *batch) {
+  batch->shapes = NULL;
+  batch->numshapes = 0;
+  batch->maxshapes = 0;
+}
+
+/*
+** Empty the shapes of a batch in one go, keeping the array and the shapes'
+** storage (see msResetShape()) for the next one.
+*/
+void msClearShapeBatch(shapeBatchObj *batch) {
+  int i;
+
+  if (!batch)
+    return;
+
+  for (i = 0; i < batch->numshapes; i++)
+    msResetShape(&(batch->shapes[i]));
+  batch->numshapes = 0;
+}
+
+void msFreeShapeBatch(shapeBatchObj *batch) {
+  int i;
+
+  if (!batch)
+    return;
+
+  /* slots past numshapes may still hold recycled storage */
+  for (i = 0; i < batch->maxshapes; i++)
+    msFreeShape(&(batch->shapes[i]));
+  free(batch->shapes);
+  msInitShapeBatch(batch);
+}
+
+/*
+** Append a shape to a batch, growing it if needed. The shape is either
+** initialized or reset, holding storage from a previous batch: readers that
+** do not recycle storage must msFreeShape() it first.
+*/
+shapeObj *msShapeBatchAdd(shapeBatchObj *batch) {
+  shapeObj *shape;
+
+  if (batch->numshapes == batch->maxshapes) {
+    int i;
+
+    batch->maxshapes = MS_MAX(16, batch->maxshapes * 2);
+    batch->shapes = (shapeObj *)msSmallRealloc(
+        batch->shapes, sizeof(shapeObj) * batch->maxshapes);
+    for (i = batch->numshapes; i < batch->maxshapes; i++)
+      msInitShape(&(batch->shapes[i]));
+  }
+
+  shape = &(batch->shapes[batch->numshapes++]);
+  return shape;
+}
+
 int msGetShapeRAMSize(shapeObj *shape) {
   int i;
   int size = 0;
@@ -379,7 +575,10 @@ int msAddLine(shapeObj *p, const lineObj *new_line) {
 int msAddLineDirectly(shapeObj *p, lineObj *new_line) {
   int c;
 
-  if (p->numlines == 0) {
+  if (p->numlines < p->maxlines) {
+    /* spare line of a shape being read, see msShapeAddPoints() */
+    free(p->line[p->numlines].point);
+  } else if (p->numlines == 0) {
     p->line = (lineObj *)malloc(sizeof(lineObj));
   } else {
     lineObj *newline =
@@ -526,15 +725,121 @@ static int clipLine(double *x1, double *y1, double *x2, double *y2,
   return (MS_TRUE);
 }
 
+/*
+** Outcodes used by the rectangle clippers. Each bit flags a point lying
+** strictly outside one side of the clip rectangle, so points on the boundary
+** get no bit for that axis.
+*/
+#define CLIP_CODE_LEFT 1
+#define CLIP_CODE_BELOW 2
+#define CLIP_CODE_RIGHT 4
+#define CLIP_CODE_ABOVE 8
+#define CLIP_CODE_X (CLIP_CODE_LEFT | CLIP_CODE_RIGHT)
+#define CLIP_CODE_Y (CLIP_CODE_BELOW | CLIP_CODE_ABOVE)
+
+/*
+** Segments are classified in batches of this many so that the outcodes of a
+** batch are computed in one tight loop and stay in cache while consumed.
+*/
+#define CLIP_BATCH_SIZE 256
+
+/*
+** Grows the output vertex buffer shared by all the parts of a shape being
+** clipped, so that the inner loops never allocate.
+*/
+static pointObj *clipReserveOutput(pointObj *out, int *maxout, int size) {
+  if (size > *maxout) {
+    free(out);
+    out = (pointObj *)msSmallMalloc(sizeof(pointObj) * size);
+    *maxout = size;
+  }
+  return out;
+}
+
+/*
+** Computes the outcodes of a batch of points. With SSE2 the x and y of a
+** point are compared against the rectangle corners together, the bit layout
+** of the outcodes matching the movemask results; otherwise the loop body is
+** kept free of branches so that compilers can vectorise it.
+*/
+static void clipComputeOutcodes(const pointObj *points, int numpoints,
+                                const rectObj *rect, unsigned char *codes) {
+  int i;
+#ifdef __SSE2__
+  const __m128d lower = _mm_loadu_pd(&rect->minx); /* minx, miny */
+  const __m128d upper = _mm_loadu_pd(&rect->maxx); /* maxx, maxy */
+
+  for (i = 0; i < numpoints; i++) {
+    const __m128d xy = _mm_loadu_pd(&points[i].x);
+    codes[i] = (unsigned char)(_mm_movemask_pd(_mm_cmplt_pd(xy, lower)) |
+                               (_mm_movemask_pd(_mm_cmpgt_pd(xy, upper)) << 2));
+  }
+#else
+  const double minx = rect->minx, miny = rect->miny;
+  const double maxx = rect->maxx, maxy = rect->maxy;
+
+  for (i = 0; i < numpoints; i++) {
+    const double x = points[i].x;
+    const double y = points[i].y;
+    codes[i] = (unsigned char)((x < minx) | ((y < miny) << 1) |
+                               ((x > maxx) << 2) | ((y > maxy) << 3));
+  }
+#endif
+}
+
+/*
+** Appends a copy of the given vertices as a new part of shape. maxlines is
+** the allocated size of shape->line, grown geometrically.
+*/
+static void clipAppendLine(shapeObj *shape, int *maxlines,
+                           const pointObj *points, int numpoints) {
+  lineObj *line;
+
+  if (shape->numlines == *maxlines) {
+    *maxlines = (*maxlines > 0) ? 2 * *maxlines : 4;
+    shape->line =
+        (lineObj *)msSmallRealloc(shape->line, sizeof(lineObj) * *maxlines);
+  }
+
+  line = &(shape->line[shape->numlines++]);
+  line->numpoints = numpoints;
+  line->point = (pointObj *)msSmallMalloc(sizeof(pointObj) * numpoints);
+  memcpy(line->point, points, sizeof(pointObj) * numpoints);
+}
+
+/*
+** Replaces the parts of shape with the clipped ones held in tmp.
+*/
+static void clipReplaceLines(shapeObj *shape, shapeObj *tmp) {
+  int i;
+
+  for (i = 0; i < shape->numlines; i++)
+    free(shape->line[i].point);
+  free(shape->line);
+
+  if (tmp->numlines == 0) {
+    free(tmp->line);
+    tmp->line = NULL;
+  }
+
+  shape->line = tmp->line;
+  shape->numlines = tmp->numlines;
+  msComputeBounds(shape);
+}
+
 /*
 ** Routine for clipping a polyline, stored in a shapeObj struct, to a
-** rectangle. Uses clipLine() function to create a new shapeObj.
+** rectangle. Uses clipLine() function to create a new shapeObj. Segments
+** that outcodes show to be entirely inside or entirely outside the rectangle
+** are handled without calling clipLine(), in the cases where clipLine() is
+** known to leave them untouched or to reject them.
 */
 void msClipPolylineRect(shapeObj *shape, rectObj rect) {
-  int i, j;
-  lineObj line = {0, NULL};
+  int i, j, k, n, maxlines, maxout = 0;
   double x1, x2, y1, y2;
   shapeObj tmp;
+  pointObj *out = NULL;
+  unsigned char codes[CLIP_BATCH_SIZE + 1];
 
   if (!shape || shape->numlines == 0) /* nothing to clip */
     return;
@@ -553,76 +858,245 @@ void msClipPolylineRect(shapeObj *shape, rectObj rect) {
     return;
   }
 
+  maxlines = shape->numlines;
+  tmp.line = (lineObj *)msSmallMalloc(sizeof(lineObj) * maxlines);
+
   for (i = 0; i < shape->numlines; i++) {
+    const pointObj *point = shape->line[i].point;
+    const int numpoints = shape->line[i].numpoints;
+
+    if (numpoints < 2)
+      continue;
+
+    /* a run of visible segments never holds more points than the part */
+    out = clipReserveOutput(out, &maxout, numpoints);
+    n = 0;
 
-    line.point =
-        (pointObj *)msSmallMalloc(sizeof(pointObj) * shape->line[i].numpoints);
-    line.numpoints = 0;
+    for (k = 1; k < numpoints; k += CLIP_BATCH_SIZE) {
+      const int end = MS_MIN(k + CLIP_BATCH_SIZE, numpoints);
 
-    x1 = shape->line[i].point[0].x;
-    y1 = shape->line[i].point[0].y;
-    for (j = 1; j < shape->line[i].numpoints; j++) {
-      x2 = shape->line[i].point[j].x;
-      y2 = shape->line[i].point[j].y;
-
-      if (clipLine(&x1, &y1, &x2, &y2, rect) == MS_TRUE) {
-        if (line.numpoints == 0) { /* first segment, add both points */
-          line.point[0].x = x1;
-          line.point[0].y = y1;
-          line.point[1].x = x2;
-          line.point[1].y = y2;
-          line.numpoints = 2;
-        } else { /* add just the last point */
-          line.point[line.numpoints].x = x2;
-          line.point[line.numpoints].y = y2;
-          line.numpoints++;
+      clipComputeOutcodes(point + k - 1, end - k + 1, &rect, codes);
+
+      for (j = k; j < end; j++) {
+        const int code1 = codes[j - k];
+        const int code2 = codes[j - k + 1];
+        int visible;
+
+        x1 = point[j - 1].x;
+        y1 = point[j - 1].y;
+        x2 = point[j].x;
+        y2 = point[j].y;
+
+        if ((code1 | code2) == 0) {
+          visible = MS_TRUE; /* clipLine() would not move either end */
+        } else if ((code1 & code2 & CLIP_CODE_X) ||
+                   ((code1 & code2 & CLIP_CODE_Y) &&
+                    ((code1 | code2) & CLIP_CODE_X) == 0)) {
+          visible = MS_FALSE; /* rejected by clipLine() before clipping */
+        } else {
+          visible = clipLine(&x1, &y1, &x2, &y2, rect);
         }
 
-        if ((x2 != shape->line[i].point[j].x) ||
-            (y2 != shape->line[i].point[j].y)) {
-          msAddLine(&tmp, &line);
-          line.numpoints = 0; /* new line */
+        if (visible == MS_TRUE) {
+          if (n == 0) { /* first segment, add both points */
+            out[0].x = x1;
+            out[0].y = y1;
+            out[1].x = x2;
+            out[1].y = y2;
+            n = 2;
+          } else { /* add just the last point */
+            out[n].x = x2;
+            out[n].y = y2;
+            n++;
+          }
+
+          if ((x2 != point[j].x) || (y2 != point[j].y)) {
+            clipAppendLine(&tmp, &maxlines, out, n);
+            n = 0; /* new line */
+          }
         }
       }
-
-      x1 = shape->line[i].point[j].x;
-      y1 = shape->line[i].point[j].y;
     }
 
-    if (line.numpoints > 0) {
-      msAddLineDirectly(&tmp, &line);
-    } else {
-      free(line.point);
-      line.numpoints = 0; /* new line */
-    }
+    if (n > 0)
+      clipAppendLine(&tmp, &maxlines, out, n);
   }
 
-  for (i = 0; i < shape->numlines; i++)
-    free(shape->line[i].point);
-  free(shape->line);
+  free(out);
+  clipReplaceLines(shape, &tmp);
+}
 
-  shape->line = tmp.line;
-  shape->numlines = tmp.numlines;
-  msComputeBounds(shape);
+/*
+** Checks one axis of a segment whose two ends lie beyond the same side of
+** the clip rectangle: dist is the distance of the first end to that side and
+** delta is how far the segment moves towards it. Returns MS_TRUE if the
+** Liang-Barsky step of msClipPolygonRect() cannot reach that side, keeping a
+** margin for rounding of its entry parameter and for the NEARZERO bump that
+** clipPolygonSegment() applies to a zero delta.
+*/
+static int clipAxisStaysOutside(double dist, double delta) {
+  return (dist > delta * (1.0 + 4 * DBL_EPSILON)) & (dist > 2 * NEARZERO);
 }
 
 /*
-** Slightly modified version of the Liang-Barsky polygon clipping algorithm
+** Returns MS_TRUE if the Liang-Barsky step of msClipPolygonRect() emits no
+** vertex for a segment whose two ends have the same non-zero outcode.
 */
-void msClipPolygonRect(shapeObj *shape, rectObj rect) {
-  int i, j;
+static int clipPolygonSegmentIsOutside(double x1, double y1, double x2,
+                                       double y2, int code,
+                                       const rectObj *rect) {
+  if ((code & CLIP_CODE_LEFT) &&
+      !clipAxisStaysOutside(rect->minx - x1, x2 - x1))
+    return MS_FALSE;
+  if ((code & CLIP_CODE_RIGHT) &&
+      !clipAxisStaysOutside(x1 - rect->maxx, x1 - x2))
+    return MS_FALSE;
+  if ((code & CLIP_CODE_BELOW) &&
+      !clipAxisStaysOutside(rect->miny - y1, y2 - y1))
+    return MS_FALSE;
+  if ((code & CLIP_CODE_ABOVE) &&
+      !clipAxisStaysOutside(y1 - rect->maxy, y1 - y2))
+    return MS_FALSE;
+  return MS_TRUE;
+}
+
+/*
+** Returns MS_TRUE if the Liang-Barsky step of msClipPolygonRect() emits
+** only the end point of the segment, which holds when both ends are strictly
+** inside the rectangle. Axis aligned segments are bumped off by NEARZERO in
+** clipPolygonSegment(), so they must also sit further than that from the
+** near edge.
+*/
+static int clipPolygonSegmentIsInside(double x1, double y1, double x2,
+                                      double y2, const rectObj *rect) {
+  if (!(x1 > rect->minx && x1 < rect->maxx && x2 > rect->minx &&
+        x2 < rect->maxx && y1 > rect->miny && y1 < rect->maxy &&
+        y2 > rect->miny && y2 < rect->maxy))
+    return MS_FALSE;
+  if (x1 == x2 && !(x1 - rect->minx > 2 * NEARZERO))
+    return MS_FALSE;
+  if (y1 == y2 && !(y1 - rect->miny > 2 * NEARZERO))
+    return MS_FALSE;
+  return MS_TRUE;
+}
+
+/*
+** One Liang-Barsky step of msClipPolygonRect(): appends to out the vertices
+** contributed by the segment (x1,y1)-(x2,y2), at most three of them.
+*/
+static void clipPolygonSegment(double x1, double y1, double x2, double y2,
+                               const rectObj *rect, pointObj *out, int *n) {
   double deltax, deltay, xin, xout, yin, yout;
   double tinx, tiny, toutx, touty, tin1, tin2, tout;
+
+  deltax = x2 - x1;
+  if (deltax == 0) { /* bump off of the vertical */
+    deltax = (x1 > rect->minx) ? -NEARZERO : NEARZERO;
+  }
+  deltay = y2 - y1;
+  if (deltay == 0) { /* bump off of the horizontal */
+    deltay = (y1 > rect->miny) ? -NEARZERO : NEARZERO;
+  }
+
+  if (deltax > 0) { /*  points to right */
+    xin = rect->minx;
+    xout = rect->maxx;
+  } else {
+    xin = rect->maxx;
+    xout = rect->minx;
+  }
+  if (deltay > 0) { /*  points up */
+    yin = rect->miny;
+    yout = rect->maxy;
+  } else {
+    yin = rect->maxy;
+    yout = rect->miny;
+  }
+
+  tinx = (xin - x1) / deltax;
+  tiny = (yin - y1) / deltay;
+
+  if (tinx < tiny) { /* hits x first */
+    tin1 = tinx;
+    tin2 = tiny;
+  } else { /* hits y first */
+    tin1 = tiny;
+    tin2 = tinx;
+  }
+
+  if (1 >= tin1) {
+    if (0 < tin1) {
+      out[*n].x = xin;
+      out[*n].y = yin;
+      (*n)++;
+    }
+    if (1 >= tin2) {
+      toutx = (xout - x1) / deltax;
+      touty = (yout - y1) / deltay;
+
+      tout = (toutx < touty) ? toutx : touty;
+
+      if (0 < tin2 || 0 < tout) {
+        if (tin2 <= tout) {
+          if (0 < tin2) {
+            if (tinx > tiny) {
+              out[*n].x = xin;
+              out[*n].y = y1 + tinx * deltay;
+              (*n)++;
+            } else {
+              out[*n].x = x1 + tiny * deltax;
+              out[*n].y = yin;
+              (*n)++;
+            }
+          }
+          if (1 > tout) {
+            if (toutx < touty) {
+              out[*n].x = xout;
+              out[*n].y = y1 + toutx * deltay;
+              (*n)++;
+            } else {
+              out[*n].x = x1 + touty * deltax;
+              out[*n].y = yout;
+              (*n)++;
+            }
+          } else {
+            out[*n].x = x2;
+            out[*n].y = y2;
+            (*n)++;
+          }
+        } else {
+          if (tinx > tiny) {
+            out[*n].x = xin;
+            out[*n].y = yout;
+            (*n)++;
+          } else {
+            out[*n].x = xout;
+            out[*n].y = yin;
+            (*n)++;
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+** Slightly modified version of the Liang-Barsky polygon clipping algorithm.
+** Outcodes are computed in batches so that the common runs of segments lying
+** entirely inside, or entirely within one outer region of, the rectangle skip
+** the full Liang-Barsky step while producing the same output.
+*/
+void msClipPolygonRect(shapeObj *shape, rectObj rect) {
+  int i, j, k, n, maxlines, maxout = 0;
   double x1, y1, x2, y2;
 
   shapeObj tmp;
-  lineObj line = {0, NULL};
+  pointObj *out = NULL;
+  unsigned char codes[CLIP_BATCH_SIZE + 1];
 
   if (!shape || shape->numlines == 0) /* nothing to clip */
     return;
 
-  msInitShape(&tmp);
-
   /*
   ** Don't do any clip processing of shapes completely within the
   ** clip rectangle based on a comparison of bounds.   We could do
@@ -635,131 +1109,63 @@ void msClipPolygonRect(shapeObj *shape, rectObj rect) {
     return;
   }
 
-  for (j = 0; j < shape->numlines; j++) {
+  msInitShape(&tmp);
 
-    line.point = (pointObj *)msSmallMalloc(
-        sizeof(pointObj) * 2 * shape->line[j].numpoints +
-        1); /* worst case scenario, +1 allows us to duplicate the 1st and last
-               point */
-    line.numpoints = 0;
+  /* clipping never produces more parts than it is given */
+  maxlines = shape->numlines;
+  tmp.line = (lineObj *)msSmallMalloc(sizeof(lineObj) * maxlines);
 
-    for (i = 0; i < shape->line[j].numpoints - 1; i++) {
+  for (j = 0; j < shape->numlines; j++) {
+    const pointObj *point = shape->line[j].point;
+    const int numpoints = shape->line[j].numpoints;
 
-      x1 = shape->line[j].point[i].x;
-      y1 = shape->line[j].point[i].y;
-      x2 = shape->line[j].point[i + 1].x;
-      y2 = shape->line[j].point[i + 1].y;
+    if (numpoints < 2)
+      continue;
 
-      deltax = x2 - x1;
-      if (deltax == 0) { /* bump off of the vertical */
-        deltax = (x1 > rect.minx) ? -NEARZERO : NEARZERO;
-      }
-      deltay = y2 - y1;
-      if (deltay == 0) { /* bump off of the horizontal */
-        deltay = (y1 > rect.miny) ? -NEARZERO : NEARZERO;
-      }
+    /* worst case is 3 points per segment, +1 to force closure */
+    out = clipReserveOutput(out, &maxout, 3 * (numpoints - 1) + 1);
+    n = 0;
 
-      if (deltax > 0) { /*  points to right */
-        xin = rect.minx;
-        xout = rect.maxx;
-      } else {
-        xin = rect.maxx;
-        xout = rect.minx;
-      }
-      if (deltay > 0) { /*  points up */
-        yin = rect.miny;
-        yout = rect.maxy;
-      } else {
-        yin = rect.maxy;
-        yout = rect.miny;
-      }
+    for (k = 0; k < numpoints - 1; k += CLIP_BATCH_SIZE) {
+      const int end = MS_MIN(k + CLIP_BATCH_SIZE, numpoints - 1);
 
-      tinx = (xin - x1) / deltax;
-      tiny = (yin - y1) / deltay;
+      clipComputeOutcodes(point + k, end - k + 1, &rect, codes);
 
-      if (tinx < tiny) { /* hits x first */
-        tin1 = tinx;
-        tin2 = tiny;
-      } else { /* hits y first */
-        tin1 = tiny;
-        tin2 = tinx;
-      }
+      for (i = k; i < end; i++) {
+        const int code = codes[i - k];
 
-      if (1 >= tin1) {
-        if (0 < tin1) {
-          line.point[line.numpoints].x = xin;
-          line.point[line.numpoints].y = yin;
-          line.numpoints++;
-        }
-        if (1 >= tin2) {
-          toutx = (xout - x1) / deltax;
-          touty = (yout - y1) / deltay;
-
-          tout = (toutx < touty) ? toutx : touty;
-
-          if (0 < tin2 || 0 < tout) {
-            if (tin2 <= tout) {
-              if (0 < tin2) {
-                if (tinx > tiny) {
-                  line.point[line.numpoints].x = xin;
-                  line.point[line.numpoints].y = y1 + tinx * deltay;
-                  line.numpoints++;
-                } else {
-                  line.point[line.numpoints].x = x1 + tiny * deltax;
-                  line.point[line.numpoints].y = yin;
-                  line.numpoints++;
-                }
-              }
-              if (1 > tout) {
-                if (toutx < touty) {
-                  line.point[line.numpoints].x = xout;
-                  line.point[line.numpoints].y = y1 + toutx * deltay;
-                  line.numpoints++;
-                } else {
-                  line.point[line.numpoints].x = x1 + touty * deltax;
-                  line.point[line.numpoints].y = yout;
-                  line.numpoints++;
-                }
-              } else {
-                line.point[line.numpoints].x = x2;
-                line.point[line.numpoints].y = y2;
-                line.numpoints++;
-              }
-            } else {
-              if (tinx > tiny) {
-                line.point[line.numpoints].x = xin;
-                line.point[line.numpoints].y = yout;
-                line.numpoints++;
-              } else {
-                line.point[line.numpoints].x = xout;
-                line.point[line.numpoints].y = yin;
-                line.numpoints++;
-              }
-            }
+        x1 = point[i].x;
+        y1 = point[i].y;
+        x2 = point[i + 1].x;
+        y2 = point[i + 1].y;
+
+        if (code == codes[i - k + 1]) {
+          if (code == 0 &&
+              clipPolygonSegmentIsInside(x1, y1, x2, y2, &rect)) {
+            out[n].x = x2;
+            out[n].y = y2;
+            n++;
+            continue;
           }
+          if (code != 0 &&
+              clipPolygonSegmentIsOutside(x1, y1, x2, y2, code, &rect))
+            continue;
         }
+
+        clipPolygonSegment(x1, y1, x2, y2, &rect, out, &n);
       }
     }
 
-    if (line.numpoints > 0) {
-      line.point[line.numpoints].x = line.point[0].x; /* force closure */
-      line.point[line.numpoints].y = line.point[0].y;
-      line.numpoints++;
-      msAddLineDirectly(&tmp, &line);
-    } else {
-      free(line.point);
+    if (n > 0) {
+      out[n].x = out[0].x; /* force closure */
+      out[n].y = out[0].y;
+      n++;
+      clipAppendLine(&tmp, &maxlines, out, n);
     }
   } /* next line */
 
-  for (i = 0; i < shape->numlines; i++)
-    free(shape->line[i].point);
-  free(shape->line);
-
-  shape->line = tmp.line;
-  shape->numlines = tmp.numlines;
-  msComputeBounds(shape);
-
-  return;
+  free(out);
+  clipReplaceLines(shape, &tmp);
 }
 
 /*
@@ -86,7 +86,15 @@ typedef struct {
   lineObj *line;
   char **values;
   void *geometry;
+  void *prepared_geometry;
   void *renderer_cache;
+
+  /* storage kept by msResetShape(): the first maxlines entries of line hold
+   * point buffers of at least numpoints points, and the first maxvalues
+   * entries of values hold strings. Both are 0 except on a reset shape, or
+   * one being read with msShapeAddPoints(). */
+  int maxlines;
+  int maxvalues;
 #endif
 
 #ifdef SWIG
@@ -113,6 +121,15 @@ typedef struct {
 
 typedef lineObj multipointObj;
 
+#ifndef SWIG
+/* a block of shapes, as returned by msLayerNextShapes() */
+typedef struct {
+  shapeObj *shapes;
+  int numshapes;
+  int maxshapes; /* allocated size of shapes */
+} shapeBatchObj;
+#endif
+
 #ifndef SWIG
 /* attribute primitives */
 typedef struct {
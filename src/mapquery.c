@@ -1489,6 +1489,37 @@ static int is_duplicate(resultCacheObj *resultcache, int shapeindex,
   return (MS_FALSE);
 }
 
+/*
+** Does a shape intersect a polygon selection shape (zero tolerance)? The
+** bounds are checked first, then GEOS is used if the selection shape has
+** been prepared with msGEOSPrepareGeometry(), so that its segments are
+** indexed once instead of being scanned for every candidate shape.
+*/
+static int msQueryIntersectsPolygon(shapeObj *selectshape, shapeObj *shape) {
+  if (!msRectOverlap(&selectshape->bounds, &shape->bounds))
+    return MS_FALSE;
+
+#ifdef USE_GEOS
+  if (selectshape->prepared_geometry) {
+    int result = msGEOSIntersects(shape, selectshape);
+    if (result != -1)
+      return result;
+  }
+#endif
+
+  switch (shape->type) {
+  case MS_SHAPE_POINT:
+    return msIntersectMultipointPolygon(shape, selectshape);
+  case MS_SHAPE_LINE:
+    return msIntersectPolylinePolygon(shape, selectshape);
+  case MS_SHAPE_POLYGON:
+    return msIntersectPolygons(shape, selectshape);
+  default:
+    break;
+  }
+  return MS_FALSE;
+}
+
 int msQueryByFeatures(mapObj *map) {
   int i, l;
   int start, stop = 0;
@@ -1636,6 +1667,11 @@ int msQueryByFeatures(mapObj *map) {
       if (slp->project)
         msProjectShape(&(slp->projection), &(map->projection), &selectshape);
 
+#ifdef USE_GEOS
+      if (selectshape.type == MS_SHAPE_POLYGON)
+        msGEOSPrepareGeometry(&selectshape);
+#endif
+
       /* identify target shapes */
       searchrect = selectshape.bounds;
 
@@ -1733,7 +1769,7 @@ int msQueryByFeatures(mapObj *map) {
                                    selectshape */
           case MS_SHAPE_POINT:
             if (tolerance == 0) /* just test for intersection */
-              status = msIntersectMultipointPolygon(&shape, &selectshape);
+              status = msQueryIntersectsPolygon(&selectshape, &shape);
             else { /* check distance, distance=0 means they intersect */
               distance = msDistanceShapeToShape(&selectshape, &shape);
               if (distance < tolerance)
@@ -1742,7 +1778,7 @@ int msQueryByFeatures(mapObj *map) {
             break;
           case MS_SHAPE_LINE:
             if (tolerance == 0) { /* just test for intersection */
-              status = msIntersectPolylinePolygon(&shape, &selectshape);
+              status = msQueryIntersectsPolygon(&selectshape, &shape);
             } else { /* check distance, distance=0 means they intersect */
               distance = msDistanceShapeToShape(&selectshape, &shape);
               if (distance < tolerance)
@@ -1751,7 +1787,7 @@ int msQueryByFeatures(mapObj *map) {
             break;
           case MS_SHAPE_POLYGON:
             if (tolerance == 0) /* just test for intersection */
-              status = msIntersectPolygons(&shape, &selectshape);
+              status = msQueryIntersectsPolygon(&selectshape, &shape);
             else { /* check distance, distance=0 means they intersect */
               distance = msDistanceShapeToShape(&selectshape, &shape);
               if (distance < tolerance)
@@ -2178,6 +2214,14 @@ int msQueryByShape(mapObj *map) {
 
   msComputeBounds(qshape); /* make sure an accurate extent exists */
 
+#ifdef USE_GEOS
+  /* the selection polygon is tested against every candidate, prepare it */
+  if (qshape->type == MS_SHAPE_POLYGON) {
+    msGEOSFreeGeometry(qshape); /* in case the shape changed since */
+    msGEOSPrepareGeometry(qshape);
+  }
+#endif
+
   for (l = start; l >= stop; l--) { /* each layer */
     reprojectionObj *reprojector = NULL;
     lp = (GET_LAYER(map, l));
@@ -2345,7 +2389,7 @@ int msQueryByShape(mapObj *map) {
             shape.type) { /* make sure shape actually intersects the shape */
         case MS_SHAPE_POINT:
           if (tolerance == 0) /* just test for intersection */
-            status = msIntersectMultipointPolygon(&shape, qshape);
+            status = msQueryIntersectsPolygon(qshape, &shape);
           else { /* check distance, distance=0 means they intersect */
             distance = msDistanceShapeToShape(qshape, &shape);
             if (distance < tolerance)
@@ -2354,7 +2398,7 @@ int msQueryByShape(mapObj *map) {
           break;
         case MS_SHAPE_LINE:
           if (tolerance == 0) { /* just test for intersection */
-            status = msIntersectPolylinePolygon(&shape, qshape);
+            status = msQueryIntersectsPolygon(qshape, &shape);
           } else { /* check distance, distance=0 means they intersect */
             distance = msDistanceShapeToShape(qshape, &shape);
             if (distance < tolerance)
@@ -2363,7 +2407,7 @@ int msQueryByShape(mapObj *map) {
           break;
         case MS_SHAPE_POLYGON:
           if (tolerance == 0) /* just test for intersection */
-            status = msIntersectPolygons(&shape, qshape);
+            status = msQueryIntersectsPolygon(qshape, &shape);
           else { /* check distance, distance=0 means they intersect */
             distance = msDistanceShapeToShape(qshape, &shape);
             if (distance < tolerance)
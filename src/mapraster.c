@@ -42,6 +42,7 @@ extern parseResultObj yypresult; /* result of parsing, true/false */
 
 #include "gdal.h"
 #include "cpl_string.h"
+#include "cpl_multiproc.h"
 #include "mapraster.h"
 
 #define MAXCOLORS 256
@@ -229,6 +230,324 @@ int msGetClass_FloatRGB_WithFirstClassToTry(layerObj *layer, float fValue,
   return msGetClass_String(layer, &color, pixel_value, firstClassToTry);
 }
 
+/************************************************************************/
+/*                   Compiled raster classification                     */
+/*                                                                      */
+/*      Evaluating the class expressions is by far the most costly      */
+/*      part of classifying float and 16 bit rasters with many          */
+/*      classes.  When every class expression is a plain interval on    */
+/*      [pixel] (comparisons to numbers joined with AND, or a string    */
+/*      holding a number), the class list is turned into a sorted       */
+/*      table of boundaries.  The class of each elementary interval     */
+/*      between two boundaries, or of a boundary itself, is resolved    */
+/*      once, and a value is then classified with a binary search.      */
+/************************************************************************/
+
+struct rasterClassTableObj {
+  int numbounds;
+  double *bounds;   /* sorted, unique */
+  int *classindex;  /* 2 * numbounds + 1 entries */
+  int nanclass;     /* class without expression, the only one matching NaN */
+};
+
+typedef struct {
+  double min, max;
+  int min_inclusive, max_inclusive;
+} rasterClassInterval;
+
+/* Restrict an interval with a "[pixel] <op> value" comparison. */
+static int msRasterClassIntervalRestrict(rasterClassInterval *interval,
+                                         int op, double value) {
+  switch (op) {
+  case MS_TOKEN_COMPARISON_EQ:
+    return msRasterClassIntervalRestrict(interval, MS_TOKEN_COMPARISON_GE,
+                                         value) &&
+           msRasterClassIntervalRestrict(interval, MS_TOKEN_COMPARISON_LE,
+                                         value);
+  case MS_TOKEN_COMPARISON_GT:
+  case MS_TOKEN_COMPARISON_GE:
+    if (value > interval->min) {
+      interval->min = value;
+      interval->min_inclusive = (op == MS_TOKEN_COMPARISON_GE);
+    } else if (value == interval->min && op == MS_TOKEN_COMPARISON_GT) {
+      interval->min_inclusive = MS_FALSE;
+    }
+    return MS_TRUE;
+  case MS_TOKEN_COMPARISON_LT:
+  case MS_TOKEN_COMPARISON_LE:
+    if (value < interval->max) {
+      interval->max = value;
+      interval->max_inclusive = (op == MS_TOKEN_COMPARISON_LE);
+    } else if (value == interval->max && op == MS_TOKEN_COMPARISON_LT) {
+      interval->max_inclusive = MS_FALSE;
+    }
+    return MS_TRUE;
+  default:
+    return MS_FALSE;
+  }
+}
+
+/*
+** Parse "term (AND term)*" where a term is a parenthesized conjunction or a
+** comparison between [pixel] and a number.  Returns MS_FALSE for anything
+** else.
+*/
+static int msRasterClassParseConjunction(tokenListNodeObjPtr *node,
+                                         rasterClassInterval *interval) {
+  while (MS_TRUE) {
+    tokenListNodeObjPtr n = *node;
+
+    if (n == NULL)
+      return MS_FALSE;
+
+    if (n->token == '(') {
+      *node = n->next;
+      if (!msRasterClassParseConjunction(node, interval))
+        return MS_FALSE;
+      if (*node == NULL || (*node)->token != ')')
+        return MS_FALSE;
+      *node = (*node)->next;
+    } else {
+      tokenListNodeObjPtr op = n->next;
+      tokenListNodeObjPtr rhs = op ? op->next : NULL;
+      int comparison;
+
+      if (rhs == NULL)
+        return MS_FALSE;
+      comparison = op->token;
+
+      if (n->token == MS_TOKEN_BINDING_DOUBLE &&
+          n->tokenval.bindval.index == 0 &&
+          rhs->token == MS_TOKEN_LITERAL_NUMBER) {
+        if (!msRasterClassIntervalRestrict(interval, comparison,
+                                           rhs->tokenval.dblval))
+          return MS_FALSE;
+      } else if (n->token == MS_TOKEN_LITERAL_NUMBER &&
+                 rhs->token == MS_TOKEN_BINDING_DOUBLE &&
+                 rhs->tokenval.bindval.index == 0) {
+        /* "value <op> [pixel]", mirror the comparison */
+        if (comparison == MS_TOKEN_COMPARISON_GT)
+          comparison = MS_TOKEN_COMPARISON_LT;
+        else if (comparison == MS_TOKEN_COMPARISON_GE)
+          comparison = MS_TOKEN_COMPARISON_LE;
+        else if (comparison == MS_TOKEN_COMPARISON_LT)
+          comparison = MS_TOKEN_COMPARISON_GT;
+        else if (comparison == MS_TOKEN_COMPARISON_LE)
+          comparison = MS_TOKEN_COMPARISON_GE;
+        if (!msRasterClassIntervalRestrict(interval, comparison,
+                                           n->tokenval.dblval))
+          return MS_FALSE;
+      } else {
+        return MS_FALSE;
+      }
+      *node = rhs->next;
+    }
+
+    if (*node == NULL || (*node)->token != MS_TOKEN_LOGICAL_AND)
+      return MS_TRUE;
+    *node = (*node)->next;
+  }
+}
+
+/* Get the interval of values matched by a class expression. */
+static int msRasterClassGetInterval(expressionObj *expression,
+                                    rasterClassInterval *interval) {
+  interval->min = -HUGE_VAL;
+  interval->max = HUGE_VAL;
+  interval->min_inclusive = interval->max_inclusive = MS_TRUE;
+
+  if (expression->string == NULL)
+    return MS_TRUE;
+
+  if (expression->type == MS_STRING) {
+    /* matched against the "%18g" formatting of the value */
+    char formatted[100];
+    const char *value = expression->string;
+    char *end;
+    double dfValue = strtod(value, &end);
+
+    if (end == value || *end != '\0' || !CPLIsFinite(dfValue))
+      return MS_FALSE;
+    snprintf(formatted, sizeof(formatted), "%g", dfValue);
+    if (strcmp(formatted, value) != 0)
+      return MS_FALSE;
+    interval->min = interval->max = dfValue;
+    return MS_TRUE;
+  }
+
+  if (expression->type == MS_EXPRESSION) {
+    tokenListNodeObjPtr node;
+    char *item_names[4] = {"pixel", "red", "green", "blue"};
+    int numitems = 4;
+
+    if (expression->tokens == NULL &&
+        msTokenizeExpression(expression, item_names, &numitems) !=
+            MS_SUCCESS)
+      return MS_FALSE;
+
+    node = expression->tokens;
+    return msRasterClassParseConjunction(&node, interval) && node == NULL;
+  }
+
+  return MS_FALSE;
+}
+
+static int msRasterClassIntervalContains(const rasterClassInterval *interval,
+                                         double value) {
+  if (value < interval->min || (value == interval->min &&
+                                !interval->min_inclusive))
+    return MS_FALSE;
+  if (value > interval->max || (value == interval->max &&
+                                !interval->max_inclusive))
+    return MS_FALSE;
+  return MS_TRUE;
+}
+
+static int msRasterClassCompareDouble(const void *a, const void *b) {
+  const double da = *(const double *)a;
+  const double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+/************************************************************************/
+/*                      msRasterClassTableCreate()                      */
+/*                                                                      */
+/*      Compile the classes of a layer for msRasterClassTableLookup().  */
+/*      Returns NULL if a class cannot be compiled, in which case the   */
+/*      expressions must be evaluated with msGetClass_FloatRGB().       */
+/************************************************************************/
+
+rasterClassTableObj *msRasterClassTableCreate(layerObj *layer) {
+  rasterClassTableObj *table;
+  rasterClassInterval *intervals;
+  int *classes;
+  int i, k, numintervals = 0, nanclass = -1;
+
+  if (layer->numclasses == 0)
+    return NULL;
+
+  intervals = (rasterClassInterval *)msSmallMalloc(
+      sizeof(rasterClassInterval) * layer->numclasses);
+  classes = (int *)msSmallMalloc(sizeof(int) * layer->numclasses);
+
+  for (i = 0; i < layer->numclasses; i++) {
+    /* a single class without expression always matches, see
+     * msGetClass_String() */
+    if (!(layer->numclasses == 1 && !layer->class[0] -> expression.string) &&
+        layer->class[i] -> group && layer -> classgroup &&strcasecmp(
+                                                 layer->class[i] -> group,
+                                                 layer -> classgroup) != 0)
+      continue;
+
+    if (!msRasterClassGetInterval(&(layer->class[i]->expression),
+                                  &(intervals[numintervals]))) {
+      msFree(intervals);
+      msFree(classes);
+      return NULL;
+    }
+    classes[numintervals++] = i;
+
+    /* later classes can never match */
+    if (layer->class[i] -> expression.string == NULL) {
+      nanclass = i;
+      break;
+    }
+  }
+
+  table = (rasterClassTableObj *)msSmallCalloc(1, sizeof(rasterClassTableObj));
+  table->nanclass = nanclass;
+  table->bounds =
+      (double *)msSmallMalloc(sizeof(double) * (2 * numintervals + 1));
+  for (i = 0; i < numintervals; i++) {
+    if (intervals[i].min != -HUGE_VAL)
+      table->bounds[table->numbounds++] = intervals[i].min;
+    if (intervals[i].max != HUGE_VAL)
+      table->bounds[table->numbounds++] = intervals[i].max;
+  }
+  qsort(table->bounds, table->numbounds, sizeof(double),
+        msRasterClassCompareDouble);
+  for (i = 0, k = 0; i < table->numbounds; i++) {
+    if (k == 0 || table->bounds[i] != table->bounds[k - 1])
+      table->bounds[k++] = table->bounds[i];
+  }
+  table->numbounds = k;
+
+  /* resolve the class of each boundary and of each interval in between */
+  table->classindex =
+      (int *)msSmallMalloc(sizeof(int) * (2 * table->numbounds + 1));
+  for (k = 0; k < 2 * table->numbounds + 1; k++) {
+    double value;
+
+    if (k % 2 == 1)
+      value = table->bounds[k / 2];
+    else if (table->numbounds == 0)
+      value = 0.0;
+    else if (k == 0) /* adding 1 would be absorbed by large bounds */
+      value = nextafter(table->bounds[0], -HUGE_VAL);
+    else if (k == 2 * table->numbounds)
+      value = nextafter(table->bounds[table->numbounds - 1], HUGE_VAL);
+    else /* halved first so that it cannot overflow */
+      value = table->bounds[k / 2 - 1] / 2 + table->bounds[k / 2] / 2;
+
+    table->classindex[k] = -1;
+    for (i = 0; i < numintervals; i++) {
+      if (msRasterClassIntervalContains(&(intervals[i]), value)) {
+        table->classindex[k] = classes[i];
+        break;
+      }
+    }
+  }
+
+  msFree(intervals);
+  msFree(classes);
+
+  return table;
+}
+
+/************************************************************************/
+/*                      msRasterClassTableLookup()                      */
+/*                                                                      */
+/*      Same result as msGetClass_FloatRGB(layer, fValue, -1, -1, -1)   */
+/*      for a compiled layer.                                           */
+/************************************************************************/
+
+int msRasterClassTableLookup(const rasterClassTableObj *table, float fValue) {
+  char pixel_value[100];
+  double value;
+  int lo = 0, hi = table->numbounds;
+
+  /* the expressions see the value formatted like msGetClass_FloatRGB() */
+  snprintf(pixel_value, sizeof(pixel_value), "%18g", fValue);
+  value = atof(pixel_value);
+  if (CPLIsNan(value))
+    return table->nanclass;
+
+  /* first boundary not below the value */
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (table->bounds[mid] < value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < table->numbounds && table->bounds[lo] == value)
+    return table->classindex[2 * lo + 1];
+  return table->classindex[2 * lo];
+}
+
+/************************************************************************/
+/*                       msRasterClassTableFree()                       */
+/************************************************************************/
+
+void msRasterClassTableFree(rasterClassTableObj *table) {
+  if (table) {
+    msFree(table->bounds);
+    msFree(table->classindex);
+    msFree(table);
+  }
+}
+
 /************************************************************************/
 /*                      msRasterSetupTileLayer()                        */
 /*                                                                      */
@@ -599,6 +918,221 @@ msDrawRasterLayerLowCheckDataset(mapObj *map, layerObj *layer, GDALDatasetH hDS,
   return CDRT_OK;
 }
 
+/************************************************************************/
+/*                        Raster dataset cache                          */
+/*                                                                      */
+/*      Opening a dataset and parsing its header often costs more       */
+/*      than reading the few pixels a map request needs, for remote    */
+/*      COGs in particular.  Released datasets are kept open in a       */
+/*      process level LRU list keyed by the decrypted path and the      */
+/*      open options, and handed out again to the next caller.  A       */
+/*      handle is used by a single caller at a time.  The number of     */
+/*      idle handles is bounded by the MS_GDAL_DATASET_CACHE_SIZE       */
+/*      configuration option, 0 disabling the cache.                    */
+/************************************************************************/
+
+#define MS_RASTER_DATASET_CACHE_DEFAULT_SIZE 32
+
+typedef struct rasterDatasetCacheEntry {
+  char *key;
+  GDALDatasetH hDS;
+  int in_use;
+  struct rasterDatasetCacheEntry *prev, *next;
+} rasterDatasetCacheEntry;
+
+static rasterDatasetCacheEntry *rasterDatasetCacheHead = NULL;
+static rasterDatasetCacheEntry *rasterDatasetCacheTail = NULL;
+
+static int msRasterDatasetCacheMaxSize(void) {
+  const char *value = CPLGetConfigOption("MS_GDAL_DATASET_CACHE_SIZE", NULL);
+  if (value == NULL)
+    return MS_RASTER_DATASET_CACHE_DEFAULT_SIZE;
+  return MS_MAX(0, atoi(value));
+}
+
+static void msRasterDatasetCacheUnlink(rasterDatasetCacheEntry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    rasterDatasetCacheHead = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    rasterDatasetCacheTail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void msRasterDatasetCachePushFront(rasterDatasetCacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = rasterDatasetCacheHead;
+  if (rasterDatasetCacheHead)
+    rasterDatasetCacheHead->prev = entry;
+  rasterDatasetCacheHead = entry;
+  if (rasterDatasetCacheTail == NULL)
+    rasterDatasetCacheTail = entry;
+}
+
+static void msRasterDatasetCacheFreeEntry(rasterDatasetCacheEntry *entry) {
+  GDALClose(entry->hDS);
+  msFree(entry->key);
+  msFree(entry);
+}
+
+/*
+** Build the cache key of a dataset from its decrypted path and the options
+** it is opened with.
+*/
+static char *msRasterDatasetCacheKey(const char *decrypted_path,
+                                     char **papszAllowedDrivers,
+                                     char **papszOpenOptions) {
+  char *key = msStringConcatenate(NULL, decrypted_path);
+  int i;
+
+  for (i = 0; papszAllowedDrivers && papszAllowedDrivers[i]; i++) {
+    key = msStringConcatenate(key, "\nD:");
+    key = msStringConcatenate(key, papszAllowedDrivers[i]);
+  }
+  for (i = 0; papszOpenOptions && papszOpenOptions[i]; i++) {
+    key = msStringConcatenate(key, "\nO:");
+    key = msStringConcatenate(key, papszOpenOptions[i]);
+  }
+  return key;
+}
+
+/************************************************************************/
+/*                    msRasterDatasetCacheOpen()                        */
+/*                                                                      */
+/*      Return an idle cached dataset matching the path and options,    */
+/*      or open a new one.  The handle must be given back with          */
+/*      msRasterDatasetCacheRelease().                                  */
+/************************************************************************/
+
+GDALDatasetH msRasterDatasetCacheOpen(const char *decrypted_path,
+                                      char **papszAllowedDrivers,
+                                      char **papszOpenOptions) {
+  rasterDatasetCacheEntry *entry;
+  GDALDatasetH hDS;
+  char *key;
+
+  if (msRasterDatasetCacheMaxSize() == 0)
+    return GDALOpenEx(decrypted_path, GDAL_OF_RASTER,
+                      (const char *const *)papszAllowedDrivers,
+                      (const char *const *)papszOpenOptions, NULL);
+
+  key = msRasterDatasetCacheKey(decrypted_path, papszAllowedDrivers,
+                                papszOpenOptions);
+
+  msAcquireLock(TLOCK_GDAL_DATASETS);
+  for (entry = rasterDatasetCacheHead; entry != NULL; entry = entry->next) {
+    if (!entry->in_use && strcmp(entry->key, key) == 0) {
+      entry->in_use = MS_TRUE;
+      msReleaseLock(TLOCK_GDAL_DATASETS);
+      msFree(key);
+      return entry->hDS;
+    }
+  }
+  msReleaseLock(TLOCK_GDAL_DATASETS);
+
+  hDS = GDALOpenEx(decrypted_path, GDAL_OF_RASTER,
+                   (const char *const *)papszAllowedDrivers,
+                   (const char *const *)papszOpenOptions, NULL);
+  if (hDS == NULL) {
+    msFree(key);
+    return NULL;
+  }
+
+  entry = (rasterDatasetCacheEntry *)msSmallCalloc(
+      1, sizeof(rasterDatasetCacheEntry));
+  entry->key = key;
+  entry->hDS = hDS;
+  entry->in_use = MS_TRUE;
+
+  msAcquireLock(TLOCK_GDAL_DATASETS);
+  msRasterDatasetCachePushFront(entry);
+  msReleaseLock(TLOCK_GDAL_DATASETS);
+
+  return hDS;
+}
+
+/************************************************************************/
+/*                   msRasterDatasetCacheRelease()                      */
+/*                                                                      */
+/*      Give back a dataset obtained from msRasterDatasetCacheOpen().   */
+/*      It is kept open for reuse unless bClose is set, and the least   */
+/*      recently used idle datasets beyond the cache size are closed.   */
+/************************************************************************/
+
+void msRasterDatasetCacheRelease(GDALDatasetH hDS, int bClose) {
+  rasterDatasetCacheEntry *entry, *victims = NULL;
+  int max_size = msRasterDatasetCacheMaxSize();
+  int idle = 0;
+
+  msAcquireLock(TLOCK_GDAL_DATASETS);
+  for (entry = rasterDatasetCacheHead; entry != NULL; entry = entry->next) {
+    if (entry->hDS == hDS && entry->in_use)
+      break;
+  }
+
+  if (entry == NULL) {
+    /* not from the cache */
+    msReleaseLock(TLOCK_GDAL_DATASETS);
+    GDALClose(hDS);
+    return;
+  }
+
+  msRasterDatasetCacheUnlink(entry);
+  if (bClose || max_size == 0) {
+    entry->next = victims;
+    victims = entry;
+  } else {
+    entry->in_use = MS_FALSE;
+    msRasterDatasetCachePushFront(entry);
+  }
+
+  /* trim idle entries from the least recently used end */
+  entry = rasterDatasetCacheHead;
+  while (entry != NULL) {
+    rasterDatasetCacheEntry *next = entry->next;
+    if (!entry->in_use && ++idle > max_size) {
+      msRasterDatasetCacheUnlink(entry);
+      entry->next = victims;
+      victims = entry;
+    }
+    entry = next;
+  }
+  msReleaseLock(TLOCK_GDAL_DATASETS);
+
+  while (victims != NULL) {
+    entry = victims;
+    victims = entry->next;
+    msRasterDatasetCacheFreeEntry(entry);
+  }
+}
+
+/************************************************************************/
+/*                    msRasterDatasetCacheCleanup()                     */
+/*                                                                      */
+/*      Close all the cached datasets.  Called from msGDALCleanup().    */
+/************************************************************************/
+
+void msRasterDatasetCacheCleanup(void) {
+  rasterDatasetCacheEntry *entry, *next;
+
+  msAcquireLock(TLOCK_GDAL_DATASETS);
+  for (entry = rasterDatasetCacheHead; entry != NULL; entry = next) {
+    next = entry->next;
+    if (entry->in_use) {
+      /* still referenced by a caller, leave it to GDAL's cleanup */
+      msFree(entry->key);
+      msFree(entry);
+    } else {
+      msRasterDatasetCacheFreeEntry(entry);
+    }
+  }
+  rasterDatasetCacheHead = rasterDatasetCacheTail = NULL;
+  msReleaseLock(TLOCK_GDAL_DATASETS);
+}
+
 /************************************************************************/
 /*              msDrawRasterLayerLowOpenDataset()                       */
 /************************************************************************/
@@ -645,10 +1179,8 @@ void *msDrawRasterLayerLowOpenDataset(mapObj *map, layerObj *layer,
         msLayerGetProcessingKey(layer, "ALLOWED_GDAL_DRIVERS");
     if (pszAllowedDrivers && !EQUAL(pszAllowedDrivers, "*"))
       papszAllowedDrivers = CSLTokenizeString2(pszAllowedDrivers, ",", 0);
-    GDALDatasetH hDS =
-        GDALOpenEx(*p_decrypted_path, GDAL_OF_RASTER | GDAL_OF_SHARED,
-                   (const char *const *)papszAllowedDrivers,
-                   (const char *const *)connectionoptions, NULL);
+    GDALDatasetH hDS = msRasterDatasetCacheOpen(
+        *p_decrypted_path, papszAllowedDrivers, connectionoptions);
     CSLDestroy(papszAllowedDrivers);
     CSLDestroy(connectionoptions);
 
@@ -678,38 +1210,34 @@ void *msDrawRasterLayerLowOpenDataset(mapObj *map, layerObj *layer,
     }
     return hDS;
   } else {
-    return GDALOpenShared(*p_decrypted_path, GA_ReadOnly);
+    return msRasterDatasetCacheOpen(*p_decrypted_path, NULL, NULL);
   }
 }
 
+/************************************************************************/
+/*                   msDrawRasterKeepDatasetOpen()                      */
+/*                                                                      */
+/*      Return MS_TRUE if a dataset should go back to the dataset       */
+/*      cache once drawn, which is the default for both single files    */
+/*      and tile indexes unless CLOSE_CONNECTION is set to something    */
+/*      else than DEFER.                                                */
+/************************************************************************/
+
+int msDrawRasterKeepDatasetOpen(layerObj *layer) {
+  const char *close_connection =
+      msLayerGetProcessingKey(layer, "CLOSE_CONNECTION");
+
+  return close_connection == NULL || strcasecmp(close_connection, "DEFER") == 0;
+}
+
 /************************************************************************/
 /*                msDrawRasterLayerLowCloseDataset()                    */
 /************************************************************************/
 
 void msDrawRasterLayerLowCloseDataset(layerObj *layer, void *hDS) {
   if (hDS) {
-    const char *close_connection;
-    close_connection = msLayerGetProcessingKey(layer, "CLOSE_CONNECTION");
-
-    if (close_connection == NULL && layer->tileindex == NULL)
-      close_connection = "DEFER";
-
-    {
-      /* Due to how GDAL processes OVERVIEW_LEVEL, datasets returned are */
-      /* not shared, despite being asked to, so close them for real */
-      char **connectionoptions =
-          msGetStringListFromHashTable(&(layer->connectionoptions));
-      if (CSLFetchNameValue(connectionoptions, "OVERVIEW_LEVEL"))
-        close_connection = NULL;
-      CSLDestroy(connectionoptions);
-    }
-
-    if (close_connection != NULL &&
-        strcasecmp(close_connection, "DEFER") == 0) {
-      GDALDereferenceDataset((GDALDatasetH)hDS);
-    } else {
-      GDALClose((GDALDatasetH)hDS);
-    }
+    msRasterDatasetCacheRelease((GDALDatasetH)hDS,
+                                !msDrawRasterKeepDatasetOpen(layer));
     msReleaseLock(TLOCK_GDAL);
   }
 }
@@ -782,6 +1310,342 @@ int msDrawRasterLayerLowCheckIfMustDraw(mapObj *map, layerObj *layer) {
   return 1;
 }
 
+/************************************************************************/
+/*                      msDrawRasterDrawDataset()                       */
+/*                                                                      */
+/*      Draw an opened dataset, resampling it if required.  Returns     */
+/*      -1 on failure like the underlying drawing functions.            */
+/************************************************************************/
+
+static int msDrawRasterDrawDataset(mapObj *map, layerObj *layer,
+                                   imageObj *image, rasterBufferObj *rb,
+                                   GDALDatasetH hDS) {
+  double adfGeoTransform[6];
+
+  msGetGDALGeoTransform(hDS, map, layer, adfGeoTransform);
+
+  /*
+  ** We want to resample if the source image is rotated, if
+  ** the projections differ or if resampling has been explicitly
+  ** requested, or if the image has north-down instead of north-up.
+  */
+
+  if (((adfGeoTransform[2] != 0.0 || adfGeoTransform[4] != 0.0 ||
+        adfGeoTransform[5] > 0.0 || adfGeoTransform[1] < 0.0) &&
+       layer->transform) ||
+      msProjectionsDiffer(&(map->projection), &(layer->projection)) ||
+      CSLFetchNameValue(layer->processing, "RESAMPLE") != NULL) {
+    return msResampleGDALToMap(map, layer, image, rb, hDS);
+  }
+
+  if (adfGeoTransform[2] != 0.0 || adfGeoTransform[4] != 0.0) {
+    if (layer->debug || map->debug)
+      msDebug("Layer %s has rotational coefficients but we\n"
+              "are unable to use them, projections support\n"
+              "needs to be built in.",
+              layer->name);
+  }
+  return msDrawRasterLayerGDAL(map, layer, image, rb, hDS);
+}
+
+#ifdef USE_THREAD
+
+#define MS_RASTER_MAX_TILE_THREADS 64
+
+typedef struct {
+  mapObj *map;
+  layerObj *layer;
+  imageObj *image;
+  CPLMutex *hCopyMutex;
+  CPLJoinableThread *hThread;
+
+  char tilename[MS_MAXPATHLEN];
+  char tilesrsname[1024];
+  int tilesrsindex;
+  char szPath[MS_MAXPATHLEN];
+  char *decrypted_path;
+
+  rasterBufferObj rb;
+  int status; /* MS_SUCCESS, MS_FAILURE or MS_DONE for a skipped tile */
+  int error_code;
+  char error_routine[ROUTINELENGTH];
+  char error_message[MESSAGELENGTH];
+} rasterTileJob;
+
+/************************************************************************/
+/*                    msDrawRasterGetTileThreads()                      */
+/*                                                                      */
+/*      Number of tiles of a tile index to decode concurrently, from    */
+/*      the TILEINDEX_THREADS processing option (a count or             */
+/*      ALL_CPUS).  Defaults to 1, ie. sequential drawing.              */
+/************************************************************************/
+
+static int msDrawRasterGetTileThreads(layerObj *layer) {
+  const char *value = msLayerGetProcessingKey(layer, "TILEINDEX_THREADS");
+  int nThreads;
+
+  if (value == NULL)
+    return 1;
+  if (EQUAL(value, "ALL_CPUS"))
+    nThreads = CPLGetNumCPUs();
+  else
+    nThreads = atoi(value);
+
+  return MS_MAX(1, MS_MIN(nThreads, MS_RASTER_MAX_TILE_THREADS));
+}
+
+/************************************************************************/
+/*                      msDrawRasterRenderTile()                        */
+/*                                                                      */
+/*      Open one tile of a tile index and draw it into the private      */
+/*      RGBA buffer of the job.  The layer and the map projection are   */
+/*      copied so that class expressions, TILESRS handling and PROJ     */
+/*      contexts are private to the calling thread.  The other map      */
+/*      members are only read.                                          */
+/************************************************************************/
+
+static void msDrawRasterRenderTile(rasterTileJob *job) {
+  mapObj sTileMap;
+  layerObj sTileLayer;
+  GDALDatasetH hDS = NULL;
+  int status;
+
+  job->status = MS_FAILURE;
+
+  memcpy(&sTileMap, job->map, sizeof(mapObj));
+  msInitProjection(&(sTileMap.projection));
+  initLayer(&sTileLayer, &sTileMap);
+
+  /* copying reads the PROJ objects of the source projections */
+  CPLAcquireMutex(job->hCopyMutex, 1000.0);
+  status = msCopyProjection(&(sTileMap.projection), &(job->map->projection));
+  if (status == MS_SUCCESS)
+    status = msCopyLayer(&sTileLayer, job->layer);
+  CPLReleaseMutex(job->hCopyMutex);
+
+  if (status != MS_SUCCESS)
+    goto cleanup;
+
+  if (MS_IMAGE_RENDERER(job->image)->initializeRasterBuffer(
+          &(job->rb), job->image->width, job->image->height,
+          MS_IMAGEMODE_RGBA) != MS_SUCCESS)
+    goto cleanup;
+
+  if (job->decrypted_path)
+    hDS = msRasterDatasetCacheOpen(job->decrypted_path, NULL, NULL);
+
+  switch (msDrawRasterLayerLowCheckDataset(&sTileMap, &sTileLayer, hDS,
+                                           job->decrypted_path, job->szPath)) {
+  case CDRT_CONTINUE_NEXT_TILE:
+    job->status = MS_DONE;
+    goto cleanup;
+  case CDRT_RETURN_MS_FAILURE:
+    goto cleanup;
+  case CDRT_OK:
+    break;
+  }
+
+  if (msDrawRasterLoadProjection(&sTileLayer, hDS, job->tilename,
+                                 job->tilesrsindex,
+                                 job->tilesrsname) != MS_SUCCESS)
+    goto cleanup;
+
+  if (msDrawRasterDrawDataset(&sTileMap, &sTileLayer, job->image, &(job->rb),
+                              hDS) != -1)
+    job->status = MS_SUCCESS;
+
+cleanup:
+  if (hDS)
+    msRasterDatasetCacheRelease(hDS, job->status != MS_SUCCESS ||
+                                         !msDrawRasterKeepDatasetOpen(
+                                             &sTileLayer));
+  freeLayer(&sTileLayer);
+  msFreeProjection(&(sTileMap.projection));
+}
+
+/************************************************************************/
+/*                      msDrawRasterTileThread()                        */
+/*                                                                      */
+/*      Thread entry point.  Errors are copied into the job since the   */
+/*      error list is per thread.  msResetErrorList() then frees the    */
+/*      errors and the te_info_t entry of this thread before it exits.  */
+/************************************************************************/
+
+static void msDrawRasterTileThread(void *pData) {
+  rasterTileJob *job = (rasterTileJob *)pData;
+  errorObj *ms_error;
+
+  msDrawRasterRenderTile(job);
+
+  ms_error = msGetErrorObj();
+  if (job->status == MS_FAILURE && ms_error->code != MS_NOERR) {
+    job->error_code = ms_error->code;
+    strlcpy(job->error_routine, ms_error->routine,
+            sizeof(job->error_routine));
+    strlcpy(job->error_message, ms_error->message,
+            sizeof(job->error_message));
+  }
+  msResetErrorList();
+}
+
+/************************************************************************/
+/*                    msDrawRasterCompositeTile()                       */
+/*                                                                      */
+/*      Composite a premultiplied RGBA tile buffer over the             */
+/*      destination buffer.                                             */
+/************************************************************************/
+
+static void msDrawRasterCompositeTile(rasterBufferObj *dst,
+                                      const rasterBufferObj *src) {
+  unsigned int i, j;
+
+  for (i = 0; i < src->height && i < dst->height; i++) {
+    for (j = 0; j < src->width && j < dst->width; j++) {
+      const size_t src_off = (size_t)j * src->data.rgba.pixel_step +
+                             (size_t)i * src->data.rgba.row_step;
+      const size_t dst_off = (size_t)j * dst->data.rgba.pixel_step +
+                             (size_t)i * dst->data.rgba.row_step;
+      const int alpha = src->data.rgba.a[src_off];
+
+      if (alpha == 0)
+        continue;
+
+      if (alpha == 255) {
+        dst->data.rgba.r[dst_off] = src->data.rgba.r[src_off];
+        dst->data.rgba.g[dst_off] = src->data.rgba.g[src_off];
+        dst->data.rgba.b[dst_off] = src->data.rgba.b[src_off];
+        if (dst->data.rgba.a)
+          dst->data.rgba.a[dst_off] = 255;
+      } else {
+        const int weight_dst = 255 - alpha;
+
+        dst->data.rgba.r[dst_off] =
+            src->data.rgba.r[src_off] +
+            (dst->data.rgba.r[dst_off] * weight_dst + 127) / 255;
+        dst->data.rgba.g[dst_off] =
+            src->data.rgba.g[src_off] +
+            (dst->data.rgba.g[dst_off] * weight_dst + 127) / 255;
+        dst->data.rgba.b[dst_off] =
+            src->data.rgba.b[src_off] +
+            (dst->data.rgba.b[dst_off] * weight_dst + 127) / 255;
+        if (dst->data.rgba.a)
+          dst->data.rgba.a[dst_off] =
+              alpha + (dst->data.rgba.a[dst_off] * weight_dst + 127) / 255;
+      }
+    }
+  }
+}
+
+/************************************************************************/
+/*                    msDrawRasterTileIndexThreaded()                   */
+/*                                                                      */
+/*      Draw the tiles of a tile index by batches of nThreads tiles.    */
+/*      The tiles of a batch are opened, decoded and resampled          */
+/*      concurrently into private buffers which are then composited     */
+/*      in index order, so the result matches sequential drawing.       */
+/************************************************************************/
+
+static int msDrawRasterTileIndexThreaded(mapObj *map, layerObj *layer,
+                                         imageObj *image, rasterBufferObj *rb,
+                                         layerObj *tlp, shapeObj *tshp,
+                                         int tileitemindex, int tilesrsindex,
+                                         int nThreads) {
+  rasterTileJob *jobs;
+  CPLMutex *hCopyMutex;
+  int i, nJobs, status, done = MS_FALSE;
+  int final_status = MS_SUCCESS;
+
+  if (layer->debug)
+    msDebug("msDrawRasterLayerLow(%s): drawing tiles with %d threads.\n",
+            layer->name, nThreads);
+
+  jobs = (rasterTileJob *)msSmallCalloc(nThreads, sizeof(rasterTileJob));
+  hCopyMutex = CPLCreateMutex(); /* created locked */
+  CPLReleaseMutex(hCopyMutex);
+
+  while (!done && final_status == MS_SUCCESS) {
+
+    /* collect the next batch of tiles */
+    nJobs = 0;
+    while (nJobs < nThreads) {
+      rasterTileJob *job = &(jobs[nJobs]);
+      const char *pszPath;
+
+      memset(job, 0, sizeof(rasterTileJob));
+      status = msDrawRasterIterateTileIndex(
+          layer, tlp, tshp, tileitemindex, tilesrsindex, job->tilename,
+          sizeof(job->tilename), job->tilesrsname, sizeof(job->tilesrsname));
+      if (status == MS_FAILURE) {
+        final_status = MS_FAILURE;
+        done = MS_TRUE;
+        break;
+      }
+      if (status == MS_DONE) {
+        done = MS_TRUE;
+        break;
+      }
+      if (strlen(job->tilename) == 0)
+        continue;
+
+      if (layer->debug)
+        msDebug("msDrawRasterLayerLow(%s): Filename is: %s\n", layer->name,
+                job->tilename);
+      if (strncmp(job->tilename, "<VRTDataset", strlen("<VRTDataset")) ==
+          0) {
+        pszPath = job->tilename;
+      } else {
+        msDrawRasterBuildRasterPath(map, layer, job->tilename, job->szPath);
+        pszPath = job->szPath;
+      }
+
+      job->map = map;
+      job->layer = layer;
+      job->image = image;
+      job->hCopyMutex = hCopyMutex;
+      job->tilesrsindex = tilesrsindex;
+      job->decrypted_path = msDecryptStringTokens(map, pszPath);
+      nJobs++;
+    }
+
+    /* decode the batch, falling back to this thread if needed */
+    for (i = 0; i < nJobs; i++) {
+      jobs[i].hThread =
+          CPLCreateJoinableThread(msDrawRasterTileThread, &(jobs[i]));
+      if (jobs[i].hThread == NULL)
+        msDrawRasterRenderTile(&(jobs[i]));
+    }
+    for (i = 0; i < nJobs; i++) {
+      if (jobs[i].hThread)
+        CPLJoinThread(jobs[i].hThread);
+    }
+
+    /* composite in index order, stopping at the first failed tile */
+    for (i = 0; i < nJobs; i++) {
+      rasterTileJob *job = &(jobs[i]);
+
+      if (final_status == MS_SUCCESS) {
+        if (job->status == MS_SUCCESS) {
+          msDrawRasterCompositeTile(rb, &(job->rb));
+        } else if (job->status == MS_FAILURE) {
+          if (job->error_code != MS_NOERR)
+            msSetError(job->error_code, "%s", job->error_routine,
+                       job->error_message);
+          final_status = MS_FAILURE;
+        }
+      }
+      msFreeRasterBuffer(&(job->rb));
+      msFree(job->decrypted_path);
+    }
+  }
+
+  CPLDestroyMutex(hCopyMutex);
+  msFree(jobs);
+
+  return final_status;
+}
+
+#endif /* USE_THREAD */
+
 /************************************************************************/
 /*                        msDrawRasterLayerLow()                        */
 /*                                                                      */
@@ -814,7 +1678,6 @@ int msDrawRasterLayerLowWithDataset(mapObj *map, layerObj *layer,
 
   rectObj searchrect;
   GDALDatasetH hDS;
-  double adfGeoTransform[6];
   void *kernel_density_cleanup_ptr = NULL;
 
   if (layer->debug > 0 || map->debug > 1)
@@ -838,6 +1701,21 @@ int msDrawRasterLayerLowWithDataset(mapObj *map, layerObj *layer,
         final_status = status;
       goto cleanup;
     }
+
+#ifdef USE_THREAD
+    /* decode tiles concurrently into private buffers when requested */
+    if (hDatasetIn == NULL && rb != NULL && rb->type == MS_BUFFER_BYTE_RGBA &&
+        layer->connectiontype != MS_KERNELDENSITY &&
+        layer->connectiontype != MS_IDW) {
+      int nThreads = msDrawRasterGetTileThreads(layer);
+      if (nThreads > 1) {
+        final_status = msDrawRasterTileIndexThreaded(
+            map, layer, image, rb, tlp, &tshp, tileitemindex, tilesrsindex,
+            nThreads);
+        goto cleanup;
+      }
+    }
+#endif
   }
 
   done = MS_FALSE;
@@ -916,41 +1794,18 @@ int msDrawRasterLayerLowWithDataset(mapObj *map, layerObj *layer,
     if (msDrawRasterLoadProjection(layer, hDS, filename, tilesrsindex,
                                    tilesrsname) != MS_SUCCESS) {
       if (hDatasetIn == NULL) {
-        GDALClose(hDS);
+        msRasterDatasetCacheRelease(hDS, MS_TRUE);
         msReleaseLock(TLOCK_GDAL);
       }
       final_status = MS_FAILURE;
       break;
     }
 
-    msGetGDALGeoTransform(hDS, map, layer, adfGeoTransform);
-
-    /*
-    ** We want to resample if the source image is rotated, if
-    ** the projections differ or if resampling has been explicitly
-    ** requested, or if the image has north-down instead of north-up.
-    */
-
-    if (((adfGeoTransform[2] != 0.0 || adfGeoTransform[4] != 0.0 ||
-          adfGeoTransform[5] > 0.0 || adfGeoTransform[1] < 0.0) &&
-         layer->transform) ||
-        msProjectionsDiffer(&(map->projection), &(layer->projection)) ||
-        CSLFetchNameValue(layer->processing, "RESAMPLE") != NULL) {
-      status = msResampleGDALToMap(map, layer, image, rb, hDS);
-    } else {
-      if (adfGeoTransform[2] != 0.0 || adfGeoTransform[4] != 0.0) {
-        if (layer->debug || map->debug)
-          msDebug("Layer %s has rotational coefficients but we\n"
-                  "are unable to use them, projections support\n"
-                  "needs to be built in.",
-                  layer->name);
-      }
-      status = msDrawRasterLayerGDAL(map, layer, image, rb, hDS);
-    }
+    status = msDrawRasterDrawDataset(map, layer, image, rb, hDS);
 
     if (status == -1) {
       if (hDatasetIn == NULL) {
-        GDALClose(hDS);
+        msRasterDatasetCacheRelease(hDS, MS_TRUE);
         msReleaseLock(TLOCK_GDAL);
       }
       final_status = MS_FAILURE;
@@ -959,8 +1814,8 @@ int msDrawRasterLayerLowWithDataset(mapObj *map, layerObj *layer,
 
     /*
     ** Should we keep this file open for future use?
-    ** default to keeping open for single data files, and
-    ** to closing for tile indexes
+    ** default to keeping it in the dataset cache, for single data
+    ** files and tile indexes alike
     */
     if (layer->connectiontype == MS_KERNELDENSITY ||
         layer->connectiontype == MS_IDW) {
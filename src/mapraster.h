@@ -57,4 +57,10 @@ int msDrawRasterLoadProjection(layerObj *layer, GDALDatasetH hDS,
                                const char *filename, int tilesrsindex,
                                const char *tilesrsname);
 
+GDALDatasetH msRasterDatasetCacheOpen(const char *decrypted_path,
+                                      char **papszAllowedDrivers,
+                                      char **papszOpenOptions);
+void msRasterDatasetCacheRelease(GDALDatasetH hDS, int bClose);
+int msDrawRasterKeepDatasetOpen(layerObj *layer);
+
 #endif /* MAPRASTER_H */
@@ -79,12 +79,25 @@ typedef struct {
 
   double shape_tolerance;
 
+  /* compiled classes, if possible, for the duration of a query */
+  rasterClassTableObj *class_table;
+
+  /* RQM_STATISTICS results: per band aggregates of the matching pixels */
+  int qs_count;
+  double *qs_min;
+  double *qs_max;
+  /* running mean and sum of squared deviations (Welford's algorithm) */
+  double *qs_mean;
+  double *qs_m2;
+  rectObj qs_rect;
+
 } rasterLayerInfo;
 
 #define RQM_UNKNOWN 0
 #define RQM_ENTRY_PER_PIXEL 1
 #define RQM_HIST_ON_CLASS 2
 #define RQM_HIST_ON_VALUE 3
+#define RQM_STATISTICS 4
 
 extern int InvGeoTransform(double *gt_in, double *gt_out);
 #define GEO_TRANS(tr, x, y) ((tr)[0] + (tr)[1] * (x) + (tr)[2] * (y))
@@ -165,6 +178,12 @@ static void msRasterLayerInfoFree(layerObj *layer)
   if (rlinfo->qc_tileindex != NULL)
     free(rlinfo->qc_tileindex);
 
+  msRasterClassTableFree(rlinfo->class_table);
+  msFree(rlinfo->qs_min);
+  msFree(rlinfo->qs_max);
+  msFree(rlinfo->qs_mean);
+  msFree(rlinfo->qs_m2);
+
   free(rlinfo);
 
   layer->layerinfo = NULL;
@@ -204,6 +223,93 @@ static void msRasterLayerInfoInitialize(layerObj *layer)
     rlinfo->query_result_hard_max =
         atoi(CSLFetchNameValue(layer->processing, "RASTER_QUERY_MAX_RESULT"));
   }
+
+  /* Rectangle and shape queries can return a single result holding band */
+  /* statistics instead of one result per pixel. */
+  if (CSLFetchNameValue(layer->processing, "RASTER_QUERY_MODE") != NULL &&
+      EQUAL(CSLFetchNameValue(layer->processing, "RASTER_QUERY_MODE"),
+            "STATISTICS"))
+    rlinfo->raster_query_mode = RQM_STATISTICS;
+}
+
+/************************************************************************/
+/*                    msRasterQueryClassifyPixel()                      */
+/*                                                                      */
+/*      Compute the color and class of a pixel.  Returns the class      */
+/*      index or -1, and sets *nodata if the pixel must be skipped.     */
+/************************************************************************/
+
+static int msRasterQueryClassifyPixel(layerObj *layer, const float *values,
+                                      int *red, int *green, int *blue,
+                                      int *nodata)
+
+{
+  rasterLayerInfo *rlinfo = (rasterLayerInfo *)layer->layerinfo;
+  int p_class = -1;
+
+  *red = *green = *blue = 0;
+  *nodata = FALSE;
+
+  /* -------------------------------------------------------------------- */
+  /*      Handle colormap                                                 */
+  /* -------------------------------------------------------------------- */
+  if (rlinfo->hCT != NULL) {
+    int pct_index = (int)floor(values[0]);
+    GDALColorEntry sEntry;
+
+    if (GDALGetColorEntryAsRGB(rlinfo->hCT, pct_index, &sEntry)) {
+      *red = sEntry.c1;
+      *green = sEntry.c2;
+      *blue = sEntry.c3;
+
+      if (sEntry.c4 == 0)
+        *nodata = TRUE;
+    } else
+      *nodata = TRUE;
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Color derived from greyscale value.                             */
+  /* -------------------------------------------------------------------- */
+  else {
+    if (rlinfo->band_count >= 3) {
+      *red = (int)MS_MAX(0, MS_MIN(255, values[0]));
+      *green = (int)MS_MAX(0, MS_MIN(255, values[1]));
+      *blue = (int)MS_MAX(0, MS_MIN(255, values[2]));
+    } else {
+      *red = *green = *blue = (int)MS_MAX(0, MS_MIN(255, values[0]));
+    }
+  }
+
+  /* -------------------------------------------------------------------- */
+  /*      Handle classification.                                          */
+  /*                                                                      */
+  /*      NOTE: The following is really quite inadequate to deal with     */
+  /*      classifications based on [red], [green] and [blue] as           */
+  /*      described in:                                                   */
+  /*       http://mapserver.gis.umn.edu/bugs/show_bug.cgi?id=1021         */
+  /* -------------------------------------------------------------------- */
+  if (layer->numclasses > 0) {
+    if (rlinfo->class_table)
+      p_class = msRasterClassTableLookup(rlinfo->class_table, values[0]);
+    else
+      p_class = msGetClass_FloatRGB(layer, values[0], *red, *green, *blue);
+
+    if (p_class == -1)
+      *nodata = TRUE;
+    else {
+      *nodata = FALSE;
+      if (layer->class[p_class] -> numstyles > 0) {
+        *red = layer->class[p_class]->styles[0]->color.red;
+        *green = layer->class[p_class]->styles[0]->color.green;
+        *blue = layer->class[p_class]->styles[0]->color.blue;
+      } else {
+        *red = *green = *blue = 0;
+      }
+    }
+  }
+
+  return p_class;
 }
 
 /************************************************************************/
@@ -230,6 +336,7 @@ static void msRasterQueryAddPixel(layerObj *layer, pointObj *location,
 
     switch (rlinfo->raster_query_mode) {
     case RQM_ENTRY_PER_PIXEL:
+    case RQM_STATISTICS: /* point queries */
       rlinfo->qc_x =
           (double *)msSmallCalloc(sizeof(double), rlinfo->query_alloc_max);
       rlinfo->qc_y =
@@ -307,61 +414,12 @@ static void msRasterQueryAddPixel(layerObj *layer, pointObj *location,
   }
 
   /* -------------------------------------------------------------------- */
-  /*      Handle colormap                                                 */
-  /* -------------------------------------------------------------------- */
-  if (rlinfo->hCT != NULL) {
-    int pct_index = (int)floor(values[0]);
-    GDALColorEntry sEntry;
-
-    if (GDALGetColorEntryAsRGB(rlinfo->hCT, pct_index, &sEntry)) {
-      red = sEntry.c1;
-      green = sEntry.c2;
-      blue = sEntry.c3;
-
-      if (sEntry.c4 == 0)
-        nodata = TRUE;
-    } else
-      nodata = TRUE;
-  }
-
-  /* -------------------------------------------------------------------- */
-  /*      Color derived from greyscale value.                             */
-  /* -------------------------------------------------------------------- */
-  else {
-    if (rlinfo->band_count >= 3) {
-      red = (int)MS_MAX(0, MS_MIN(255, values[0]));
-      green = (int)MS_MAX(0, MS_MIN(255, values[1]));
-      blue = (int)MS_MAX(0, MS_MIN(255, values[2]));
-    } else {
-      red = green = blue = (int)MS_MAX(0, MS_MIN(255, values[0]));
-    }
-  }
-
-  /* -------------------------------------------------------------------- */
-  /*      Handle classification.                                          */
-  /*                                                                      */
-  /*      NOTE: The following is really quite inadequate to deal with     */
-  /*      classifications based on [red], [green] and [blue] as           */
-  /*      described in:                                                   */
-  /*       http://mapserver.gis.umn.edu/bugs/show_bug.cgi?id=1021         */
+  /*      Compute color and classification.                               */
   /* -------------------------------------------------------------------- */
-  if (rlinfo->qc_class != NULL) {
-    p_class = msGetClass_FloatRGB(layer, values[0], red, green, blue);
-
-    if (p_class == -1)
-      nodata = TRUE;
-    else {
-      nodata = FALSE;
-      rlinfo->qc_class[rlinfo->query_results] = p_class;
-      if (layer->class[p_class] -> numstyles > 0) {
-        red = layer->class[p_class]->styles[0]->color.red;
-        green = layer->class[p_class]->styles[0]->color.green;
-        blue = layer->class[p_class]->styles[0]->color.blue;
-      } else {
-        red = green = blue = 0;
-      }
-    }
-  }
+  p_class =
+      msRasterQueryClassifyPixel(layer, values, &red, &green, &blue, &nodata);
+  if (rlinfo->qc_class != NULL && p_class != -1)
+    rlinfo->qc_class[rlinfo->query_results] = p_class;
 
   /* -------------------------------------------------------------------- */
   /*      Record the color.                                               */
@@ -396,6 +454,52 @@ static void msRasterQueryAddPixel(layerObj *layer, pointObj *location,
   }
 }
 
+/************************************************************************/
+/*                    msRasterQueryAccumulatePixel()                    */
+/*                                                                      */
+/*      Add a pixel to the per band statistics of RQM_STATISTICS.       */
+/************************************************************************/
+
+static void msRasterQueryAccumulatePixel(layerObj *layer, const float *values)
+
+{
+  rasterLayerInfo *rlinfo = (rasterLayerInfo *)layer->layerinfo;
+  int red, green, blue, nodata, iBand;
+
+  for (iBand = 0; iBand < rlinfo->band_count; iBand++) {
+    if (CPLIsNan(values[iBand]))
+      return;
+  }
+
+  msRasterQueryClassifyPixel(layer, values, &red, &green, &blue, &nodata);
+  if (nodata)
+    return;
+
+  if (rlinfo->qs_min == NULL) {
+    rlinfo->qs_min =
+        (double *)msSmallCalloc(sizeof(double), rlinfo->band_count);
+    rlinfo->qs_max =
+        (double *)msSmallCalloc(sizeof(double), rlinfo->band_count);
+    rlinfo->qs_mean =
+        (double *)msSmallCalloc(sizeof(double), rlinfo->band_count);
+    rlinfo->qs_m2 =
+        (double *)msSmallCalloc(sizeof(double), rlinfo->band_count);
+  }
+
+  for (iBand = 0; iBand < rlinfo->band_count; iBand++) {
+    const double dfValue = values[iBand];
+    const double dfDelta = dfValue - rlinfo->qs_mean[iBand];
+
+    if (rlinfo->qs_count == 0 || dfValue < rlinfo->qs_min[iBand])
+      rlinfo->qs_min[iBand] = dfValue;
+    if (rlinfo->qs_count == 0 || dfValue > rlinfo->qs_max[iBand])
+      rlinfo->qs_max[iBand] = dfValue;
+    rlinfo->qs_mean[iBand] += dfDelta / (rlinfo->qs_count + 1);
+    rlinfo->qs_m2[iBand] += dfDelta * (dfValue - rlinfo->qs_mean[iBand]);
+  }
+  rlinfo->qs_count++;
+}
+
 /************************************************************************/
 /*                       msRasterQueryByRectLow()                       */
 /************************************************************************/
@@ -413,8 +517,14 @@ static int msRasterQueryByRectLow(mapObj *map, layerObj *layer,
   CPLErr eErr;
   rasterLayerInfo *rlinfo;
   rectObj searchrect;
+  int bStatistics;
+  double dfNearestDist = -1.0;
+  int nNearestOffset = -1;
+  pointObj sNearestLocation = {0}, sNearestReprojectedLocation = {0};
 
   rlinfo = (rasterLayerInfo *)layer->layerinfo;
+  bStatistics =
+      rlinfo->raster_query_mode == RQM_STATISTICS && rlinfo->range_mode < 0;
 
   /* -------------------------------------------------------------------- */
   /*      Reproject the search rect into the projection of this           */
@@ -612,14 +722,25 @@ static int msRasterQueryByRectLow(mapObj *map, layerObj *layer,
         if (dist >= dfAdjustedRange)
           continue;
 
-        /* If we can only have one feature, trim range and clear */
-        /* previous result.  */
+        /* If we can only have one feature, just remember the nearest */
+        /* pixel, it is added once the window has been scanned.       */
         if (rlinfo->range_mode == MS_QUERY_SINGLE) {
-          rlinfo->range_dist = dist;
-          rlinfo->query_results = 0;
+          if (nNearestOffset < 0 || dist < dfNearestDist) {
+            dfNearestDist = dist;
+            nNearestOffset = (iLine * nWinXSize + iPixel) * nBandCount;
+            sNearestLocation = sPixelLocation;
+            sNearestReprojectedLocation = sReprojectedPixelLocation;
+          }
+          continue;
         }
       }
 
+      if (bStatistics) {
+        msRasterQueryAccumulatePixel(
+            layer, pafRaster + (iLine * nWinXSize + iPixel) * nBandCount);
+        continue;
+      }
+
       msRasterQueryAddPixel(layer,
                             &sPixelLocation, // return coords in layer SRS
                             &sReprojectedPixelLocation,
@@ -628,6 +749,20 @@ static int msRasterQueryByRectLow(mapObj *map, layerObj *layer,
     }
   }
 
+  /* -------------------------------------------------------------------- */
+  /*      Add the nearest pixel of a single result query, replacing any   */
+  /*      result from a previous tile that was further away.              */
+  /* -------------------------------------------------------------------- */
+  if (nNearestOffset >= 0 &&
+      (rlinfo->query_results == 0 || dfNearestDist < rlinfo->range_dist)) {
+    rlinfo->range_dist = dfNearestDist;
+    rlinfo->query_results = 0;
+    layer->resultcache->numresults = 0;
+    msRasterQueryAddPixel(layer, &sNearestLocation,
+                          &sNearestReprojectedLocation,
+                          pafRaster + nNearestOffset);
+  }
+
   /* -------------------------------------------------------------------- */
   /*      Cleanup.                                                        */
   /* -------------------------------------------------------------------- */
@@ -668,6 +803,24 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
   }
   rlinfo = (rasterLayerInfo *)layer->layerinfo;
 
+  /* -------------------------------------------------------------------- */
+  /*      Compile the classes once for the whole query, falling back to   */
+  /*      msGetClass_FloatRGB() per pixel if that is not possible.        */
+  /* -------------------------------------------------------------------- */
+  msRasterClassTableFree(rlinfo->class_table);
+  rlinfo->class_table = NULL;
+  if (layer->numclasses > 0)
+    rlinfo->class_table = msRasterClassTableCreate(layer);
+
+  rlinfo->qs_count = 0;
+  if (rlinfo->qs_mean != NULL) {
+    memset(rlinfo->qs_mean, 0, sizeof(double) * rlinfo->band_count);
+    memset(rlinfo->qs_m2, 0, sizeof(double) * rlinfo->band_count);
+  }
+  rlinfo->qs_rect = queryRect;
+  if (msProjectionsDiffer(&(layer->projection), &(map->projection)))
+    msProjectRect(&(map->projection), &(layer->projection), &rlinfo->qs_rect);
+
   /* -------------------------------------------------------------------- */
   /*      Clear old results cache.                                        */
   /* -------------------------------------------------------------------- */
@@ -780,11 +933,10 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
     if (!layer->tileindex) {
       char **connectionoptions =
           msGetStringListFromHashTable(&(layer->connectionoptions));
-      hDS = GDALOpenEx(decrypted_path, GDAL_OF_RASTER, NULL,
-                       (const char *const *)connectionoptions, NULL);
+      hDS = msRasterDatasetCacheOpen(decrypted_path, NULL, connectionoptions);
       CSLDestroy(connectionoptions);
     } else {
-      hDS = GDALOpen(decrypted_path, GA_ReadOnly);
+      hDS = msRasterDatasetCacheOpen(decrypted_path, NULL, NULL);
     }
 
     if (hDS == NULL) {
@@ -820,6 +972,7 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
 
     if (msDrawRasterLoadProjection(layer, hDS, filename, tilesrsindex,
                                    tilesrsname) != MS_SUCCESS) {
+      msRasterDatasetCacheRelease(hDS, MS_TRUE);
       msReleaseLock(TLOCK_GDAL);
       status = MS_FAILURE;
       goto cleanup;
@@ -831,11 +984,20 @@ int msRasterQueryByRect(mapObj *map, layerObj *layer, rectObj queryRect)
     if (status == MS_SUCCESS)
       status = msRasterQueryByRectLow(map, layer, hDS, queryRect);
 
-    GDALClose(hDS);
+    msRasterDatasetCacheRelease(hDS, !msDrawRasterKeepDatasetOpen(layer));
     msReleaseLock(TLOCK_GDAL);
 
   } /* next tile */
 
+  /* -------------------------------------------------------------------- */
+  /*      In statistics mode the whole query yields a single result.      */
+  /* -------------------------------------------------------------------- */
+  if (status != MS_FAILURE && rlinfo->raster_query_mode == RQM_STATISTICS &&
+      rlinfo->range_mode < 0 && rlinfo->qs_count > 0) {
+    addResult(layer->resultcache, -1, 0, 0);
+    rlinfo->query_results = 1;
+  }
+
   /* -------------------------------------------------------------------- */
   /*      Cleanup tileindex if it is open.                                */
   /* -------------------------------------------------------------------- */
@@ -1136,9 +1298,12 @@ int msRASTERLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record) {
   }
 
   /* -------------------------------------------------------------------- */
-  /*      Apply the geometry.                                             */
+  /*      Apply the geometry.  Statistics cover the whole search          */
+  /*      rectangle.                                                      */
   /* -------------------------------------------------------------------- */
-  if (rlinfo->qc_x != NULL) {
+  if (rlinfo->qs_count > 0) {
+    msRectToPolygon(rlinfo->qs_rect, shape);
+  } else if (rlinfo->qc_x != NULL) {
     lineObj line;
     pointObj point;
 
@@ -1167,7 +1332,32 @@ int msRASTERLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record) {
       char szWork[1000];
 
       szWork[0] = '\0';
-      if (EQUAL(layer->items[i], "x") && rlinfo->qc_x_reproj)
+      if (rlinfo->qs_count > 0) {
+        const int n = rlinfo->qs_count;
+        const char *pszStat = NULL;
+        int iValue = -1;
+
+        if (EQUAL(layer->items[i], "count"))
+          snprintf(szWork, bufferSize, "%d", n);
+        else if (EQUALN(layer->items[i], "value_", 6)) {
+          iValue = atoi(layer->items[i] + 6);
+          pszStat = strchr(layer->items[i] + 6, '_');
+        }
+
+        if (pszStat != NULL && iValue >= 0 && iValue < rlinfo->band_count) {
+          const double dfMean = rlinfo->qs_mean[iValue];
+          const double dfVar = rlinfo->qs_m2[iValue] / n;
+
+          if (EQUAL(pszStat, "_min"))
+            snprintf(szWork, bufferSize, "%.8g", rlinfo->qs_min[iValue]);
+          else if (EQUAL(pszStat, "_max"))
+            snprintf(szWork, bufferSize, "%.8g", rlinfo->qs_max[iValue]);
+          else if (EQUAL(pszStat, "_mean"))
+            snprintf(szWork, bufferSize, "%.8g", dfMean);
+          else if (EQUAL(pszStat, "_stddev"))
+            snprintf(szWork, bufferSize, "%.8g", sqrt(MS_MAX(0.0, dfVar)));
+        }
+      } else if (EQUAL(layer->items[i], "x") && rlinfo->qc_x_reproj)
         snprintf(szWork, bufferSize, "%.8g", rlinfo->qc_x_reproj[shapeindex]);
       else if (EQUAL(layer->items[i], "y") && rlinfo->qc_y_reproj)
         snprintf(szWork, bufferSize, "%.8g", rlinfo->qc_y_reproj[shapeindex]);
@@ -1224,6 +1414,26 @@ int msRASTERLayerGetItems(layerObj *layer) {
   if (rlinfo == NULL)
     return MS_FAILURE;
 
+  if (rlinfo->qs_count > 0) {
+    int i;
+
+    /* statistics mode: count, then min/max/mean/stddev per band */
+    maxnumitems = 1 + 4 * rlinfo->band_count;
+    layer->items = (char **)msSmallCalloc(sizeof(char *), maxnumitems);
+    layer->numitems = 0;
+    layer->items[layer->numitems++] = msStrdup("count");
+    for (i = 0; i < rlinfo->band_count; i++) {
+      static const char *const apszStats[] = {"min", "max", "mean", "stddev"};
+      int iStat;
+      for (iStat = 0; iStat < 4; iStat++) {
+        char szName[100];
+        snprintf(szName, sizeof(szName), "value_%d_%s", i, apszStats[iStat]);
+        layer->items[layer->numitems++] = msStrdup(szName);
+      }
+    }
+    return msRASTERLayerInitItemInfo(layer);
+  }
+
   maxnumitems = 8 + (rlinfo->qc_values ? rlinfo->band_count : 0);
   layer->items = (char **)msSmallCalloc(sizeof(char *), maxnumitems);
 
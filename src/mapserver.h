@@ -217,6 +217,9 @@ extern "C" {
 #define MS_STYLE_ALLOCSIZE 4
 #define MS_LABEL_ALLOCSIZE 2 /* not too common */
 
+/* Number of shapes fetched at once by msLayerNextShapes() when drawing */
+#define MS_SHAPE_BATCH_SIZE 64
+
 #define MS_MAX_LABEL_PRIORITY 10
 #define MS_MAX_LABEL_FONTS 5
 #define MS_DEFAULT_LABEL_PRIORITY 1
@@ -2484,6 +2487,9 @@ struct mapObj { /* structure for a map */
   char *shapepath; ///< Where are the shape files located - see :ref:`SHAPEPATH
                    ///< <mapfile-map-shapepath>`
   char *mappath;   ///< Path of the mapfile, all paths are relative to this path
+#ifndef SWIG
+  char *mapfile; /* name of the file the map was loaded from, if any */
+#endif
 
   /**
   URL of SLD document as specified with "&SLD=..." WMS parameter d- currently
@@ -2542,6 +2548,8 @@ struct layerVTable {
   char *(*LayerEscapePropertyName)(layerObj *layer, const char *pszString);
   void (*LayerEnablePaging)(layerObj *layer, int value);
   int (*LayerGetPaging)(layerObj *layer);
+  int (*LayerNextShapes)(layerObj *layer, shapeBatchObj *batch,
+                         int maxshapes);
 };
 #endif /*SWIG*/
 
@@ -3046,6 +3054,18 @@ MS_DLL_EXPORT char *msShapeToWKT(shapeObj *shape);
 MS_DLL_EXPORT void msInitShape(shapeObj *shape);
 MS_DLL_EXPORT void msShapeDeleteLine(shapeObj *shape, int line);
 MS_DLL_EXPORT int msCopyShape(const shapeObj *from, shapeObj *to);
+#ifndef SWIG
+MS_DLL_EXPORT void msResetShape(shapeObj *shape);
+MS_DLL_EXPORT int msShapeAllocLines(shapeObj *shape, int numlines);
+MS_DLL_EXPORT pointObj *msShapeAllocPoints(shapeObj *shape, int line,
+                                           int numpoints);
+MS_DLL_EXPORT pointObj *msShapeAddPoints(shapeObj *shape, int numpoints);
+MS_DLL_EXPORT void msShapeTrimLines(shapeObj *shape);
+MS_DLL_EXPORT void msInitShapeBatch(shapeBatchObj *batch);
+MS_DLL_EXPORT void msClearShapeBatch(shapeBatchObj *batch);
+MS_DLL_EXPORT void msFreeShapeBatch(shapeBatchObj *batch);
+MS_DLL_EXPORT shapeObj *msShapeBatchAdd(shapeBatchObj *batch);
+#endif
 MS_DLL_EXPORT int msIsOuterRing(shapeObj *shape, int r);
 MS_DLL_EXPORT int *msGetOuterList(shapeObj *shape);
 MS_DLL_EXPORT int *msGetInnerList(shapeObj *shape, int r, int *outerlist);
@@ -3152,6 +3172,7 @@ MS_DLL_EXPORT void msSetBit(ms_bitarray array, int index, int value);
 MS_DLL_EXPORT void msSetAllBits(ms_bitarray array, int index, int value);
 MS_DLL_EXPORT void msFlipBit(ms_bitarray array, int index);
 MS_DLL_EXPORT int msGetNextBit(ms_const_bitarray array, int index, int size);
+MS_DLL_EXPORT int msCountBits(ms_const_bitarray array, int size);
 
 /* maplayer.c - layerObj  api */
 
@@ -3171,12 +3192,17 @@ MS_DLL_EXPORT int msLayerGetItemIndex(layerObj *layer, char *item);
 MS_DLL_EXPORT int msLayerWhichItems(layerObj *layer, int get_all,
                                     const char *metadata);
 MS_DLL_EXPORT int msLayerNextShape(layerObj *layer, shapeObj *shape);
+#ifndef SWIG
+MS_DLL_EXPORT int msLayerNextShapes(layerObj *layer, shapeBatchObj *batch,
+                                    int maxshapes);
+#endif
 MS_DLL_EXPORT int msLayerGetItems(layerObj *layer);
 MS_DLL_EXPORT int msLayerSetItems(layerObj *layer, char **items, int numitems);
 MS_DLL_EXPORT int msLayerGetShape(layerObj *layer, shapeObj *shape,
                                   resultObj *record);
 MS_DLL_EXPORT int msLayerGetShapeCount(layerObj *layer, rectObj rect,
                                        projectionObj *rectProjection);
+MS_DLL_EXPORT int msLayerGetCountEstimateThreshold(const layerObj *layer);
 MS_DLL_EXPORT int msLayerGetExtent(layerObj *layer, rectObj *extent);
 MS_DLL_EXPORT int msLayerSetExtent(layerObj *layer, double minx, double miny,
                                    double maxx, double maxy);
@@ -3260,6 +3286,7 @@ MS_DLL_EXPORT int msConnectLayer(layerObj *layer, const int connectiontype,
 MS_DLL_EXPORT int msINLINELayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msSHPLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msFlatGeobufLayerInitializeVirtualTable(layerObj *layer);
+MS_DLL_EXPORT void msFlatGeobufCleanup(void);
 MS_DLL_EXPORT int msTiledSHPLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msOGRLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msPostGISLayerInitializeVirtualTable(layerObj *layer);
@@ -3269,6 +3296,7 @@ MS_DLL_EXPORT int msGraticuleLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msRASTERLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msUVRASTERLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msContourLayerInitializeVirtualTable(layerObj *layer);
+MS_DLL_EXPORT void msContourCacheCleanup(void);
 MS_DLL_EXPORT int msPluginLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT int msUnionLayerInitializeVirtualTable(layerObj *layer);
 MS_DLL_EXPORT void msPluginFreeVirtualTableFactory(void);
@@ -3420,6 +3448,7 @@ MS_DLL_EXPORT int msJoinConnect(layerObj *layer, joinObj *join);
 MS_DLL_EXPORT int msJoinPrepare(joinObj *join, shapeObj *shape);
 MS_DLL_EXPORT int msJoinNext(joinObj *join);
 MS_DLL_EXPORT int msJoinClose(joinObj *join);
+MS_DLL_EXPORT void msJoinCleanup(void);
 
 /*in mapraster.c */
 int msDrawRasterLayerLowCheckIfMustDraw(mapObj *map, layerObj *layer);
@@ -3428,6 +3457,7 @@ void *msDrawRasterLayerLowOpenDataset(mapObj *map, layerObj *layer,
                                       char szPath[MS_MAXPATHLEN],
                                       char **p_decrypted_path);
 void msDrawRasterLayerLowCloseDataset(layerObj *layer, void *hDataset);
+void msRasterDatasetCacheCleanup(void);
 int msDrawRasterLayerLowWithDataset(mapObj *map, layerObj *layer,
                                     imageObj *image, rasterBufferObj *rb,
                                     void *hDatasetIn);
@@ -3441,6 +3471,11 @@ MS_DLL_EXPORT int msGetClass_FloatRGB(layerObj *layer, float fValue, int red,
 int msGetClass_FloatRGB_WithFirstClassToTry(layerObj *layer, float fValue,
                                             int red, int green, int blue,
                                             int firstClassToTry);
+typedef struct rasterClassTableObj rasterClassTableObj;
+MS_DLL_EXPORT rasterClassTableObj *msRasterClassTableCreate(layerObj *layer);
+MS_DLL_EXPORT int msRasterClassTableLookup(const rasterClassTableObj *table,
+                                           float fValue);
+MS_DLL_EXPORT void msRasterClassTableFree(rasterClassTableObj *table);
 
 /* in mapdrawgdal.c */
 MS_DLL_EXPORT int msDrawRasterLayerGDAL(mapObj *map, layerObj *layer,
@@ -3707,10 +3742,26 @@ MS_DLL_EXPORT int msCopyRasterBuffer(rasterBufferObj *dst,
 /* ==================================================================== */
 /*      mappool.c: connection pooling API.                              */
 /* ==================================================================== */
+typedef struct {
+  int connections;    /* open connections */
+  int idle;           /* open connections not in use */
+  long hits;          /* requests served from the pool */
+  long misses;        /* requests left to the driver to open a connection */
+  long waits;         /* requests that waited for CONNECTION_POOL_MAX */
+  long timeouts;      /* waits that ran out of CONNECTION_POOL_WAIT */
+  long evictions;     /* idle connections closed by timeout or idle limit */
+  long failed_checks; /* pooled connections found dead by their probe */
+} connPoolStatsObj;
+
 MS_DLL_EXPORT void *msConnPoolRequest(layerObj *layer);
 MS_DLL_EXPORT void msConnPoolRelease(layerObj *layer, void *);
 MS_DLL_EXPORT void msConnPoolRegister(layerObj *layer, void *conn_handle,
                                       void (*close)(void *));
+MS_DLL_EXPORT void msConnPoolRegisterWithCheck(layerObj *layer,
+                                               void *conn_handle,
+                                               void (*close)(void *),
+                                               int (*is_alive)(void *));
+MS_DLL_EXPORT void msConnPoolGetStatistics(connPoolStatsObj *stats);
 MS_DLL_EXPORT void msConnPoolCloseUnreferenced(void);
 MS_DLL_EXPORT void msConnPoolFinalCleanup(void);
 
@@ -3727,6 +3778,7 @@ MS_DLL_EXPORT void *msGetSymbol(const char *pszLibrary,
 MS_DLL_EXPORT void msGEOSSetup(void);
 MS_DLL_EXPORT void msGEOSCleanup(void);
 MS_DLL_EXPORT void msGEOSFreeGeometry(shapeObj *shape);
+MS_DLL_EXPORT int msGEOSPrepareGeometry(shapeObj *shape);
 
 MS_DLL_EXPORT shapeObj *msGEOSShapeFromWKT(const char *string);
 MS_DLL_EXPORT char *msGEOSShapeToWKT(shapeObj *shape);
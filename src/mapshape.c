@@ -1363,11 +1363,19 @@ static void ReadRect(rectObj *r, const uchar *src) {
 ** msSHPReadShape() - Reads the vertices for one shape from a shape file.
 */
 void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
+  msInitShape(shape); /* initialize the shape */
+  msSHPReadRecycledShape(psSHP, hEntity, shape);
+}
+
+/*
+** msSHPReadRecycledShape() - Same as msSHPReadShape(), but the shape must be
+** initialized or reset with msResetShape(), in which case its storage is
+** reused.
+*/
+void msSHPReadRecycledShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
   int i, j, k;
   int nEntitySize, nRequiredSize;
 
-  msInitShape(shape); /* initialize the shape */
-
   /* -------------------------------------------------------------------- */
   /*      Validate the record/entity number.                              */
   /* -------------------------------------------------------------------- */
@@ -1501,10 +1509,10 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj) * nParts);
-    MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj) * nParts);
-
-    shape->numlines = nParts;
+    if (msShapeAllocLines(shape, nParts) != MS_SUCCESS) {
+      shape->type = MS_SHAPE_NULL;
+      return;
+    }
 
     k = 0; /* overall point counter */
     for (i = 0; i < nParts; i++) {
@@ -1515,25 +1523,12 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
                    "Corrupted .shp file : shape %d, shape->line[%d].start=%d, "
                    "shape->line[%d].end=%d",
                    "msSHPReadShape()", hEntity, i, psSHP->panParts[i], i, end);
-        while (--i >= 0)
-          free(shape->line[i].point);
-        free(shape->line);
-        shape->line = NULL;
-        shape->numlines = 0;
-        shape->type = MS_SHAPE_NULL;
+        msFreeShape(shape); /* type is MS_SHAPE_NULL */
         return;
       }
 
-      shape->line[i].numpoints = end - psSHP->panParts[i];
-      if ((shape->line[i].point = (pointObj *)malloc(
-               sizeof(pointObj) * shape->line[i].numpoints)) == NULL) {
-        while (--i >= 0)
-          free(shape->line[i].point);
-        free(shape->line);
-        shape->line = NULL;
-        shape->numlines = 0;
-        shape->type = MS_SHAPE_NULL;
-        msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
+      if (msShapeAllocPoints(shape, i, end - psSHP->panParts[i]) == NULL) {
+        msFreeShape(shape);
         return;
       }
 
@@ -1617,19 +1612,7 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
     if (bBigEndian)
       nPoints = SWAP_FOUR_BYTES(nPoints);
 
-    /* -------------------------------------------------------------------- */
-    /*      Fill the shape structure.                                       */
-    /* -------------------------------------------------------------------- */
-    if ((shape->line = (lineObj *)malloc(sizeof(lineObj))) == NULL) {
-      shape->type = MS_SHAPE_NULL;
-      msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
-      return;
-    }
-
     if (nPoints < 0 || nPoints > 50 * 1000 * 1000) {
-      free(shape->line);
-      shape->line = NULL;
-      shape->numlines = 0;
       shape->type = MS_SHAPE_NULL;
       msSetError(MS_SHPERR, "Corrupted .shp file : shape %d, nPoints=%d.",
                  "msSHPReadShape()", hEntity, nPoints);
@@ -1641,9 +1624,6 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
         psSHP->nShapeType == SHP_MULTIPOINTM)
       nRequiredSize += 16 + nPoints * 8;
     if (nRequiredSize > nEntitySize) {
-      free(shape->line);
-      shape->line = NULL;
-      shape->numlines = 0;
       shape->type = MS_SHAPE_NULL;
       msSetError(
           MS_SHPERR,
@@ -1652,15 +1632,15 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
       return;
     }
 
-    shape->numlines = 1;
-    shape->line[0].numpoints = nPoints;
-    shape->line[0].point = (pointObj *)malloc(nPoints * sizeof(pointObj));
-    if (shape->line[0].point == NULL) {
-      free(shape->line);
-      shape->line = NULL;
-      shape->numlines = 0;
+    /* -------------------------------------------------------------------- */
+    /*      Fill the shape structure.                                       */
+    /* -------------------------------------------------------------------- */
+    if (msShapeAllocLines(shape, 1) != MS_SUCCESS) {
       shape->type = MS_SHAPE_NULL;
-      msSetError(MS_MEMERR, "Out of memory", "msSHPReadShape()");
+      return;
+    }
+    if (msShapeAllocPoints(shape, 0, nPoints) == NULL) {
+      msFreeShape(shape);
       return;
     }
 
@@ -1716,12 +1696,14 @@ void msSHPReadShape(SHPHandle psSHP, int hEntity, shapeObj *shape) {
     /* -------------------------------------------------------------------- */
     /*      Fill the shape structure.                                       */
     /* -------------------------------------------------------------------- */
-    shape->line = (lineObj *)malloc(sizeof(lineObj));
-    MS_CHECK_ALLOC_NO_RET(shape->line, sizeof(lineObj));
-
-    shape->numlines = 1;
-    shape->line[0].numpoints = 1;
-    shape->line[0].point = (pointObj *)msSmallMalloc(sizeof(pointObj));
+    if (msShapeAllocLines(shape, 1) != MS_SUCCESS) {
+      shape->type = MS_SHAPE_NULL;
+      return;
+    }
+    if (msShapeAllocPoints(shape, 0, 1) == NULL) {
+      msFreeShape(shape);
+      return;
+    }
 
     memcpy(&(shape->line[0].point[0].x), pabyRec + 12, 8);
     memcpy(&(shape->line[0].point[0].y), pabyRec + 20, 8);
@@ -1843,6 +1825,90 @@ int msSHPReadBounds(SHPHandle psSHP, int hEntity, rectObj *padBounds) {
   return MS_SUCCESS;
 }
 
+/************************************************************************/
+/*                        msSHPReadBoundsRange()                        */
+/*                                                                      */
+/*      Read the bounds of nCount shapes starting at hFirst into        */
+/*      padBounds. Rather than seeking to every record as               */
+/*      msSHPReadBounds() does, the .shp is read in large blocks, which */
+/*      turns a pass over a shapefile written in record order into a    */
+/*      sequential read. pabValid is set to MS_FALSE for shapes whose   */
+/*      bounds can't be read (NULL or empty shapes, bad offsets).       */
+/************************************************************************/
+
+#define SHP_BOUNDS_BUFFER_SIZE (1024 * 1024)
+
+int msSHPReadBoundsRange(SHPHandle psSHP, int hFirst, int nCount,
+                         rectObj *padBounds, char *pabValid) {
+  uchar *pabyBuf;
+  vsi_l_offset nBufStart = 0;
+  size_t nBufLen = 0;
+  int i;
+
+  if (hFirst < 0 || nCount < 0 || hFirst > psSHP->nRecords - nCount) {
+    msSetError(MS_SHPERR, "Invalid record range.", "msSHPReadBoundsRange()");
+    return (MS_FAILURE);
+  }
+
+  const int bIsPoint = psSHP->nShapeType == SHP_POINT ||
+                       psSHP->nShapeType == SHP_POINTZ ||
+                       psSHP->nShapeType == SHP_POINTM;
+  const size_t nNeeded = sizeof(double) * (bIsPoint ? 2 : 4);
+
+  pabyBuf = (uchar *)msSmallMalloc(SHP_BOUNDS_BUFFER_SIZE);
+
+  for (i = 0; i < nCount; i++) {
+    rectObj *psBounds = padBounds + i;
+    const int hEntity = hFirst + i;
+
+    psBounds->minx = psBounds->miny = psBounds->maxx = psBounds->maxy = 0.0;
+    pabValid[i] = MS_FALSE;
+
+    if (msSHXReadSize(psSHP, hEntity) <= 4) /* NULL shape */
+      continue;
+
+    const int offset = msSHXReadOffset(psSHP, hEntity);
+    if (offset <= 0 || offset >= INT_MAX - 12)
+      continue;
+
+    /* refill the buffer if the record bounds are not in it */
+    const vsi_l_offset nStart = (vsi_l_offset)offset + 12;
+    if (nStart < nBufStart || nStart + nNeeded > nBufStart + nBufLen) {
+      if (VSIFSeekL(psSHP->fpSHP, nStart, 0) != 0)
+        continue;
+      nBufStart = nStart;
+      nBufLen = VSIFReadL(pabyBuf, 1, SHP_BOUNDS_BUFFER_SIZE, psSHP->fpSHP);
+      if (nBufLen < nNeeded)
+        continue;
+    }
+
+    memcpy(psBounds, pabyBuf + (nStart - nBufStart), nNeeded);
+
+    if (bBigEndian) {
+      SwapWord(8, &(psBounds->minx));
+      SwapWord(8, &(psBounds->miny));
+      if (!bIsPoint) {
+        SwapWord(8, &(psBounds->maxx));
+        SwapWord(8, &(psBounds->maxy));
+      }
+    }
+
+    if (bIsPoint) {
+      psBounds->maxx = psBounds->minx;
+      psBounds->maxy = psBounds->miny;
+    } else if (msIsNan(psBounds->minx)) { /* empty shape */
+      psBounds->minx = psBounds->miny = psBounds->maxx = psBounds->maxy = 0.0;
+      continue;
+    }
+
+    pabValid[i] = MS_TRUE;
+  }
+
+  free(pabyBuf);
+
+  return (MS_SUCCESS);
+}
+
 int msShapefileOpenHandle(shapefileObj *shpfile, const char *filename,
                           SHPHandle hSHP, DBFHandle hDBF) {
   assert(filename != NULL);
@@ -2005,6 +2071,33 @@ void msShapefileClose(shapefileObj *shpfile) {
 
 /* status array lives in the shpfile, can return MS_SUCCESS/MS_FAILURE/MS_DONE
  */
+/*
+** Returns the path of the spatial index (.qix) of a shapefile, to be freed by
+** the caller.
+*/
+static char *msShapefileIndexFilename(shapefileObj *shpfile) {
+  char *filename;
+
+  /* deal with case where sourcename is of the form 'file.shp' */
+  char *sourcename =
+      msStrdup(shpfile->source); /* shape file source string from map file */
+  char *s = strstr(sourcename, ".shp");
+  if (s)
+    *s = '\0';
+  else {
+    s = strstr(sourcename, ".SHP");
+    if (s)
+      *s = '\0';
+  }
+
+  filename = (char *)msSmallMalloc(strlen(sourcename) +
+                                   strlen(MS_INDEX_EXTENSION) + 1);
+  sprintf(filename, "%s%s", sourcename, MS_INDEX_EXTENSION);
+  free(sourcename);
+
+  return filename;
+}
+
 int msShapefileWhichShapes(shapefileObj *shpfile, rectObj rect, int debug) {
   int i;
   rectObj shaperect;
@@ -2025,31 +2118,10 @@ int msShapefileWhichShapes(shapefileObj *shpfile, rectObj rect, int debug) {
     }
     msSetAllBits(shpfile->status, shpfile->numshapes, 1);
   } else {
-
-    /* deal with case where sourcename is of the form 'file.shp' */
-    char *sourcename =
-        msStrdup(shpfile->source); /* shape file source string from map file */
-    char *s = strstr(sourcename, ".shp");
-    if (s)
-      *s = '\0';
-    else {
-      s = strstr(sourcename, ".SHP");
-      if (s)
-        *s = '\0';
-    }
-
-    filename =
-        (char *)malloc(strlen(sourcename) + strlen(MS_INDEX_EXTENSION) + 1);
-    MS_CHECK_ALLOC(filename,
-                   strlen(sourcename) + strlen(MS_INDEX_EXTENSION) + 1,
-                   MS_FAILURE);
-
-    sprintf(filename, "%s%s", sourcename, MS_INDEX_EXTENSION);
-
+    filename = msShapefileIndexFilename(shpfile);
     shpfile->status =
         msSearchDiskTree(filename, rect, debug, shpfile->numshapes);
     free(filename);
-    free(sourcename);
 
     if (shpfile->status) { /* index  */
       msFilterTreeSearch(shpfile, shpfile->status, rect);
@@ -3043,6 +3115,70 @@ int msSHPLayerNextShape(layerObj *layer, shapeObj *shape) {
   return MS_SUCCESS;
 }
 
+/*
+** Batch reader: walks the status bit array directly, skipping NULL shapes
+** without going back through the layer vtable for each of them.
+*/
+int msSHPLayerNextShapes(layerObj *layer, shapeBatchObj *batch,
+                         int maxshapes) {
+  int i, first = batch->numshapes;
+  shapefileObj *shpfile;
+
+  shpfile = layer->layerinfo;
+
+  if (!shpfile) {
+    msSetError(MS_SHPERR, "Shapefile layer has not been opened.",
+               "msSHPLayerNextShapes()");
+    return MS_FAILURE;
+  }
+
+  if (!shpfile->status) {
+    /* probably whichShapes didn't overlap */
+    return MS_DONE;
+  }
+
+  while (batch->numshapes - first < maxshapes) {
+    shapeObj *shape;
+
+    i = msGetNextBit(shpfile->status, shpfile->lastshape + 1,
+                     shpfile->numshapes);
+    shpfile->lastshape = i;
+    if (i == -1)
+      break; /* nothing else to read */
+
+    /* reuse the storage of the shape that last occupied this slot */
+    shape = msShapeBatchAdd(batch);
+    msSHPReadRecycledShape(shpfile->hSHP, i, shape);
+    if (shape->type == MS_SHAPE_NULL) {
+      msResetShape(shape);
+      batch->numshapes--;
+      continue; /* skip NULL shapes */
+    }
+
+    if (shape->maxvalues == layer->numitems && layer->numitems > 0) {
+      if (msDBFReuseValueList(shpfile->hDBF, i, layer->iteminfo,
+                              layer->numitems, shape->values) == MS_SUCCESS) {
+        shape->numvalues = layer->numitems;
+        shape->maxvalues = 0;
+        continue;
+      }
+    }
+
+    if (shape->maxvalues > 0) { /* spare values that can't be reused */
+      msFreeCharArray(shape->values, shape->maxvalues);
+      shape->values = NULL;
+      shape->maxvalues = 0;
+    }
+    shape->numvalues = layer->numitems;
+    shape->values =
+        msDBFGetValueList(shpfile->hDBF, i, layer->iteminfo, layer->numitems);
+    if (!shape->values)
+      shape->numvalues = 0;
+  }
+
+  return (batch->numshapes > first) ? MS_SUCCESS : MS_DONE;
+}
+
 int msSHPLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record) {
   shapefileObj *shpfile;
   long shapeindex;
@@ -3078,6 +3214,128 @@ int msSHPLayerGetShape(layerObj *layer, shapeObj *shape, resultObj *record) {
   return MS_SUCCESS;
 }
 
+/*
+** Estimate the number of shapes matching rect from the spatial index, without
+** reading any shape. Returns -1 if the shapefile has no index.
+*/
+static int msSHPGetShapeCountEstimate(shapefileObj *shpfile, rectObj rect,
+                                      int debug) {
+  ms_bitarray status;
+  char *filename;
+  int count;
+
+  if (msRectOverlap(&shpfile->bounds, &rect) != MS_TRUE)
+    return 0;
+  if (msRectContained(&shpfile->bounds, &rect) == MS_TRUE)
+    return shpfile->numshapes;
+
+  filename = msShapefileIndexFilename(shpfile);
+  status = msSearchDiskTree(filename, rect, debug, shpfile->numshapes);
+  free(filename);
+  if (!status)
+    return -1;
+
+  count = msCountBits(status, shpfile->numshapes);
+  free(status);
+
+  return count;
+}
+
+/*
+** Count the shapes matching rect without reading their attributes. Shapes
+** whose bounds are within rect are counted from their record header, so only
+** the geometry of the shapes crossing the edge of rect has to be read.
+*/
+int msSHPLayerGetShapeCount(layerObj *layer, rectObj rect,
+                            projectionObj *rectProjection) {
+  int i, status, threshold;
+  int nShapeCount = 0;
+  shapefileObj *shpfile;
+  shapeObj shape, searchshape;
+  rectObj searchrect = rect;
+  int bReproject = MS_FALSE;
+
+  shpfile = layer->layerinfo;
+
+  if (!shpfile) {
+    msSetError(MS_SHPERR, "Shapefile layer has not been opened.",
+               "msSHPLayerGetShapeCount()");
+    return -1;
+  }
+
+  /* the layer FILTER can only be evaluated on the shape attributes */
+  if (layer->filter.string != NULL)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  if (rectProjection != NULL && layer->project &&
+      msProjectionsDiffer(&(layer->projection), rectProjection)) {
+    msProjectRect(rectProjection, &(layer->projection), &searchrect);
+    bReproject = MS_TRUE;
+  }
+
+  threshold = msLayerGetCountEstimateThreshold(layer);
+  if (threshold >= 0) {
+    int nEstimate =
+        msSHPGetShapeCountEstimate(shpfile, searchrect, layer->debug);
+    if (nEstimate >= threshold) {
+      if (layer->maxfeatures > 0 && nEstimate > layer->maxfeatures)
+        nEstimate = layer->maxfeatures;
+      return nEstimate;
+    }
+  }
+
+  /* shapes have to be reprojected to be tested against rect */
+  if (bReproject)
+    return LayerDefaultGetShapeCount(layer, rect, rectProjection);
+
+  status = msShapefileWhichShapes(shpfile, searchrect, layer->debug);
+  if (status == MS_DONE)
+    return 0;
+  if (status != MS_SUCCESS)
+    return -1;
+
+  msInitShape(&searchshape);
+  msRectToPolygon(searchrect, &searchshape);
+
+  for (i = msGetNextBit(shpfile->status, 0, shpfile->numshapes); i >= 0;
+       i = msGetNextBit(shpfile->status, i + 1, shpfile->numshapes)) {
+    rectObj shaperect;
+
+    if (msSHPReadBounds(shpfile->hSHP, i, &shaperect) == MS_SUCCESS &&
+        msRectContained(&shaperect, &searchrect) == MS_TRUE) {
+      nShapeCount++;
+    } else {
+      /* NULL shapes are skipped, like in msSHPLayerNextShape() */
+      msInitShape(&shape);
+      msSHPReadShape(shpfile->hSHP, i, &shape);
+      switch (shape.type) {
+      case MS_SHAPE_POINT:
+        status = msIntersectMultipointPolygon(&shape, &searchshape);
+        break;
+      case MS_SHAPE_LINE:
+        status = msIntersectPolylinePolygon(&shape, &searchshape);
+        break;
+      case MS_SHAPE_POLYGON:
+        status = msIntersectPolygons(&shape, &searchshape);
+        break;
+      default:
+        status = MS_FALSE;
+        break;
+      }
+      msFreeShape(&shape);
+      if (status == MS_TRUE)
+        nShapeCount++;
+    }
+
+    if (layer->maxfeatures > 0 && layer->maxfeatures == nShapeCount)
+      break;
+  }
+
+  msFreeShape(&searchshape);
+
+  return nShapeCount;
+}
+
 int msSHPLayerClose(layerObj *layer) {
   shapefileObj *shpfile;
   shpfile = layer->layerinfo;
@@ -3141,8 +3399,9 @@ int msSHPLayerInitializeVirtualTable(layerObj *layer) {
   layer->vtable->LayerIsOpen = msSHPLayerIsOpen;
   layer->vtable->LayerWhichShapes = msSHPLayerWhichShapes;
   layer->vtable->LayerNextShape = msSHPLayerNextShape;
+  layer->vtable->LayerNextShapes = msSHPLayerNextShapes;
   layer->vtable->LayerGetShape = msSHPLayerGetShape;
-  /* layer->vtable->LayerGetShapeCount, use default */
+  layer->vtable->LayerGetShapeCount = msSHPLayerGetShapeCount;
   layer->vtable->LayerClose = msSHPLayerClose;
   layer->vtable->LayerGetItems = msSHPLayerGetItems;
   layer->vtable->LayerGetExtent = msSHPLayerGetExtent;
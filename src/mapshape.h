@@ -142,6 +142,10 @@ typedef struct {
   int bCurrentRecordModified;
   char *pszCurrentRecord;
 
+  char *pszRecordBlock; /* read ahead buffer for sequential record access */
+  int nBlockFirst;
+  int nBlockCount;
+
   int bNoHeader;
   int bUpdated;
 
@@ -219,8 +223,13 @@ MS_DLL_EXPORT void msSHPGetInfo(SHPHandle hSHP, int *pnEntities,
                                 int *pnShapeType);
 MS_DLL_EXPORT int msSHPReadBounds(SHPHandle psSHP, int hEntity,
                                   rectObj *padBounds);
+MS_DLL_EXPORT int msSHPReadBoundsRange(SHPHandle psSHP, int hFirst,
+                                       int nCount, rectObj *padBounds,
+                                       char *pabValid);
 MS_DLL_EXPORT void msSHPReadShape(SHPHandle psSHP, int hEntity,
                                   shapeObj *shape);
+MS_DLL_EXPORT void msSHPReadRecycledShape(SHPHandle psSHP, int hEntity,
+                                          shapeObj *shape);
 MS_DLL_EXPORT int msSHPReadPoint(SHPHandle psSHP, int hEntity, pointObj *point);
 MS_DLL_EXPORT int msSHPWriteShape(SHPHandle psSHP, shapeObj *shape);
 MS_DLL_EXPORT int msSHPWritePoint(SHPHandle psSHP, pointObj *point);
@@ -262,6 +271,9 @@ MS_DLL_EXPORT char **msDBFGetItems(DBFHandle dbffile);
 MS_DLL_EXPORT char **msDBFGetValues(DBFHandle dbffile, int record);
 MS_DLL_EXPORT char **msDBFGetValueList(DBFHandle dbffile, int record,
                                        int *itemindexes, int numitems);
+MS_DLL_EXPORT int msDBFReuseValueList(DBFHandle dbffile, int record,
+                                      int *itemindexes, int numitems,
+                                      char **values);
 MS_DLL_EXPORT int *msDBFGetItemIndexes(DBFHandle dbffile, char **items,
                                        int numitems);
 MS_DLL_EXPORT int msDBFGetItemIndex(DBFHandle dbffile, char *name);
@@ -98,6 +98,11 @@ static const char *const olLayerWMSTag =
 static char *processLine(mapservObj *mapserv, const char *instr, FILE *stream,
                          int mode);
 
+typedef struct templateObj templateObj;
+static templateObj *compileTemplate(const char *source);
+static char *renderTemplate(mapservObj *mapserv, templateObj *template);
+static void freeTemplate(templateObj *template);
+
 static int isValidTemplate(FILE *stream, const char *filename) {
   char buffer[MS_BUFFER_LENGTH];
 
@@ -938,6 +943,8 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
   const char *argValue;
   char *tag, *tagInstance;
   hashTableObj *tagArgs = NULL;
+  templateObj *template;
+  msStringBuffer *sb;
 
   int limit = -1;
   const char *trimLast = NULL;
@@ -985,7 +992,10 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
 
   /* start rebuilding **line */
   free(*line);
-  *line = preTag;
+  *line = NULL;
+  sb = msStringBufferAlloc();
+  msStringBufferAppend(sb, preTag);
+  free(preTag);
 
   /* we know the layer has query results or we wouldn't be in this code */
 
@@ -1003,11 +1013,15 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
         msFreeHashTable(tagArgs);
         msFree(postTag);
         msFree(tag);
+        *line = msStringBufferReleaseStringAndFree(sb);
         return status;
       }
     }
   }
 
+  /* the tag is rendered once per feature, so compile it up front */
+  template = compileTemplate(tag);
+
   mapserv->LRN = 1; /* layer result counter */
   mapserv->resultlayer = layer;
   msInitShape(&(mapserv->resultshape));
@@ -1024,6 +1038,8 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
       msFreeHashTable(tagArgs);
       msFree(postTag);
       msFree(tag);
+      freeTemplate(template);
+      *line = msStringBufferReleaseStringAndFree(sb);
       return status;
     }
 
@@ -1045,13 +1061,17 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
     */
     if (trimLast && (i == limit - 1)) {
       char *ptr;
-      if ((ptr = strrstr(tag, trimLast)) != NULL)
+      if ((ptr = strrstr(tag, trimLast)) != NULL) {
         *ptr = '\0';
+        freeTemplate(template);
+        template = compileTemplate(tag);
+      }
     }
 
     /* process the tag */
-    tagInstance = processLine(mapserv, tag, NULL, QUERY); /* do substitutions */
-    *line = msStringConcatenate(*line, tagInstance);      /* grow the line */
+    tagInstance = renderTemplate(mapserv, template); /* do substitutions */
+    if (tagInstance)
+      msStringBufferAppend(sb, tagInstance); /* grow the line */
 
     free(tagInstance);
     msFreeShape(&(mapserv->resultshape)); /* init too */
@@ -1063,13 +1083,17 @@ static int processFeatureTag(mapservObj *mapserv, char **line,
   /* msLayerClose(layer); */
   mapserv->resultlayer = NULL; /* necessary? */
 
-  *line = msStringConcatenate(*line, postTag);
+  msStringBufferAppend(sb, postTag);
+  *line = msStringBufferReleaseStringAndFree(sb);
+  if (!*line)
+    *line = msStrdup("");
 
   /*
   ** clean up
   */
   free(postTag);
   free(tag);
+  freeTemplate(template);
   msFreeHashTable(tagArgs);
 
   return (MS_SUCCESS);
@@ -1302,167 +1326,249 @@ static int processResultSetTag(mapservObj *mapserv, char **line, FILE *stream) {
 */
 enum ITEM_ESCAPING { ESCAPE_HTML, ESCAPE_URL, ESCAPE_JSON, ESCAPE_NONE };
 
-static int processItemTag(layerObj *layer, char **line, shapeObj *shape) {
-  int i;
+/*
+** Arguments of an [item ...] tag, parsed once by getItemTagArgs() so the same
+** tag can be rendered for any number of shapes.
+*/
+typedef struct {
+  char *name;
+  char *pattern;
+  char *format;
+  char *nullFormat;
+  int precision;
+  int padding;
+  int uc;
+  int lc;
+  int commify;
+  int ignoremissing;
+  int escape;
+} itemTagArgsObj;
+
+static void freeItemTagArgs(itemTagArgsObj *args) {
+  msFree(args->name);
+  msFree(args->pattern);
+  msFree(args->format);
+  msFree(args->nullFormat);
+}
 
-  char *tagEnd;
+/*
+** Parse the arguments of the [item ...] tag starting at tagStart. A missing
+** name argument is not an error here, callers check args->name.
+*/
+static int getItemTagArgs(const char *tagStart, itemTagArgsObj *args) {
+  hashTableObj *tagArgs = NULL;
 
-  if (!*line) {
-    msSetError(MS_WEBERR, "Invalid line pointer.", "processItemTag()");
+  memset(args, 0, sizeof(itemTagArgsObj)); /* initialize the tag arguments */
+  args->precision = -1;
+  args->padding = -1;
+  args->escape = ESCAPE_HTML;
+
+  /* check for any tag arguments */
+  if (getTagArgs("item", tagStart, &tagArgs) != MS_SUCCESS)
     return (MS_FAILURE);
-  }
+  if (tagArgs) {
+    const char *argValue = msLookupHashTable(tagArgs, "name");
+    if (argValue)
+      args->name = msStrdup(argValue);
 
-  const char *tagStart = findTag(*line, "item");
+    argValue = msLookupHashTable(tagArgs, "pattern");
+    if (argValue)
+      args->pattern = msStrdup(argValue);
 
-  if (!tagStart)
-    return (MS_SUCCESS); /* OK, just return; */
+    argValue = msLookupHashTable(tagArgs, "precision");
+    if (argValue)
+      args->precision = atoi(argValue);
 
-  while (tagStart) {
-    const char *format = "$value"; /* initialize the tag arguments */
-    const char *nullFormat = "";
-    int precision = -1;
-    int padding = -1;
-    const char *name = NULL;
-    const char *pattern = NULL;
-    int uc = MS_FALSE;
-    int lc = MS_FALSE;
-    int commify = MS_FALSE;
-    int ignoremissing = MS_FALSE;
-    int escape = ESCAPE_HTML;
-    int skip = MS_FALSE;
+    argValue = msLookupHashTable(tagArgs, "padding");
+    if (argValue)
+      args->padding = atoi(argValue);
 
-    /* check for any tag arguments */
-    hashTableObj *tagArgs = NULL;
-    if (getTagArgs("item", tagStart, &tagArgs) != MS_SUCCESS)
-      return (MS_FAILURE);
-    if (tagArgs) {
-      const char *argValue = msLookupHashTable(tagArgs, "name");
-      if (argValue)
-        name = argValue;
+    argValue = msLookupHashTable(tagArgs, "format");
+    if (argValue)
+      args->format = msStrdup(argValue);
 
-      argValue = msLookupHashTable(tagArgs, "pattern");
-      if (argValue)
-        pattern = argValue;
+    argValue = msLookupHashTable(tagArgs, "nullformat");
+    if (argValue)
+      args->nullFormat = msStrdup(argValue);
 
-      argValue = msLookupHashTable(tagArgs, "precision");
-      if (argValue)
-        precision = atoi(argValue);
+    argValue = msLookupHashTable(tagArgs, "uc");
+    if (argValue && strcasecmp(argValue, "true") == 0)
+      args->uc = MS_TRUE;
 
-      argValue = msLookupHashTable(tagArgs, "padding");
-      if (argValue)
-        padding = atoi(argValue);
+    argValue = msLookupHashTable(tagArgs, "lc");
+    if (argValue && strcasecmp(argValue, "true") == 0)
+      args->lc = MS_TRUE;
 
-      argValue = msLookupHashTable(tagArgs, "format");
-      if (argValue)
-        format = argValue;
+    argValue = msLookupHashTable(tagArgs, "commify");
+    if (argValue && strcasecmp(argValue, "true") == 0)
+      args->commify = MS_TRUE;
 
-      argValue = msLookupHashTable(tagArgs, "nullformat");
-      if (argValue)
-        nullFormat = argValue;
+    argValue = msLookupHashTable(tagArgs, "ignoremissing");
+    if (argValue && strcasecmp(argValue, "true") == 0)
+      args->ignoremissing = MS_TRUE;
 
-      argValue = msLookupHashTable(tagArgs, "uc");
-      if (argValue && strcasecmp(argValue, "true") == 0)
-        uc = MS_TRUE;
+    argValue = msLookupHashTable(tagArgs, "escape");
+    if (argValue && strcasecmp(argValue, "url") == 0)
+      args->escape = ESCAPE_URL;
+    else if (argValue && strcasecmp(argValue, "none") == 0)
+      args->escape = ESCAPE_NONE;
+    else if (argValue && strcasecmp(argValue, "json") == 0)
+      args->escape = ESCAPE_JSON;
 
-      argValue = msLookupHashTable(tagArgs, "lc");
-      if (argValue && strcasecmp(argValue, "true") == 0)
-        lc = MS_TRUE;
+    /* TODO: deal with sub strings */
 
-      argValue = msLookupHashTable(tagArgs, "commify");
-      if (argValue && strcasecmp(argValue, "true") == 0)
-        commify = MS_TRUE;
+    msFreeHashTable(tagArgs);
+  }
 
-      argValue = msLookupHashTable(tagArgs, "ignoremissing");
-      if (argValue && strcasecmp(argValue, "true") == 0)
-        ignoremissing = MS_TRUE;
+  if (!args->format)
+    args->format = msStrdup("$value");
+  if (!args->nullFormat)
+    args->nullFormat = msStrdup("");
 
-      argValue = msLookupHashTable(tagArgs, "escape");
-      if (argValue && strcasecmp(argValue, "url") == 0)
-        escape = ESCAPE_URL;
-      else if (argValue && strcasecmp(argValue, "none") == 0)
-        escape = ESCAPE_NONE;
-      else if (argValue && strcasecmp(argValue, "json") == 0)
-        escape = ESCAPE_JSON;
+  return (MS_SUCCESS);
+}
 
-      /* TODO: deal with sub strings */
-    }
+/*
+** Find the index of the item referenced by an [item ...] tag. *item is set to
+** -1 if the item is missing and the tag asks for it to be ignored.
+*/
+static int getItemTagIndex(layerObj *layer, itemTagArgsObj *args, int *item) {
+  int i;
 
-    if (!name) {
-      msSetError(MS_WEBERR, "Item tag contains no name attribute.",
-                 "processItemTag()");
+  for (i = 0; i < layer->numitems; i++)
+    if (strcasecmp(args->name, layer->items[i]) == 0)
+      break;
+
+  if (i == layer->numitems) {
+    if (args->ignoremissing == MS_TRUE) {
+      i = -1;
+    } else {
+      msSetError(MS_WEBERR, "Item name (%s) not found in layer item list.",
+                 "processItemTag()", args->name);
       return (MS_FAILURE);
     }
+  }
 
-    for (i = 0; i < layer->numitems; i++)
-      if (strcasecmp(name, layer->items[i]) == 0)
-        break;
+  *item = i;
+  return (MS_SUCCESS);
+}
 
-    if (i == layer->numitems) {
-      if (ignoremissing == MS_TRUE) {
-        skip = MS_TRUE;
-      } else {
-        msSetError(MS_WEBERR, "Item name (%s) not found in layer item list.",
-                   "processItemTag()", name);
-        return (MS_FAILURE);
-      }
+/*
+** Build the (escaped) text an [item ...] tag is replaced with for shape. The
+** string returned must be freed by the caller.
+*/
+static char *getItemTagValue(itemTagArgsObj *args, shapeObj *shape, int item) {
+  char *tagValue = NULL, *encodedTagValue = NULL;
+
+  if (item >= 0 && (shape->values[item] && strlen(shape->values[item]) > 0)) {
+    char *itemValue = NULL;
+
+    /* set tag text depending on pattern (if necessary), nullFormat can
+     * contain $value (#3637) */
+    if (args->pattern &&
+        msEvalRegex(args->pattern, shape->values[item]) != MS_TRUE)
+      tagValue = msStrdup(args->nullFormat);
+    else
+      tagValue = msStrdup(args->format);
+
+    if (args->precision != -1) {
+      char numberFormat[16];
+
+      itemValue = (char *)msSmallMalloc(64); /* plenty big */
+      snprintf(numberFormat, sizeof(numberFormat), "%%.%dlf", args->precision);
+      snprintf(itemValue, 64, numberFormat, atof(shape->values[item]));
+    } else
+      itemValue = msStrdup(shape->values[item]);
+
+    if (args->commify == MS_TRUE)
+      itemValue = msCommifyString(itemValue);
+
+    /* apply other effects */
+    if (args->uc == MS_TRUE)
+      for (unsigned j = 0; j < strlen(itemValue); j++)
+        itemValue[j] = toupper(itemValue[j]);
+    if (args->lc == MS_TRUE)
+      for (unsigned j = 0; j < strlen(itemValue); j++)
+        itemValue[j] = tolower(itemValue[j]);
+
+    tagValue = msReplaceSubstring(tagValue, "$value", itemValue);
+    msFree(itemValue);
+
+    if (args->padding > 0 && args->padding < 1000) {
+      int paddedSize = strlen(tagValue) + args->padding + 1;
+      char *paddedValue = NULL;
+      paddedValue = (char *)msSmallMalloc(paddedSize);
+      snprintf(paddedValue, paddedSize, "%-*s", args->padding, tagValue);
+      msFree(tagValue);
+      tagValue = paddedValue;
     }
 
-    /*
-    ** now we know which item so build the tagValue
-    */
+    if (!tagValue) {
+      msSetError(MS_WEBERR, "Error applying item format.", "processItemTag()");
+      return (NULL);
+    }
+  } else {
+    tagValue = msStrdup(args->nullFormat); /* attribute value is NULL or empty */
+  }
 
-    char *tagValue = NULL;
-    if (!skip && (shape->values[i] && strlen(shape->values[i]) > 0)) {
-      char *itemValue = NULL;
+  switch (args->escape) {
+  case ESCAPE_HTML:
+    encodedTagValue = msEncodeHTMLEntities(tagValue);
+    break;
+  case ESCAPE_JSON:
+    encodedTagValue = msEscapeJSonString(tagValue);
+    break;
+  case ESCAPE_URL:
+    encodedTagValue = msEncodeUrl(tagValue);
+    break;
+  default: /* ESCAPE_NONE */
+    return (tagValue);
+  }
 
-      /* set tag text depending on pattern (if necessary), nullFormat can
-       * contain $value (#3637) */
-      if (pattern && msEvalRegex(pattern, shape->values[i]) != MS_TRUE)
-        tagValue = msStrdup(nullFormat);
-      else
-        tagValue = msStrdup(format);
+  msFree(tagValue);
+  return (encodedTagValue);
+}
 
-      if (precision != -1) {
-        char numberFormat[16];
+static int processItemTag(layerObj *layer, char **line, shapeObj *shape) {
+  char *tagEnd;
 
-        itemValue = (char *)msSmallMalloc(64); /* plenty big */
-        snprintf(numberFormat, sizeof(numberFormat), "%%.%dlf", precision);
-        snprintf(itemValue, 64, numberFormat, atof(shape->values[i]));
-      } else
-        itemValue = msStrdup(shape->values[i]);
-
-      if (commify == MS_TRUE)
-        itemValue = msCommifyString(itemValue);
-
-      /* apply other effects */
-      if (uc == MS_TRUE)
-        for (unsigned j = 0; j < strlen(itemValue); j++)
-          itemValue[j] = toupper(itemValue[j]);
-      if (lc == MS_TRUE)
-        for (unsigned j = 0; j < strlen(itemValue); j++)
-          itemValue[j] = tolower(itemValue[j]);
-
-      tagValue = msReplaceSubstring(tagValue, "$value", itemValue);
-      msFree(itemValue);
-
-      if (padding > 0 && padding < 1000) {
-        int paddedSize = strlen(tagValue) + padding + 1;
-        char *paddedValue = NULL;
-        paddedValue = (char *)msSmallMalloc(paddedSize);
-        snprintf(paddedValue, paddedSize, "%-*s", padding, tagValue);
-        msFree(tagValue);
-        tagValue = paddedValue;
-      }
+  if (!*line) {
+    msSetError(MS_WEBERR, "Invalid line pointer.", "processItemTag()");
+    return (MS_FAILURE);
+  }
 
-      if (!tagValue) {
-        msSetError(MS_WEBERR, "Error applying item format.",
-                   "processItemTag()");
-        return (MS_FAILURE); /* todo leaking... */
-      }
-    } else {
-      tagValue = msStrdup(nullFormat); /* attribute value is NULL or empty */
+  const char *tagStart = findTag(*line, "item");
+
+  if (!tagStart)
+    return (MS_SUCCESS); /* OK, just return; */
+
+  while (tagStart) {
+    itemTagArgsObj args;
+    int item;
+
+    if (getItemTagArgs(tagStart, &args) != MS_SUCCESS)
+      return (MS_FAILURE);
+
+    if (!args.name) {
+      msSetError(MS_WEBERR, "Item tag contains no name attribute.",
+                 "processItemTag()");
+      freeItemTagArgs(&args);
+      return (MS_FAILURE);
+    }
+
+    if (getItemTagIndex(layer, &args, &item) != MS_SUCCESS) {
+      freeItemTagArgs(&args);
+      return (MS_FAILURE);
     }
 
+    /*
+    ** now we know which item so build the tagValue
+    */
+    char *tagValue = getItemTagValue(&args, shape, item);
+    freeItemTagArgs(&args);
+    if (!tagValue)
+      return (MS_FAILURE);
+
     /* find the end of the tag */
     tagEnd = findTagEnd(tagStart);
     tagEnd++;
@@ -1473,35 +1579,10 @@ static int processItemTag(layerObj *layer, char **line, shapeObj *shape) {
     strlcpy(tag, tagStart, tagLength + 1);
 
     /* do the replacement */
-    switch (escape) {
-    case ESCAPE_HTML: {
-      char *encodedTagValue = msEncodeHTMLEntities(tagValue);
-      *line = msReplaceSubstring(*line, tag, encodedTagValue);
-      msFree(encodedTagValue);
-      break;
-    }
-    case ESCAPE_JSON: {
-      char *encodedTagValue = msEscapeJSonString(tagValue);
-      *line = msReplaceSubstring(*line, tag, encodedTagValue);
-      msFree(encodedTagValue);
-      break;
-    }
-    case ESCAPE_URL: {
-      char *encodedTagValue = msEncodeUrl(tagValue);
-      *line = msReplaceSubstring(*line, tag, encodedTagValue);
-      msFree(encodedTagValue);
-      break;
-    }
-    case ESCAPE_NONE:
-      *line = msReplaceSubstring(*line, tag, tagValue);
-      break;
-    default:
-      break;
-    }
+    *line = msReplaceSubstring(*line, tag, tagValue);
 
     /* clean up */
     free(tag);
-    msFreeHashTable(tagArgs);
     msFree(tagValue);
 
     tagStart = findTag(*line, "item");
@@ -3979,6 +4060,512 @@ char *processOneToManyJoin(mapservObj *mapserv, joinObj *join) {
 *[resultset]...[/resultset]) can be multi-line so
 ** we pass the filehandle to look ahead if necessary.
 */
+/*
+** Compiled query templates.
+**
+** Query templates are processed once per result, which with processLine()
+** means one search and replace pass over the text for every tag MapServer
+** knows about. Instead a template is split once into segments: literal text,
+** tags that can be rendered straight from the current result ([item ...],
+** attributes, counters and shape tags), and any other tag, which is still
+** handed to processLine(). Rendering a result is then a single pass over the
+** segments into a growing buffer.
+*/
+enum TEMPLATE_SEGMENT_TYPE {
+  TEMPLATE_SEGMENT_TEXT,      /* literal text */
+  TEMPLATE_SEGMENT_LINE,      /* any other tag, passed to processLine() */
+  TEMPLATE_SEGMENT_ITEM,      /* [item ...] */
+  TEMPLATE_SEGMENT_ATTRIBUTE, /* [name], [name_esc] or [name_raw] */
+  TEMPLATE_SEGMENT_SHPXY,
+  TEMPLATE_SEGMENT_SHPLABEL,
+  TEMPLATE_SEGMENT_SHPEXT,
+  TEMPLATE_SEGMENT_SHPEXT_ESC,
+  TEMPLATE_SEGMENT_NR,
+  TEMPLATE_SEGMENT_NL,
+  TEMPLATE_SEGMENT_NLR,
+  TEMPLATE_SEGMENT_RN,
+  TEMPLATE_SEGMENT_LRN,
+  TEMPLATE_SEGMENT_CL,
+  TEMPLATE_SEGMENT_SHPMID,
+  TEMPLATE_SEGMENT_SHPMIDX,
+  TEMPLATE_SEGMENT_SHPMIDY,
+  TEMPLATE_SEGMENT_SHPCLASS,
+  TEMPLATE_SEGMENT_SHPMINX,
+  TEMPLATE_SEGMENT_SHPMINY,
+  TEMPLATE_SEGMENT_SHPMAXX,
+  TEMPLATE_SEGMENT_SHPMAXY,
+  TEMPLATE_SEGMENT_SHPIDX,
+  TEMPLATE_SEGMENT_TILEIDX,
+  TEMPLATE_SEGMENT_VALUES
+};
+
+/* tags that take arguments */
+static const struct {
+  const char *name;
+  int type;
+} templateArgumentTags[] = {
+    {"item", TEMPLATE_SEGMENT_ITEM},
+    {"shpxy", TEMPLATE_SEGMENT_SHPXY},
+    {"shplabel", TEMPLATE_SEGMENT_SHPLABEL},
+    {"shpext", TEMPLATE_SEGMENT_SHPEXT},
+    {"shpext_esc", TEMPLATE_SEGMENT_SHPEXT_ESC},
+    {NULL, 0}};
+
+/* tags without arguments */
+static const struct {
+  const char *name;
+  int type;
+} templateSimpleTags[] = {{"shpxy", TEMPLATE_SEGMENT_SHPXY},
+                          {"shplabel", TEMPLATE_SEGMENT_SHPLABEL},
+                          {"shpext", TEMPLATE_SEGMENT_SHPEXT},
+                          {"shpext_esc", TEMPLATE_SEGMENT_SHPEXT_ESC},
+                          {"nr", TEMPLATE_SEGMENT_NR},
+                          {"nl", TEMPLATE_SEGMENT_NL},
+                          {"nlr", TEMPLATE_SEGMENT_NLR},
+                          {"rn", TEMPLATE_SEGMENT_RN},
+                          {"lrn", TEMPLATE_SEGMENT_LRN},
+                          {"cl", TEMPLATE_SEGMENT_CL},
+                          {"shpmid", TEMPLATE_SEGMENT_SHPMID},
+                          {"shpmidx", TEMPLATE_SEGMENT_SHPMIDX},
+                          {"shpmidy", TEMPLATE_SEGMENT_SHPMIDY},
+                          {"shpclass", TEMPLATE_SEGMENT_SHPCLASS},
+                          {"shpminx", TEMPLATE_SEGMENT_SHPMINX},
+                          {"shpminy", TEMPLATE_SEGMENT_SHPMINY},
+                          {"shpmaxx", TEMPLATE_SEGMENT_SHPMAXX},
+                          {"shpmaxy", TEMPLATE_SEGMENT_SHPMAXY},
+                          {"shpidx", TEMPLATE_SEGMENT_SHPIDX},
+                          {"tileidx", TEMPLATE_SEGMENT_TILEIDX},
+                          {"values", TEMPLATE_SEGMENT_VALUES},
+                          {NULL, 0}};
+
+typedef struct {
+  int type;
+  char *text;           /* literal text or the complete tag */
+  itemTagArgsObj *args; /* TEMPLATE_SEGMENT_ITEM only */
+  int item;   /* item index within the layer the template is bound to */
+  int escape; /* TEMPLATE_SEGMENT_ATTRIBUTE only */
+} templateSegmentObj;
+
+struct templateObj {
+  char *name; /* template file, NULL for inline templates */
+
+  templateSegmentObj *segments;
+  int numsegments;
+
+  layerObj *layer; /* layer (and item list) the item indexes are bound to */
+  char **items;    /* copy of the item names, the list may be reallocated */
+  int numitems;
+
+  struct templateObj *next;
+};
+
+static void addTemplateSegment(templateObj *template, int type,
+                               const char *text, int length) {
+  templateSegmentObj *segment;
+
+  template->segments = (templateSegmentObj *)msSmallRealloc(
+      template->segments,
+      sizeof(templateSegmentObj) * (template->numsegments + 1));
+  segment = &(template->segments[template->numsegments++]);
+
+  segment->type = type;
+  segment->text = (char *)msSmallMalloc(length + 1);
+  strlcpy(segment->text, text, length + 1);
+  segment->args = NULL;
+  segment->item = -1;
+  segment->escape = ESCAPE_HTML;
+}
+
+/*
+** Figure out how the tag at tagStart, ending at tagEnd, can be rendered.
+*/
+static int getTemplateSegmentType(const char *tagStart, const char *tagEnd,
+                                  itemTagArgsObj **args) {
+  const char *nameEnd = tagStart + 1;
+  int i, length;
+
+  while (isalnum((unsigned char)*nameEnd) || *nameEnd == '_')
+    nameEnd++;
+  length = nameEnd - tagStart - 1;
+
+  if (nameEnd == tagEnd) {
+    for (i = 0; templateSimpleTags[i].name; i++) {
+      if (strlen(templateSimpleTags[i].name) == (size_t)length &&
+          strncmp(tagStart + 1, templateSimpleTags[i].name, length) == 0)
+        return templateSimpleTags[i].type;
+    }
+    return TEMPLATE_SEGMENT_ATTRIBUTE; /* resolved against the layer items */
+  }
+
+  if (*nameEnd != ' ')
+    return TEMPLATE_SEGMENT_LINE;
+
+  for (i = 0; templateArgumentTags[i].name; i++) {
+    if (strlen(templateArgumentTags[i].name) != (size_t)length ||
+        strncmp(tagStart + 1, templateArgumentTags[i].name, length) != 0)
+      continue;
+
+    if (templateArgumentTags[i].type == TEMPLATE_SEGMENT_ITEM) {
+      itemTagArgsObj itemArgs;
+
+      if (getItemTagArgs(tagStart, &itemArgs) != MS_SUCCESS)
+        return TEMPLATE_SEGMENT_LINE;
+
+      /* leave broken tags and formats with nested tags to processLine() */
+      if (!itemArgs.name || strchr(itemArgs.format, '[') ||
+          strchr(itemArgs.nullFormat, '[')) {
+        freeItemTagArgs(&itemArgs);
+        return TEMPLATE_SEGMENT_LINE;
+      }
+
+      *args = (itemTagArgsObj *)msSmallMalloc(sizeof(itemTagArgsObj));
+      **args = itemArgs;
+    }
+    return templateArgumentTags[i].type;
+  }
+
+  return TEMPLATE_SEGMENT_LINE;
+}
+
+/*
+** Split a query template into segments. Templates used to be processed line
+** by line, so tags may not span lines.
+*/
+static templateObj *compileTemplate(const char *source) {
+  templateObj *template;
+  const char *text = source, *tagStart = source;
+
+  template = (templateObj *)msSmallCalloc(1, sizeof(templateObj));
+
+  while ((tagStart = strchr(tagStart, '[')) != NULL) {
+    const char *tagEnd;
+    itemTagArgsObj *args = NULL;
+    int type;
+
+    if (!isalpha((unsigned char)tagStart[1]) && tagStart[1] != '_') {
+      tagStart++; /* a literal bracket */
+      continue;
+    }
+
+    tagEnd = findTagEnd(tagStart);
+    if (!tagEnd || memchr(tagStart, '\n', tagEnd - tagStart)) {
+      tagStart++;
+      continue;
+    }
+
+    type = getTemplateSegmentType(tagStart, tagEnd, &args);
+
+    if (tagStart > text)
+      addTemplateSegment(template, TEMPLATE_SEGMENT_TEXT, text,
+                         tagStart - text);
+    addTemplateSegment(template, type, tagStart, tagEnd - tagStart + 1);
+    template->segments[template->numsegments - 1].args = args;
+
+    text = tagStart = tagEnd + 1;
+  }
+
+  if (*text != '\0')
+    addTemplateSegment(template, TEMPLATE_SEGMENT_TEXT, text, strlen(text));
+
+  return template;
+}
+
+static void freeTemplate(templateObj *template) {
+  int i;
+
+  while (template) {
+    templateObj *next = template->next;
+
+    for (i = 0; i < template->numsegments; i++) {
+      msFree(template->segments[i].text);
+      if (template->segments[i].args) {
+        freeItemTagArgs(template->segments[i].args);
+        msFree(template->segments[i].args);
+      }
+    }
+    msFree(template->segments);
+    msFree(template->name);
+    msFreeCharArray(template->items, template->numitems);
+    msFree(template);
+
+    template = next;
+  }
+}
+
+/*
+** Resolve [item ...] and attribute tags against the items of layer.
+** Attribute tags that don't match any item are left to processLine().
+*/
+static int bindTemplate(templateObj *template, layerObj *layer) {
+  int i, j;
+
+  template->layer = NULL;
+  msFreeCharArray(template->items, template->numitems);
+  template->items = NULL;
+  template->numitems = 0;
+
+  for (i = 0; i < template->numsegments; i++) {
+    templateSegmentObj *segment = &(template->segments[i]);
+
+    if (segment->type == TEMPLATE_SEGMENT_ITEM) {
+      if (getItemTagIndex(layer, segment->args, &segment->item) != MS_SUCCESS)
+        return MS_FAILURE;
+    } else if (segment->type == TEMPLATE_SEGMENT_ATTRIBUTE) {
+      const char *name = segment->text + 1;
+      const int length = strlen(name) - 1; /* without the closing bracket */
+
+      segment->item = -1;
+      for (j = 0; j < layer->numitems; j++) {
+        const int itemLength = strlen(layer->items[j]);
+
+        if (itemLength > length || strncmp(name, layer->items[j], itemLength))
+          continue;
+
+        if (itemLength == length)
+          segment->escape = ESCAPE_HTML;
+        else if (itemLength + 4 == length &&
+                 strncmp(name + itemLength, "_esc", 4) == 0)
+          segment->escape = ESCAPE_URL;
+        else if (itemLength + 4 == length &&
+                 strncmp(name + itemLength, "_raw", 4) == 0)
+          segment->escape = ESCAPE_NONE;
+        else
+          continue;
+
+        segment->item = j;
+        break;
+      }
+    }
+  }
+
+  template->layer = layer;
+  if (layer->numitems > 0) {
+    template->items = (char **)msSmallMalloc(sizeof(char *) * layer->numitems);
+    for (i = 0; i < layer->numitems; i++)
+      template->items[i] = msStrdup(layer->items[i]);
+  }
+  template->numitems = layer->numitems;
+
+  return MS_SUCCESS;
+}
+
+/*
+** Whether the item indexes of template are valid for the current items of
+** layer. The item list may have been rebuilt since the binding, even at the
+** same address, so the names are compared.
+*/
+static int isTemplateBound(const templateObj *template, const layerObj *layer) {
+  int i;
+
+  if (template->layer != layer || template->numitems != layer->numitems)
+    return MS_FALSE;
+  for (i = 0; i < layer->numitems; i++) {
+    if (strcmp(template->items[i], layer->items[i]) != 0)
+      return MS_FALSE;
+  }
+
+  return MS_TRUE;
+}
+
+/*
+** Render a compiled template for the current result (mapserv->resultlayer and
+** mapserv->resultshape). The string returned must be freed by the caller.
+*/
+static char *renderTemplate(mapservObj *mapserv, templateObj *template) {
+  layerObj *layer = mapserv->resultlayer;
+  shapeObj *shape = &(mapserv->resultshape);
+  msStringBuffer *sb;
+  char buffer[128], *value, *page;
+  int i, status = MS_SUCCESS;
+
+  if (!isTemplateBound(template, layer)) {
+    if (bindTemplate(template, layer) != MS_SUCCESS)
+      return NULL;
+  }
+
+  sb = msStringBufferAlloc();
+
+  for (i = 0; i < template->numsegments && status == MS_SUCCESS; i++) {
+    templateSegmentObj *segment = &(template->segments[i]);
+
+    value = NULL;
+    buffer[0] = '\0';
+
+    switch (segment->type) {
+    case TEMPLATE_SEGMENT_TEXT:
+      msStringBufferAppend(sb, segment->text);
+      continue;
+    case TEMPLATE_SEGMENT_ITEM:
+      if ((value = getItemTagValue(segment->args, shape, segment->item)) ==
+          NULL)
+        status = MS_FAILURE;
+      break;
+    case TEMPLATE_SEGMENT_ATTRIBUTE:
+      if (segment->item == -1) {
+        if ((value = processLine(mapserv, segment->text, NULL, QUERY)) == NULL)
+          status = MS_FAILURE;
+      } else if (segment->escape == ESCAPE_HTML)
+        value = msEncodeHTMLEntities(shape->values[segment->item]);
+      else if (segment->escape == ESCAPE_URL)
+        value = msEncodeUrl(shape->values[segment->item]);
+      else if (shape->values[segment->item])
+        msStringBufferAppend(sb, shape->values[segment->item]);
+      break;
+    case TEMPLATE_SEGMENT_LINE:
+      if ((value = processLine(mapserv, segment->text, NULL, QUERY)) == NULL)
+        status = MS_FAILURE;
+      break;
+    case TEMPLATE_SEGMENT_SHPXY:
+      value = msStrdup(segment->text);
+      status = processShpxyTag(layer, &value, shape);
+      break;
+    case TEMPLATE_SEGMENT_SHPLABEL:
+      value = msStrdup(segment->text);
+      status = processShplabelTag(layer, &value, shape);
+      break;
+    case TEMPLATE_SEGMENT_SHPEXT:
+      value = msStrdup(segment->text);
+      status = processExtentTag(mapserv, &value, "shpext", &(shape->bounds),
+                                &(layer->projection));
+      break;
+    case TEMPLATE_SEGMENT_SHPEXT_ESC:
+      value = msStrdup(segment->text);
+      status = processExtentTag(mapserv, &value, "shpext_esc",
+                                &(shape->bounds), &(layer->projection));
+      break;
+    case TEMPLATE_SEGMENT_NR:
+      snprintf(buffer, sizeof(buffer), "%d", mapserv->NR);
+      break;
+    case TEMPLATE_SEGMENT_NL:
+      snprintf(buffer, sizeof(buffer), "%d", mapserv->NL);
+      break;
+    case TEMPLATE_SEGMENT_NLR:
+      snprintf(buffer, sizeof(buffer), "%d", mapserv->NLR);
+      break;
+    case TEMPLATE_SEGMENT_RN:
+      snprintf(buffer, sizeof(buffer), "%d", mapserv->RN);
+      break;
+    case TEMPLATE_SEGMENT_LRN:
+      snprintf(buffer, sizeof(buffer), "%d", mapserv->LRN);
+      break;
+    case TEMPLATE_SEGMENT_CL:
+      if (layer->name)
+        msStringBufferAppend(sb, layer->name);
+      break;
+    case TEMPLATE_SEGMENT_SHPMID:
+      snprintf(buffer, sizeof(buffer), "%f %f",
+               (shape->bounds.maxx + shape->bounds.minx) / 2,
+               (shape->bounds.maxy + shape->bounds.miny) / 2);
+      break;
+    case TEMPLATE_SEGMENT_SHPMIDX:
+      snprintf(buffer, sizeof(buffer), "%f",
+               (shape->bounds.maxx + shape->bounds.minx) / 2);
+      break;
+    case TEMPLATE_SEGMENT_SHPMIDY:
+      snprintf(buffer, sizeof(buffer), "%f",
+               (shape->bounds.maxy + shape->bounds.miny) / 2);
+      break;
+    case TEMPLATE_SEGMENT_SHPCLASS:
+      snprintf(buffer, sizeof(buffer), "%d", shape->classindex);
+      break;
+    case TEMPLATE_SEGMENT_SHPMINX:
+      snprintf(buffer, sizeof(buffer), "%f", shape->bounds.minx);
+      break;
+    case TEMPLATE_SEGMENT_SHPMINY:
+      snprintf(buffer, sizeof(buffer), "%f", shape->bounds.miny);
+      break;
+    case TEMPLATE_SEGMENT_SHPMAXX:
+      snprintf(buffer, sizeof(buffer), "%f", shape->bounds.maxx);
+      break;
+    case TEMPLATE_SEGMENT_SHPMAXY:
+      snprintf(buffer, sizeof(buffer), "%f", shape->bounds.maxy);
+      break;
+    case TEMPLATE_SEGMENT_SHPIDX:
+      snprintf(buffer, sizeof(buffer), "%ld", shape->index);
+      break;
+    case TEMPLATE_SEGMENT_TILEIDX:
+      snprintf(buffer, sizeof(buffer), "%d", shape->tileindex);
+      break;
+    case TEMPLATE_SEGMENT_VALUES: /* all attributes in one delimited list */
+      value = msJoinStrings(shape->values, layer->numitems, ",");
+      break;
+    default:
+      break;
+    }
+
+    if (value) {
+      if (status == MS_SUCCESS)
+        msStringBufferAppend(sb, value);
+      msFree(value);
+    } else if (buffer[0] != '\0')
+      msStringBufferAppend(sb, buffer);
+  }
+
+  if (status != MS_SUCCESS) {
+    msStringBufferFree(sb);
+    return NULL;
+  }
+
+  page = msStringBufferReleaseStringAndFree(sb);
+  return page ? page : msStrdup("");
+}
+
+/*
+** Return the compiled version of query template html, reading and compiling
+** it on first use. The same template is processed for every result so
+** compiled templates are kept on the mapservObj.
+*/
+static templateObj *getQueryTemplate(mapservObj *mapserv, const char *html) {
+  templateObj *template;
+  FILE *stream;
+  char line[MS_BUFFER_LENGTH], *source = NULL;
+  ms_regex_t re; /* compiled regular expression to be matched */
+  char szPath[MS_MAXPATHLEN];
+
+  for (template = mapserv->templates; template; template = template->next) {
+    if (strcmp(template->name, html) == 0)
+      return template;
+  }
+
+  if (ms_regcomp(&re, MS_TEMPLATE_EXPR,
+                 MS_REG_EXTENDED | MS_REG_NOSUB | MS_REG_ICASE) != 0) {
+    msSetError(MS_REGEXERR, NULL, "msReturnPage()");
+    return NULL;
+  }
+
+  if (ms_regexec(&re, html, 0, NULL, 0) != 0) { /* no match */
+    ms_regfree(&re);
+    msSetError(MS_WEBERR, "Malformed template name (%s).", "msReturnPage()",
+               html);
+    return NULL;
+  }
+  ms_regfree(&re);
+
+  if ((stream = fopen(msBuildPath(szPath, mapserv->map->mappath, html), "r")) ==
+      NULL) {
+    msSetError(MS_IOERR, "%s", "msReturnPage()", html);
+    return NULL;
+  }
+
+  if (isValidTemplate(stream, html) != MS_TRUE) {
+    fclose(stream);
+    return NULL;
+  }
+
+  while (fgets(line, MS_BUFFER_LENGTH, stream) != NULL)
+    source = msStringConcatenate(source, line);
+  fclose(stream);
+
+  template = compileTemplate(source ? source : "");
+  msFree(source);
+
+  template->name = msStrdup(html);
+  template->next = mapserv->templates;
+  mapserv->templates = template;
+
+  return template;
+}
+
 static char *processLine(mapservObj *mapserv, const char *instr, FILE *stream,
                          int mode) {
   int i, j;
@@ -4187,19 +4774,15 @@ static char *processLine(mapservObj *mapserv, const char *instr, FILE *stream,
    */
 
   if (strstr(outstr, "web_")) {
-    for (j = 0; j < MS_HASHSIZE; j++) {
-      if (mapserv->map->web.metadata.items[j] != NULL) {
-        for (tp = mapserv->map->web.metadata.items[j]; tp != NULL;
-             tp = tp->next) {
-          snprintf(substr, PROCESSLINE_BUFLEN, "[web_%s]", tp->key);
-          outstr = msReplaceSubstring(outstr, substr, tp->data);
-          snprintf(substr, PROCESSLINE_BUFLEN, "[web_%s_esc]", tp->key);
-
-          encodedstr = msEncodeUrl(tp->data);
-          outstr = msReplaceSubstring(outstr, substr, encodedstr);
-          free(encodedstr);
-        }
-      }
+    for (j = 0; j < mapserv->map->web.metadata.numitems; j++) {
+      tp = &(mapserv->map->web.metadata.items[j]);
+      snprintf(substr, PROCESSLINE_BUFLEN, "[web_%s]", tp->key);
+      outstr = msReplaceSubstring(outstr, substr, tp->data);
+      snprintf(substr, PROCESSLINE_BUFLEN, "[web_%s_esc]", tp->key);
+
+      encodedstr = msEncodeUrl(tp->data);
+      outstr = msReplaceSubstring(outstr, substr, encodedstr);
+      free(encodedstr);
     }
   }
 
@@ -4207,26 +4790,22 @@ static char *processLine(mapservObj *mapserv, const char *instr, FILE *stream,
   for (i = 0; i < mapserv->map->numlayers; i++) {
     if (GET_LAYER(mapserv->map, i)->name &&
         strstr(outstr, GET_LAYER(mapserv->map, i)->name)) {
-      for (j = 0; j < MS_HASHSIZE; j++) {
-        if (GET_LAYER(mapserv->map, i)->metadata.items[j] != NULL) {
-          for (tp = GET_LAYER(mapserv->map, i)->metadata.items[j]; tp != NULL;
-               tp = tp->next) {
-            snprintf(substr, PROCESSLINE_BUFLEN, "[%s_%s]",
-                     GET_LAYER(mapserv->map, i)->name, tp->key);
-            if (GET_LAYER(mapserv->map, i)->status == MS_ON)
-              outstr = msReplaceSubstring(outstr, substr, tp->data);
-            else
-              outstr = msReplaceSubstring(outstr, substr, "");
-            snprintf(substr, PROCESSLINE_BUFLEN, "[%s_%s_esc]",
-                     GET_LAYER(mapserv->map, i)->name, tp->key);
-            if (GET_LAYER(mapserv->map, i)->status == MS_ON) {
-              encodedstr = msEncodeUrl(tp->data);
-              outstr = msReplaceSubstring(outstr, substr, encodedstr);
-              free(encodedstr);
-            } else
-              outstr = msReplaceSubstring(outstr, substr, "");
-          }
-        }
+      for (j = 0; j < GET_LAYER(mapserv->map, i)->metadata.numitems; j++) {
+        tp = &(GET_LAYER(mapserv->map, i)->metadata.items[j]);
+        snprintf(substr, PROCESSLINE_BUFLEN, "[%s_%s]",
+                 GET_LAYER(mapserv->map, i)->name, tp->key);
+        if (GET_LAYER(mapserv->map, i)->status == MS_ON)
+          outstr = msReplaceSubstring(outstr, substr, tp->data);
+        else
+          outstr = msReplaceSubstring(outstr, substr, "");
+        snprintf(substr, PROCESSLINE_BUFLEN, "[%s_%s_esc]",
+                 GET_LAYER(mapserv->map, i)->name, tp->key);
+        if (GET_LAYER(mapserv->map, i)->status == MS_ON) {
+          encodedstr = msEncodeUrl(tp->data);
+          outstr = msReplaceSubstring(outstr, substr, encodedstr);
+          free(encodedstr);
+        } else
+          outstr = msReplaceSubstring(outstr, substr, "");
       }
     }
   }
@@ -4413,19 +4992,15 @@ static char *processLine(mapservObj *mapserv, const char *instr, FILE *stream,
     /* allow layer metadata access when there is a current result layer
      * (implicitly a query template) */
     if (strstr(outstr, "[metadata_")) {
-      for (i = 0; i < MS_HASHSIZE; i++) {
-        if (mapserv->resultlayer->metadata.items[i] != NULL) {
-          for (tp = mapserv->resultlayer->metadata.items[i]; tp != NULL;
-               tp = tp->next) {
-            snprintf(substr, PROCESSLINE_BUFLEN, "[metadata_%s]", tp->key);
-            outstr = msReplaceSubstring(outstr, substr, tp->data);
-
-            snprintf(substr, PROCESSLINE_BUFLEN, "[metadata_%s_esc]", tp->key);
-            encodedstr = msEncodeUrl(tp->data);
-            outstr = msReplaceSubstring(outstr, substr, encodedstr);
-            free(encodedstr);
-          }
-        }
+      for (i = 0; i < mapserv->resultlayer->metadata.numitems; i++) {
+        tp = &(mapserv->resultlayer->metadata.items[i]);
+        snprintf(substr, PROCESSLINE_BUFLEN, "[metadata_%s]", tp->key);
+        outstr = msReplaceSubstring(outstr, substr, tp->data);
+
+        snprintf(substr, PROCESSLINE_BUFLEN, "[metadata_%s_esc]", tp->key);
+        encodedstr = msEncodeUrl(tp->data);
+        outstr = msReplaceSubstring(outstr, substr, encodedstr);
+        free(encodedstr);
       }
     }
   }
@@ -4629,6 +5204,26 @@ int msReturnPage(mapservObj *mapserv, char *html, int mode,
     return MS_FAILURE;
   }
 
+  if (mode == QUERY) { /* processed once per result, use a compiled template */
+    templateObj *template = getQueryTemplate(mapserv, html);
+    if (!template)
+      return MS_FAILURE;
+
+    tmpline = renderTemplate(mapserv, template);
+    if (!tmpline)
+      return MS_FAILURE;
+
+    if (papszBuffer)
+      (*papszBuffer) = msStringConcatenate((*papszBuffer), tmpline);
+    else {
+      msIO_fwrite(tmpline, strlen(tmpline), 1, stdout);
+      fflush(stdout);
+    }
+
+    free(tmpline);
+    return MS_SUCCESS;
+  }
+
   if (ms_regcomp(&re, MS_TEMPLATE_EXPR,
                  MS_REG_EXTENDED | MS_REG_NOSUB | MS_REG_ICASE) != 0) {
     msSetError(MS_REGEXERR, NULL, "msReturnPage()");
@@ -5113,6 +5708,8 @@ mapservObj *msAllocMapServObj() {
 
   mapserv->hittest = NULL;
 
+  mapserv->templates = NULL;
+
   return mapserv;
 }
 
@@ -5148,6 +5745,8 @@ void msFreeMapServObj(mapservObj *mapserv) {
 
     msFree(mapserv->TileCoords);
 
+    freeTemplate(mapserv->templates);
+
     msFree(mapserv);
   }
 }
@@ -179,6 +179,8 @@ typedef struct {
 
   map_hittest *hittest;
 
+  struct templateObj *templates; /* compiled query templates */
+
 } mapservObj;
 
 /*! \fn msAllocMapServObj
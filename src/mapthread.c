@@ -140,10 +140,12 @@ files instead.
 static int thread_debug = 0;
 
 static char *const lock_names[] = {
-    NULL,           "PARSER",    "GDAL",    "ERROROBJ", "PROJ",
-    "TTF",          "POOL",      "SDE",     "ORACLE",   "OWS",
-    "LAYER_VTABLE", "IOCONTEXT", "TMPFILE", "DEBUGOBJ", "OGR",
-    "TIME",         "FRIBIDI",   "WXS",     "GEOS",     NULL};
+    NULL,           "PARSER",     "GDAL",     "ERROROBJ", "PROJ",
+    "TTF",          "POOL",       "SDE",      "ORACLE",   "OWS",
+    "LAYER_VTABLE", "IOCONTEXT",  "TMPFILE",  "DEBUGOBJ", "OGR",
+    "TIME",         "FRIBIDI",    "WXS",      "GEOS",     "JOIN",
+    "FLATGEOBUF",   "CURL_SHARE", "CURL_DNS", "CURL_SSL", "GDAL_DATASETS",
+    "CONTOUR"};
 #endif
 
 /************************************************************************/
@@ -158,6 +160,7 @@ static char *const lock_names[] = {
 
 static int mutexes_initialized = 0;
 static pthread_mutex_t mutex_locks[TLOCK_MAX];
+static pthread_cond_t cond_locks[TLOCK_MAX];
 
 /************************************************************************/
 /*                            msThreadInit()                            */
@@ -173,8 +176,10 @@ void msThreadInit()
 
   pthread_mutex_lock(&core_lock);
 
-  for (; mutexes_initialized < TLOCK_STATIC_MAX; mutexes_initialized++)
+  for (; mutexes_initialized < TLOCK_STATIC_MAX; mutexes_initialized++) {
     pthread_mutex_init(mutex_locks + mutexes_initialized, NULL);
+    pthread_cond_init(cond_locks + mutexes_initialized, NULL);
+  }
 
   pthread_mutex_unlock(&core_lock);
 }
@@ -225,6 +230,56 @@ void msReleaseLock(int nLockId)
   pthread_mutex_unlock(mutex_locks + nLockId);
 }
 
+/************************************************************************/
+/*                            msWaitOnLock()                            */
+/*                                                                      */
+/*      Release the lock, which the caller holds, until another         */
+/*      thread calls msSignalLockWaiters() on it or timeout_ms          */
+/*      milliseconds have passed, and acquire it again.  Like any       */
+/*      condition wait it may return early, callers check their         */
+/*      condition again.                                                */
+/************************************************************************/
+
+void msWaitOnLock(int nLockId, int timeout_ms)
+
+{
+  struct timespec deadline;
+
+  assert(mutexes_initialized > 0);
+  assert(nLockId >= 0 && nLockId < mutexes_initialized);
+
+  if (thread_debug)
+    fprintf(stderr, "msWaitOnLock(%d/%s,%d) (posix)\n", nLockId,
+            lock_names[nLockId], timeout_ms);
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_cond_timedwait(cond_locks + nLockId, mutex_locks + nLockId,
+                         &deadline);
+}
+
+/************************************************************************/
+/*                        msSignalLockWaiters()                         */
+/*                                                                      */
+/*      Wake up all the threads in msWaitOnLock() for this lock.  The   */
+/*      caller holds the lock.                                          */
+/************************************************************************/
+
+void msSignalLockWaiters(int nLockId)
+
+{
+  assert(mutexes_initialized > 0);
+  assert(nLockId >= 0 && nLockId < mutexes_initialized);
+
+  pthread_cond_broadcast(cond_locks + nLockId);
+}
+
 #endif /* defined(USE_THREAD) && !defined(_WIN32) */
 
 /************************************************************************/
@@ -239,6 +294,7 @@ void msReleaseLock(int nLockId)
 
 static int mutexes_initialized = 0;
 static HANDLE mutex_locks[TLOCK_MAX];
+static HANDLE event_locks[TLOCK_MAX];
 
 /************************************************************************/
 /*                            msThreadInit()                            */
@@ -261,8 +317,11 @@ void msThreadInit()
   else
     WaitForSingleObject(core_lock, INFINITE);
 
-  for (; mutexes_initialized < TLOCK_STATIC_MAX; mutexes_initialized++)
+  for (; mutexes_initialized < TLOCK_STATIC_MAX; mutexes_initialized++) {
     mutex_locks[mutexes_initialized] = CreateMutex(NULL, FALSE, NULL);
+    /* auto reset, a signal wakes up a single waiter */
+    event_locks[mutexes_initialized] = CreateEvent(NULL, FALSE, FALSE, NULL);
+  }
 
   ReleaseMutex(core_lock);
 }
@@ -313,4 +372,40 @@ void msReleaseLock(int nLockId)
   ReleaseMutex(mutex_locks[nLockId]);
 }
 
+/************************************************************************/
+/*                            msWaitOnLock()                            */
+/*                                                                      */
+/*      See the posix version.  A win32 event wakes up a single         */
+/*      waiter, so the others wait at most 50ms at a time before        */
+/*      checking their condition again.                                 */
+/************************************************************************/
+
+void msWaitOnLock(int nLockId, int timeout_ms)
+
+{
+  assert(mutexes_initialized > 0);
+  assert(nLockId >= 0 && nLockId < mutexes_initialized);
+
+  if (thread_debug)
+    fprintf(stderr, "msWaitOnLock(%d/%s,%d) (win32)\n", nLockId,
+            lock_names[nLockId], timeout_ms);
+
+  SignalObjectAndWait(mutex_locks[nLockId], event_locks[nLockId],
+                      MS_MIN(timeout_ms, 50), FALSE);
+  WaitForSingleObject(mutex_locks[nLockId], INFINITE);
+}
+
+/************************************************************************/
+/*                        msSignalLockWaiters()                         */
+/************************************************************************/
+
+void msSignalLockWaiters(int nLockId)
+
+{
+  assert(mutexes_initialized > 0);
+  assert(nLockId >= 0 && nLockId < mutexes_initialized);
+
+  SetEvent(event_locks[nLockId]);
+}
+
 #endif /* defined(USE_THREAD) && defined(_WIN32) */
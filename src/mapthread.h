@@ -39,11 +39,27 @@ void msThreadInit(void);
 void *msGetThreadId(void);
 void msAcquireLock(int);
 void msReleaseLock(int);
+void msWaitOnLock(int, int);
+void msSignalLockWaiters(int);
 #else
 #define msThreadInit()
 #define msGetThreadId() (0)
 #define msAcquireLock(x)
 #define msReleaseLock(x)
+#define msWaitOnLock(x, ms)
+#define msSignalLockWaiters(x)
+#endif
+
+/*
+** Storage class for per-thread caches. Without thread support this is just
+** a plain static.
+*/
+#if defined(USE_THREAD) && defined(_MSC_VER)
+#define MS_THREAD_LOCAL __declspec(thread)
+#elif defined(USE_THREAD)
+#define MS_THREAD_LOCAL __thread
+#else
+#define MS_THREAD_LOCAL
 #endif
 
 /*
@@ -69,8 +85,15 @@ void msReleaseLock(int);
 #define TLOCK_FRIBIDI 16
 #define TLOCK_WxS 17
 #define TLOCK_GEOS 18
+#define TLOCK_JOIN 19
+#define TLOCK_FLATGEOBUF 20
+#define TLOCK_CURL_SHARE 21
+#define TLOCK_CURL_DNS 22
+#define TLOCK_CURL_SSL 23
+#define TLOCK_GDAL_DATASETS 24
+#define TLOCK_CONTOUR 25
 
-#define TLOCK_STATIC_MAX 20
+#define TLOCK_STATIC_MAX 26
 #define TLOCK_MAX 100
 
 #ifdef __cplusplus
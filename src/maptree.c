@@ -32,6 +32,9 @@
 #include "maptree.h"
 
 #include <limits.h>
+#include <stdint.h>
+
+#include "cpl_multiproc.h"
 
 #ifdef __BYTE_ORDER__
 /* GCC/clang predefined macro */
@@ -59,7 +62,22 @@
 /* -------------------------------------------------------------------- */
 #define SPLITRATIO 0.55
 
+/* -------------------------------------------------------------------- */
+/*      Bulk loading (see treeBulkLoad()) reads this many shape bounds  */
+/*      at a time, and computes their position in the tree on up to    */
+/*      TREE_MAX_THREADS threads.                                       */
+/* -------------------------------------------------------------------- */
+#define TREE_BULK_BLOCK 1048576
+#define TREE_MAX_THREADS 16
+
+/* a tree path holds its depth in the low bits, and 2 bits per level */
+#define TREE_PATH_DEPTH_MASK 0x3f
+#define TREE_PATH_MAX_DEPTH 29
+#define TREE_PATH_NONE UINT64_MAX
+
 static int treeAddShapeId(treeObj *tree, int id, rectObj rect);
+static void treeSplitBounds(rectObj *in, rectObj *out1, rectObj *out2);
+static void destroyTreeNode(treeNodeObj *node);
 
 static void SwapWord(int length, void *wordP) {
   int i;
@@ -96,6 +114,24 @@ static treeNodeObj *treeNodeCreate(rectObj rect) {
   return node;
 }
 
+/*
+** Append a shape id to a node, growing the id list to the next power of two
+** so that building large nodes doesn't reallocate for every id.
+*/
+static void treeNodeAppendId(treeNodeObj *node, int id) {
+  if ((node->numshapes & (node->numshapes - 1)) == 0) {
+    ms_int32 *ids = SfRealloc(node->ids, sizeof(ms_int32) *
+                                             MS_MAX(1, node->numshapes * 2));
+    if (ids == NULL) {
+      msSetError(MS_MEMERR, NULL, "treeNodeAppendId()");
+      return;
+    }
+    node->ids = ids;
+  }
+
+  node->ids[node->numshapes++] = id;
+}
+
 SHPTreeHandle msSHPDiskTreeOpen(const char *pszTree, int debug) {
   char *pszFullname, *pszBasename;
   SHPTreeHandle psTree;
@@ -205,6 +241,166 @@ void msSHPDiskTreeClose(SHPTreeHandle disktree) {
   free(disktree);
 }
 
+/* -------------------------------------------------------------------- */
+/*      Bulk loading.                                                   */
+/*                                                                      */
+/*      The node a shape ends up in only depends on its bounds, the     */
+/*      bounds of the root and the maximum depth, not on the other      */
+/*      shapes: it goes down into the first quadrant that contains it   */
+/*      for as long as there is one.  So the path from the root to      */
+/*      that node can be computed for every shape independently, and    */
+/*      in parallel, and the tree is the same as the one built by       */
+/*      inserting shapes one at a time with treeAddShapeId().           */
+/* -------------------------------------------------------------------- */
+
+static void treeSplitQuadrants(rectObj *in, rectObj *quads) {
+  rectObj half1, half2;
+
+  treeSplitBounds(in, &half1, &half2);
+  treeSplitBounds(&half1, &quads[0], &quads[1]);
+  treeSplitBounds(&half2, &quads[2], &quads[3]);
+}
+
+static uint64_t treeComputePath(rectObj node, const rectObj *rect,
+                                int maxdepth) {
+  uint64_t path = 0;
+  int depth = 0, i;
+
+  while (maxdepth > 1) {
+    rectObj quads[4];
+
+    treeSplitQuadrants(&node, quads);
+    for (i = 0; i < 4; i++) {
+      if (msRectContained(rect, &quads[i]))
+        break;
+    }
+    if (i == 4)
+      break;
+
+    path |= (uint64_t)i << (62 - 2 * depth);
+    node = quads[i];
+    depth++;
+    maxdepth--;
+  }
+
+  return path | depth;
+}
+
+static treeNodeObj *treeNodeForPath(treeNodeObj *node, uint64_t path) {
+  const int depth = (int)(path & TREE_PATH_DEPTH_MASK);
+  int level;
+
+  for (level = 0; level < depth; level++) {
+    if (node->numsubnodes == 0) {
+      rectObj quads[4];
+
+      treeSplitQuadrants(&node->rect, quads);
+      node->numsubnodes = 4;
+      node->subnode[0] = treeNodeCreate(quads[0]);
+      node->subnode[1] = treeNodeCreate(quads[1]);
+      node->subnode[2] = treeNodeCreate(quads[2]);
+      node->subnode[3] = treeNodeCreate(quads[3]);
+    }
+    node = node->subnode[(path >> (62 - 2 * level)) & 3];
+  }
+
+  return node;
+}
+
+typedef struct {
+  rectObj root;
+  int maxdepth;
+  const rectObj *bounds;
+  const char *valid;
+  uint64_t *paths;
+  int count;
+  CPLJoinableThread *hThread;
+} treePathJob;
+
+static void treeComputePaths(void *pData) {
+  treePathJob *job = (treePathJob *)pData;
+  int i;
+
+  for (i = 0; i < job->count; i++) {
+    if (job->valid[i])
+      job->paths[i] =
+          treeComputePath(job->root, job->bounds + i, job->maxdepth);
+    else
+      job->paths[i] = TREE_PATH_NONE;
+  }
+}
+
+/*
+** Read the bounds of all shapes block by block, in a sequential pass over
+** the .shp, compute their paths on several threads and add them to the tree
+** in id order.
+*/
+static int treeBulkLoad(treeObj *tree, shapefileObj *shapefile) {
+  treePathJob jobs[TREE_MAX_THREADS];
+  rectObj *bounds;
+  char *valid;
+  uint64_t *paths;
+  int first, i, nThreads;
+
+  const int blocksize = MS_MIN(TREE_BULK_BLOCK, MS_MAX(1, tree->numshapes));
+
+  nThreads = MS_MAX(1, MS_MIN(CPLGetNumCPUs(), TREE_MAX_THREADS));
+  if (blocksize < 1024 * nThreads)
+    nThreads = 1; /* not worth it */
+
+  bounds = (rectObj *)msSmallMalloc(sizeof(rectObj) * blocksize);
+  valid = (char *)msSmallMalloc(blocksize);
+  paths = (uint64_t *)msSmallMalloc(sizeof(uint64_t) * blocksize);
+
+  for (first = 0; first < tree->numshapes; first += blocksize) {
+    const int count = MS_MIN(blocksize, tree->numshapes - first);
+
+    if (msSHPReadBoundsRange(shapefile->hSHP, first, count, bounds, valid) !=
+        MS_SUCCESS) {
+      free(bounds);
+      free(valid);
+      free(paths);
+      return MS_FAILURE;
+    }
+
+    for (i = 0; i < nThreads; i++) {
+      const int start = (int)((long long)count * i / nThreads);
+      const int end = (int)((long long)count * (i + 1) / nThreads);
+
+      jobs[i].root = tree->root->rect;
+      jobs[i].maxdepth = tree->maxdepth;
+      jobs[i].bounds = bounds + start;
+      jobs[i].valid = valid + start;
+      jobs[i].paths = paths + start;
+      jobs[i].count = end - start;
+      jobs[i].hThread = NULL;
+    }
+
+    /* compute the paths, falling back to this thread if needed */
+    for (i = 1; i < nThreads; i++) {
+      jobs[i].hThread = CPLCreateJoinableThread(treeComputePaths, &(jobs[i]));
+      if (jobs[i].hThread == NULL)
+        treeComputePaths(&(jobs[i]));
+    }
+    treeComputePaths(&(jobs[0]));
+    for (i = 1; i < nThreads; i++) {
+      if (jobs[i].hThread)
+        CPLJoinThread(jobs[i].hThread);
+    }
+
+    for (i = 0; i < count; i++) {
+      if (paths[i] != TREE_PATH_NONE)
+        treeNodeAppendId(treeNodeForPath(tree->root, paths[i]), first + i);
+    }
+  }
+
+  free(bounds);
+  free(valid);
+  free(paths);
+
+  return MS_SUCCESS;
+}
+
 treeObj *msCreateTree(shapefileObj *shapefile, int maxdepth) {
   int i;
   treeObj *tree;
@@ -239,6 +435,17 @@ treeObj *msCreateTree(shapefileObj *shapefile, int maxdepth) {
   /* -------------------------------------------------------------------- */
   tree->root = treeNodeCreate(shapefile->bounds);
 
+#if MAX_SUBNODES == 4
+  if (tree->maxdepth <= TREE_PATH_MAX_DEPTH + 1) {
+    if (treeBulkLoad(tree, shapefile) == MS_SUCCESS)
+      return tree;
+
+    /* start over, one shape at a time */
+    destroyTreeNode(tree->root);
+    tree->root = treeNodeCreate(shapefile->bounds);
+  }
+#endif
+
   for (i = 0; i < shapefile->numshapes; i++) {
     if (msSHPReadBounds(shapefile->hSHP, i, &bounds) == MS_SUCCESS)
       treeAddShapeId(tree, i, bounds);
@@ -368,10 +575,7 @@ static int treeNodeAddShapeId(treeNodeObj *node, int id, rectObj rect,
   /* -------------------------------------------------------------------- */
   /*      If none of that worked, just add it to this nodes list.         */
   /* -------------------------------------------------------------------- */
-  node->numshapes++;
-
-  node->ids = SfRealloc(node->ids, sizeof(ms_int32) * node->numshapes);
-  node->ids[node->numshapes - 1] = id;
+  treeNodeAppendId(node, id);
 
   return MS_TRUE;
 }
@@ -689,15 +893,26 @@ static ms_int32 getSubNodeOffset(treeNodeObj *node) {
   return (offset);
 }
 
-static void writeTreeNode(SHPTreeHandle disktree, treeNodeObj *node) {
+/*
+** Write node and its subnodes. The record buffer is shared by all nodes and
+** only grown when a node has more shapes than any written before.
+*/
+static void writeTreeNode(SHPTreeHandle disktree, treeNodeObj *node,
+                          char **buffer, size_t *buffersize) {
   int i, j;
   ms_int32 offset;
   char *pabyRec = NULL;
+  const size_t recsize = sizeof(rectObj) + (3 * sizeof(ms_int32)) +
+                         (node->numshapes * sizeof(ms_int32));
 
   offset = getSubNodeOffset(node);
 
-  pabyRec = msSmallMalloc(sizeof(rectObj) + (3 * sizeof(ms_int32)) +
-                          (node->numshapes * sizeof(ms_int32)));
+  if (recsize > *buffersize) {
+    free(*buffer);
+    *buffer = msSmallMalloc(recsize);
+    *buffersize = recsize;
+  }
+  pabyRec = *buffer;
 
   memcpy(pabyRec, &offset, 4);
   if (disktree->needswap)
@@ -723,11 +938,10 @@ static void writeTreeNode(SHPTreeHandle disktree, treeNodeObj *node) {
     SwapWord(4, pabyRec + 40 + j);
 
   fwrite(pabyRec, 44 + j, 1, disktree->fp);
-  free(pabyRec);
 
   for (i = 0; i < node->numsubnodes; i++) {
     if (node->subnode[i])
-      writeTreeNode(disktree, node->subnode[i]);
+      writeTreeNode(disktree, node->subnode[i], buffer, buffersize);
   }
 
   return;
@@ -829,7 +1043,10 @@ int msWriteTree(treeObj *tree, char *filename, int B_order) {
     return (MS_FALSE);
   }
 
-  writeTreeNode(disktree, tree->root);
+  char *buffer = NULL;
+  size_t buffersize = 0;
+  writeTreeNode(disktree, tree->root, &buffer, &buffersize);
+  free(buffer);
 
   msSHPDiskTreeClose(disktree);
 
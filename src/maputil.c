@@ -2180,6 +2180,14 @@ void msCleanup() {
 
   msTimeCleanup();
 
+  msJoinCleanup();
+
+  msFlatGeobufCleanup();
+
+  msContourCacheCleanup();
+
+  msOWSCapabilitiesCacheCleanup();
+
   msIO_Cleanup();
 
   msResetErrorList();
@@ -37,6 +37,7 @@
 /* There is a dependency to GDAL/OGR for the GML driver and MiniXML parser */
 #include "cpl_minixml.h"
 #include "cpl_conv.h"
+#include "cpl_multiproc.h"
 #include "cpl_string.h"
 
 #include "mapogcfilter.h"
@@ -47,7 +48,10 @@
 #include "maplibxml2.h"
 #endif
 
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 
 static int msWFSAnalyzeStoredQuery(mapObj *map, wfsParamsObj *wfsparams,
                                    const char *id,
@@ -2229,11 +2233,13 @@ static int msWFSRunFilter(mapObj *map, layerObj *lp,
 }
 
 /*
-** msWFSRunBasicGetFeature()
+** msWFSSetupBasicGetFeature()
+**
+** Set up map->query to retrieve all the features of a layer.
 */
-static int msWFSRunBasicGetFeature(mapObj *map, layerObj *lp,
-                                   const wfsParamsObj *paramsObj,
-                                   int nWFSVersion) {
+static int msWFSSetupBasicGetFeature(mapObj *map, layerObj *lp,
+                                     const wfsParamsObj *paramsObj,
+                                     int nWFSVersion) {
   rectObj ext;
   int status;
 
@@ -2271,8 +2277,7 @@ static int msWFSRunBasicGetFeature(mapObj *map, layerObj *lp,
         msSetError(MS_WFSERR, "msLoadProjectionString() failed: %s",
                    "msWFSGetFeature()", pszMapSRS);
         msFree(pszMapSRS);
-        return msWFSException(map, "mapserv", MS_OWS_ERROR_NO_APPLICABLE_CODE,
-                              paramsObj->pszVersion);
+        return MS_FAILURE;
       }
     }
     msFree(pszMapSRS);
@@ -2300,6 +2305,20 @@ static int msWFSRunBasicGetFeature(mapObj *map, layerObj *lp,
     map->query.rect = ext;
   }
 
+  return MS_SUCCESS;
+}
+
+/*
+** msWFSRunBasicGetFeature()
+*/
+static int msWFSRunBasicGetFeature(mapObj *map, layerObj *lp,
+                                   const wfsParamsObj *paramsObj,
+                                   int nWFSVersion) {
+  if (msWFSSetupBasicGetFeature(map, lp, paramsObj, nWFSVersion) !=
+      MS_SUCCESS)
+    return msWFSException(map, "mapserv", MS_OWS_ERROR_NO_APPLICABLE_CODE,
+                          paramsObj->pszVersion);
+
   if (msQueryByRect(map) != MS_SUCCESS) {
     errorObj *ms_error;
     ms_error = msGetErrorObj();
@@ -2314,6 +2333,294 @@ static int msWFSRunBasicGetFeature(mapObj *map, layerObj *lp,
   return MS_SUCCESS;
 }
 
+#ifdef USE_THREAD
+
+/*
+** State of a layer query run by msWFSRunBasicGetFeatureParallel().
+*/
+typedef struct {
+  mapObj *map; /* private copy of the map of the thread that ran the query */
+  int layerindex;
+  /* map->query as set up by msWFSSetupBasicGetFeature(), only the plain
+   * members are used */
+  queryObj query;
+  int status;
+  int errorcode;
+  char routine[ROUTINELENGTH];
+  char message[MESSAGELENGTH];
+} WFSLayerQueryTask;
+
+/*
+** msWFSCanQueryLayersInParallel()
+**
+** Parallel retrieval is opt-in with the wfs_parallel_query metadata, as
+** the queried layers replace the layerObj of the map (something mapscript
+** callers holding layer references would not expect). It is only used
+** when the layer queries are independent of each other: no global feature
+** limit or start index, and no layer depending on other layers of the
+** map.
+*/
+static int msWFSCanQueryLayersInParallel(mapObj *map) {
+  const char *value;
+  int j, numlayers = 0;
+
+  value = msOWSLookupMetadata(&(map->web.metadata), "F", "parallel_query");
+  if (value == NULL || !EQUAL(value, "true"))
+    return MS_FALSE;
+
+  if (map->query.maxfeatures >= 0 || map->query.startindex > 1)
+    return MS_FALSE;
+
+  for (j = 0; j < map->numlayers; j++) {
+    layerObj *lp = GET_LAYER(map, j);
+    if (lp->status != MS_ON)
+      continue;
+    if (lp->startindex > 1 || lp->connectiontype == MS_UNION ||
+        lp->connectiontype == MS_TILED_SHAPEFILE || lp->tileindex != NULL ||
+        lp->cluster.region != NULL)
+      return MS_FALSE;
+    numlayers++;
+  }
+
+  return numlayers > 1;
+}
+
+static void msWFSRunLayerQueryTask(const mapObj *source, mapObj *map,
+                                   WFSLayerQueryTask *task) {
+  layerObj *lp = GET_LAYER(map, task->layerindex);
+  const layerObj *orig = GET_LAYER(source, task->layerindex);
+  /* classes don't affect retrieval of features, see msWFSRetrieveFeatures() */
+  int numclasses = lp->numclasses;
+
+  map->query.type = task->query.type;
+  map->query.mode = task->query.mode;
+  map->query.layer = task->query.layer;
+  map->query.rect = task->query.rect;
+  map->query.startindex = task->query.startindex;
+  lp->startindex = orig->startindex;
+  if (orig->sortBy.nProperties > 0)
+    msLayerSetSort(lp, &(orig->sortBy));
+  task->map = map;
+
+  lp->numclasses = 0;
+  task->status = msQueryByRect(map);
+  lp->numclasses = numclasses;
+
+  if (task->status != MS_SUCCESS) {
+    errorObj *ms_error = msGetErrorObj();
+    task->errorcode = ms_error->code;
+    strlcpy(task->routine, ms_error->routine, sizeof(task->routine));
+    strlcpy(task->message, ms_error->message, sizeof(task->message));
+  }
+
+  /* release the error list entry of this thread */
+  msResetErrorList();
+}
+
+/*
+** msWFSRunLayerQueryWorker()
+**
+** Run the queries of the layers not yet taken by another worker, on the
+** private map copy of this worker. The original map is only read.
+*/
+static void msWFSRunLayerQueryWorker(const mapObj *source, mapObj *map,
+                                     std::vector<WFSLayerQueryTask> *tasks,
+                                     std::atomic<size_t> *next) {
+  size_t i;
+
+  while ((i = (*next)++) < tasks->size())
+    msWFSRunLayerQueryTask(source, map, &((*tasks)[i]));
+}
+
+/*
+** msWFSGetParallelQueryThreads()
+**
+** Number of layers queried concurrently, from the
+** MS_WFS_PARALLEL_QUERY_THREADS configuration option. Defaults to the
+** number of CPUs.
+*/
+static int msWFSGetParallelQueryThreads(void) {
+  const char *value =
+      CPLGetConfigOption("MS_WFS_PARALLEL_QUERY_THREADS", NULL);
+  int nThreads;
+
+  if (value == NULL || EQUAL(value, "ALL_CPUS"))
+    nThreads = CPLGetNumCPUs();
+  else
+    nThreads = atoi(value);
+
+  return MS_MAX(1, nThreads);
+}
+
+/*
+** msWFSCopyMapForQuery()
+**
+** Copy of the map, with the query settings, for a query worker.
+*/
+static mapObj *msWFSCopyMapForQuery(mapObj *map) {
+  mapObj *mapTmp = (mapObj *)msSmallCalloc(1, sizeof(mapObj));
+
+  if (initMap(mapTmp) == -1) {
+    free(mapTmp);
+    return NULL;
+  }
+  if (msCopyMap(mapTmp, map) != MS_SUCCESS) {
+    msFreeMap(mapTmp);
+    return NULL;
+  }
+  mapTmp->query.maxfeatures = map->query.maxfeatures;
+  mapTmp->query.only_cache_result_count = map->query.only_cache_result_count;
+  mapTmp->query.cache_shapes = map->query.cache_shapes;
+  mapTmp->query.max_cached_shape_count = map->query.max_cached_shape_count;
+  mapTmp->query.max_cached_shape_ram_amount =
+      map->query.max_cached_shape_ram_amount;
+
+  return mapTmp;
+}
+
+/*
+** msWFSAdoptQueriedLayer()
+**
+** Swap the queried layer of a map copy into the original map, with its
+** result cache and open data source.
+*/
+static void msWFSAdoptQueriedLayer(mapObj *map, mapObj *mapTmp, int index) {
+  layerObj *lp = GET_LAYER(map, index);
+  layerObj *queried = GET_LAYER(mapTmp, index);
+  projectionObj projection;
+
+  GET_LAYER(map, index) = queried;
+  GET_LAYER(mapTmp, index) = lp;
+  queried->map = map;
+  lp->map = mapTmp;
+
+  /* The projection context of the copy goes back to the pool with it */
+  msInitProjection(&projection);
+  msProjectionSetContext(&projection, map->projContext);
+  msCopyProjection(&projection, &(queried->projection));
+  msFreeProjection(&(queried->projection));
+  queried->projection = projection;
+  msProjectDestroyReprojector(queried->reprojectorLayerToMap);
+  queried->reprojectorLayerToMap = NULL;
+}
+
+/*
+** msWFSRunBasicGetFeatureParallel()
+**
+** Equivalent of calling msWFSRunBasicGetFeature() on each layer that is
+** ON, but with the layer queries executed concurrently by a small pool of
+** workers, each with its own copy of the map. The query set up is still
+** done in layer order on the map itself, so it ends up in the same state
+** as after a sequential run.
+*/
+static int msWFSRunBasicGetFeatureParallel(mapObj *map,
+                                           const wfsParamsObj *paramsObj,
+                                           int nWFSVersion) {
+  std::vector<WFSLayerQueryTask> tasks;
+  std::vector<mapObj *> maps;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next(0);
+  int j, status = MS_SUCCESS;
+
+  for (j = 0; j < map->numlayers; j++) {
+    layerObj *lp = GET_LAYER(map, j);
+    WFSLayerQueryTask task;
+
+    if (lp->status != MS_ON)
+      continue;
+
+    if (msWFSSetupBasicGetFeature(map, lp, paramsObj, nWFSVersion) !=
+        MS_SUCCESS) {
+      status = MS_FAILURE;
+      break;
+    }
+
+    memset(&task, 0, sizeof(task));
+    task.layerindex = j;
+    task.query = map->query;
+    tasks.push_back(task);
+  }
+
+  if (status == MS_SUCCESS) {
+    const size_t nWorkers = MS_MIN((size_t)msWFSGetParallelQueryThreads(),
+                                   tasks.size());
+
+    while (maps.size() < nWorkers) {
+      mapObj *mapTmp = msWFSCopyMapForQuery(map);
+      if (mapTmp == NULL) {
+        status = MS_FAILURE;
+        break;
+      }
+      maps.push_back(mapTmp);
+    }
+  }
+
+  if (status == MS_SUCCESS) {
+    for (auto mapTmp : maps)
+      threads.emplace_back(msWFSRunLayerQueryWorker, map, mapTmp, &tasks,
+                           &next);
+    for (auto &thread : threads)
+      thread.join();
+
+    /* report the first failure in layer order, as a sequential run would */
+    for (auto &task : tasks) {
+      if (task.status != MS_SUCCESS && task.errorcode != MS_NOTFOUND) {
+        msSetError(task.errorcode, "%s", task.routine, task.message);
+        msSetError(MS_WFSERR, "ms_error->code not found", "msWFSGetFeature()");
+        status = MS_FAILURE;
+        break;
+      }
+      msWFSAdoptQueriedLayer(map, task.map, task.layerindex);
+    }
+  }
+
+  for (auto mapTmp : maps)
+    msFreeMap(mapTmp);
+
+  if (status != MS_SUCCESS)
+    return msWFSException(map, "mapserv", MS_OWS_ERROR_NO_APPLICABLE_CODE,
+                          paramsObj->pszVersion);
+
+  return MS_SUCCESS;
+}
+
+#endif /* USE_THREAD */
+
+/*
+** msWFSRunBasicGetFeatures()
+**
+** Run msWFSRunBasicGetFeature() on all the layers that are ON.
+*/
+static int msWFSRunBasicGetFeatures(mapObj *map, const wfsParamsObj *paramsObj,
+                                    int nWFSVersion) {
+  int j;
+
+#ifdef USE_THREAD
+  if (msWFSCanQueryLayersInParallel(map))
+    return msWFSRunBasicGetFeatureParallel(map, paramsObj, nWFSVersion);
+#endif
+
+  for (j = 0; j < map->numlayers; j++) {
+    layerObj *lp;
+    lp = GET_LAYER(map, j);
+    if (lp->status == MS_ON) {
+      // classes don't affect retrieval of features, so set the count to 0
+      // when the query is executed this avoids selecting any fields
+      // referenced in a CLASS from the data source
+      int numclasses = lp->numclasses;
+      lp->numclasses = 0;
+      int status = msWFSRunBasicGetFeature(map, lp, paramsObj, nWFSVersion);
+      // set the class count back to its original value once the query is
+      // run
+      lp->numclasses = numclasses;
+      if (status != MS_SUCCESS)
+        return status;
+    }
+  }
+
+  return MS_SUCCESS;
+}
+
 /*
 ** msWFSRetrieveFeatures()
 */
@@ -2599,23 +2906,9 @@ this request. Check wfs/ows_enable_request settings.",
                             paramsObj->pszVersion);
 
     if (!bBBOXSet) {
-      for (j = 0; j < map->numlayers; j++) {
-        layerObj *lp;
-        lp = GET_LAYER(map, j);
-        if (lp->status == MS_ON) {
-          // classes don't affect retrieval of features, so set the count to 0
-          // when the query is executed this avoids selecting any fields
-          // referenced in a CLASS from the data source
-          int numclasses = lp->numclasses;
-          lp->numclasses = 0;
-          int status = msWFSRunBasicGetFeature(map, lp, paramsObj, nWFSVersion);
-          // set the class count back to its original value once the query is
-          // run
-          lp->numclasses = numclasses;
-          if (status != MS_SUCCESS)
-            return status;
-        }
-      }
+      int status = msWFSRunBasicGetFeatures(map, paramsObj, nWFSVersion);
+      if (status != MS_SUCCESS)
+        return status;
     } else {
 
       char *sBBoxSrs = NULL;
@@ -30,10 +30,15 @@
 
 #include "mapserver.h"
 #include <stdlib.h> /* for atof() and atoi() */
+#include <ctype.h>
+#include <limits.h>
 #include <math.h>
 
 #include "cpl_vsi.h"
 
+/* size of the read ahead buffer used when records are read in sequence */
+#define DBF_READ_BLOCK_SIZE 65536
+
 static inline void IGUR_sizet(size_t ignored) {
   (void)ignored;
 } /* Ignore GCC Unused Result */
@@ -125,6 +130,69 @@ static void flushRecord(DBFHandle psDBF)
   }
 }
 
+/************************************************************************/
+/*                             loadRecord()                             */
+/*                                                                      */
+/*      Make hEntity the current record. When records are read in       */
+/*      sequence, and the file has not been written to, a block of      */
+/*      them is read at once and the following records are served      */
+/*      from that block.                                                */
+/************************************************************************/
+static int loadRecord(DBFHandle psDBF, int hEntity)
+
+{
+  unsigned int nRecordOffset;
+  int nBlockMax;
+
+  if (psDBF->nCurrentRecord == hEntity)
+    return (MS_SUCCESS);
+
+  flushRecord(psDBF);
+
+  if (psDBF->nBlockCount > 0 && hEntity >= psDBF->nBlockFirst &&
+      hEntity < psDBF->nBlockFirst + psDBF->nBlockCount) {
+    memcpy(psDBF->pszCurrentRecord,
+           psDBF->pszRecordBlock +
+               (size_t)(hEntity - psDBF->nBlockFirst) * psDBF->nRecordLength,
+           psDBF->nRecordLength);
+    psDBF->nCurrentRecord = hEntity;
+    return (MS_SUCCESS);
+  }
+
+  nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
+  nBlockMax = MS_MIN(DBF_READ_BLOCK_SIZE / (int)psDBF->nRecordLength,
+                     psDBF->nRecords - hEntity);
+
+  VSIFSeekL(psDBF->fp, nRecordOffset, 0);
+
+  if (hEntity == psDBF->nCurrentRecord + 1 && nBlockMax > 1 &&
+      !psDBF->bUpdated) {
+    if (psDBF->pszRecordBlock == NULL)
+      psDBF->pszRecordBlock = (char *)msSmallMalloc(
+          (size_t)(DBF_READ_BLOCK_SIZE / psDBF->nRecordLength) *
+          psDBF->nRecordLength);
+
+    psDBF->nBlockFirst = hEntity;
+    psDBF->nBlockCount = (int)VSIFReadL(
+        psDBF->pszRecordBlock, psDBF->nRecordLength, nBlockMax, psDBF->fp);
+    if (psDBF->nBlockCount < 1) {
+      psDBF->nBlockCount = 0;
+      msSetError(MS_DBFERR, "Cannot read record %d.", "loadRecord()", hEntity);
+      return (MS_FAILURE);
+    }
+    memcpy(psDBF->pszCurrentRecord, psDBF->pszRecordBlock,
+           psDBF->nRecordLength);
+  } else if (VSIFReadL(psDBF->pszCurrentRecord, psDBF->nRecordLength, 1,
+                       psDBF->fp) != 1) {
+    msSetError(MS_DBFERR, "Cannot read record %d.", "loadRecord()", hEntity);
+    return (MS_FAILURE);
+  }
+
+  psDBF->nCurrentRecord = hEntity;
+
+  return (MS_SUCCESS);
+}
+
 DBFHandle msDBFOpenVirtualFile(VSILFILE *fp) {
   DBFHandle psDBF;
   uchar *pabyBuf;
@@ -317,6 +385,7 @@ void msDBFClose(DBFHandle psDBF) {
 
   free(psDBF->pszHeader);
   free(psDBF->pszCurrentRecord);
+  free(psDBF->pszRecordBlock);
 
   free(psDBF->pszStringField);
 
@@ -379,6 +448,10 @@ DBFHandle msDBFCreate(const char *pszFilename)
   psDBF->bCurrentRecordModified = MS_FALSE;
   psDBF->pszCurrentRecord = NULL;
 
+  psDBF->pszRecordBlock = NULL;
+  psDBF->nBlockFirst = 0;
+  psDBF->nBlockCount = 0;
+
   psDBF->pszStringField = NULL;
   psDBF->nStringFieldLen = 0;
 
@@ -508,17 +581,18 @@ static int DBFIsValueNULL(const char *pszValue, char type)
 }
 
 /************************************************************************/
-/*                          msDBFReadAttribute()                        */
+/*                           msDBFFieldSpan()                           */
 /*                                                                      */
-/*      Read one of the attribute fields of a record.                   */
+/*      Locate one of the attribute fields of a record in the record    */
+/*      buffer, with trailing blanks (and leading blanks for numeric    */
+/*      types) trimmed. Nothing is copied.                              */
 /************************************************************************/
-static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField)
+static int msDBFFieldSpan(DBFHandle psDBF, int hEntity, int iField,
+                          const char **ppszField, int *pnLength)
 
 {
-  int i;
-  unsigned int nRecordOffset;
-  const uchar *pabyRec;
-  const char *pReturnField = NULL;
+  const char *pszField, *pszNul;
+  int nLength;
 
   /* -------------------------------------------------------------------- */
   /*  Is the request valid?                             */
@@ -526,37 +600,83 @@ static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField)
   if (iField < 0 || iField >= psDBF->nFields) {
     msSetError(MS_DBFERR, "Invalid field index %d.", "msDBFReadAttribute()",
                iField);
-    return (NULL);
+    return (MS_FAILURE);
   }
 
   if (hEntity < 0 || hEntity >= psDBF->nRecords) {
     msSetError(MS_DBFERR, "Invalid record number %d.", "msDBFReadAttribute()",
                hEntity);
-    return (NULL);
+    return (MS_FAILURE);
   }
 
   /* -------------------------------------------------------------------- */
   /*  Have we read the record?              */
   /* -------------------------------------------------------------------- */
-  if (psDBF->nCurrentRecord != hEntity) {
-    flushRecord(psDBF);
+  if (loadRecord(psDBF, hEntity) != MS_SUCCESS)
+    return (MS_FAILURE);
 
-    nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
+  pszField = psDBF->pszCurrentRecord + psDBF->panFieldOffset[iField];
+  nLength = psDBF->panFieldSize[iField];
 
-    VSIFSeekL(psDBF->fp, nRecordOffset, 0);
-    if (VSIFReadL(psDBF->pszCurrentRecord, psDBF->nRecordLength, 1,
-                  psDBF->fp) != 1) {
-      msSetError(MS_DBFERR, "Cannot read record %d.", "msDBFReadAttribute()",
-                 hEntity);
-      return (NULL);
-    }
+  /* the field ends at the first NUL, if any */
+  pszNul = (const char *)memchr(pszField, '\0', nLength);
+  if (pszNul)
+    nLength = (int)(pszNul - pszField);
 
-    psDBF->nCurrentRecord = hEntity;
+  /*
+  ** Trim trailing blanks (SDL Modification)
+  */
+  while (nLength > 0 && pszField[nLength - 1] == ' ')
+    nLength--;
+
+  /*
+  ** Trim/skip leading blanks (SDL/DM Modification - only on numeric types)
+  */
+  if (psDBF->pachFieldType[iField] == 'N' ||
+      psDBF->pachFieldType[iField] == 'F' ||
+      psDBF->pachFieldType[iField] == 'D') {
+    while (nLength > 0 && *pszField == ' ') {
+      pszField++;
+      nLength--;
+    }
   }
 
-  pabyRec = (const uchar *)psDBF->pszCurrentRecord;
-  /* DEBUG */
-  /* printf("CurrentRecord(%c):%s\n", psDBF->pachFieldType[iField], pabyRec); */
+  *ppszField = pszField;
+  *pnLength = nLength;
+
+  return (MS_SUCCESS);
+}
+
+/************************************************************************/
+/*                          msDBFIsNumericNULL()                        */
+/*                                                                      */
+/*      Return TRUE if a numeric field value is NULL. Such values are   */
+/*      returned as "0".                                                */
+/************************************************************************/
+static int msDBFIsNumericNULL(DBFHandle psDBF, int iField,
+                              const char *pszValue)
+
+{
+  return ((psDBF->pachFieldType[iField] == 'N' ||
+           psDBF->pachFieldType[iField] == 'F' ||
+           psDBF->pachFieldType[iField] == 'D') &&
+          DBFIsValueNULL(pszValue, psDBF->pachFieldType[iField]));
+}
+
+/************************************************************************/
+/*                          msDBFReadAttribute()                        */
+/*                                                                      */
+/*      Read one of the attribute fields of a record.                   */
+/************************************************************************/
+static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField)
+
+{
+  const char *pszField;
+  int nLength;
+
+  if (msDBFFieldSpan(psDBF, hEntity, iField, &pszField, &nLength) !=
+      MS_SUCCESS)
+    return (NULL);
 
   /* -------------------------------------------------------------------- */
   /*  Ensure our field buffer is large enough to hold this buffer.      */
@@ -570,57 +690,100 @@ static const char *msDBFReadAttribute(DBFHandle psDBF, int hEntity, int iField)
   /* -------------------------------------------------------------------- */
   /*  Extract the requested field.              */
   /* -------------------------------------------------------------------- */
-  strncpy(psDBF->pszStringField,
-          (const char *)pabyRec + psDBF->panFieldOffset[iField],
-          psDBF->panFieldSize[iField]);
-  psDBF->pszStringField[psDBF->panFieldSize[iField]] = '\0';
+  memcpy(psDBF->pszStringField, pszField, nLength);
+  psDBF->pszStringField[nLength] = '\0';
 
-  /*
-  ** Trim trailing blanks (SDL Modification)
-  */
-  for (i = strlen(psDBF->pszStringField) - 1; i >= 0; i--) {
-    if (psDBF->pszStringField[i] != ' ') {
-      psDBF->pszStringField[i + 1] = '\0';
-      break;
-    }
-  }
+  /*  detect null values */
+  if (msDBFIsNumericNULL(psDBF, iField, psDBF->pszStringField))
+    return ("0");
 
-  if (i == -1)
-    psDBF->pszStringField[0] = '\0'; /* whole string is blank (SDL fix)       */
+  return (psDBF->pszStringField);
+}
 
-  /*
-  ** Trim/skip leading blanks (SDL/DM Modification - only on numeric types)
-  */
-  if (psDBF->pachFieldType[iField] == 'N' ||
-      psDBF->pachFieldType[iField] == 'F' ||
-      psDBF->pachFieldType[iField] == 'D') {
-    for (i = 0; psDBF->pszStringField[i] != '\0'; i++) {
-      if (psDBF->pszStringField[i] != ' ')
-        break;
-    }
-    pReturnField = psDBF->pszStringField + i;
-  } else
-    pReturnField = psDBF->pszStringField;
+/************************************************************************/
+/*                          msDBFSetValue()                             */
+/*                                                                      */
+/*      Copy one of the attribute fields of a record straight from      */
+/*      the record buffer into *ppszValue. A previous value (or NULL)   */
+/*      is reused if long enough, and reallocated otherwise.            */
+/************************************************************************/
+static int msDBFSetValue(DBFHandle psDBF, int hEntity, int iField,
+                         char **ppszValue)
+
+{
+  const char *pszField;
+  char *pszValue = *ppszValue;
+  int nLength;
+
+  if (msDBFFieldSpan(psDBF, hEntity, iField, &pszField, &nLength) !=
+      MS_SUCCESS)
+    return (MS_FAILURE);
+
+  if (pszValue == NULL || (int)strlen(pszValue) < nLength)
+    pszValue = *ppszValue = (char *)msSmallRealloc(pszValue, nLength + 1);
+  memcpy(pszValue, pszField, nLength);
+  pszValue[nLength] = '\0';
 
   /*  detect null values */
-  if (DBFIsValueNULL(pReturnField, psDBF->pachFieldType[iField])) {
-    if (psDBF->pachFieldType[iField] == 'N' ||
-        psDBF->pachFieldType[iField] == 'F' ||
-        psDBF->pachFieldType[iField] == 'D')
-      pReturnField = "0";
+  if (msDBFIsNumericNULL(psDBF, iField, pszValue)) {
+    pszValue[0] = '0';
+    pszValue[1] = '\0';
   }
-  return (pReturnField);
+
+  return (MS_SUCCESS);
+}
+
+/************************************************************************/
+/*                          msDBFGetValue()                             */
+/*                                                                      */
+/*      Return a newly allocated copy of one of the attribute fields    */
+/*      of a record.                                                    */
+/************************************************************************/
+static char *msDBFGetValue(DBFHandle psDBF, int hEntity, int iField)
+
+{
+  char *pszValue = NULL;
+
+  if (msDBFSetValue(psDBF, hEntity, iField, &pszValue) != MS_SUCCESS)
+    return (NULL);
+
+  return (pszValue);
 }
 
 /************************************************************************/
 /*                        msDBFReadIntAttribute()                       */
 /*                                                                      */
-/*      Read an integer attribute.                                      */
+/*      Read an integer attribute. The digits are parsed in place, in   */
+/*      the record buffer. N fields can be wider than an int, values    */
+/*      out of range are clamped to INT_MIN/INT_MAX.                    */
 /************************************************************************/
 int msDBFReadIntegerAttribute(DBFHandle psDBF, int iRecord, int iField)
 
 {
-  return (atoi(msDBFReadAttribute(psDBF, iRecord, iField)));
+  const char *pszField;
+  int nLength, i = 0, bNegative = MS_FALSE;
+  long long nValue = 0;
+
+  if (msDBFFieldSpan(psDBF, iRecord, iField, &pszField, &nLength) !=
+      MS_SUCCESS)
+    return (0);
+
+  while (i < nLength && isspace((unsigned char)pszField[i]))
+    i++;
+
+  if (i < nLength && (pszField[i] == '-' || pszField[i] == '+')) {
+    bNegative = (pszField[i] == '-');
+    i++;
+  }
+
+  for (; i < nLength && pszField[i] >= '0' && pszField[i] <= '9'; i++) {
+    if (nValue <= INT_MAX) /* further digits can't bring it back in range */
+      nValue = nValue * 10 + (pszField[i] - '0');
+  }
+
+  if (bNegative)
+    nValue = -nValue;
+  return ((int)MS_MAX(MS_MIN(nValue, INT_MAX), INT_MIN));
 }
 
 /************************************************************************/
@@ -629,7 +792,20 @@ int msDBFReadIntegerAttribute(DBFHandle psDBF, int iRecord, int iField)
 /*      Read a double attribute.                                        */
 /************************************************************************/
 double msDBFReadDoubleAttribute(DBFHandle psDBF, int iRecord, int iField) {
-  return (atof(msDBFReadAttribute(psDBF, iRecord, iField)));
+  const char *pszField;
+  char szNumber[256];
+  int nLength;
+
+  if (msDBFFieldSpan(psDBF, iRecord, iField, &pszField, &nLength) !=
+      MS_SUCCESS)
+    return (0);
+
+  /* numeric fields are at most 255 characters wide */
+  nLength = MS_MIN(nLength, (int)sizeof(szNumber) - 1);
+  memcpy(szNumber, pszField, nLength);
+  szNumber[nLength] = '\0';
+
+  return (atof(szNumber));
 }
 
 /************************************************************************/
@@ -699,7 +875,6 @@ DBFFieldType msDBFGetFieldInfo(DBFHandle psDBF, int iField, char *pszFieldName,
 /************************************************************************/
 static int msDBFWriteAttribute(DBFHandle psDBF, int hEntity, int iField,
                                void *pValue) {
-  unsigned int nRecordOffset;
   int len;
   uchar *pabyRec;
   char szSField[40];
@@ -730,18 +905,11 @@ static int msDBFWriteAttribute(DBFHandle psDBF, int hEntity, int iField,
   /*      Is this an existing record, but different than the last one     */
   /*      we accessed?                                                    */
   /* -------------------------------------------------------------------- */
-  if (psDBF->nCurrentRecord != hEntity) {
-    flushRecord(psDBF);
+  if (loadRecord(psDBF, hEntity) != MS_SUCCESS)
+    return MS_FALSE;
 
-    nRecordOffset = psDBF->nRecordLength * hEntity + psDBF->nHeaderLength;
-
-    VSIFSeekL(psDBF->fp, nRecordOffset, 0);
-    if (VSIFReadL(psDBF->pszCurrentRecord, psDBF->nRecordLength, 1,
-                  psDBF->fp) != 1)
-      return MS_FALSE;
-
-    psDBF->nCurrentRecord = hEntity;
-  }
+  /* the read ahead block no longer matches what is on disk */
+  psDBF->nBlockCount = 0;
 
   pabyRec = (uchar *)psDBF->pszCurrentRecord;
 
@@ -868,8 +1036,13 @@ char **msDBFGetValues(DBFHandle dbffile, int record) {
   values = (char **)malloc(sizeof(char *) * nFields);
   MS_CHECK_ALLOC(values, sizeof(char *) * nFields, NULL);
 
-  for (i = 0; i < nFields; i++)
-    values[i] = msStrdup(msDBFReadStringAttribute(dbffile, record, i));
+  for (i = 0; i < nFields; i++) {
+    values[i] = msDBFGetValue(dbffile, record, i);
+    if (values[i] == NULL) {
+      msFreeCharArray(values, i);
+      return (NULL); /* Error already reported by msDBFGetValue() */
+    }
+  }
 
   return (values);
 }
@@ -896,7 +1069,6 @@ int *msDBFGetItemIndexes(DBFHandle dbffile, char **items, int numitems) {
 
 char **msDBFGetValueList(DBFHandle dbffile, int record, int *itemindexes,
                          int numitems) {
-  const char *value;
   char **values = NULL;
   int i;
 
@@ -906,14 +1078,33 @@ char **msDBFGetValueList(DBFHandle dbffile, int record, int *itemindexes,
   values = (char **)malloc(sizeof(char *) * numitems);
   MS_CHECK_ALLOC(values, sizeof(char *) * numitems, NULL);
 
+  /* values are copied straight from the record buffer, only the requested
+   * items are extracted */
   for (i = 0; i < numitems; i++) {
-    value = msDBFReadStringAttribute(dbffile, record, itemindexes[i]);
-    if (value == NULL) {
-      free(values);
-      return NULL; /* Error already reported by msDBFReadStringAttribute() */
+    values[i] = msDBFGetValue(dbffile, record, itemindexes[i]);
+    if (values[i] == NULL) {
+      msFreeCharArray(values, i);
+      return NULL; /* Error already reported by msDBFGetValue() */
     }
-    values[i] = msStrdup(value);
   }
 
   return (values);
 }
+
+/*
+** Same as msDBFGetValueList(), but filling values, the numitems strings
+** returned for a previous record, in place. Strings are only reallocated
+** when the new value is longer.
+*/
+int msDBFReuseValueList(DBFHandle dbffile, int record, int *itemindexes,
+                        int numitems, char **values) {
+  int i;
+
+  for (i = 0; i < numitems; i++) {
+    if (msDBFSetValue(dbffile, record, itemindexes[i], &(values[i])) !=
+        MS_SUCCESS)
+      return (MS_FAILURE);
+  }
+
+  return (MS_SUCCESS);
+}
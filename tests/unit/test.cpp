@@ -1,5 +1,8 @@
 #include "../../src/mapserver.h"
 #include "../../src/maperror.h"
+#include "../../src/mapows.h"
+
+#include "cpl_vsi.h"
 
 /* ----------------------------------------------------------------------- */
 
@@ -145,8 +148,339 @@ static void testToString() {
 
 /* ----------------------------------------------------------------------- */
 
+static void testClipRect() {
+  rectObj rect;
+  rect.minx = 2;
+  rect.miny = 2;
+  rect.maxx = 5;
+  rect.maxy = 5;
+  {
+    // Square ring enclosing the clip rectangle
+    shapeObj shape;
+    msInitShape(&shape);
+    shape.type = MS_SHAPE_POLYGON;
+    rectObj square;
+    square.minx = 0;
+    square.miny = 0;
+    square.maxx = 10;
+    square.maxy = 10;
+    msRectToPolygon(square, &shape);
+    msClipPolygonRect(&shape, rect);
+    EXPECT_TRUE(shape.numlines == 1);
+    EXPECT_TRUE(shape.bounds.minx == 2 && shape.bounds.miny == 2 &&
+                shape.bounds.maxx == 5 && shape.bounds.maxy == 5);
+    EXPECT_TRUE(shape.line[0].point[0].x ==
+                    shape.line[0].point[shape.line[0].numpoints - 1].x &&
+                shape.line[0].point[0].y ==
+                    shape.line[0].point[shape.line[0].numpoints - 1].y);
+    msFreeShape(&shape);
+  }
+  {
+    // Line entering and leaving the clip rectangle twice
+    shapeObj shape;
+    msInitShape(&shape);
+    shape.type = MS_SHAPE_LINE;
+    pointObj points[4] = {};
+    points[0].x = 0;
+    points[0].y = 3;
+    points[1].x = 10;
+    points[1].y = 3;
+    points[2].x = 10;
+    points[2].y = 4;
+    points[3].x = 0;
+    points[3].y = 4;
+    lineObj line = {4, points};
+    msAddLine(&shape, &line);
+    msComputeBounds(&shape);
+    msClipPolylineRect(&shape, rect);
+    EXPECT_TRUE(shape.numlines == 2);
+    EXPECT_TRUE(shape.line[0].numpoints == 2 && shape.line[1].numpoints == 2);
+    EXPECT_TRUE(shape.line[0].point[0].x == 2 &&
+                shape.line[0].point[1].x == 5);
+    EXPECT_TRUE(shape.line[1].point[0].x == 5 &&
+                shape.line[1].point[1].x == 2);
+    msFreeShape(&shape);
+  }
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void testIOWriter() {
+  FILE *fp = tmpfile();
+  msIOWriter writer;
+  char expected[8192];
+  char got[8192];
+  const double values[] = {0.0,    -0.0,     1.5,        2.5,   -0.125,
+                           1e-7,   123.4565, -45.999999, 1e16,  1e300,
+                           0.0005, 7.0 / 3,  -179.99999, 1e-300};
+
+  expected[0] = '\0';
+  msIO_writerInit(&writer, fp);
+  for (int precision = 0; precision <= 16; precision += 4) {
+    for (double value : values) {
+      char buf[512];
+      snprintf(buf, sizeof(buf), "%.*f ", precision, value);
+      strcat(expected, buf);
+      msIO_writerDouble(&writer, value, precision);
+      msIO_writerWrite(&writer, " ", 1);
+    }
+  }
+  msIO_writerXMLEncode(&writer, "a&b<c>\"d'e");
+  msIO_writerPrintf(&writer, "|%d", 42);
+  strcat(expected, "a&amp;b&lt;c&gt;&quot;d&#39;e|42");
+  msIO_writerClose(&writer);
+
+  rewind(fp);
+  size_t n = fread(got, 1, sizeof(got) - 1, fp);
+  got[n] = '\0';
+  fclose(fp);
+  EXPECT_STREQ(got, expected);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void testCountBits() {
+  ms_bitarray array = msAllocBitArray(100);
+  EXPECT_TRUE(msCountBits(array, 100) == 0);
+  msSetBit(array, 0, 1);
+  msSetBit(array, 31, 1);
+  msSetBit(array, 32, 1);
+  msSetBit(array, 99, 1);
+  EXPECT_TRUE(msCountBits(array, 100) == 4);
+  EXPECT_TRUE(msCountBits(array, 32) == 2);
+  EXPECT_TRUE(msCountBits(array, 99) == 3);
+  /* msSetAllBits() may also set bits past the end of the array */
+  msSetAllBits(array, 100, 1);
+  EXPECT_TRUE(msCountBits(array, 100) == 100);
+  EXPECT_TRUE(msCountBits(array, 37) == 37);
+  free(array);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void addRasterClass(layerObj *layer, const char *expression) {
+  classObj *c = msGrowLayerClasses(layer);
+  initClass(c);
+  if (expression)
+    msLoadExpressionString(&c->expression, expression);
+  layer->numclasses++;
+}
+
+static void testRasterClassTable() {
+  layerObj layer;
+  initLayer(&layer, NULL);
+  addRasterClass(&layer, "([pixel] >= 0 and [pixel] < 10)");
+  addRasterClass(&layer, "(([pixel] >= 10) AND (20 >= [pixel]))");
+  addRasterClass(&layer, "25");
+  addRasterClass(&layer, "([pixel] > 5 and [pixel] < 100)");
+  addRasterClass(&layer, "([pixel] > 1000)");
+
+  rasterClassTableObj *table = msRasterClassTableCreate(&layer);
+  EXPECT_TRUE(table != NULL);
+  if (table) {
+    const float values[] = {-1.0f,  0.0f,     5.0f,   9.99f,
+                            10.0f,  20.0f,    20.5f,  25.0f,
+                            25.01f, 100.0f,   1000.0f, 1000.5f};
+    for (float value : values) {
+      EXPECT_TRUE(msRasterClassTableLookup(table, value) ==
+                  msGetClass_FloatRGB(&layer, value, -1, -1, -1));
+    }
+    EXPECT_TRUE(msRasterClassTableLookup(table, 25) == 2);
+    EXPECT_TRUE(msRasterClassTableLookup(table, 50) == 3);
+    EXPECT_TRUE(msRasterClassTableLookup(table, NAN) == -1);
+    msRasterClassTableFree(table);
+  }
+
+  /* not an interval */
+  addRasterClass(&layer, "([pixel] != 3)");
+  EXPECT_TRUE(msRasterClassTableCreate(&layer) == NULL);
+
+  freeLayer(&layer);
+
+  /* a class without expression matches everything else, NaN included */
+  initLayer(&layer, NULL);
+  addRasterClass(&layer, "([pixel] < 10)");
+  addRasterClass(&layer, NULL);
+  table = msRasterClassTableCreate(&layer);
+  EXPECT_TRUE(table != NULL);
+  if (table) {
+    EXPECT_TRUE(msRasterClassTableLookup(table, NAN) == 1);
+    EXPECT_TRUE(msRasterClassTableLookup(table, NAN) ==
+                msGetClass_FloatRGB(&layer, NAN, -1, -1, -1));
+    EXPECT_TRUE(msRasterClassTableLookup(table, 5) == 0);
+    EXPECT_TRUE(msRasterClassTableLookup(table, 50) == 1);
+    msRasterClassTableFree(table);
+  }
+
+  freeLayer(&layer);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void testHashTable() {
+  hashTableObj *table = msCreateHashTable();
+  char key[32], value[32];
+
+  EXPECT_TRUE(msHashIsEmpty(table));
+  EXPECT_TRUE(msFirstKeyFromHashTable(table) == NULL);
+  EXPECT_TRUE(msLookupHashTable(table, "foo") == NULL);
+
+  /* enough items to grow the table a few times */
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    snprintf(value, sizeof(value), "value%d", i);
+    EXPECT_TRUE(msInsertHashTable(table, key, value) != NULL);
+  }
+  EXPECT_TRUE(table->numitems == 100);
+  EXPECT_STREQ(msLookupHashTable(table, "KEY42"), "value42");
+
+  /* replacing keeps the position, removing keeps the order */
+  msInsertHashTable(table, "Key0", "zero");
+  EXPECT_TRUE(table->numitems == 100);
+  EXPECT_TRUE(msRemoveHashTable(table, "key1") == MS_SUCCESS);
+  EXPECT_TRUE(msRemoveHashTable(table, "key1") == MS_FAILURE);
+  EXPECT_TRUE(msLookupHashTable(table, "key1") == NULL);
+  EXPECT_STREQ(msFirstKeyFromHashTable(table), "key0");
+  EXPECT_STREQ(msLookupHashTable(table, "key0"), "zero");
+  EXPECT_STREQ(msNextKeyFromHashTable(table, "key0"), "key2");
+  EXPECT_TRUE(msNextKeyFromHashTable(table, "key99") == NULL);
+  EXPECT_STREQ(msLookupHashTable(table, "key99"), "value99");
+
+  msFreeHashTable(table);
+}
+
+static void testOWSResolvedMetadata() {
+  hashTableObj table;
+  initHashTable(&table);
+  msInsertHashTable(&table, "ows_title", "ows title");
+  msInsertHashTable(&table, "WMS_TITLE", "wms title");
+  msInsertHashTable(&table, "wfs_abstract", "wfs abstract");
+  msInsertHashTable(&table, "other", "value");
+
+  for (int pass = 0; pass < 2; pass++) {
+    EXPECT_STREQ(msOWSLookupMetadata(&table, "MO", "title"), "wms title");
+    EXPECT_STREQ(msOWSLookupMetadata(&table, "FO", "title"), "ows title");
+    EXPECT_STREQ(msOWSLookupMetadata(&table, "MFO", "abstract"),
+                 "wfs abstract");
+    EXPECT_TRUE(msOWSLookupMetadata(&table, "MO", "abstract") == NULL);
+    EXPECT_TRUE(msOWSLookupMetadata(&table, "MO", "other") == NULL);
+    EXPECT_STREQ(msOWSLookupMetadata(&table, NULL, "other"), "value");
+    msOWSResolveMetadata(&table);
+  }
+
+  /* modifying the table drops the resolved view */
+  msInsertHashTable(&table, "wms_abstract", "wms abstract");
+  EXPECT_TRUE(table.resolved == NULL);
+  EXPECT_STREQ(msOWSLookupMetadata(&table, "MO", "abstract"), "wms abstract");
+
+  msFreeHashItems(&table);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void testResetShape() {
+  shapeObj shape;
+  msInitShape(&shape);
+
+  EXPECT_TRUE(msShapeAllocLines(&shape, 2) == MS_SUCCESS);
+  EXPECT_TRUE(msShapeAllocPoints(&shape, 0, 10) != NULL);
+  EXPECT_TRUE(msShapeAllocPoints(&shape, 1, 3) != NULL);
+  EXPECT_TRUE(shape.numlines == 2 && shape.maxlines == 0);
+  pointObj *point0 = shape.line[0].point;
+
+  /* the storage survives the reset */
+  msResetShape(&shape);
+  EXPECT_TRUE(shape.numlines == 0 && shape.maxlines == 2);
+  EXPECT_TRUE(shape.type == MS_SHAPE_NULL);
+
+  /* and is handed out again, grown only where needed */
+  EXPECT_TRUE(msShapeAllocLines(&shape, 1) == MS_SUCCESS);
+  EXPECT_TRUE(msShapeAllocPoints(&shape, 0, 5) == point0);
+  EXPECT_TRUE(shape.numlines == 1 && shape.maxlines == 0);
+  EXPECT_TRUE(shape.line[0].numpoints == 5);
+  msFreeShape(&shape);
+
+  /* lines appended one at a time are reused the same way */
+  EXPECT_TRUE(msShapeAddPoints(&shape, 3) != NULL);
+  EXPECT_TRUE(msShapeAddPoints(&shape, 2) != NULL);
+  point0 = shape.line[0].point;
+  msShapeTrimLines(&shape);
+  EXPECT_TRUE(shape.numlines == 2 && shape.maxlines == 0);
+  msResetShape(&shape);
+  EXPECT_TRUE(msShapeAddPoints(&shape, 3) == point0);
+  msShapeTrimLines(&shape);
+  EXPECT_TRUE(shape.numlines == 1 && shape.maxlines == 0);
+  msFreeShape(&shape);
+
+  /* batches keep the storage of their shapes from one fill to the next */
+  shapeBatchObj batch;
+  msInitShapeBatch(&batch);
+  shapeObj *first = msShapeBatchAdd(&batch);
+  EXPECT_TRUE(msShapeAllocLines(first, 1) == MS_SUCCESS);
+  EXPECT_TRUE(msShapeAllocPoints(first, 0, 4) != NULL);
+  msShapeBatchAdd(&batch);
+  EXPECT_TRUE(batch.numshapes == 2);
+  msClearShapeBatch(&batch);
+  EXPECT_TRUE(batch.numshapes == 0);
+  first = msShapeBatchAdd(&batch);
+  EXPECT_TRUE(first->numlines == 0 && first->maxlines == 1);
+  msFreeShapeBatch(&batch);
+  EXPECT_TRUE(batch.shapes == NULL && batch.maxshapes == 0);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void testOGRAutoStyleDraw() {
+  /* STYLEITEM "AUTO" looks the style up on the last feature read, so every
+   * feature must be styled before the next one is read */
+  static const char szCSV[] =
+      "WKT,OGR_STYLE\n"
+      "\"POINT(1 1)\",\"SYMBOL(c:#FF0000,s:4px)\"\n"
+      "\"POINT(2 2)\",\"SYMBOL(c:#00FF00,s:4px)\"\n"
+      "\"POINT(3 3)\",\"SYMBOL(c:#0000FF,s:4px)\"\n";
+  VSIFCloseL(VSIFileFromMemBuffer("/vsimem/autostyle.csv",
+                                  (GByte *)szCSV, strlen(szCSV), FALSE));
+
+  char szMap[] = "MAP\n"
+                 "  SIZE 50 50\n"
+                 "  EXTENT 0 0 4 4\n"
+                 "  IMAGETYPE png\n"
+                 "  LAYER\n"
+                 "    NAME \"autostyle\"\n"
+                 "    TYPE POINT\n"
+                 "    STATUS ON\n"
+                 "    CONNECTIONTYPE OGR\n"
+                 "    CONNECTION \"/vsimem/autostyle.csv\"\n"
+                 "    STYLEITEM \"AUTO\"\n"
+                 "    CLASS END\n"
+                 "  END\n"
+                 "END\n";
+  mapObj *map = msLoadMapFromString(szMap, NULL, NULL);
+  EXPECT_TRUE(map != NULL);
+  if (map) {
+    imageObj *image = msDrawMap(map, MS_FALSE);
+    EXPECT_TRUE(image != NULL);
+    if (image)
+      msFreeImage(image);
+    msFreeMap(map);
+  }
+  msResetErrorList();
+
+  VSIUnlink("/vsimem/autostyle.csv");
+}
+
+/* ----------------------------------------------------------------------- */
+
 int main() {
   testRedactCredentials();
   testToString();
+  testClipRect();
+  testIOWriter();
+  testCountBits();
+  testRasterClassTable();
+  testHashTable();
+  testOWSResolvedMetadata();
+  testResetShape();
+  testOGRAutoStyleDraw();
   return gTestRetCode;
 }